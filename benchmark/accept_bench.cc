@@ -0,0 +1,143 @@
+// accept速率压测：对比单Acceptor（baseloop accept后转交subloop）和SO_REUSEPORT多Acceptor两种模式
+// 客户端线程用阻塞connect不停建连接，建好后立刻以RST关闭（SO_LINGER 0），避免客户端端口耗尽在TIME_WAIT上
+// 统计服务端每秒建立的TcpConnection数
+//
+// 用法：accept_bench [-m single|reuseport] [-s 服务端subloop数] [-t 客户端线程数] [-d 秒数] [-b 每次accept上限] [-P 端口]
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ads_EventLoop.h"
+#include "ads_TcpServer.h"
+
+namespace
+{
+
+struct Options{
+    std::string mode = "single";
+    int serverThreads = 4;
+    int clientThreads = 4;
+    int seconds = 3;
+    int acceptBatch = 16;
+    uint16_t port = 8084;
+};
+
+std::atomic_llong g_accepted(0);
+
+void connectLoop(const Options &opt, const std::atomic_bool *running, std::atomic_llong *connected, std::atomic_llong *failed){
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opt.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    linger rst = {1, 0};
+    while(*running){
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+        if(fd < 0){
+            ++*failed;
+            continue;
+        }
+        if(::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) == 0){
+            ++*connected;
+        }
+        else{
+            ++*failed;
+        }
+        ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &rst, sizeof rst);
+        ::close(fd);
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+    Options opt;
+    int c;
+    while((c = ::getopt(argc, argv, "m:s:t:d:b:P:")) != -1){
+        switch(c){
+            case 'm': opt.mode = optarg; break;
+            case 's': opt.serverThreads = atoi(optarg); break;
+            case 't': opt.clientThreads = atoi(optarg); break;
+            case 'd': opt.seconds = atoi(optarg); break;
+            case 'b': opt.acceptBatch = atoi(optarg); break;
+            case 'P': opt.port = static_cast<uint16_t>(atoi(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-m single|reuseport] [-s server threads] [-t client threads]"
+                                " [-d seconds] [-b accept batch] [-P port]\n", argv[0]);
+                return 1;
+        }
+    }
+    if(opt.mode != "single" && opt.mode != "reuseport"){
+        fprintf(stderr, "unknown mode %s\n", opt.mode.c_str());
+        return 1;
+    }
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(opt.port, "127.0.0.1"), "accept_bench",
+                     opt.mode == "reuseport" ? TcpServer::kReusePort : TcpServer::kNoReusePort);
+    server.setConnectionCallback([](const TcpConnectionPtr &conn){
+        if(conn->connected()){
+            ++g_accepted;
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp){
+        buf->retrieveAll();
+    });
+    server.setThreadNum(opt.serverThreads);
+    server.setAcceptBatch(opt.acceptBatch);
+    server.start();
+
+    std::thread driver([&](){
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        std::atomic_bool running(true);
+        std::atomic_llong connected(0);
+        std::atomic_llong failed(0);
+        long long acceptedBefore = g_accepted;
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<std::thread> clients;
+        for(int i = 0; i < opt.clientThreads; ++i){
+            clients.emplace_back(connectLoop, std::cref(opt), &running, &connected, &failed);
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+        long long accepted = g_accepted - acceptedBefore;
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        running = false;
+        for(std::thread &t : clients){
+            t.join();
+        }
+
+        printf("accept_bench: mode=%s server_threads=%d client_threads=%d\n",
+               opt.mode.c_str(), opt.serverThreads, opt.clientThreads);
+        printf("  %lld connections accepted in %.2fs, %lld connects, %lld failed\n",
+               accepted, elapsed, (long long)connected, (long long)failed);
+        printf("  Accepts/sec: %.0f\n", accepted / elapsed);
+        // 等服务端处理完残留的关闭
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        loop.quit();
+    });
+    loop.loop();
+    driver.join();
+
+    // acceptStats()要在baseloop线程里读
+    AcceptStats stats = server.acceptStats();
+    printf("  accept batch=%d: %llu accepted, %llu rejected, %llu batches, avg %.2f per batch\n",
+           opt.acceptBatch, (unsigned long long)stats.accepted, (unsigned long long)stats.rejected,
+           (unsigned long long)stats.batches, stats.batches ? double(stats.accepted) / stats.batches : 0.0);
+    printf("  batch sizes [1, 2-3, 4-7, 8-15, 16-31, 32+]:");
+    for(int i = 0; i < AcceptStats::kBatchBuckets; ++i){
+        printf(" %llu", (unsigned long long)stats.batchSizes[i]);
+    }
+    printf("\n");
+    return 0;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+// 压测程序共用的客户端小工具：建立连接，在loop线程里执行并等待
+// 只有头文件，和bench_report.h一样不进adangs_muduo库
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <functional>
+#include <future>
+#include <string>
+
+#include "ads_EventLoop.h"
+#include "ads_InetAddress.h"
+
+namespace bench
+{
+
+// connectTo()的选项，可以按位组合
+enum ConnectOption{
+    kNoDelay = 1,       // TCP_NODELAY，Unix域套接字上忽略
+    kNonBlock = 2,      // 连上之后设为非阻塞，交给EventLoop驱动
+    kSendTimeout = 4,   // 阻塞写100毫秒超时，压测结束时卡住的write能及时返回
+    kRecvTimeout = 8,   // 阻塞读100毫秒超时
+};
+
+// 阻塞地连接addr，失败返回-1
+inline int connectTo(const InetAddress &addr, int options = kNoDelay){
+    int fd = ::socket(addr.family(), SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0){
+        return -1;
+    }
+    if(::connect(fd, addr.getSockAddr(), addr.getSockLen()) != 0){
+        ::close(fd);
+        return -1;
+    }
+    if((options & kNoDelay) && !addr.isUnix()){
+        int on = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+    }
+    timeval timeout{0, 100 * 1000};
+    if(options & kSendTimeout){
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof timeout);
+    }
+    if(options & kRecvTimeout){
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+    }
+    if(options & kNonBlock){
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+    return fd;
+}
+
+// 连接本机127.0.0.1:port
+inline int connectTo(uint16_t port, int options = kNoDelay){
+    return connectTo(InetAddress(port, "127.0.0.1"), options);
+}
+
+// 在loop线程里执行f并等它结束
+inline void runAndWait(EventLoop *loop, const std::function<void()> &f){
+    std::promise<void> done;
+    loop->runInLoop([&](){
+        f();
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
+} // namespace bench
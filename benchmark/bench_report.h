@@ -0,0 +1,164 @@
+#pragma once
+
+// 压测程序共用的小工具：解析"1,2,4"这样的参数列表，把每一轮的结果按text/json/csv输出
+// 只有头文件，不进adangs_muduo库
+
+#include <sys/resource.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench
+{
+
+// "1,2,4"解析成{1,2,4}；有非数字或负数时返回空
+inline std::vector<int> parseIntList(const std::string &list){
+    std::vector<int> values;
+    size_t pos = 0;
+    while(pos <= list.size()){
+        size_t comma = list.find(',', pos);
+        std::string item = list.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        char *end = nullptr;
+        long value = ::strtol(item.c_str(), &end, 10);
+        if(item.empty() || *end != '\0' || value < 0){
+            return std::vector<int>();
+        }
+        values.push_back(static_cast<int>(value));
+        if(comma == std::string::npos){
+            break;
+        }
+        pos = comma + 1;
+    }
+    return values;
+}
+
+// 连接数多的时候默认的软限制不够，抬到硬限制
+inline void raiseFdLimit(){
+    rlimit limit;
+    if(::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max){
+        limit.rlim_cur = limit.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+/** 一次压测的结果表，每轮参数组合一行，列的顺序按第一次add()的顺序
+ * text: 每行"key=value ..."，给人看
+ * json: 对象数组，数字不加引号
+ * csv:  第一行是表头
+ **/
+class Report{
+public:
+    enum Format{
+        kText,
+        kJson,
+        kCsv,
+    };
+
+    static bool parseFormat(const std::string &name, Format *format){
+        if(name == "text"){
+            *format = kText;
+        }
+        else if(name == "json"){
+            *format = kJson;
+        }
+        else if(name == "csv"){
+            *format = kCsv;
+        }
+        else{
+            return false;
+        }
+        return true;
+    }
+
+    void beginRow() {rows_.push_back(Row());}
+    void add(const char *key, const std::string &value) {rows_.back().push_back(Field{key, value, false});}
+    void add(const char *key, const char *value) {add(key, std::string(value));}
+    void add(const char *key, int64_t value) {addNumber(key, "%lld", static_cast<long long>(value));}
+    void add(const char *key, int value) {add(key, static_cast<int64_t>(value));}
+    void add(const char *key, double value) {addNumber(key, "%.3f", value);}
+
+    // path为空时写到stdout
+    bool write(Format format, const std::string &path) const{
+        FILE *fp = path.empty() ? stdout : ::fopen(path.c_str(), "w");
+        if(fp == nullptr){
+            perror(path.c_str());
+            return false;
+        }
+        std::string out = format == kJson ? toJson() : format == kCsv ? toCsv() : toText();
+        ::fwrite(out.data(), 1, out.size(), fp);
+        if(fp != stdout){
+            ::fclose(fp);
+        }
+        else{
+            ::fflush(fp);
+        }
+        return true;
+    }
+
+private:
+    struct Field{
+        std::string key;
+        std::string value;
+        bool number;
+    };
+    using Row = std::vector<Field>;
+
+    template <typename T>
+    void addNumber(const char *key, const char *fmt, T value){
+        char buf[64];
+        snprintf(buf, sizeof buf, fmt, value);
+        rows_.back().push_back(Field{key, buf, true});
+    }
+
+    std::string toText() const{
+        std::string out;
+        for(const Row &row : rows_){
+            for(size_t i = 0; i < row.size(); ++i){
+                out += (i == 0 ? "" : " ") + row[i].key + "=" + row[i].value;
+            }
+            out += "\n";
+        }
+        return out;
+    }
+
+    std::string toJson() const{
+        std::string out("[\n");
+        for(size_t r = 0; r < rows_.size(); ++r){
+            out += "  {";
+            for(size_t i = 0; i < rows_[r].size(); ++i){
+                const Field &field = rows_[r][i];
+                out += (i == 0 ? "\"" : ", \"") + field.key + "\": ";
+                out += field.number ? field.value : "\"" + field.value + "\"";
+            }
+            out += r + 1 == rows_.size() ? "}\n" : "},\n";
+        }
+        out += "]\n";
+        return out;
+    }
+
+    std::string toCsv() const{
+        std::string out;
+        if(rows_.empty()){
+            return out;
+        }
+        for(size_t i = 0; i < rows_[0].size(); ++i){
+            out += (i == 0 ? "" : ",") + rows_[0][i].key;
+        }
+        out += "\n";
+        for(const Row &row : rows_){
+            for(size_t i = 0; i < row.size(); ++i){
+                out += (i == 0 ? "" : ",") + row[i].value;
+            }
+            out += "\n";
+        }
+        return out;
+    }
+
+    std::vector<Row> rows_;
+};
+
+} // namespace bench
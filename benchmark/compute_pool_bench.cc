@@ -0,0 +1,224 @@
+// 计算与IO混合负载：一部分连接发耗CPU的请求，另一部分只发ping，对比两种服务端写法
+//   -m inline  在MessageCallback里直接计算，算的时候同一个loop上的ping全都要等
+//   -m pool    计算交给ComputePool，每条连接一个Strand保序，结果queueInLoop回到连接的loop再发送
+// 请求是一行"H\r\n"或"P\r\n"，服务端分别回"h <结果>\r\n"和"p\r\n"；客户端每条连接同时只有一个请求在途
+// 关注ping的延迟：inline模式下它被计算拖慢，pool模式下应该接近空载
+//
+// 用法：compute_pool_bench [-m inline|pool] [-s 服务端subloop数] [-w 计算线程数] [-H 计算连接数]
+//                          [-L ping连接数] [-u 每个计算请求的迭代次数] [-d 秒数] [-P 端口]
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ads_EventLoop.h"
+#include "ads_TcpServer.h"
+#include "ads_ComputePool.h"
+#include "bench_fixture.h"
+
+namespace
+{
+
+struct Options{
+    std::string mode = "pool";
+    int serverThreads = 2;
+    int computeThreads = 2;
+    int heavyClients = 4;
+    int lightClients = 4;
+    int iterations = 200000;
+    int seconds = 3;
+    uint16_t port = 8086;
+};
+
+// 模拟解析/压缩/加解密：FNV-1a反复混合，结果依赖每一轮，编译器优化不掉
+uint64_t burnCpu(int iterations){
+    uint64_t hash = 14695981039346656037ULL;
+    for(int i = 0; i < iterations; ++i){
+        hash ^= static_cast<uint64_t>(i);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::string heavyReply(uint64_t hash){
+    char buf[48];
+    snprintf(buf, sizeof buf, "h %016llx\r\n", (unsigned long long)hash);
+    return buf;
+}
+
+struct ClientStats{
+    std::mutex mutex;
+    std::vector<int64_t> lightLatencies;    // 微秒
+    std::atomic_llong heavyDone{0};
+    std::atomic_llong lightDone{0};
+    std::atomic_llong failed{0};
+};
+
+void clientLoop(const Options &opt, bool heavy, const std::atomic_bool *running, ClientStats *stats){
+    int fd = bench::connectTo(opt.port);
+    if(fd < 0){
+        ++stats->failed;
+        return;
+    }
+    const char *request = heavy ? "H\r\n" : "P\r\n";
+    std::vector<int64_t> latencies;
+    char buf[256];
+    while(*running){
+        auto begin = std::chrono::steady_clock::now();
+        if(::write(fd, request, 3) != 3){
+            ++stats->failed;
+            break;
+        }
+        // 应答以\r\n结尾，一次请求只有一行
+        size_t received = 0;
+        bool ok = false;
+        while(received < sizeof buf){
+            ssize_t n = ::read(fd, buf + received, sizeof buf - received);
+            if(n <= 0){
+                break;
+            }
+            received += n;
+            if(received >= 2 && buf[received - 2] == '\r' && buf[received - 1] == '\n'){
+                ok = true;
+                break;
+            }
+        }
+        if(!ok){
+            ++stats->failed;
+            break;
+        }
+        if(heavy){
+            ++stats->heavyDone;
+        }
+        else{
+            ++stats->lightDone;
+            latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - begin).count());
+        }
+    }
+    ::close(fd);
+    std::lock_guard<std::mutex> lock(stats->mutex);
+    stats->lightLatencies.insert(stats->lightLatencies.end(), latencies.begin(), latencies.end());
+}
+
+int64_t percentile(const std::vector<int64_t> &sorted, int p){
+    return sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1, sorted.size() * p / 100)];
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+    Options opt;
+    int c;
+    while((c = ::getopt(argc, argv, "m:s:w:H:L:u:d:P:")) != -1){
+        switch(c){
+            case 'm': opt.mode = optarg; break;
+            case 's': opt.serverThreads = atoi(optarg); break;
+            case 'w': opt.computeThreads = atoi(optarg); break;
+            case 'H': opt.heavyClients = atoi(optarg); break;
+            case 'L': opt.lightClients = atoi(optarg); break;
+            case 'u': opt.iterations = atoi(optarg); break;
+            case 'd': opt.seconds = atoi(optarg); break;
+            case 'P': opt.port = static_cast<uint16_t>(atoi(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-m inline|pool] [-s server threads] [-w compute threads]"
+                                " [-H heavy clients] [-L light clients] [-u iterations per heavy request]"
+                                " [-d seconds] [-P port]\n", argv[0]);
+                return 1;
+        }
+    }
+    if(opt.mode != "inline" && opt.mode != "pool"){
+        fprintf(stderr, "unknown mode %s\n", opt.mode.c_str());
+        return 1;
+    }
+    const bool offload = opt.mode == "pool";
+    const int iterations = opt.iterations;
+
+    ComputePool pool("compute");
+    pool.setThreadNum(offload ? opt.computeThreads : 0);
+    pool.start();
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(opt.port, "127.0.0.1"), "compute_pool_bench");
+    server.setConnectionCallback([&pool, offload](const TcpConnectionPtr &conn){
+        if(conn->connected()){
+            conn->setTcpNoDelay(true);
+            if(offload){
+                conn->setContext(pool.makeStrand());
+            }
+        }
+    });
+    server.setMessageCallback([&pool, offload, iterations](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+        const char *crlf;
+        while((crlf = buf->findCRLF()) != nullptr){
+            bool heavy = buf->peek()[0] == 'H';
+            buf->retrieveUntil(crlf + 2);
+            if(!heavy){
+                conn->send("p\r\n", 3);
+            }
+            else if(!offload){
+                conn->send(heavyReply(burnCpu(iterations)));
+            }
+            else{
+                ComputePool::StrandPtr strand = std::static_pointer_cast<ComputePool::Strand>(conn->getContext());
+                pool.submit(strand, conn->getLoop(),
+                            [iterations](){ return burnCpu(iterations); },
+                            [conn](uint64_t hash){
+                                if(conn->connected()){
+                                    conn->send(heavyReply(hash));
+                                }
+                            });
+            }
+        }
+    });
+    server.setThreadNum(opt.serverThreads);
+    server.start();
+
+    ClientStats stats;
+    std::thread driver([&](){
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        std::atomic_bool running(true);
+        std::vector<std::thread> clients;
+        for(int i = 0; i < opt.heavyClients + opt.lightClients; ++i){
+            clients.emplace_back(clientLoop, std::cref(opt), i < opt.heavyClients, &running, &stats);
+        }
+        auto begin = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+        running = false;
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        // 计算请求可能还在算，客户端线程等它的应答后退出
+        for(std::thread &t : clients){
+            t.join();
+        }
+
+        std::vector<int64_t> &latencies = stats.lightLatencies;
+        std::sort(latencies.begin(), latencies.end());
+        printf("compute_pool_bench: mode=%s server_threads=%d compute_threads=%d heavy=%d light=%d iterations=%d\n",
+               opt.mode.c_str(), opt.serverThreads, offload ? opt.computeThreads : 0,
+               opt.heavyClients, opt.lightClients, opt.iterations);
+        printf("  heavy: %lld done, %.0f/sec\n", (long long)stats.heavyDone, stats.heavyDone / elapsed);
+        printf("  light: %lld done, %.0f/sec, latency p50 %lldus p99 %lldus max %lldus\n",
+               (long long)stats.lightDone, stats.lightDone / elapsed,
+               (long long)percentile(latencies, 50), (long long)percentile(latencies, 99),
+               (long long)(latencies.empty() ? 0 : latencies.back()));
+        printf("  failed: %lld, pool executed %llu steals %llu\n", (long long)stats.failed,
+               (unsigned long long)pool.executed(), (unsigned long long)pool.steals());
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        loop.quit();
+    });
+    loop.loop();
+    driver.join();
+    return 0;
+}
@@ -0,0 +1,225 @@
+// 连接抖动压测：客户端线程不停地 建连接 -> 发一条消息 -> 收到回显 -> RST关闭，服务端echo
+// 每隔一段时间打印一次这段时间的建连速率和进程RSS，长时间运行时RSS应该稳定在一个平台上，
+// 用来检查连接对象、Channel/Socket和Buffer走MemoryPool之后既不泄漏也不会越涨越高
+//
+// 服务端subloop数可以给一个列表，逐个跑一轮；每轮的汇总按-f指定的格式输出，text格式下还会打印每个间隔的数据
+//
+// 用法：conn_churn_bench [-s 服务端subloop数列表] [-t 客户端线程数] [-d 每轮秒数] [-i 打印间隔秒数]
+//                        [-b 消息字节数] [-M 关闭MemoryPool做对比] [-f text|json|csv] [-o 结果文件] [-P 端口]
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ads_EventLoop.h"
+#include "ads_TcpServer.h"
+#include "ads_MemoryPool.h"
+#include "bench_report.h"
+
+namespace
+{
+
+struct Options{
+    std::vector<int> serverThreads{4};
+    int clientThreads = 4;
+    int seconds = 10;
+    int interval = 1;
+    int payload = 64;
+    bool pool = true;
+    bench::Report::Format format = bench::Report::kText;
+    std::string output;
+    uint16_t port = 8085;
+};
+
+std::atomic_llong g_established(0);
+
+// /proc/self/statm第二列是常驻页数
+double rssMegabytes(){
+    FILE *fp = ::fopen("/proc/self/statm", "r");
+    if(fp == nullptr){
+        return 0;
+    }
+    long size = 0;
+    long resident = 0;
+    if(::fscanf(fp, "%ld %ld", &size, &resident) != 2){
+        resident = 0;
+    }
+    ::fclose(fp);
+    return resident * static_cast<double>(::sysconf(_SC_PAGESIZE)) / (1024 * 1024);
+}
+
+void churnLoop(const Options &opt, const std::atomic_bool *running, std::atomic_llong *completed, std::atomic_llong *failed){
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opt.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    linger rst = {1, 0};
+    std::string message(opt.payload, 'x');
+    std::vector<char> reply(opt.payload);
+    while(*running){
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+        if(fd < 0){
+            ++*failed;
+            continue;
+        }
+        bool ok = ::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) == 0
+                  && ::write(fd, message.data(), message.size()) == static_cast<ssize_t>(message.size());
+        size_t received = 0;
+        while(ok && received < reply.size()){
+            ssize_t n = ::read(fd, reply.data() + received, reply.size() - received);
+            if(n <= 0){
+                ok = false;
+            }
+            else{
+                received += n;
+            }
+        }
+        if(ok){
+            ++*completed;
+        }
+        else{
+            ++*failed;
+        }
+        // RST关闭，客户端端口不会堆在TIME_WAIT上
+        ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &rst, sizeof rst);
+        ::close(fd);
+    }
+}
+
+// 服务端已经在监听，跑opt.seconds秒，结果写进report
+void runClients(const Options &opt, int serverThreads, bench::Report *report){
+    std::atomic_bool running(true);
+    std::atomic_llong completed(0);
+    std::atomic_llong failed(0);
+    std::vector<std::thread> clients;
+    for(int i = 0; i < opt.clientThreads; ++i){
+        clients.emplace_back(churnLoop, std::cref(opt), &running, &completed, &failed);
+    }
+
+    const bool verbose = opt.format == bench::Report::kText;
+    if(verbose){
+        printf("conn_churn_bench: server_threads=%d client_threads=%d payload=%d pool=%s\n",
+               serverThreads, opt.clientThreads, opt.payload, opt.pool ? "on" : "off");
+        printf("  %8s %12s %10s %10s\n", "time(s)", "conns/sec", "rss(MB)", "peak(MB)");
+        fflush(stdout);
+    }
+    auto begin = std::chrono::steady_clock::now();
+    auto last = begin;
+    long long lastEstablished = g_established;
+    double firstRss = 0;
+    double peakRss = 0;
+    for(int elapsed = opt.interval; elapsed <= opt.seconds; elapsed += opt.interval){
+        std::this_thread::sleep_until(begin + std::chrono::seconds(elapsed));
+        auto now = std::chrono::steady_clock::now();
+        long long established = g_established;
+        double rss = rssMegabytes();
+        if(firstRss == 0){
+            firstRss = rss;
+        }
+        peakRss = std::max(peakRss, rss);
+        if(verbose){
+            printf("  %8d %12.0f %10.1f %10.1f\n", elapsed,
+                   (established - lastEstablished) / std::chrono::duration<double>(now - last).count(), rss, peakRss);
+            fflush(stdout);
+        }
+        last = now;
+        lastEstablished = established;
+    }
+    running = false;
+    for(std::thread &t : clients){
+        t.join();
+    }
+    double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    report->beginRow();
+    report->add("bench", "conn_churn");
+    report->add("server_threads", serverThreads);
+    report->add("client_threads", opt.clientThreads);
+    report->add("payload", opt.payload);
+    report->add("pool", opt.pool ? "on" : "off");
+    report->add("seconds", total);
+    report->add("round_trips", static_cast<int64_t>(completed));
+    report->add("conns_per_sec", completed / total);
+    report->add("failed", static_cast<int64_t>(failed));
+    report->add("rss_first_mb", firstRss);
+    report->add("rss_end_mb", rssMegabytes());
+    report->add("rss_peak_mb", peakRss);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+    Options opt;
+    int c;
+    while((c = ::getopt(argc, argv, "s:t:d:i:b:Mf:o:P:")) != -1){
+        switch(c){
+            case 's': opt.serverThreads = bench::parseIntList(optarg); break;
+            case 't': opt.clientThreads = atoi(optarg); break;
+            case 'd': opt.seconds = atoi(optarg); break;
+            case 'i': opt.interval = atoi(optarg); break;
+            case 'b': opt.payload = atoi(optarg); break;
+            case 'M': opt.pool = false; break;
+            case 'f':
+                if(!bench::Report::parseFormat(optarg, &opt.format)){
+                    fprintf(stderr, "unknown format %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'o': opt.output = optarg; break;
+            case 'P': opt.port = static_cast<uint16_t>(atoi(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-s server threads list] [-t client threads] [-d seconds per run]"
+                                " [-i report interval] [-b payload bytes] [-M disable MemoryPool]"
+                                " [-f text|json|csv] [-o file] [-P port]\n", argv[0]);
+                return 1;
+        }
+    }
+    if(opt.interval <= 0 || opt.payload <= 0 || opt.serverThreads.empty()){
+        fprintf(stderr, "interval and payload must be positive\n");
+        return 1;
+    }
+    // 要在任何分配之前决定
+    MemoryPool::setEnabled(opt.pool);
+
+    // 一轮结束时对端可能已经RST，往它写不能让整个进程退出
+    ::signal(SIGPIPE, SIG_IGN);
+    bench::Report report;
+    EventLoop loop;
+    for(int serverThreads : opt.serverThreads){
+        TcpServer server(&loop, InetAddress(opt.port, "127.0.0.1"), "conn_churn_bench");
+        server.setConnectionCallback([](const TcpConnectionPtr &conn){
+            if(conn->connected()){
+                ++g_established;
+            }
+        });
+        server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+            conn->send(buf);
+        });
+        server.setThreadNum(serverThreads);
+        server.start();
+
+        std::thread driver([&](){
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            runClients(opt, serverThreads, &report);
+            // 等服务端处理完残留的关闭
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            loop.quit();
+        });
+        loop.loop();
+        driver.join();
+    }
+    return report.write(opt.format, opt.output) ? 0 : 1;
+}
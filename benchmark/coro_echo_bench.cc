@@ -0,0 +1,210 @@
+// 协程与回调写法的开销对比：长度前缀echo，请求是4字节大端长度 + 负载，服务端原样返回
+//   -m coro      每条连接一个协程：readExactly(4) -> readExactly(n) -> write，顺序写出协议
+//   -m coro-sleep 同coro，但读到负载之后先sleepFor(100微秒)再用它：验证跨co_await持有读到的StringPiece
+//                 不会失效，配合-p让后面的请求在sleep期间到达
+//   -m callback  传统MessageCallback，在回调里自己判断帧是否完整
+// 客户端每条连接同时有-p个请求在途（默认1），每个请求的负载内容不同，应答逐字节校验，统计每秒完成的请求数
+// 这个程序要用-std=c++20编译，库本身仍是C++11
+//
+// 用法：coro_echo_bench [-m coro|coro-sleep|callback] [-s 服务端subloop数] [-c 客户端连接数] [-b 负载字节数]
+//                       [-p 每连接在途请求数] [-d 秒数] [-P 端口]
+// 例：coro_echo_bench -m coro-sleep -p 4
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ads_EventLoop.h"
+#include "ads_TcpServer.h"
+#include "ads_Coroutine.h"
+#include "bench_fixture.h"
+
+namespace
+{
+
+struct Options{
+    std::string mode = "coro";
+    int serverThreads = 2;
+    int connections = 8;
+    int payload = 64;
+    int pipeline = 1;
+    int seconds = 3;
+    uint16_t port = 8087;
+};
+
+// coro-sleep模式读到负载之后等多久再用
+const double kSleepSeconds = 0.0001;
+
+CoTask<void> echoSession(CoConnectionPtr cc, double sleepSeconds){
+    cc->connection()->setTcpNoDelay(true);
+    // 应答拼在这里一次写出，容量留下来给后面的请求复用
+    std::string reply;
+    while(true){
+        StringPiece header = co_await cc->readExactly(sizeof(uint32_t));
+        if(header.empty()){
+            break;
+        }
+        // 下一次读之后header就失效了，先拷出来
+        uint32_t be;
+        ::memcpy(&be, header.data(), sizeof be);
+        StringPiece body = co_await cc->readExactly(ntohl(be));
+        if(body.empty()){
+            break;
+        }
+        // 等待期间连接停止读，后面到达的请求留在内核里，body仍然指向原来的数据
+        if(sleepSeconds > 0){
+            co_await cc->sleepFor(sleepSeconds);
+        }
+        reply.assign(reinterpret_cast<const char *>(&be), sizeof be);
+        reply.append(body.data(), body.size());
+        if(!co_await cc->write(reply)){
+            break;
+        }
+    }
+}
+
+void onCallbackMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+    while(buf->readableBytes() >= sizeof(uint32_t)){
+        uint32_t be;
+        ::memcpy(&be, buf->peek(), sizeof be);
+        size_t length = sizeof be + ntohl(be);
+        if(buf->readableBytes() < length){
+            break;
+        }
+        conn->send(buf->peek(), length);
+        buf->retrieve(length);
+    }
+}
+
+// 第i个请求的负载全是同一个字母，按i轮换，服务端拿错或拿到被覆盖的数据都会校验失败
+std::string makeRequest(const Options &opt, long long i){
+    uint32_t be = htonl(static_cast<uint32_t>(opt.payload));
+    std::string request(reinterpret_cast<const char *>(&be), sizeof be);
+    request.append(opt.payload, static_cast<char>('a' + i % 26));
+    return request;
+}
+
+void clientLoop(const Options &opt, const std::atomic_bool *running, std::atomic_llong *completed, std::atomic_llong *failed){
+    int fd = bench::connectTo(opt.port);
+    if(fd < 0){
+        ++*failed;
+        return;
+    }
+    long long sent = 0;
+    long long received = 0;
+    std::vector<char> reply(sizeof(uint32_t) + opt.payload);
+    while(*running || received < sent){
+        // 在途请求不足-p个就补上，结束时只收完已经发出的
+        while(*running && sent - received < opt.pipeline){
+            std::string request = makeRequest(opt, sent);
+            if(::write(fd, request.data(), request.size()) != static_cast<ssize_t>(request.size())){
+                ++*failed;
+                ::close(fd);
+                return;
+            }
+            ++sent;
+        }
+        size_t got = 0;
+        while(got < reply.size()){
+            ssize_t n = ::read(fd, reply.data() + got, reply.size() - got);
+            if(n <= 0){
+                break;
+            }
+            got += n;
+        }
+        std::string expected = makeRequest(opt, received);
+        if(got < reply.size() || ::memcmp(reply.data(), expected.data(), reply.size()) != 0){
+            ++*failed;
+            break;
+        }
+        ++received;
+        ++*completed;
+    }
+    ::close(fd);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+    Options opt;
+    int c;
+    while((c = ::getopt(argc, argv, "m:s:c:b:p:d:P:")) != -1){
+        switch(c){
+            case 'm': opt.mode = optarg; break;
+            case 's': opt.serverThreads = atoi(optarg); break;
+            case 'c': opt.connections = atoi(optarg); break;
+            case 'b': opt.payload = atoi(optarg); break;
+            case 'p': opt.pipeline = atoi(optarg); break;
+            case 'd': opt.seconds = atoi(optarg); break;
+            case 'P': opt.port = static_cast<uint16_t>(atoi(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-m coro|coro-sleep|callback] [-s server threads] [-c connections]"
+                                " [-b payload bytes] [-p requests in flight] [-d seconds] [-P port]\n", argv[0]);
+                return 1;
+        }
+    }
+    if(opt.mode != "coro" && opt.mode != "coro-sleep" && opt.mode != "callback"){
+        fprintf(stderr, "unknown mode %s\n", opt.mode.c_str());
+        return 1;
+    }
+    if(opt.payload <= 0 || opt.pipeline <= 0){
+        fprintf(stderr, "payload and requests in flight must be positive\n");
+        return 1;
+    }
+
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(opt.port, "127.0.0.1"), "coro_echo_bench");
+    if(opt.mode != "callback"){
+        double sleepSeconds = opt.mode == "coro-sleep" ? kSleepSeconds : 0;
+        server.setConnectionCallback(CoConnection::serve([sleepSeconds](CoConnectionPtr cc){
+            return echoSession(cc, sleepSeconds);
+        }));
+    }
+    else{
+        server.setConnectionCallback([](const TcpConnectionPtr &conn){
+            if(conn->connected()){
+                conn->setTcpNoDelay(true);
+            }
+        });
+        server.setMessageCallback(onCallbackMessage);
+    }
+    server.setThreadNum(opt.serverThreads);
+    server.start();
+
+    std::thread driver([&](){
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        std::atomic_bool running(true);
+        std::atomic_llong completed(0);
+        std::atomic_llong failed(0);
+        std::vector<std::thread> clients;
+        auto begin = std::chrono::steady_clock::now();
+        for(int i = 0; i < opt.connections; ++i){
+            clients.emplace_back(clientLoop, std::cref(opt), &running, &completed, &failed);
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+        running = false;
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        for(std::thread &t : clients){
+            t.join();
+        }
+        printf("coro_echo_bench: mode=%s server_threads=%d connections=%d payload=%d in_flight=%d\n",
+               opt.mode.c_str(), opt.serverThreads, opt.connections, opt.payload, opt.pipeline);
+        printf("  %lld requests in %.2fs, %lld failed\n", (long long)completed, elapsed, (long long)failed);
+        printf("  Requests/sec: %.0f\n", completed / elapsed);
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        loop.quit();
+    });
+    loop.loop();
+    driver.join();
+    return 0;
+}
@@ -0,0 +1,255 @@
+// 排队任务泛滥时IO的延迟：一个生产者线程不停往服务端subloop里queueInLoop小任务，让队列一直积压着
+// 几千个任务，同时客户端在同一个loop的连接上做ping-pong，统计往返时间；另外测新连接从connect到第一次回显的时间
+// 每轮用不同的预算（见EventLoop::setFunctorBudget）重新建服务端：
+//   0/0    不限，一轮要把取出的任务全部执行完才回到poll，往返时间约等于一整批任务的执行时间
+//   64/0   每轮最多64个任务，0/500 每轮最多500微秒，剩下的留到下一轮，IO事件在两批之间得到处理
+// 连接建立走kHighPriority，不排在积压的任务后面
+//
+// 用法：functor_flood_bench [-B 预算列表，每项为"任务数/微秒"] [-q 积压的任务数] [-w 每个任务的耗时（纳秒）]
+//                           [-n 新连接测量次数] [-d 每轮秒数] [-f text|json|csv] [-o 结果文件] [-P 端口]
+// 例：functor_flood_bench -B 0/0,16/0,64/0,0/200 -q 20000 -f csv -o flood.csv
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ads_EventLoop.h"
+#include "ads_TcpServer.h"
+#include "ads_Histogram.h"
+#include "bench_report.h"
+#include "bench_fixture.h"
+
+namespace
+{
+
+struct Budget{
+    size_t tasks;
+    int64_t micros;
+};
+
+struct Options{
+    std::vector<Budget> budgets{{0, 0}, {64, 0}, {0, 500}};
+    int backlog = 10000;
+    int64_t taskNanos = 2000;
+    int connects = 20;
+    int seconds = 3;
+    bench::Report::Format format = bench::Report::kText;
+    std::string output;
+    uint16_t port = 8093;
+};
+
+// 忙等模拟一个小任务，比如把一条消息编码后交给连接
+void spin(int64_t nanos){
+    int64_t end = monotonicNanos() + nanos;
+    while(monotonicNanos() < end){
+    }
+}
+
+// 发一个字节等它回来，返回往返纳秒数，失败返回-1
+int64_t roundTrip(int fd){
+    char c = 'f';
+    int64_t begin = monotonicNanos();
+    if(::write(fd, &c, 1) != 1 || ::read(fd, &c, 1) != 1){
+        return -1;
+    }
+    return monotonicNanos() - begin;
+}
+
+// 让loop至少转一轮，并等到它发布新的统计
+void settle(EventLoop *loop){
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    std::promise<void> done;
+    loop->runInLoop([&done](){ done.set_value(); });
+    done.get_future().get();
+}
+
+void runOnce(const Options &opt, EventLoop *loop, const Budget &budget, uint16_t port, bench::Report *report){
+    std::atomic<EventLoop *> ioLoop(nullptr);
+    TcpServer server(loop, InetAddress(port, "127.0.0.1"), "functor_flood_bench");
+    server.setThreadNum(1);
+    server.setFunctorBudget(budget.tasks, budget.micros);
+    server.setThreadInitCallback([&ioLoop](EventLoop *l){ ioLoop = l; });
+    server.setConnectionCallback([](const TcpConnectionPtr &conn){
+        if(conn->connected()){
+            conn->setTcpNoDelay(true);
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+        conn->send(buf);
+    });
+    server.start();
+
+    Histogram connectTimes;
+    Histogram rtt;
+    int failed = 0;
+    double elapsed = 0;
+    std::thread driver([&](){
+        while(ioLoop.load() == nullptr){
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        EventLoop *target = ioLoop.load();
+        LoopLoad &load = target->load();
+
+        // 生产者把队列维持在backlog附近
+        std::atomic<bool> flooding(true);
+        std::thread producer([&](){
+            const int64_t nanos = opt.taskNanos;
+            while(flooding.load(std::memory_order_relaxed)){
+                if(load.queueDepth.load(std::memory_order_relaxed) >= opt.backlog){
+                    std::this_thread::yield();
+                    continue;
+                }
+                for(int i = 0; i < 256; ++i){
+                    target->queueInLoop([nanos](){ spin(nanos); });
+                }
+            }
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        auto begin = std::chrono::steady_clock::now();
+        // 新连接：connect在内核里就完成了，第一次回显要等服务端建好TcpConnection
+        for(int i = 0; i < opt.connects; ++i){
+            int64_t start = monotonicNanos();
+            int fd = bench::connectTo(port);
+            if(fd < 0 || roundTrip(fd) < 0){
+                ++failed;
+            }
+            else{
+                connectTimes.record(monotonicNanos() - start);
+            }
+            if(fd >= 0){
+                ::close(fd);
+            }
+        }
+        int fd = bench::connectTo(port);
+        if(fd < 0){
+            ++failed;
+        }
+        else{
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(opt.seconds);
+            while(std::chrono::steady_clock::now() < deadline){
+                int64_t t = roundTrip(fd);
+                if(t < 0){
+                    ++failed;
+                    break;
+                }
+                rtt.record(t);
+            }
+            ::close(fd);
+        }
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        flooding = false;
+        producer.join();
+        // 等积压的任务执行完
+        while(load.queueDepth.load(std::memory_order_relaxed) > 0){
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        settle(target);
+        loop->quit();
+    });
+    loop->loop();
+    driver.join();
+
+    std::vector<LoopMetrics> metrics;
+    std::vector<LoopHistograms> histograms;
+    server.loopMetrics(&metrics);
+    server.loopHistograms(&histograms);
+    const LoopMetrics &m = metrics.front();
+    const Histogram &age = histograms.front().queueAge;
+
+    char spec[48];
+    snprintf(spec, sizeof spec, "%zu/%lld", budget.tasks, (long long)budget.micros);
+    report->beginRow();
+    report->add("bench", "functor_flood");
+    report->add("budget", spec);
+    report->add("backlog", opt.backlog);
+    report->add("task_ns", opt.taskNanos);
+    report->add("seconds", elapsed);
+    report->add("tasks_per_sec", m.functors / elapsed);
+    report->add("rtt_count", static_cast<int64_t>(rtt.count()));
+    report->add("rtt_p50_us", rtt.percentile(50) / 1000.0);
+    report->add("rtt_p99_us", rtt.percentile(99) / 1000.0);
+    report->add("rtt_max_us", rtt.max() / 1000.0);
+    report->add("connect_p50_us", connectTimes.percentile(50) / 1000.0);
+    report->add("connect_max_us", connectTimes.max() / 1000.0);
+    report->add("queue_age_avg_us", age.mean() / 1000.0);
+    report->add("queue_age_p99_us", age.percentile(99) / 1000.0);
+    report->add("max_batch", static_cast<int64_t>(m.maxFunctorBatch));
+    report->add("budget_hits", static_cast<int64_t>(m.functorBudgetHits));
+    report->add("failed", failed);
+}
+
+bool parseBudgets(const char *arg, std::vector<Budget> *budgets){
+    budgets->clear();
+    std::stringstream ss(arg);
+    std::string item;
+    while(std::getline(ss, item, ',')){
+        unsigned long tasks = 0;
+        long long micros = 0;
+        if(sscanf(item.c_str(), "%lu/%lld", &tasks, &micros) != 2 || micros < 0){
+            return false;
+        }
+        budgets->push_back(Budget{tasks, static_cast<int64_t>(micros)});
+    }
+    return !budgets->empty();
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+    Options opt;
+    int c;
+    while((c = ::getopt(argc, argv, "B:q:w:n:d:f:o:P:")) != -1){
+        switch(c){
+            case 'B':
+                if(!parseBudgets(optarg, &opt.budgets)){
+                    fprintf(stderr, "bad budget list %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'q': opt.backlog = atoi(optarg); break;
+            case 'w': opt.taskNanos = atoll(optarg); break;
+            case 'n': opt.connects = atoi(optarg); break;
+            case 'd': opt.seconds = atoi(optarg); break;
+            case 'f':
+                if(!bench::Report::parseFormat(optarg, &opt.format)){
+                    fprintf(stderr, "unknown format %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'o': opt.output = optarg; break;
+            case 'P': opt.port = static_cast<uint16_t>(atoi(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-B tasks/micros,...] [-q backlog] [-w task ns] [-n connects]"
+                                " [-d seconds per run] [-f text|json|csv] [-o file] [-P port]\n", argv[0]);
+                return 1;
+        }
+    }
+    if(opt.backlog <= 0 || opt.taskNanos < 0 || opt.connects < 0 || opt.seconds <= 0){
+        fprintf(stderr, "bad arguments\n");
+        return 1;
+    }
+
+    ::signal(SIGPIPE, SIG_IGN);
+    bench::Report report;
+    EventLoop loop;
+    // 每轮换一个端口，不受上一轮连接关闭的影响
+    for(size_t i = 0; i < opt.budgets.size(); ++i){
+        runOnce(opt, &loop, opt.budgets[i], static_cast<uint16_t>(opt.port + i), &report);
+    }
+    return report.write(opt.format, opt.output) ? 0 : 1;
+}
@@ -0,0 +1,356 @@
+// HTTP压测工具：不依赖wrk等外部工具，在回环地址上测量HttpServer每秒处理的请求数
+// 默认在进程内启动一个HttpServer，也可以用 -H/-P 指向外部服务器
+//
+// 用法：http_loadgen [-c 连接数] [-t 客户端线程数] [-s 服务端线程数] [-d 秒数]
+//                    [-p 管道深度] [-u 路径] [-F 静态文件字节数] [-H 主机 -P 端口]
+// 服务端路由：/       返回固定的短文本
+//            /chunked 返回chunked编码的响应
+//            /file   通过sendFile返回一个-F字节的临时文件
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ads_EventLoop.h"
+#include "ads_EventLoopThread.h"
+#include "ads_Channel.h"
+#include "ads_Buffer.h"
+#include "ads_InetAddress.h"
+#include "ads_HttpServer.h"
+#include "ads_HttpRequest.h"
+#include "ads_HttpResponse.h"
+#include "bench_fixture.h"
+
+namespace
+{
+
+struct Options{
+    int connections = 64;
+    int clientThreads = 4;
+    int serverThreads = 4;
+    int seconds = 5;
+    int pipeline = 1;
+    int fileBytes = 4096;
+    std::string path = "/";
+    std::string host = "127.0.0.1";
+    uint16_t port = 8082;
+    bool external = false;
+};
+
+std::string g_filePath;
+
+void onRequest(const HttpRequest &req, HttpResponse *resp){
+    if(req.path() == "/"){
+        resp->setStatusCode(HttpResponse::k200Ok);
+        resp->setContentType("text/plain");
+        resp->setBody("hello, world!\n");
+    }
+    else if(req.path() == "/chunked"){
+        resp->setStatusCode(HttpResponse::k200Ok);
+        resp->setContentType("text/plain");
+        resp->setChunked(true);
+        resp->addChunk("hello, ");
+        resp->addChunk("chunked ");
+        resp->addChunk("world!\n");
+    }
+    else if(req.path() == "/file"){
+        int fd = ::open(g_filePath.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0){
+            resp->setStatusCode(HttpResponse::k500InternalServerError);
+            return;
+        }
+        off_t length = ::lseek(fd, 0, SEEK_END);
+        resp->setStatusCode(HttpResponse::k200Ok);
+        resp->setContentType("application/octet-stream");
+        resp->setFile(fd, 0, static_cast<size_t>(length));
+    }
+    else{
+        resp->setStatusCode(HttpResponse::k404NotFound);
+    }
+}
+
+// 一个压测连接：始终保持pipeline个请求在途，每收到n个完整响应就再一次性写出n个请求
+class LoadConnection : noncopyable{
+public:
+    LoadConnection(EventLoop *loop, int fd, const std::string &request, int pipeline)
+        : loop_(loop)
+        , fd_(fd)
+        , channel_(loop, fd)
+        , request_(request)
+        , pipeline_(pipeline)
+        , completed_(0)
+        , bytesRead_(0)
+        , failed_(false)
+    {
+        channel_.setReadCallback(std::bind(&LoadConnection::onRead, this));
+        channel_.setWriteCallback(std::bind(&LoadConnection::onWrite, this));
+    }
+    ~LoadConnection(){
+        ::close(fd_);
+    }
+
+    void start(){
+        channel_.enableReading();
+        sendRequests(pipeline_);
+    }
+    void stop(){
+        channel_.disableALL();
+        channel_.remove();
+    }
+
+    int64_t completed() const {return completed_;}
+    int64_t bytesRead() const {return bytesRead_;}
+    bool failed() const {return failed_;}
+
+private:
+    void sendRequests(int count){
+        for(int i = 0; i < count; ++i){
+            output_.append(request_);
+        }
+        onWrite();
+    }
+
+    void onWrite(){
+        ssize_t n = ::write(fd_, output_.peek(), output_.readableBytes());
+        if(n > 0){
+            output_.retrieve(n);
+        }
+        else if(n < 0 && errno != EWOULDBLOCK){
+            fail();
+            return;
+        }
+        if(output_.readableBytes() > 0 && !channel_.isWriting()){
+            channel_.enableWriting();
+        }
+        else if(output_.readableBytes() == 0 && channel_.isWriting()){
+            channel_.disableWriting();
+        }
+    }
+
+    void onRead(){
+        int saveErrno = 0;
+        ssize_t n = input_.readFd(fd_, &saveErrno);
+        if(n <= 0){
+            fail();
+            return;
+        }
+        bytesRead_ += n;
+        int done = 0;
+        while(true){
+            size_t length = completeResponseLength();
+            if(length == 0){
+                break;
+            }
+            input_.retrieve(length);
+            ++done;
+        }
+        completed_ += done;
+        if(done > 0){
+            sendRequests(done);
+        }
+    }
+
+    // 返回缓冲区开头第一个完整响应的长度，不完整返回0
+    size_t completeResponseLength() const{
+        const char *begin = input_.peek();
+        size_t readable = input_.readableBytes();
+        const char *headerEnd = static_cast<const char *>(::memmem(begin, readable, "\r\n\r\n", 4));
+        if(headerEnd == nullptr){
+            return 0;
+        }
+        size_t headerLength = headerEnd + 4 - begin;
+        if(::memmem(begin, headerLength, "Transfer-Encoding: chunked", 26) != nullptr){
+            return chunkedResponseLength(begin, readable, headerLength);
+        }
+        const char *field = static_cast<const char *>(::memmem(begin, headerLength, "Content-Length: ", 16));
+        size_t bodyLength = field ? ::strtoul(field + 16, nullptr, 10) : 0;
+        if(readable < headerLength + bodyLength){
+            return 0;
+        }
+        return headerLength + bodyLength;
+    }
+
+    // 逐个跳过"size\r\ndata\r\n"，直到"0\r\n\r\n"（客户端不发trailer）
+    static size_t chunkedResponseLength(const char *begin, size_t readable, size_t pos){
+        while(true){
+            const char *crlf = static_cast<const char *>(::memmem(begin + pos, readable - pos, "\r\n", 2));
+            if(crlf == nullptr){
+                return 0;
+            }
+            size_t size = ::strtoul(begin + pos, nullptr, 16);
+            pos = crlf + 2 - begin;
+            if(size == 0){
+                return readable >= pos + 2 ? pos + 2 : 0;
+            }
+            pos += size + 2;
+            if(pos > readable){
+                return 0;
+            }
+        }
+    }
+
+    void fail(){
+        failed_ = true;
+        channel_.disableALL();
+    }
+
+    EventLoop *loop_;
+    int fd_;
+    Channel channel_;
+    std::string request_;
+    int pipeline_;
+    Buffer input_;
+    Buffer output_;
+    int64_t completed_;
+    int64_t bytesRead_;
+    bool failed_;
+};
+
+void runClient(const Options &opt){
+    InetAddress serverAddr(opt.port, opt.host);
+    std::string request = "GET " + opt.path + " HTTP/1.1\r\nHost: " + opt.host + "\r\n\r\n";
+
+    std::vector<std::unique_ptr<EventLoopThread>> threads;
+    std::vector<EventLoop *> loops;
+    for(int i = 0; i < opt.clientThreads; ++i){
+        threads.emplace_back(new EventLoopThread(EventLoopThread::ThreadInitCallback(), "loadgen"));
+        loops.push_back(threads.back()->startLoop());
+    }
+
+    std::vector<std::unique_ptr<LoadConnection>> conns;
+    for(int i = 0; i < opt.connections; ++i){
+        EventLoop *loop = loops[i % loops.size()];
+        int fd = bench::connectTo(serverAddr, bench::kNoDelay | bench::kNonBlock);
+        if(fd < 0){
+            perror("connect");
+            exit(1);
+        }
+        conns.emplace_back(new LoadConnection(loop, fd, request, opt.pipeline));
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    for(int i = 0; i < opt.connections; ++i){
+        LoadConnection *conn = conns[i].get();
+        loops[i % loops.size()]->runInLoop([conn](){ conn->start(); });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+    for(int i = 0; i < opt.connections; ++i){
+        LoadConnection *conn = conns[i].get();
+        bench::runAndWait(loops[i % loops.size()], [conn](){ conn->stop(); });
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    int64_t requests = 0;
+    int64_t bytes = 0;
+    int failed = 0;
+    for(const auto &conn : conns){
+        requests += conn->completed();
+        bytes += conn->bytesRead();
+        failed += conn->failed() ? 1 : 0;
+    }
+    conns.clear();
+    threads.clear();
+
+    printf("http_loadgen: path=%s connections=%d client_threads=%d server_threads=%d pipeline=%d\n",
+           opt.path.c_str(), opt.connections, opt.clientThreads, opt.external ? -1 : opt.serverThreads, opt.pipeline);
+    printf("  %lld requests in %.2fs, %.2f MB read, %d failed connections\n",
+           (long long)requests, elapsed, bytes / 1024.0 / 1024.0, failed);
+    printf("  Requests/sec: %.0f\n", requests / elapsed);
+    printf("  Transfer/sec: %.2f MB\n", bytes / elapsed / 1024.0 / 1024.0);
+}
+
+// 压测期间服务端各subloop的运行统计，两次快照相减
+void printServerMetrics(const LoopMetrics &before, const LoopMetrics &after){
+    uint64_t iterations = after.iterations - before.iterations;
+    uint64_t pollWait = after.pollWaitMicros - before.pollWaitMicros;
+    uint64_t busy = after.busyMicros - before.busyMicros;
+    uint64_t functors = after.functors - before.functors;
+    printf("  Server loops: %llu, %llu iterations, busy %.1f%%, %.2f events/iter (max %llu)\n",
+           (unsigned long long)after.loops, (unsigned long long)iterations,
+           pollWait + busy == 0 ? 0.0 : busy * 100.0 / (pollWait + busy),
+           iterations == 0 ? 0.0 : static_cast<double>(after.events - before.events) / iterations,
+           (unsigned long long)after.maxEvents);
+    printf("  Server functors: %llu, %.1f us each, wakeups %llu\n",
+           (unsigned long long)functors,
+           functors == 0 ? 0.0 : static_cast<double>(after.functorMicros - before.functorMicros) / functors,
+           (unsigned long long)(after.wakeups - before.wakeups));
+}
+
+void createFile(int bytes){
+    char path[] = "/tmp/http_loadgen_XXXXXX";
+    int fd = ::mkstemp(path);
+    if(fd < 0){
+        perror("mkstemp");
+        exit(1);
+    }
+    std::string data(bytes, 'x');
+    if(::write(fd, data.data(), data.size()) != static_cast<ssize_t>(data.size())){
+        perror("write");
+        exit(1);
+    }
+    ::close(fd);
+    g_filePath = path;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+    Options opt;
+    int c;
+    while((c = ::getopt(argc, argv, "c:t:s:d:p:u:F:H:P:")) != -1){
+        switch(c){
+            case 'c': opt.connections = atoi(optarg); break;
+            case 't': opt.clientThreads = atoi(optarg); break;
+            case 's': opt.serverThreads = atoi(optarg); break;
+            case 'd': opt.seconds = atoi(optarg); break;
+            case 'p': opt.pipeline = atoi(optarg); break;
+            case 'u': opt.path = optarg; break;
+            case 'F': opt.fileBytes = atoi(optarg); break;
+            case 'H': opt.host = optarg; opt.external = true; break;
+            case 'P': opt.port = static_cast<uint16_t>(atoi(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-c conns] [-t client threads] [-s server threads] [-d seconds]"
+                                " [-p pipeline] [-u path] [-F file bytes] [-H host -P port]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if(opt.external){
+        runClient(opt);
+        return 0;
+    }
+
+    // 进程内服务端跑在主线程的baseloop上，客户端在另一个线程里压测，压完让baseloop退出
+    createFile(opt.fileBytes);
+    EventLoop loop;
+    HttpServer server(&loop, InetAddress(opt.port, opt.host), "http_loadgen");
+    server.setHttpCallback(onRequest);
+    server.setThreadNum(opt.serverThreads);
+    server.start();
+
+    std::thread client([&](){
+        // 等baseloop开始监听
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        LoopMetrics before = server.loopMetrics();
+        runClient(opt);
+        printServerMetrics(before, server.loopMetrics());
+        LoopHistograms histograms = server.loopHistograms();
+        printf("  Handler latency: %s\n", histograms.handlers.toString().c_str());
+        printf("  Functor latency: %s\n", histograms.functors.toString().c_str());
+        loop.quit();
+    });
+    loop.loop();
+    client.join();
+    ::unlink(g_filePath.c_str());
+    return 0;
+}
@@ -0,0 +1,271 @@
+// 空闲连接的内存占用：建立大量连接，每条连接来回一条消息后保持空闲，报告各阶段每条连接平均占多少内存
+// 三个阶段：connected（刚建立，还没有数据）、burst（每条连接收发过一条消息）、idle（空闲了2个回收周期之后）
+// 每个阶段给出进程RSS折算到每条连接的字节数，以及服务端所有连接读写缓冲区实际占用的存储之和除以连接数
+// lazy是库的默认行为（缓冲区有数据才分配）并打开空闲回收；eager模拟以前的做法：
+// 连接建立时两个缓冲区各预分配kInitialSize，且不做空闲回收
+// 客户端是普通的阻塞socket，只占内核内存，RSS的增长基本都来自服务端
+// -L 给出lazy模式刚建立连接时每条连接RSS的上限（字节），超过时返回非0，可以当作内存占用的回归检查
+//
+// 用法：idle_conn_bench [-m lazy,eager] [-n 连接数] [-b 消息字节数] [-I 空闲回收周期秒数] [-L 每连接字节上限]
+//                       [-f text|json|csv] [-o 结果文件] [-P 端口]
+// 例：idle_conn_bench -n 10000 -b 65536 -f csv -o idle.csv
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ads_EventLoop.h"
+#include "ads_TcpServer.h"
+#include "bench_report.h"
+#include "bench_fixture.h"
+
+namespace
+{
+
+struct Options{
+    std::vector<std::string> modes{"lazy", "eager"};
+    int conns = 5000;
+    int payload = 16 * 1024;
+    double idle = 1.0;
+    double maxPerConn = 0;
+    bench::Report::Format format = bench::Report::kText;
+    std::string output;
+    uint16_t port = 8092;
+};
+
+// 先让glibc把空闲的页还给系统，RSS反映的是还在用的内存；/proc/self/statm第二列是常驻页数
+double rssBytes(){
+    ::malloc_trim(0);
+    FILE *fp = ::fopen("/proc/self/statm", "r");
+    if(fp == nullptr){
+        return 0;
+    }
+    long size = 0;
+    long resident = 0;
+    if(::fscanf(fp, "%ld %ld", &size, &resident) != 2){
+        resident = 0;
+    }
+    ::fclose(fp);
+    return resident * static_cast<double>(::sysconf(_SC_PAGESIZE));
+}
+
+bool writeAll(int fd, const char *data, size_t len){
+    while(len > 0){
+        ssize_t n = ::write(fd, data, len);
+        if(n <= 0){
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool readAll(int fd, char *data, size_t len){
+    while(len > 0){
+        ssize_t n = ::read(fd, data, len);
+        if(n <= 0){
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// 服务端连接表，只在baseloop线程访问
+struct ServerState{
+    std::vector<TcpConnectionPtr> conns;
+    std::atomic_int established{0};
+};
+
+// 在loop线程里统计所有连接的缓冲区存储
+size_t bufferBytes(EventLoop *loop, ServerState *state){
+    std::promise<size_t> total;
+    loop->runInLoop([state, &total](){
+        size_t bytes = 0;
+        for(const TcpConnectionPtr &conn : state->conns){
+            bytes += conn->inputBuffer()->capacity() + conn->outputBuffer()->capacity();
+        }
+        total.set_value(bytes);
+    });
+    return total.get_future().get();
+}
+
+// 返回connected阶段每条连接的RSS字节数
+double runOnce(const Options &opt, EventLoop *loop, const std::string &mode, uint16_t port, bench::Report *report){
+    const bool eager = mode == "eager";
+    ServerState state;
+    TcpServer server(loop, InetAddress(port, "127.0.0.1"), "idle_conn_bench");
+    server.setIdleBufferRelease(eager ? 0 : opt.idle);
+    server.setConnectionCallback([&state, eager](const TcpConnectionPtr &conn){
+        if(conn->connected()){
+            if(eager){
+                conn->inputBuffer()->ensureWriteable(Buffer::kInitialSize);
+                conn->outputBuffer()->ensureWriteable(Buffer::kInitialSize);
+            }
+            state.conns.push_back(conn);
+            ++state.established;
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+        conn->send(buf);
+    });
+    server.start();
+
+    double connectedPerConn = 0;
+    std::thread driver([&](){
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        double baseRss = rssBytes();
+
+        std::vector<int> fds;
+        int failed = 0;
+        for(int i = 0; i < opt.conns; ++i){
+            int fd = bench::connectTo(port, 0);
+            if(fd < 0){
+                ++failed;
+                continue;
+            }
+            fds.push_back(fd);
+        }
+        while(state.established < static_cast<int>(fds.size())){
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        const int conns = static_cast<int>(fds.size());
+
+        auto addRow = [&](const char *phase) -> double{
+            double rss = rssBytes();
+            double perConn = conns > 0 ? (rss - baseRss) / conns : 0.0;
+            size_t buffers = bufferBytes(loop, &state);
+            report->beginRow();
+            report->add("bench", "idle_conn");
+            report->add("mode", mode);
+            report->add("conns", conns);
+            report->add("payload", opt.payload);
+            report->add("idle_release_s", eager ? 0.0 : opt.idle);
+            report->add("phase", phase);
+            report->add("rss_mb", rss / (1024 * 1024));
+            report->add("rss_per_conn", perConn);
+            report->add("buffer_per_conn", conns > 0 ? static_cast<double>(buffers) / conns : 0.0);
+            report->add("conn_object", static_cast<int>(sizeof(TcpConnection)));
+            report->add("failed", failed);
+            return perConn;
+        };
+        connectedPerConn = addRow("connected");
+
+        // 每条连接发一条消息并收完回显，之后连接保持空闲
+        std::string message(opt.payload, 'i');
+        std::vector<char> reply(opt.payload);
+        for(int fd : fds){
+            if(!writeAll(fd, message.data(), message.size()) || !readAll(fd, reply.data(), reply.size())){
+                ++failed;
+            }
+        }
+        addRow("burst");
+
+        // 两个检查周期之后空闲连接的缓冲区一定已经回收；eager模式也等同样长的时间
+        std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int>(opt.idle * 2000) + 500));
+        addRow("idle");
+
+        for(int fd : fds){
+            ::close(fd);
+        }
+        // 等服务端处理完关闭，再在loop线程里放掉连接
+        while(state.established > 0){
+            std::promise<size_t> alive;
+            loop->runInLoop([&state, &alive](){
+                size_t n = 0;
+                for(const TcpConnectionPtr &conn : state.conns){
+                    n += conn->connected() ? 1 : 0;
+                }
+                alive.set_value(n);
+            });
+            state.established = static_cast<int>(alive.get_future().get());
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        loop->runInLoop([&state](){ state.conns.clear(); });
+        loop->quit();
+    });
+    loop->loop();
+    driver.join();
+    return connectedPerConn;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+    Options opt;
+    int c;
+    while((c = ::getopt(argc, argv, "m:n:b:I:L:f:o:P:")) != -1){
+        switch(c){
+            case 'm':{
+                opt.modes.clear();
+                std::stringstream ss(optarg);
+                std::string mode;
+                while(std::getline(ss, mode, ',')){
+                    if(mode != "lazy" && mode != "eager"){
+                        fprintf(stderr, "unknown mode %s\n", mode.c_str());
+                        return 1;
+                    }
+                    opt.modes.push_back(mode);
+                }
+                break;
+            }
+            case 'n': opt.conns = atoi(optarg); break;
+            case 'b': opt.payload = atoi(optarg); break;
+            case 'I': opt.idle = atof(optarg); break;
+            case 'L': opt.maxPerConn = atof(optarg); break;
+            case 'f':
+                if(!bench::Report::parseFormat(optarg, &opt.format)){
+                    fprintf(stderr, "unknown format %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'o': opt.output = optarg; break;
+            case 'P': opt.port = static_cast<uint16_t>(atoi(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-m lazy,eager] [-n conns] [-b payload bytes] [-I idle release seconds] [-L max bytes per conn]"
+                                " [-f text|json|csv] [-o file] [-P port]\n", argv[0]);
+                return 1;
+        }
+    }
+    if(opt.modes.empty() || opt.conns <= 0 || opt.payload <= 0 || opt.idle <= 0){
+        fprintf(stderr, "bad arguments\n");
+        return 1;
+    }
+
+    ::signal(SIGPIPE, SIG_IGN);
+    bench::Report report;
+    EventLoop loop;
+    // 每轮换一个端口，不受上一轮连接关闭的影响
+    double lazyPerConn = 0;
+    for(size_t i = 0; i < opt.modes.size(); ++i){
+        double perConn = runOnce(opt, &loop, opt.modes[i], static_cast<uint16_t>(opt.port + i), &report);
+        if(opt.modes[i] == "lazy"){
+            lazyPerConn = std::max(lazyPerConn, perConn);
+        }
+    }
+    if(!report.write(opt.format, opt.output)){
+        return 1;
+    }
+    if(opt.maxPerConn > 0 && lazyPerConn > opt.maxPerConn){
+        fprintf(stderr, "idle connection uses %.0f bytes, limit %.0f\n", lazyPerConn, opt.maxPerConn);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,377 @@
+// 核心组件的微基准：Buffer、readFd、queueInLoop、LOG_*、Channel分发和epoll_ctl，不依赖任何第三方库
+// 每个用例跑若干个样本，每个样本连续执行一批操作，取平均每次操作的纳秒数记进Histogram，报告分位数
+// 跨线程延迟这类用例一批只有一次操作，分位数就是单次操作的分布
+// 结果用-f csv -o保存下来，下次用-B指定这个文件，就会在每一行后面给出和它相比p50的变化
+// 库自己的日志在运行期间被重定向到/dev/null，结果直接写到stdout或-o指定的文件
+//
+// 用法：micro_bench [-k 用例名包含的子串] [-n 样本数] [-f text|json|csv] [-o 结果文件] [-B 基线csv]
+// 例：micro_bench -f csv -o before.csv ; （改代码、重新编译）; micro_bench -B before.csv
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ads_EventLoop.h"
+#include "ads_EventLoopThread.h"
+#include "ads_Channel.h"
+#include "ads_Buffer.h"
+#include "ads_Logger.h"
+#include "ads_Histogram.h"
+#include "bench_report.h"
+
+namespace
+{
+
+struct Options{
+    std::string filter;
+    int samples = 200;
+    bench::Report::Format format = bench::Report::kText;
+    std::string output;
+    std::string baseline;
+};
+
+// 一个用例：setup在计时之前执行一次，op(n)执行n次被测操作，teardown在最后执行
+struct Case{
+    std::string name;
+    int batch;                          // 每个样本执行的操作次数
+    std::function<void()> setup;
+    std::function<void(int)> op;
+    std::function<void()> teardown;
+};
+
+// 编译器看不到结果被使用时会把整个循环删掉
+volatile size_t g_sink;
+
+// 每个样本的平均每次操作纳秒数
+Histogram runCase(const Case &c, int samples){
+    if(c.setup){
+        c.setup();
+    }
+    // 预热：填满缓存、触发首次分配
+    for(int i = 0; i < 3; ++i){
+        c.op(c.batch);
+    }
+    Histogram perOp;
+    for(int i = 0; i < samples; ++i){
+        int64_t begin = monotonicNanos();
+        c.op(c.batch);
+        perOp.record((monotonicNanos() - begin) / c.batch);
+    }
+    if(c.teardown){
+        c.teardown();
+    }
+    return perOp;
+}
+
+// 读基线csv，取case和p50_ns两列
+std::map<std::string, double> loadBaseline(const std::string &path){
+    std::map<std::string, double> baseline;
+    std::ifstream in(path);
+    std::string line;
+    if(!std::getline(in, line)){
+        fprintf(stderr, "cannot read baseline %s\n", path.c_str());
+        return baseline;
+    }
+    std::vector<std::string> header;
+    auto split = [](const std::string &s){
+        std::vector<std::string> fields;
+        size_t pos = 0;
+        while(true){
+            size_t comma = s.find(',', pos);
+            fields.push_back(s.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos));
+            if(comma == std::string::npos){
+                return fields;
+            }
+            pos = comma + 1;
+        }
+    };
+    header = split(line);
+    size_t nameColumn = header.size();
+    size_t p50Column = header.size();
+    for(size_t i = 0; i < header.size(); ++i){
+        if(header[i] == "case"){
+            nameColumn = i;
+        }
+        else if(header[i] == "p50_ns"){
+            p50Column = i;
+        }
+    }
+    if(nameColumn == header.size() || p50Column == header.size()){
+        fprintf(stderr, "baseline %s has no case/p50_ns columns\n", path.c_str());
+        return baseline;
+    }
+    while(std::getline(in, line)){
+        std::vector<std::string> fields = split(line);
+        if(fields.size() == header.size()){
+            baseline[fields[nameColumn]] = ::atof(fields[p50Column].c_str());
+        }
+    }
+    return baseline;
+}
+
+// 被测的各个环境，用例的setup/teardown负责创建和销毁
+struct Fixture{
+    Buffer buffer;
+    std::string chunk;
+    int fds[2] = {-1, -1};
+    std::unique_ptr<EventLoopThread> thread;
+    EventLoop *remote = nullptr;
+    std::atomic_llong executed{0};
+    EventLoop *local = nullptr;         // main()栈上的loop，Channel用例挂在它上面，不进入loop()
+    std::unique_ptr<Channel> channel;
+    int64_t dispatched = 0;
+};
+
+std::vector<Case> makeCases(Fixture *f){
+    std::vector<Case> cases;
+
+    // Buffer
+    cases.push_back(Case{"buffer_append_retrieve_64", 1000,
+        [f](){ f->chunk.assign(64, 'b'); },
+        [f](int n){
+            for(int i = 0; i < n; ++i){
+                f->buffer.append(f->chunk.data(), f->chunk.size());
+                f->buffer.retrieve(f->chunk.size());
+            }
+        },
+        nullptr});
+    cases.push_back(Case{"buffer_append_4k_retrieve_all", 1000,
+        [f](){ f->chunk.assign(4096, 'b'); },
+        [f](int n){
+            for(int i = 0; i < n; ++i){
+                f->buffer.append(f->chunk.data(), f->chunk.size());
+                f->buffer.retrieveAll();
+            }
+        },
+        nullptr});
+    // 从空Buffer开始按1KB追加到64KB，每次容量不够都走makeSpace扩容
+    cases.push_back(Case{"buffer_grow_to_64k", 100,
+        [f](){ f->chunk.assign(1024, 'b'); },
+        [f](int n){
+            for(int i = 0; i < n; ++i){
+                Buffer buf;
+                for(int k = 0; k < 64; ++k){
+                    buf.append(f->chunk.data(), f->chunk.size());
+                }
+                g_sink = buf.readableBytes();
+            }
+        },
+        nullptr});
+    // 读走一大半之后再追加，makeSpace把剩下的数据挪到前面而不是扩容
+    cases.push_back(Case{"buffer_makespace_compact", 1000,
+        [f](){
+            f->chunk.assign(700, 'b');
+            f->buffer.retrieveAll();
+        },
+        [f](int n){
+            for(int i = 0; i < n; ++i){
+                f->buffer.append(f->chunk.data(), f->chunk.size());
+                f->buffer.retrieve(f->chunk.size() - 16);
+                f->buffer.append(f->chunk.data(), f->chunk.size());
+                f->buffer.retrieveAll();
+            }
+        },
+        nullptr});
+
+    // readFd：每次先往socketpair另一端写4KB，时间里包含这次write
+    cases.push_back(Case{"socketpair_write_readfd_4k", 200,
+        [f](){
+            f->chunk.assign(4096, 'r');
+            ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, f->fds);
+            f->buffer.retrieveAll();
+        },
+        [f](int n){
+            int saveErrno = 0;
+            for(int i = 0; i < n; ++i){
+                g_sink = ::write(f->fds[1], f->chunk.data(), f->chunk.size());
+                f->buffer.readFd(f->fds[0], &saveErrno);
+                f->buffer.retrieveAll();
+            }
+        },
+        [f](){
+            ::close(f->fds[0]);
+            ::close(f->fds[1]);
+        }});
+
+    // queueInLoop吞吐：一次投递一批，等最后一个执行完
+    cases.push_back(Case{"queueinloop_throughput", 1000,
+        [f](){
+            f->thread.reset(new EventLoopThread(EventLoopThread::ThreadInitCallback(), "micro"));
+            f->remote = f->thread->startLoop();
+        },
+        [f](int n){
+            f->executed = 0;
+            for(int i = 0; i < n; ++i){
+                f->remote->queueInLoop([f](){ ++f->executed; });
+            }
+            // 让出CPU而不是空转，单核机器上空转会挡住loop线程
+            while(f->executed.load(std::memory_order_acquire) < n){
+                std::this_thread::yield();
+            }
+        },
+        [f](){ f->thread.reset(); }});
+    // queueInLoop延迟：投递一个任务，自旋等它在另一个线程执行完，即一次跨线程往返
+    cases.push_back(Case{"queueinloop_roundtrip", 1,
+        [f](){
+            f->thread.reset(new EventLoopThread(EventLoopThread::ThreadInitCallback(), "micro"));
+            f->remote = f->thread->startLoop();
+        },
+        [f](int n){
+            for(int i = 0; i < n; ++i){
+                f->executed = 0;
+                f->remote->queueInLoop([f](){ f->executed.store(1, std::memory_order_release); });
+                while(f->executed.load(std::memory_order_acquire) == 0){
+                    std::this_thread::yield();
+                }
+            }
+        },
+        [f](){ f->thread.reset(); }});
+
+    // 日志：LOG_INFO格式化并写到（已重定向的）stdout；LOG_DEBUG在没有定义MUDEBUG时应该是零开销
+    cases.push_back(Case{"log_info", 1000, nullptr,
+        [](int n){
+            for(int i = 0; i < n; ++i){
+                LOG_INFO("micro_bench log line %d %s\n", i, "payload");
+            }
+        },
+        nullptr});
+    cases.push_back(Case{"log_debug_disabled", 1000, nullptr,
+        [](int n){
+            for(int i = 0; i < n; ++i){
+                LOG_DEBUG("micro_bench log line %d %s\n", i, "payload");
+                g_sink = i;
+            }
+        },
+        nullptr});
+
+    // Channel分发：直接调用handleEvent，回调只做一次自增
+    cases.push_back(Case{"channel_handle_event", 1000,
+        [f](){
+            ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, f->fds);
+            f->channel.reset(new Channel(f->local, f->fds[0]));
+            f->channel->setReadCallback([f](Timestamp){ ++f->dispatched; });
+            f->channel->set_revents(EPOLLIN);
+        },
+        [f](int n){
+            Timestamp now = Timestamp::now();
+            for(int i = 0; i < n; ++i){
+                f->channel->handleEvent(now);
+            }
+        },
+        [f](){
+            f->channel.reset();
+            ::close(f->fds[0]);
+            ::close(f->fds[1]);
+        }});
+    // updateChannel：每次操作打开再关闭写事件，两次epoll_ctl(MOD)
+    cases.push_back(Case{"update_channel_epoll_ctl", 1000,
+        [f](){
+            ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, f->fds);
+            f->channel.reset(new Channel(f->local, f->fds[0]));
+            f->channel->enableReading();
+        },
+        [f](int n){
+            for(int i = 0; i < n; ++i){
+                f->channel->enableWriting();
+                f->channel->disableWriting();
+            }
+        },
+        [f](){
+            f->channel->disableALL();
+            f->channel->remove();
+            f->channel.reset();
+            ::close(f->fds[0]);
+            ::close(f->fds[1]);
+        }});
+    return cases;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+    Options opt;
+    int c;
+    while((c = ::getopt(argc, argv, "k:n:f:o:B:")) != -1){
+        switch(c){
+            case 'k': opt.filter = optarg; break;
+            case 'n': opt.samples = atoi(optarg); break;
+            case 'f':
+                if(!bench::Report::parseFormat(optarg, &opt.format)){
+                    fprintf(stderr, "unknown format %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'o': opt.output = optarg; break;
+            case 'B': opt.baseline = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [-k case filter] [-n samples] [-f text|json|csv] [-o file] [-B baseline csv]\n", argv[0]);
+                return 1;
+        }
+    }
+    if(opt.samples <= 0){
+        fprintf(stderr, "samples must be positive\n");
+        return 1;
+    }
+    std::map<std::string, double> baseline;
+    if(!opt.baseline.empty()){
+        baseline = loadBaseline(opt.baseline);
+    }
+
+    // Logger直接写std::cout，测量期间把fd 1指向/dev/null
+    std::cout.flush();
+    ::fflush(stdout);
+    int savedStdout = ::dup(STDOUT_FILENO);
+    int devNull = ::open("/dev/null", O_WRONLY | O_CLOEXEC);
+    ::dup2(devNull, STDOUT_FILENO);
+
+    bench::Report report;
+    // loop和fixture析构时也会打日志，放在块里，恢复stdout之前析构
+    {
+        EventLoop loop;
+        Fixture fixture;
+        fixture.local = &loop;
+        for(const Case &cs : makeCases(&fixture)){
+            if(!opt.filter.empty() && cs.name.find(opt.filter) == std::string::npos){
+                continue;
+            }
+            Histogram perOp = runCase(cs, opt.samples);
+            report.beginRow();
+            report.add("case", cs.name);
+            report.add("batch", cs.batch);
+            report.add("samples", opt.samples);
+            report.add("mean_ns", perOp.mean());
+            report.add("p50_ns", perOp.percentile(50));
+            report.add("p90_ns", perOp.percentile(90));
+            report.add("p99_ns", perOp.percentile(99));
+            report.add("max_ns", perOp.max());
+            report.add("ops_per_sec", perOp.mean() > 0 ? 1e9 / perOp.mean() : 0.0);
+            // 有基线时每行都带这两列，基线里没有的用例记0，csv的列才对得上
+            if(!opt.baseline.empty()){
+                auto it = baseline.find(cs.name);
+                double base = it == baseline.end() ? 0.0 : it->second;
+                report.add("base_p50_ns", base);
+                report.add("p50_change_pct", base > 0 ? (perOp.percentile(50) - base) * 100.0 / base : 0.0);
+            }
+        }
+    }
+
+    std::cout.flush();
+    ::fflush(stdout);
+    ::dup2(savedStdout, STDOUT_FILENO);
+    ::close(savedStdout);
+    ::close(devNull);
+    return report.write(opt.format, opt.output) ? 0 : 1;
+}
@@ -0,0 +1,487 @@
+// 开环压测（wrk2的做法）：按固定速率发请求，不管前面的应答回来没有，
+// 延迟从"按计划应该发出的时刻"开始算，服务端卡住时排在后面的请求也把等待时间算进去，不会出现coordinated omission
+// 每条消息的前8字节就是它的计划发送时刻（单调时钟纳秒），收到后用当前时间减去它，记进Histogram
+//   -m echo    服务端原样回显字节流，客户端按固定长度切分消息
+//   -m framed  4字节大端长度 + 消息体，服务端按帧解析后回同样的帧
+//   -m chat    按-g把连接分成若干房间，服务端把每帧转发给同房间的其他连接，延迟在每个接收方上统计
+// 速率可以给一个列表，逐个跑一轮；客户端跑在本库的EventLoop上，每个loop用一个定时器在最早到期的请求时刻醒来，发出所有到期的请求
+//
+// 用法：openloop_loadgen [-m echo|framed|chat] [-R 每秒请求数列表] [-c 连接数] [-t 客户端线程数] [-s 服务端subloop数]
+//                        [-b 消息字节数] [-g 聊天房间人数] [-d 每轮秒数] [-f text|json|csv] [-o 结果文件] [-P 端口]
+// 例：openloop_loadgen -m chat -R 5000,10000,20000 -c 64 -g 8 -f csv -o chat.csv
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ads_EventLoop.h"
+#include "ads_EventLoopThread.h"
+#include "ads_Channel.h"
+#include "ads_Buffer.h"
+#include "ads_TcpServer.h"
+#include "ads_Histogram.h"
+#include "bench_report.h"
+#include "bench_fixture.h"
+
+namespace
+{
+
+enum Mode{
+    kEcho,
+    kFramed,
+    kChat,
+};
+
+struct Options{
+    Mode mode = kEcho;
+    std::vector<int> rates{10000, 20000, 40000};
+    int connections = 64;
+    int clientThreads = 2;
+    int serverThreads = 2;
+    int payload = 64;
+    int group = 4;
+    int seconds = 5;
+    bench::Report::Format format = bench::Report::kText;
+    std::string output;
+    uint16_t port = 8090;
+};
+
+const char *modeName(Mode mode){
+    return mode == kEcho ? "echo" : mode == kFramed ? "framed" : "chat";
+}
+
+// 每帧前面的长度字段
+const size_t kHeaderLength = sizeof(uint32_t);
+
+// 聊天室：每个房间一组连接，服务端各个loop都会读，用一把锁保护
+class ChatRooms : noncopyable{
+public:
+    explicit ChatRooms(int group) : group_(group), joined_(0) {}
+
+    void join(const TcpConnectionPtr &conn){
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t room = joined_++ / group_;
+        if(room >= rooms_.size()){
+            rooms_.resize(room + 1);
+        }
+        rooms_[room].push_back(conn);
+        conn->setContext(std::make_shared<size_t>(room));
+    }
+    void leave(const TcpConnectionPtr &conn){
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::shared_ptr<size_t> room = std::static_pointer_cast<size_t>(conn->getContext());
+        if(room){
+            std::vector<TcpConnectionPtr> &members = rooms_[*room];
+            for(size_t i = 0; i < members.size(); ++i){
+                if(members[i] == conn){
+                    members.erase(members.begin() + i);
+                    break;
+                }
+            }
+        }
+    }
+    // 转发给同房间除自己之外的所有连接，其他loop上的连接由send()投递过去
+    void broadcast(const TcpConnectionPtr &from, const char *data, size_t len){
+        std::shared_ptr<size_t> room = std::static_pointer_cast<size_t>(from->getContext());
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(const TcpConnectionPtr &member : rooms_[*room]){
+            if(member != from){
+                member->send(data, len);
+            }
+        }
+    }
+
+private:
+    const size_t group_;
+    std::mutex mutex_;
+    size_t joined_;
+    std::vector<std::vector<TcpConnectionPtr>> rooms_;
+};
+
+class OpenLoopConnection;
+
+// 一个客户端loop上的连接和它们共用的统计，只在该loop线程里访问
+struct ClientLoop{
+    EventLoop *loop;
+    std::vector<OpenLoopConnection *> conns;
+    bool sending = false;
+    Histogram latency;      // 纳秒
+    int64_t sent = 0;
+    int64_t received = 0;
+    int failed = 0;
+};
+
+class OpenLoopConnection : noncopyable{
+public:
+    OpenLoopConnection(ClientLoop *client, int fd, const Options &opt)
+        : client_(client)
+        , fd_(fd)
+        , channel_(client->loop, fd)
+        , framed_(opt.mode != kEcho)
+        , message_(opt.payload, 'm')
+        , interval_(0)
+        , next_(0)
+        , sending_(false)
+        , failed_(false)
+    {
+        channel_.setReadCallback(std::bind(&OpenLoopConnection::onRead, this));
+        channel_.setWriteCallback(std::bind(&OpenLoopConnection::onWrite, this));
+    }
+    ~OpenLoopConnection(){
+        ::close(fd_);
+    }
+
+    // first是第一个请求的计划时刻，之后每隔interval纳秒一个；interval为0时只收不发
+    void start(int64_t first, int64_t interval){
+        next_ = first;
+        interval_ = interval;
+        sending_ = interval > 0;
+        channel_.enableReading();
+    }
+    // 停止发送，还在途的应答继续收
+    void stopSending() {sending_ = false;}
+    void stop(){
+        channel_.disableALL();
+        channel_.remove();
+    }
+
+    int64_t next() const {return next_;}
+
+    // 把到now为止按计划应该发出的请求都发出去，落后了就连续补发
+    void tick(int64_t now){
+        if(!sending_ || failed_){
+            return;
+        }
+        bool queued = false;
+        while(next_ <= now){
+            if(framed_){
+                uint32_t be = htonl(static_cast<uint32_t>(message_.size()));
+                output_.append(reinterpret_cast<const char *>(&be), sizeof be);
+            }
+            ::memcpy(&message_[0], &next_, sizeof next_);
+            output_.append(message_.data(), message_.size());
+            next_ += interval_;
+            ++client_->sent;
+            queued = true;
+        }
+        if(queued){
+            onWrite();
+        }
+    }
+
+private:
+    void onWrite(){
+        ssize_t n = ::write(fd_, output_.peek(), output_.readableBytes());
+        if(n > 0){
+            output_.retrieve(n);
+        }
+        else if(n < 0 && errno != EWOULDBLOCK){
+            fail();
+            return;
+        }
+        if(output_.readableBytes() > 0 && !channel_.isWriting()){
+            channel_.enableWriting();
+        }
+        else if(output_.readableBytes() == 0 && channel_.isWriting()){
+            channel_.disableWriting();
+        }
+    }
+
+    void onRead(){
+        int saveErrno = 0;
+        ssize_t n = input_.readFd(fd_, &saveErrno);
+        if(n <= 0){
+            fail();
+            return;
+        }
+        int64_t now = monotonicNanos();
+        while(true){
+            size_t length = message_.size();
+            if(framed_){
+                if(input_.readableBytes() < kHeaderLength){
+                    break;
+                }
+                uint32_t be;
+                ::memcpy(&be, input_.peek(), sizeof be);
+                length = ntohl(be);
+                if(input_.readableBytes() < kHeaderLength + length){
+                    break;
+                }
+                input_.retrieve(kHeaderLength);
+            }
+            else if(input_.readableBytes() < length){
+                break;
+            }
+            int64_t intended;
+            ::memcpy(&intended, input_.peek(), sizeof intended);
+            client_->latency.record(now - intended);
+            ++client_->received;
+            input_.retrieve(length);
+        }
+    }
+
+    void fail(){
+        if(!failed_){
+            failed_ = true;
+            ++client_->failed;
+        }
+        channel_.disableALL();
+    }
+
+    ClientLoop *client_;
+    int fd_;
+    Channel channel_;
+    bool framed_;
+    std::string message_;
+    Buffer input_;
+    Buffer output_;
+    int64_t interval_;
+    int64_t next_;          // 下一个请求的计划发送时刻
+    bool sending_;
+    bool failed_;
+};
+
+// 发出loop上所有到期的请求，再把定时器设到最早的下一个计划时刻
+void pump(ClientLoop *client){
+    if(!client->sending){
+        return;
+    }
+    int64_t now = monotonicNanos();
+    int64_t earliest = now + 1000 * 1000 * 1000;
+    for(OpenLoopConnection *conn : client->conns){
+        conn->tick(now);
+        earliest = std::min(earliest, conn->next());
+    }
+    double delay = std::max<int64_t>(0, earliest - monotonicNanos()) / 1e9;
+    client->loop->runAfter(delay, [client](){ pump(client); });
+}
+
+void runClients(const Options &opt, int rate, bench::Report *report){
+    std::vector<std::unique_ptr<EventLoopThread>> threads;
+    std::vector<std::unique_ptr<ClientLoop>> clients;
+    for(int i = 0; i < opt.clientThreads; ++i){
+        threads.emplace_back(new EventLoopThread(EventLoopThread::ThreadInitCallback(), "openloop"));
+        clients.emplace_back(new ClientLoop);
+        clients.back()->loop = threads.back()->startLoop();
+    }
+
+    std::vector<std::unique_ptr<OpenLoopConnection>> conns;
+    int connectFailed = 0;
+    for(int i = 0; i < opt.connections; ++i){
+        int fd = bench::connectTo(opt.port, bench::kNoDelay | bench::kNonBlock);
+        if(fd < 0){
+            ++connectFailed;
+            continue;
+        }
+        conns.emplace_back(new OpenLoopConnection(clients[i % clients.size()].get(), fd, opt));
+    }
+    // 等服务端把所有连接分进房间再开始发
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // 总速率平均分给每条连接，各连接的第一个请求在一个间隔内错开
+    int64_t interval = conns.empty() || rate <= 0 ? 0 : static_cast<int64_t>(1e9 * conns.size() / rate);
+    int64_t first = monotonicNanos() + 10 * 1000 * 1000;
+    for(size_t k = 0; k < clients.size(); ++k){
+        ClientLoop *client = clients[k].get();
+        for(size_t i = k; i < conns.size(); i += clients.size()){
+            client->conns.push_back(conns[i].get());
+        }
+        bench::runAndWait(client->loop, [&, client, k](){
+            for(size_t i = k; i < conns.size(); i += clients.size()){
+                conns[i]->start(first + interval * static_cast<int64_t>(i) / static_cast<int64_t>(conns.size()), interval);
+            }
+            client->sending = interval > 0;
+            pump(client);
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+    for(const auto &client : clients){
+        ClientLoop *c = client.get();
+        bench::runAndWait(c->loop, [c](){
+            c->sending = false;
+            for(OpenLoopConnection *conn : c->conns){
+                conn->stopSending();
+            }
+        });
+    }
+    // 留一点时间给在途的应答
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    for(size_t k = 0; k < clients.size(); ++k){
+        bench::runAndWait(clients[k]->loop, [&, k](){
+            for(size_t i = k; i < conns.size(); i += clients.size()){
+                conns[i]->stop();
+            }
+        });
+    }
+    conns.clear();
+    threads.clear();
+
+    Histogram latency;
+    int64_t sent = 0;
+    int64_t received = 0;
+    int failed = connectFailed;
+    for(const auto &client : clients){
+        latency.merge(client->latency);
+        sent += client->sent;
+        received += client->received;
+        failed += client->failed;
+    }
+    // 聊天模式下每条消息要送到房间里的其他人；最后一个房间可能不满，按实际连接数算
+    int64_t expected = sent;
+    if(opt.mode == kChat){
+        int connected = opt.connections - connectFailed;
+        int full = connected / opt.group;
+        int rest = connected % opt.group;
+        double fanout = connected == 0 ? 0.0
+                        : (static_cast<double>(full) * opt.group * (opt.group - 1) + rest * (rest - 1)) / connected;
+        expected = static_cast<int64_t>(sent * fanout + 0.5);
+    }
+
+    report->beginRow();
+    report->add("bench", "openloop");
+    report->add("mode", modeName(opt.mode));
+    report->add("target_rate", rate);
+    report->add("achieved_rate", sent / static_cast<double>(opt.seconds));
+    report->add("connections", opt.connections);
+    report->add("server_threads", opt.serverThreads);
+    report->add("payload", opt.payload);
+    report->add("sent", sent);
+    report->add("received", received);
+    report->add("expected", expected);
+    report->add("p50_us", latency.percentile(50) / 1000.0);
+    report->add("p99_us", latency.percentile(99) / 1000.0);
+    report->add("p999_us", latency.percentile(99.9) / 1000.0);
+    report->add("p9999_us", latency.percentile(99.99) / 1000.0);
+    report->add("max_us", latency.max() / 1000.0);
+    report->add("failed", failed);
+}
+
+void onFramedMessage(ChatRooms *rooms, const TcpConnectionPtr &conn, Buffer *buf){
+    while(buf->readableBytes() >= kHeaderLength){
+        uint32_t be;
+        ::memcpy(&be, buf->peek(), sizeof be);
+        size_t length = kHeaderLength + ntohl(be);
+        if(buf->readableBytes() < length){
+            break;
+        }
+        if(rooms){
+            rooms->broadcast(conn, buf->peek(), length);
+        }
+        else{
+            conn->send(buf->peek(), length);
+        }
+        buf->retrieve(length);
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+    Options opt;
+    int c;
+    while((c = ::getopt(argc, argv, "m:R:c:t:s:b:g:d:f:o:P:")) != -1){
+        switch(c){
+            case 'm':
+                if(strcmp(optarg, "echo") == 0){
+                    opt.mode = kEcho;
+                }
+                else if(strcmp(optarg, "framed") == 0){
+                    opt.mode = kFramed;
+                }
+                else if(strcmp(optarg, "chat") == 0){
+                    opt.mode = kChat;
+                }
+                else{
+                    fprintf(stderr, "unknown mode %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'R': opt.rates = bench::parseIntList(optarg); break;
+            case 'c': opt.connections = atoi(optarg); break;
+            case 't': opt.clientThreads = atoi(optarg); break;
+            case 's': opt.serverThreads = atoi(optarg); break;
+            case 'b': opt.payload = atoi(optarg); break;
+            case 'g': opt.group = atoi(optarg); break;
+            case 'd': opt.seconds = atoi(optarg); break;
+            case 'f':
+                if(!bench::Report::parseFormat(optarg, &opt.format)){
+                    fprintf(stderr, "unknown format %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'o': opt.output = optarg; break;
+            case 'P': opt.port = static_cast<uint16_t>(atoi(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-m echo|framed|chat] [-R rates list] [-c connections] [-t client threads]"
+                                " [-s server threads] [-b payload bytes] [-g chat group size] [-d seconds per run]"
+                                " [-f text|json|csv] [-o file] [-P port]\n", argv[0]);
+                return 1;
+        }
+    }
+    // 消息里要放8字节的计划发送时刻
+    if(opt.rates.empty() || opt.connections <= 0 || opt.clientThreads <= 0 || opt.seconds <= 0
+       || opt.payload < static_cast<int>(sizeof(int64_t)) || opt.group < 2){
+        fprintf(stderr, "bad arguments\n");
+        return 1;
+    }
+    bench::raiseFdLimit();
+    // 一轮结束时对端可能已经RST，往它写不能让整个进程退出
+    ::signal(SIGPIPE, SIG_IGN);
+
+    bench::Report report;
+    EventLoop loop;
+    for(int rate : opt.rates){
+        ChatRooms rooms(opt.group);
+        ChatRooms *chat = opt.mode == kChat ? &rooms : nullptr;
+        TcpServer server(&loop, InetAddress(opt.port, "127.0.0.1"), "openloop_loadgen");
+        server.setConnectionCallback([chat](const TcpConnectionPtr &conn){
+            if(conn->connected()){
+                conn->setTcpNoDelay(true);
+                if(chat){
+                    chat->join(conn);
+                }
+            }
+            else if(chat){
+                chat->leave(conn);
+            }
+        });
+        if(opt.mode == kEcho){
+            server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+                conn->send(buf);
+            });
+        }
+        else{
+            server.setMessageCallback([chat](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+                onFramedMessage(chat, conn, buf);
+            });
+        }
+        server.setThreadNum(opt.serverThreads);
+        server.start();
+
+        std::thread driver([&](){
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            runClients(opt, rate, &report);
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            loop.quit();
+        });
+        loop.loop();
+        driver.join();
+    }
+    return report.write(opt.format, opt.output) ? 0 : 1;
+}
@@ -0,0 +1,335 @@
+// ping-pong延迟：每条连接同时只有一条消息在途，服务端echo，客户端收齐后立刻发下一条，记录每条消息的往返时间
+// 服务端subloop数和连接数各给一个列表，逐个组合跑一轮，每轮重新建服务端和连接
+// 客户端也跑在本库的EventLoop上（非阻塞fd + Channel），1万条连接也只需要几个线程
+// -T给出要对比的传输方式：tcp（127.0.0.1）、tcp6（::1）、unix（/tmp下的socket文件）、abstract（抽象命名空间）
+// -n让服务端把每次echo拆成n次send()，模拟一个请求回多条小消息，-C打开服务端的合并写，对比系统调用合并的效果
+//
+// 用法：pingpong_bench [-s 服务端subloop数列表] [-c 连接数列表] [-t 客户端线程数] [-b 消息字节数]
+//                      [-T 传输方式列表] [-n 每次echo拆成几次send] [-C] [-d 每轮秒数] [-f text|json|csv] [-o 结果文件] [-P 端口]
+// 例：pingpong_bench -s 0,1,2,4 -c 1,10,100,1000,10000 -f json -o pingpong.json
+//     pingpong_bench -T tcp,unix -s 1 -c 1,100  对比本机TCP和Unix域socket的往返延迟
+//     pingpong_bench -T tcp -s 1 -c 100 -b 640 -n 20 -C  每个响应20条小消息，合并写
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ads_EventLoop.h"
+#include "ads_EventLoopThread.h"
+#include "ads_Channel.h"
+#include "ads_Buffer.h"
+#include "ads_TcpServer.h"
+#include "ads_Histogram.h"
+#include "bench_report.h"
+#include "bench_fixture.h"
+
+namespace
+{
+
+struct Options{
+    std::vector<int> serverThreads{0, 1, 2, 4};
+    std::vector<int> connections{1, 10, 100, 1000};
+    std::vector<std::string> transports{"tcp", "unix"};
+    int clientThreads = 2;
+    int payload = 64;
+    int pieces = 1;
+    bool coalesce = false;
+    int seconds = 3;
+    bench::Report::Format format = bench::Report::kText;
+    std::string output;
+    uint16_t port = 8088;
+};
+
+// 一个客户端loop上所有连接共用的统计，只在该loop线程里写
+struct ClientLoop{
+    EventLoop *loop;
+    Histogram latency;      // 纳秒
+    int64_t messages = 0;
+    int failed = 0;
+};
+
+class PingConnection : noncopyable{
+public:
+    PingConnection(ClientLoop *client, int fd, int payload)
+        : client_(client)
+        , fd_(fd)
+        , channel_(client->loop, fd)
+        , message_(payload, 'p')
+        , sendTime_(0)
+        , running_(true)
+    {
+        channel_.setReadCallback(std::bind(&PingConnection::onRead, this));
+        channel_.setWriteCallback(std::bind(&PingConnection::onWrite, this));
+    }
+    ~PingConnection(){
+        ::close(fd_);
+    }
+
+    void start(){
+        channel_.enableReading();
+        sendMessage();
+    }
+    // 在途的那条消息不再计数
+    void stop(){
+        running_ = false;
+        channel_.disableALL();
+        channel_.remove();
+    }
+
+private:
+    void sendMessage(){
+        sendTime_ = monotonicNanos();
+        output_.append(message_.data(), message_.size());
+        onWrite();
+    }
+
+    void onWrite(){
+        ssize_t n = ::write(fd_, output_.peek(), output_.readableBytes());
+        if(n > 0){
+            output_.retrieve(n);
+        }
+        else if(n < 0 && errno != EWOULDBLOCK){
+            fail();
+            return;
+        }
+        if(output_.readableBytes() > 0 && !channel_.isWriting()){
+            channel_.enableWriting();
+        }
+        else if(output_.readableBytes() == 0 && channel_.isWriting()){
+            channel_.disableWriting();
+        }
+    }
+
+    void onRead(){
+        int saveErrno = 0;
+        ssize_t n = input_.readFd(fd_, &saveErrno);
+        if(n <= 0){
+            fail();
+            return;
+        }
+        if(input_.readableBytes() < message_.size() || !running_){
+            return;
+        }
+        client_->latency.record(monotonicNanos() - sendTime_);
+        ++client_->messages;
+        input_.retrieve(message_.size());
+        sendMessage();
+    }
+
+    void fail(){
+        ++client_->failed;
+        channel_.disableALL();
+    }
+
+    ClientLoop *client_;
+    int fd_;
+    Channel channel_;
+    std::string message_;
+    Buffer input_;
+    Buffer output_;
+    int64_t sendTime_;
+    bool running_;
+};
+
+// 传输方式对应的服务端地址，不认识的返回false
+bool transportAddress(const std::string &transport, uint16_t port, InetAddress *addr){
+    if(transport == "tcp"){
+        *addr = InetAddress(port, "127.0.0.1");
+    }
+    else if(transport == "tcp6"){
+        *addr = InetAddress(port, "::1");
+    }
+    else if(transport == "unix"){
+        *addr = InetAddress::fromUnixPath("/tmp/pingpong_bench." + std::to_string(port) + ".sock");
+    }
+    else if(transport == "abstract"){
+        *addr = InetAddress::fromAbstract("pingpong_bench." + std::to_string(port));
+    }
+    else{
+        return false;
+    }
+    return true;
+}
+
+std::vector<std::string> splitList(const std::string &list){
+    std::vector<std::string> items;
+    size_t pos = 0;
+    while(pos <= list.size()){
+        size_t comma = list.find(',', pos);
+        items.push_back(list.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos));
+        if(comma == std::string::npos){
+            break;
+        }
+        pos = comma + 1;
+    }
+    return items;
+}
+
+// 跑一轮：服务端已经在监听，建connections条连接，压opt.seconds秒，结果写进report
+void runClients(const Options &opt, const std::string &transport, const InetAddress &serverAddr,
+                int serverThreads, int connections, bench::Report *report){
+    std::vector<std::unique_ptr<EventLoopThread>> threads;
+    std::vector<std::unique_ptr<ClientLoop>> clients;
+    for(int i = 0; i < opt.clientThreads; ++i){
+        threads.emplace_back(new EventLoopThread(EventLoopThread::ThreadInitCallback(), "pingpong"));
+        clients.emplace_back(new ClientLoop);
+        clients.back()->loop = threads.back()->startLoop();
+    }
+
+    std::vector<std::unique_ptr<PingConnection>> conns;
+    int connectFailed = 0;
+    for(int i = 0; i < connections; ++i){
+        int fd = bench::connectTo(serverAddr, bench::kNoDelay | bench::kNonBlock);
+        if(fd < 0){
+            ++connectFailed;
+            continue;
+        }
+        conns.emplace_back(new PingConnection(clients[i % clients.size()].get(), fd, opt.payload));
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < conns.size(); ++i){
+        PingConnection *conn = conns[i].get();
+        clients[i % clients.size()]->loop->runInLoop([conn](){ conn->start(); });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    // 每个loop一次停掉自己的全部连接，连接多时逐条等待会让停止阶段拖得很长
+    for(size_t k = 0; k < clients.size(); ++k){
+        bench::runAndWait(clients[k]->loop, [&conns, &clients, k](){
+            for(size_t i = k; i < conns.size(); i += clients.size()){
+                conns[i]->stop();
+            }
+        });
+    }
+    conns.clear();
+    threads.clear();
+
+    Histogram latency;
+    int64_t messages = 0;
+    int failed = connectFailed;
+    for(const auto &client : clients){
+        latency.merge(client->latency);
+        messages += client->messages;
+        failed += client->failed;
+    }
+    report->beginRow();
+    report->add("bench", "pingpong");
+    report->add("transport", transport);
+    report->add("server_threads", serverThreads);
+    report->add("connections", connections);
+    report->add("client_threads", opt.clientThreads);
+    report->add("payload", opt.payload);
+    report->add("pieces", opt.pieces);
+    report->add("coalesce", opt.coalesce ? 1 : 0);
+    report->add("seconds", elapsed);
+    report->add("messages", messages);
+    report->add("msgs_per_sec", messages / elapsed);
+    report->add("mean_us", latency.mean() / 1000.0);
+    report->add("p50_us", latency.percentile(50) / 1000.0);
+    report->add("p90_us", latency.percentile(90) / 1000.0);
+    report->add("p99_us", latency.percentile(99) / 1000.0);
+    report->add("p999_us", latency.percentile(99.9) / 1000.0);
+    report->add("max_us", latency.max() / 1000.0);
+    report->add("failed", failed);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+    Options opt;
+    int c;
+    while((c = ::getopt(argc, argv, "s:c:t:b:T:n:Cd:f:o:P:")) != -1){
+        switch(c){
+            case 's': opt.serverThreads = bench::parseIntList(optarg); break;
+            case 'c': opt.connections = bench::parseIntList(optarg); break;
+            case 't': opt.clientThreads = atoi(optarg); break;
+            case 'b': opt.payload = atoi(optarg); break;
+            case 'T': opt.transports = splitList(optarg); break;
+            case 'n': opt.pieces = atoi(optarg); break;
+            case 'C': opt.coalesce = true; break;
+            case 'd': opt.seconds = atoi(optarg); break;
+            case 'f':
+                if(!bench::Report::parseFormat(optarg, &opt.format)){
+                    fprintf(stderr, "unknown format %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'o': opt.output = optarg; break;
+            case 'P': opt.port = static_cast<uint16_t>(atoi(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-s server threads list] [-c connections list] [-t client threads]"
+                                " [-b payload bytes] [-T tcp,tcp6,unix,abstract] [-n sends per echo] [-C] [-d seconds per run] [-f text|json|csv] [-o file] [-P port]\n", argv[0]);
+                return 1;
+        }
+    }
+    if(opt.serverThreads.empty() || opt.connections.empty() || opt.clientThreads <= 0 || opt.payload <= 0 || opt.pieces <= 0){
+        fprintf(stderr, "bad arguments\n");
+        return 1;
+    }
+    for(const std::string &transport : opt.transports){
+        InetAddress addr;
+        if(!transportAddress(transport, opt.port, &addr)){
+            fprintf(stderr, "unknown transport %s\n", transport.c_str());
+            return 1;
+        }
+    }
+    bench::raiseFdLimit();
+
+    // 一轮结束时对端可能已经RST，往它写不能让整个进程退出
+    ::signal(SIGPIPE, SIG_IGN);
+    bench::Report report;
+    EventLoop loop;
+    for(const std::string &transport : opt.transports){
+        InetAddress serverAddr;
+        transportAddress(transport, opt.port, &serverAddr);
+        for(int serverThreads : opt.serverThreads){
+            for(int connections : opt.connections){
+                TcpServer server(&loop, serverAddr, "pingpong_bench");
+                server.setConnectionCallback([](const TcpConnectionPtr &conn){
+                    if(conn->connected()){
+                        conn->setTcpNoDelay(true);
+                    }
+                });
+                int pieces = opt.pieces;
+                server.setMessageCallback([pieces](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+                    // 收到的数据分成pieces份逐份send()
+                    size_t piece = (buf->readableBytes() + pieces - 1) / pieces;
+                    while(buf->readableBytes() > 0){
+                        size_t n = std::min(piece, buf->readableBytes());
+                        conn->send(buf->peek(), n);
+                        buf->retrieve(n);
+                    }
+                });
+                server.setCoalesceWrites(opt.coalesce);
+                server.setThreadNum(serverThreads);
+                server.start();
+
+                std::thread driver([&](){
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    runClients(opt, transport, serverAddr, serverThreads, connections, &report);
+                    // 等服务端处理完关闭
+                    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                    loop.quit();
+                });
+                loop.loop();
+                driver.join();
+            }
+        }
+    }
+    return report.write(opt.format, opt.output) ? 0 : 1;
+}
@@ -0,0 +1,249 @@
+// 限速的准确度：服务端按配置的令牌桶限速，客户端全速收或发，看实际速率是不是落在限制上
+//   -m send  服务端不停往每条连接推数据（写完成回调里接着发），每条连接限速-r，整个服务器限速-S
+//   -m recv  客户端全速往服务端灌数据，同一对端IP（都是127.0.0.1）限速-r，整个服务器限速-S
+// 每种模式按服务端loop数列表各跑一轮；服务器限速的桶被所有loop共用，按对端IP的桶也跨loop共用
+// 速率里包含开始时桶里的burst，每轮秒数越长越接近限制
+//
+// 用法：rate_limit_bench [-m send,recv] [-s 服务端subloop数列表] [-c 连接数] [-r 每连接/每IP字节每秒]
+//                        [-S 服务器合计字节每秒] [-b burst字节] [-d 每轮秒数] [-f text|json|csv] [-o 结果文件] [-P 端口]
+// 例：rate_limit_bench -m send -s 1,2 -c 8 -r 1048576 -S 4194304 -f csv -o rate.csv
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ads_EventLoop.h"
+#include "ads_TcpServer.h"
+#include "bench_report.h"
+#include "bench_fixture.h"
+
+namespace
+{
+
+struct Options{
+    std::vector<std::string> modes{"send", "recv"};
+    std::vector<int> serverThreads{1, 2};
+    int conns = 4;
+    double rate = 2 * 1024 * 1024;
+    double serverRate = 0;
+    double burst = 64 * 1024;
+    int seconds = 3;
+    bench::Report::Format format = bench::Report::kText;
+    std::string output;
+    uint16_t port = 8095;
+};
+
+const size_t kChunk = 64 * 1024;
+
+// 每条客户端连接计的字节数，只在各自线程里写，各自单独分配
+struct Counter{
+    std::atomic<int64_t> bytes{0};
+};
+
+void runOnce(const Options &opt, EventLoop *loop, const std::string &mode, int serverThreads,
+             uint16_t port, bench::Report *report){
+    const bool send = mode == "send";
+    std::atomic<int64_t> serverRecv(0);
+    std::atomic_int established(0);
+    TcpServer server(loop, InetAddress(port, "127.0.0.1"), "rate_limit_bench");
+    server.setThreadNum(serverThreads);
+    if(send){
+        server.setSendRateLimit(opt.rate, opt.burst);
+        server.setServerSendLimit(opt.serverRate, opt.burst);
+    }
+    else{
+        server.setPeerRecvLimit(opt.rate, opt.burst);
+        server.setServerRecvLimit(opt.serverRate, opt.burst);
+    }
+    std::shared_ptr<std::string> chunk = std::make_shared<std::string>(kChunk, 's');
+    server.setConnectionCallback([send, chunk, &established](const TcpConnectionPtr &conn){
+        if(conn->connected()){
+            ++established;
+            // 先放两块，写完成回调里再补，outputBuffer_里一直有数据等着令牌
+            if(send){
+                conn->send(*chunk);
+                conn->send(*chunk);
+            }
+        }
+    });
+    server.setWriteCompleteCallback([chunk](const TcpConnectionPtr &conn){
+        if(conn->connected()){
+            conn->send(*chunk);
+        }
+    });
+    server.setMessageCallback([&serverRecv](const TcpConnectionPtr &, Buffer *buf, Timestamp){
+        serverRecv.fetch_add(buf->readableBytes(), std::memory_order_relaxed);
+        buf->retrieveAll();
+    });
+    server.start();
+
+    std::vector<int64_t> perConn(opt.conns, 0);
+    int failed = 0;
+    double elapsed = 0;
+    int64_t total = 0;
+    std::thread driver([&](){
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        std::vector<int> fds;
+        for(int i = 0; i < opt.conns; ++i){
+            int fd = bench::connectTo(port, bench::kSendTimeout | bench::kRecvTimeout);
+            if(fd < 0){
+                ++failed;
+                continue;
+            }
+            fds.push_back(fd);
+        }
+        while(established < static_cast<int>(fds.size())){
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        std::atomic<bool> running(true);
+        std::vector<std::unique_ptr<Counter>> counters;
+        std::vector<std::thread> threads;
+        for(int fd : fds){
+            counters.emplace_back(new Counter);
+            Counter *counter = counters.back().get();
+            threads.emplace_back([fd, send, counter, &running](){
+                std::vector<char> data(kChunk, 'c');
+                while(running.load(std::memory_order_relaxed)){
+                    ssize_t n = send ? ::read(fd, data.data(), data.size()) : ::write(fd, data.data(), data.size());
+                    if(n > 0){
+                        counter->bytes.fetch_add(n, std::memory_order_relaxed);
+                    }
+                    else if(n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)){
+                        break;
+                    }
+                }
+            });
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        int64_t recvBegin = serverRecv.load();
+        std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        for(size_t i = 0; i < counters.size(); ++i){
+            perConn[i] = counters[i]->bytes.load();
+        }
+        // recv模式以服务端实际交给messageCallback的字节为准，客户端写进内核缓冲区的不算
+        total = serverRecv.load() - recvBegin;
+        running = false;
+        for(std::thread &t : threads){
+            t.join();
+        }
+        for(int fd : fds){
+            ::close(fd);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        loop->quit();
+    });
+    loop->loop();
+    driver.join();
+
+    const double mb = 1024.0 * 1024.0;
+    double minConn = 0;
+    double maxConn = 0;
+    int64_t clientTotal = 0;
+    for(size_t i = 0; i < perConn.size(); ++i){
+        double rate = perConn[i] / elapsed / mb;
+        minConn = i == 0 ? rate : std::min(minConn, rate);
+        maxConn = std::max(maxConn, rate);
+        clientTotal += perConn[i];
+    }
+    if(send){
+        total = clientTotal;
+    }
+    // 每连接（send）或者所有连接合计（recv，同一个IP）的限制，再和服务器合计取小
+    double limit = send ? opt.rate * opt.conns : opt.rate;
+    if(opt.serverRate > 0){
+        limit = limit > 0 ? std::min(limit, opt.serverRate) : opt.serverRate;
+    }
+
+    report->beginRow();
+    report->add("bench", "rate_limit");
+    report->add("mode", mode);
+    report->add("server_loops", serverThreads);
+    report->add("conns", opt.conns);
+    report->add("rate_mb", opt.rate / mb);
+    report->add("server_rate_mb", opt.serverRate / mb);
+    report->add("burst_kb", opt.burst / 1024);
+    report->add("seconds", elapsed);
+    report->add("limit_mb_per_sec", limit / mb);
+    report->add("total_mb_per_sec", total / elapsed / mb);
+    report->add("ratio", limit > 0 ? total / elapsed / limit : 0.0);
+    report->add("conn_min_mb_per_sec", minConn);
+    report->add("conn_max_mb_per_sec", maxConn);
+    report->add("failed", failed);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+    Options opt;
+    int c;
+    while((c = ::getopt(argc, argv, "m:s:c:r:S:b:d:f:o:P:")) != -1){
+        switch(c){
+            case 'm':{
+                opt.modes.clear();
+                std::stringstream ss(optarg);
+                std::string mode;
+                while(std::getline(ss, mode, ',')){
+                    if(mode != "send" && mode != "recv"){
+                        fprintf(stderr, "unknown mode %s\n", mode.c_str());
+                        return 1;
+                    }
+                    opt.modes.push_back(mode);
+                }
+                break;
+            }
+            case 's': opt.serverThreads = bench::parseIntList(optarg); break;
+            case 'c': opt.conns = atoi(optarg); break;
+            case 'r': opt.rate = atof(optarg); break;
+            case 'S': opt.serverRate = atof(optarg); break;
+            case 'b': opt.burst = atof(optarg); break;
+            case 'd': opt.seconds = atoi(optarg); break;
+            case 'f':
+                if(!bench::Report::parseFormat(optarg, &opt.format)){
+                    fprintf(stderr, "unknown format %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'o': opt.output = optarg; break;
+            case 'P': opt.port = static_cast<uint16_t>(atoi(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-m send,recv] [-s server threads list] [-c conns] [-r bytes/s per conn or ip]"
+                                " [-S server bytes/s] [-b burst bytes] [-d seconds per run] [-f text|json|csv] [-o file] [-P port]\n", argv[0]);
+                return 1;
+        }
+    }
+    if(opt.modes.empty() || opt.serverThreads.empty() || opt.conns <= 0 || opt.rate < 0 || opt.serverRate < 0
+       || (opt.rate == 0 && opt.serverRate == 0) || opt.burst <= 0 || opt.seconds <= 0){
+        fprintf(stderr, "bad arguments\n");
+        return 1;
+    }
+
+    ::signal(SIGPIPE, SIG_IGN);
+    bench::Report report;
+    EventLoop loop;
+    // 每轮换一个端口，不受上一轮连接关闭的影响
+    uint16_t port = opt.port;
+    for(const std::string &mode : opt.modes){
+        for(int serverThreads : opt.serverThreads){
+            runOnce(opt, &loop, mode, serverThreads, port++, &report);
+        }
+    }
+    return report.write(opt.format, opt.output) ? 0 : 1;
+}
@@ -0,0 +1,288 @@
+// 读公平性：几条"大流量"连接全速往服务端灌数据，同一个subloop上另有几条ping-pong连接，统计ping的往返时间
+// 服务端处理数据的开销按字节计（-c 每KB纳秒数），一次读得越多，同一轮里排在后面的连接等得越久
+// 每轮用不同的读预算（见TcpConnection::setReadBudget）重新建服务端：
+//   0/0       不限，每次可读事件读到缓冲区可写空间加64KB
+//   16384/0   每次最多读16KB，读满了就排进就绪列表，和别的连接轮流读
+//   16384/100 同时限制每轮处理事件的时间，超过100微秒后不再读，没读到的连接下一轮优先
+// 报告ping的往返时间、大流量连接的吞吐，以及两类连接的读公平性统计
+//
+// 用法：read_fairness_bench [-B 预算列表，每项为"字节数/微秒"] [-H 大流量连接数] [-L ping连接数]
+//                           [-c 服务端每KB处理开销（纳秒）] [-d 每轮秒数] [-f text|json|csv] [-o 结果文件] [-P 端口]
+// 例：read_fairness_bench -B 0/0,4096/0,16384/0,0/100 -H 4 -f csv -o fairness.csv
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ads_EventLoop.h"
+#include "ads_TcpServer.h"
+#include "ads_Histogram.h"
+#include "bench_report.h"
+#include "bench_fixture.h"
+
+namespace
+{
+
+struct Budget{
+    size_t bytes;
+    int64_t micros;
+};
+
+struct Options{
+    std::vector<Budget> budgets{{0, 0}, {16384, 0}, {16384, 100}};
+    int hogs = 2;
+    int pingers = 4;
+    int64_t nanosPerKb = 1000;
+    int seconds = 3;
+    bench::Report::Format format = bench::Report::kText;
+    std::string output;
+    uint16_t port = 8094;
+};
+
+void spin(int64_t nanos){
+    int64_t end = monotonicNanos() + nanos;
+    while(monotonicNanos() < end){
+    }
+}
+
+// 服务端连接表，只在subloop线程访问
+struct ServerState{
+    std::vector<TcpConnectionPtr> conns;
+    std::atomic_int established{0};
+};
+
+// 按类别汇总的读公平性统计，在subloop线程里收集
+struct Fairness{
+    TcpConnection::ReadStats hog;
+    TcpConnection::ReadStats ping;
+};
+
+void add(TcpConnection::ReadStats *total, const TcpConnection::ReadStats &stats){
+    total->reads += stats.reads;
+    total->bytes += stats.bytes;
+    total->budgetHits += stats.budgetHits;
+    total->deferred += stats.deferred;
+    total->waitMicros += stats.waitMicros;
+    total->maxWaitMicros = std::max(total->maxWaitMicros, stats.maxWaitMicros);
+}
+
+void runOnce(const Options &opt, EventLoop *loop, const Budget &budget, uint16_t port, bench::Report *report){
+    std::atomic<EventLoop *> ioLoop(nullptr);
+    ServerState state;
+    TcpServer server(loop, InetAddress(port, "127.0.0.1"), "read_fairness_bench");
+    server.setThreadNum(1);
+    server.setReadBudget(budget.bytes, budget.micros);
+    server.setThreadInitCallback([&ioLoop](EventLoop *l){ ioLoop = l; });
+    server.setConnectionCallback([&state](const TcpConnectionPtr &conn){
+        if(conn->connected()){
+            conn->setTcpNoDelay(true);
+            state.conns.push_back(conn);
+            ++state.established;
+        }
+    });
+    const int64_t nanosPerKb = opt.nanosPerKb;
+    server.setMessageCallback([nanosPerKb](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+        spin(static_cast<int64_t>(buf->readableBytes()) * nanosPerKb / 1024);
+        if(*buf->peek() == 'p'){
+            conn->send(buf);
+        }
+        else{
+            buf->retrieveAll();
+        }
+    });
+    server.start();
+
+    Histogram rtt;
+    std::atomic<int64_t> hogBytes(0);
+    int failed = 0;
+    double elapsed = 0;
+    Fairness fairness;
+    std::thread driver([&](){
+        while(ioLoop.load() == nullptr){
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        EventLoop *target = ioLoop.load();
+        std::vector<int> hogFds;
+        std::vector<int> pingFds;
+        for(int i = 0; i < opt.hogs + opt.pingers; ++i){
+            int fd = bench::connectTo(port, bench::kNoDelay | bench::kSendTimeout);
+            if(fd < 0){
+                ++failed;
+                continue;
+            }
+            (i < opt.hogs ? hogFds : pingFds).push_back(fd);
+        }
+        while(state.established < static_cast<int>(hogFds.size() + pingFds.size())){
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        std::atomic<bool> running(true);
+        std::vector<std::thread> hogs;
+        for(int fd : hogFds){
+            hogs.emplace_back([fd, &running, &hogBytes](){
+                std::string chunk(256 * 1024, 'h');
+                while(running.load(std::memory_order_relaxed)){
+                    ssize_t n = ::write(fd, chunk.data(), chunk.size());
+                    if(n > 0){
+                        hogBytes.fetch_add(n, std::memory_order_relaxed);
+                    }
+                    else if(n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+                        break;
+                    }
+                }
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        hogBytes = 0;
+        auto begin = std::chrono::steady_clock::now();
+        auto deadline = begin + std::chrono::seconds(opt.seconds);
+        while(!pingFds.empty() && std::chrono::steady_clock::now() < deadline){
+            for(int fd : pingFds){
+                char c = 'p';
+                int64_t start = monotonicNanos();
+                if(::write(fd, &c, 1) != 1 || ::read(fd, &c, 1) != 1){
+                    ++failed;
+                    continue;
+                }
+                rtt.record(monotonicNanos() - start);
+            }
+        }
+        if(pingFds.empty()){
+            std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+        }
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        int64_t bytes = hogBytes.load();
+        running = false;
+        for(std::thread &t : hogs){
+            t.join();
+        }
+        hogBytes = bytes;
+
+        std::promise<void> collected;
+        target->runInLoop([&state, &fairness, &collected](){
+            for(const TcpConnectionPtr &conn : state.conns){
+                TcpConnection::ReadStats stats = conn->readStats();
+                // ping连接每次只读到一个字节
+                add(stats.bytes > stats.reads ? &fairness.hog : &fairness.ping, stats);
+            }
+            collected.set_value();
+        });
+        collected.get_future().get();
+
+        for(int fd : hogFds){
+            ::close(fd);
+        }
+        for(int fd : pingFds){
+            ::close(fd);
+        }
+        // 等服务端处理完关闭，再在loop线程里放掉连接
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        std::promise<void> cleared;
+        target->runInLoop([&state, &cleared](){
+            state.conns.clear();
+            cleared.set_value();
+        });
+        cleared.get_future().get();
+        loop->quit();
+    });
+    loop->loop();
+    driver.join();
+
+    char spec[48];
+    snprintf(spec, sizeof spec, "%zu/%lld", budget.bytes, (long long)budget.micros);
+    report->beginRow();
+    report->add("bench", "read_fairness");
+    report->add("budget", spec);
+    report->add("hogs", opt.hogs);
+    report->add("pingers", opt.pingers);
+    report->add("ns_per_kb", opt.nanosPerKb);
+    report->add("seconds", elapsed);
+    report->add("hog_mb_per_sec", hogBytes.load() / elapsed / (1024 * 1024));
+    report->add("rtt_count", static_cast<int64_t>(rtt.count()));
+    report->add("rtt_p50_us", rtt.percentile(50) / 1000.0);
+    report->add("rtt_p99_us", rtt.percentile(99) / 1000.0);
+    report->add("rtt_max_us", rtt.max() / 1000.0);
+    report->add("hog_read_avg", fairness.hog.reads > 0 ? static_cast<double>(fairness.hog.bytes) / fairness.hog.reads : 0.0);
+    report->add("hog_budget_hits", static_cast<int64_t>(fairness.hog.budgetHits));
+    report->add("hog_deferred", static_cast<int64_t>(fairness.hog.deferred));
+    report->add("ping_deferred", static_cast<int64_t>(fairness.ping.deferred));
+    report->add("ping_max_wait_us", static_cast<int64_t>(fairness.ping.maxWaitMicros));
+    report->add("failed", failed);
+}
+
+bool parseBudgets(const char *arg, std::vector<Budget> *budgets){
+    budgets->clear();
+    std::stringstream ss(arg);
+    std::string item;
+    while(std::getline(ss, item, ',')){
+        unsigned long bytes = 0;
+        long long micros = 0;
+        if(sscanf(item.c_str(), "%lu/%lld", &bytes, &micros) != 2 || micros < 0){
+            return false;
+        }
+        budgets->push_back(Budget{bytes, static_cast<int64_t>(micros)});
+    }
+    return !budgets->empty();
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+    Options opt;
+    int c;
+    while((c = ::getopt(argc, argv, "B:H:L:c:d:f:o:P:")) != -1){
+        switch(c){
+            case 'B':
+                if(!parseBudgets(optarg, &opt.budgets)){
+                    fprintf(stderr, "bad budget list %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'H': opt.hogs = atoi(optarg); break;
+            case 'L': opt.pingers = atoi(optarg); break;
+            case 'c': opt.nanosPerKb = atoll(optarg); break;
+            case 'd': opt.seconds = atoi(optarg); break;
+            case 'f':
+                if(!bench::Report::parseFormat(optarg, &opt.format)){
+                    fprintf(stderr, "unknown format %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'o': opt.output = optarg; break;
+            case 'P': opt.port = static_cast<uint16_t>(atoi(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-B bytes/micros,...] [-H hog conns] [-L ping conns] [-c server ns per KB]"
+                                " [-d seconds per run] [-f text|json|csv] [-o file] [-P port]\n", argv[0]);
+                return 1;
+        }
+    }
+    if(opt.hogs < 0 || opt.pingers < 0 || opt.nanosPerKb < 0 || opt.seconds <= 0){
+        fprintf(stderr, "bad arguments\n");
+        return 1;
+    }
+
+    ::signal(SIGPIPE, SIG_IGN);
+    bench::Report report;
+    EventLoop loop;
+    // 每轮换一个端口，不受上一轮连接关闭的影响
+    for(size_t i = 0; i < opt.budgets.size(); ++i){
+        runOnce(opt, &loop, opt.budgets[i], static_cast<uint16_t>(opt.port + i), &report);
+    }
+    return report.write(opt.format, opt.output) ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+// TcpClient断线重连：连上 -> echo -> 关掉服务端 -> 过一会儿在同一端口重启 -> 客户端自动重连 -> 再echo
+// 每轮报告从服务端重启到重连后第一个echo回来的耗时，主要由Connector的退避时间决定
+// 客户端的connect()和最后的stop()都在驱动线程里调用（不是客户端loop线程），顺带覆盖Connector的跨线程start/stop
+//
+// 用法：reconnect_bench [-n 重启轮数] [-D 服务端停机毫秒] [-r 初始退避毫秒] [-R 最大退避毫秒] [-f text|json|csv] [-o 结果文件] [-P 端口]
+// 例：reconnect_bench -n 5 -D 200 -r 10 -R 100
+
+#include <unistd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "ads_EventLoop.h"
+#include "ads_EventLoopThread.h"
+#include "ads_TcpServer.h"
+#include "ads_TcpClient.h"
+#include "bench_report.h"
+#include "bench_fixture.h"
+
+namespace
+{
+
+struct Options{
+    int rounds = 3;
+    int downMs = 100;
+    int initialRetryMs = 10;
+    int maxRetryMs = 100;
+    bench::Report::Format format = bench::Report::kText;
+    std::string output;
+    uint16_t port = 8096;
+};
+
+using Clock = std::chrono::steady_clock;
+
+// 等cond成立，最多等timeoutMs毫秒
+template <typename Cond>
+bool waitFor(Cond cond, int timeoutMs){
+    Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+    while(!cond()){
+        if(Clock::now() > deadline){
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+    Options opt;
+    int c;
+    while((c = ::getopt(argc, argv, "n:D:r:R:f:o:P:")) != -1){
+        switch(c){
+            case 'n': opt.rounds = atoi(optarg); break;
+            case 'D': opt.downMs = atoi(optarg); break;
+            case 'r': opt.initialRetryMs = atoi(optarg); break;
+            case 'R': opt.maxRetryMs = atoi(optarg); break;
+            case 'f':
+                if(!bench::Report::parseFormat(optarg, &opt.format)){
+                    fprintf(stderr, "unknown format %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'o': opt.output = optarg; break;
+            case 'P': opt.port = static_cast<uint16_t>(atoi(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-n rounds] [-D server down ms] [-r initial retry ms] [-R max retry ms]"
+                                " [-f text|json|csv] [-o file] [-P port]\n", argv[0]);
+                return 1;
+        }
+    }
+    if(opt.rounds < 0 || opt.downMs < 0 || opt.initialRetryMs <= 0 || opt.maxRetryMs < opt.initialRetryMs){
+        fprintf(stderr, "bad arguments\n");
+        return 1;
+    }
+
+    ::signal(SIGPIPE, SIG_IGN);
+    const InetAddress addr(opt.port, "127.0.0.1");
+
+    // 服务端跑在单独的loop线程里，每轮在那里析构再重新创建
+    EventLoopThread serverThread;
+    EventLoop *serverLoop = serverThread.startLoop();
+    std::unique_ptr<TcpServer> server;
+    auto startServer = [&](){
+        bench::runAndWait(serverLoop, [&](){
+            server.reset(new TcpServer(serverLoop, addr, "reconnect_bench_server"));
+            server->setConnectionCallback([](const TcpConnectionPtr &){});
+            server->setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+                conn->send(buf->retrieveAllAsString());
+            });
+            server->start();
+        });
+    };
+    auto stopServer = [&](){
+        bench::runAndWait(serverLoop, [&](){
+            server.reset();
+        });
+    };
+
+    // 客户端在主线程的loop里
+    EventLoop loop;
+    TcpClient client(&loop, addr, "reconnect_bench");
+    client.enableRetry();
+    client.setRetryDelay(opt.initialRetryMs, opt.maxRetryMs);
+    std::atomic_bool connected(false);
+    std::atomic_int connects(0);
+    std::atomic_int echoes(0);
+    client.setConnectionCallback([&](const TcpConnectionPtr &conn){
+        connected = conn->connected();
+        if(conn->connected()){
+            ++connects;
+            conn->send("ping");
+        }
+    });
+    client.setMessageCallback([&](const TcpConnectionPtr &, Buffer *buf, Timestamp){
+        if(buf->readableBytes() >= 4){
+            buf->retrieve(4);
+            ++echoes;
+        }
+    });
+
+    bench::Report report;
+    int failed = 0;
+    std::thread driver([&](){
+        startServer();
+        Clock::time_point begin = Clock::now();
+        client.connect();
+        if(!waitFor([&](){ return echoes >= 1; }, 5000)){
+            fprintf(stderr, "initial connect failed\n");
+            ++failed;
+        }
+        else{
+            report.beginRow();
+            report.add("bench", "reconnect");
+            report.add("round", 0);
+            report.add("reconnect_ms", std::chrono::duration<double, std::milli>(Clock::now() - begin).count());
+        }
+        for(int round = 1; round <= opt.rounds && failed == 0; ++round){
+            stopServer();
+            if(!waitFor([&](){ return !connected; }, 5000)){
+                fprintf(stderr, "round %d: client did not see the server go away\n", round);
+                ++failed;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(opt.downMs));
+            startServer();
+            Clock::time_point restarted = Clock::now();
+            // 退避最长maxRetryMs，再留出余量
+            if(!waitFor([&](){ return echoes >= round + 1; }, opt.maxRetryMs * 2 + 5000)){
+                fprintf(stderr, "round %d: client did not reconnect\n", round);
+                ++failed;
+                break;
+            }
+            report.beginRow();
+            report.add("bench", "reconnect");
+            report.add("round", round);
+            report.add("reconnect_ms", std::chrono::duration<double, std::milli>(Clock::now() - restarted).count());
+        }
+        // 从驱动线程停掉重试再断开，loop线程同时可能正在处理Connector
+        client.stop();
+        client.disconnect();
+        waitFor([&](){ return !connected; }, 1000);
+        stopServer();
+        loop.quit();
+    });
+    loop.loop();
+    driver.join();
+
+    printf("reconnect_bench: rounds=%d down_ms=%d retry_ms=%d..%d connects=%d echoes=%d failed=%d\n",
+           opt.rounds, opt.downMs, opt.initialRetryMs, opt.maxRetryMs, connects.load(), echoes.load(), failed);
+    if(!report.write(opt.format, opt.output)){
+        return 1;
+    }
+    return failed == 0 ? 0 : 1;
+}
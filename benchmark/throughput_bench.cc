@@ -0,0 +1,247 @@
+// 大块数据吞吐：每条连接开始时发出一条-b字节的消息，服务端echo，客户端收到多少就原样再发回去，
+// 数据在两端之间不停地流动，每条连接在途的数据量始终是一条消息，统计客户端每秒收到的字节数
+// 服务端subloop数和消息大小各给一个列表，逐个组合跑一轮，每轮重新建服务端和连接
+//
+// 用法：throughput_bench [-s 服务端subloop数列表] [-b 消息字节数列表] [-c 连接数] [-t 客户端线程数]
+//                        [-d 每轮秒数] [-f text|json|csv] [-o 结果文件] [-P 端口]
+// 例：throughput_bench -s 0,1,2,4 -b 4096,65536,1048576 -f csv -o throughput.csv
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ads_EventLoop.h"
+#include "ads_EventLoopThread.h"
+#include "ads_Channel.h"
+#include "ads_Buffer.h"
+#include "ads_TcpServer.h"
+#include "bench_report.h"
+#include "bench_fixture.h"
+
+namespace
+{
+
+struct Options{
+    std::vector<int> serverThreads{0, 1, 2, 4};
+    std::vector<int> sizes{4096, 65536, 1048576};
+    int connections = 16;
+    int clientThreads = 2;
+    int seconds = 3;
+    bench::Report::Format format = bench::Report::kText;
+    std::string output;
+    uint16_t port = 8089;
+};
+
+class StreamConnection : noncopyable{
+public:
+    StreamConnection(EventLoop *loop, int fd, int size)
+        : fd_(fd)
+        , channel_(loop, fd)
+        , size_(size)
+        , bytesRead_(0)
+        , failed_(false)
+    {
+        channel_.setReadCallback(std::bind(&StreamConnection::onRead, this));
+        channel_.setWriteCallback(std::bind(&StreamConnection::onWrite, this));
+    }
+    ~StreamConnection(){
+        ::close(fd_);
+    }
+
+    void start(){
+        channel_.enableReading();
+        std::string message(size_, 's');
+        output_.append(message.data(), message.size());
+        onWrite();
+    }
+    void stop(){
+        channel_.disableALL();
+        channel_.remove();
+    }
+
+    int64_t bytesRead() const {return bytesRead_;}
+    bool failed() const {return failed_;}
+
+private:
+    void onWrite(){
+        ssize_t n = ::write(fd_, output_.peek(), output_.readableBytes());
+        if(n > 0){
+            output_.retrieve(n);
+        }
+        else if(n < 0 && errno != EWOULDBLOCK){
+            fail();
+            return;
+        }
+        if(output_.readableBytes() > 0 && !channel_.isWriting()){
+            channel_.enableWriting();
+        }
+        else if(output_.readableBytes() == 0 && channel_.isWriting()){
+            channel_.disableWriting();
+        }
+    }
+
+    // 收到的数据直接换到发送缓冲区里发回去，不拷贝
+    void onRead(){
+        int saveErrno = 0;
+        ssize_t n = input_.readFd(fd_, &saveErrno);
+        if(n <= 0){
+            fail();
+            return;
+        }
+        bytesRead_ += n;
+        if(output_.readableBytes() == 0){
+            output_.swap(input_);
+        }
+        else{
+            output_.append(input_.peek(), input_.readableBytes());
+            input_.retrieveAll();
+        }
+        onWrite();
+    }
+
+    void fail(){
+        failed_ = true;
+        channel_.disableALL();
+    }
+
+    int fd_;
+    Channel channel_;
+    int size_;
+    Buffer input_;
+    Buffer output_;
+    int64_t bytesRead_;
+    bool failed_;
+};
+
+void runClients(const Options &opt, int serverThreads, int size, bench::Report *report){
+    std::vector<std::unique_ptr<EventLoopThread>> threads;
+    std::vector<EventLoop *> loops;
+    for(int i = 0; i < opt.clientThreads; ++i){
+        threads.emplace_back(new EventLoopThread(EventLoopThread::ThreadInitCallback(), "throughput"));
+        loops.push_back(threads.back()->startLoop());
+    }
+
+    std::vector<std::unique_ptr<StreamConnection>> conns;
+    int failed = 0;
+    for(int i = 0; i < opt.connections; ++i){
+        int fd = bench::connectTo(opt.port, bench::kNoDelay | bench::kNonBlock);
+        if(fd < 0){
+            ++failed;
+            continue;
+        }
+        conns.emplace_back(new StreamConnection(loops[i % loops.size()], fd, size));
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < conns.size(); ++i){
+        StreamConnection *conn = conns[i].get();
+        loops[i % loops.size()]->runInLoop([conn](){ conn->start(); });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    // 每个loop一次停掉自己的全部连接并取出计数
+    int64_t bytes = 0;
+    for(size_t k = 0; k < loops.size(); ++k){
+        bench::runAndWait(loops[k], [&conns, &loops, &bytes, &failed, k](){
+            for(size_t i = k; i < conns.size(); i += loops.size()){
+                conns[i]->stop();
+                bytes += conns[i]->bytesRead();
+                failed += conns[i]->failed() ? 1 : 0;
+            }
+        });
+    }
+    conns.clear();
+    threads.clear();
+
+    report->beginRow();
+    report->add("bench", "throughput");
+    report->add("server_threads", serverThreads);
+    report->add("connections", opt.connections);
+    report->add("client_threads", opt.clientThreads);
+    report->add("message_bytes", size);
+    report->add("seconds", elapsed);
+    report->add("bytes", bytes);
+    report->add("mib_per_sec", bytes / elapsed / (1024 * 1024));
+    report->add("msgs_per_sec", bytes / elapsed / size);
+    report->add("failed", failed);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+    Options opt;
+    int c;
+    while((c = ::getopt(argc, argv, "s:b:c:t:d:f:o:P:")) != -1){
+        switch(c){
+            case 's': opt.serverThreads = bench::parseIntList(optarg); break;
+            case 'b': opt.sizes = bench::parseIntList(optarg); break;
+            case 'c': opt.connections = atoi(optarg); break;
+            case 't': opt.clientThreads = atoi(optarg); break;
+            case 'd': opt.seconds = atoi(optarg); break;
+            case 'f':
+                if(!bench::Report::parseFormat(optarg, &opt.format)){
+                    fprintf(stderr, "unknown format %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'o': opt.output = optarg; break;
+            case 'P': opt.port = static_cast<uint16_t>(atoi(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-s server threads list] [-b message bytes list] [-c connections]"
+                                " [-t client threads] [-d seconds per run] [-f text|json|csv] [-o file] [-P port]\n", argv[0]);
+                return 1;
+        }
+    }
+    if(opt.serverThreads.empty() || opt.sizes.empty() || opt.connections <= 0 || opt.clientThreads <= 0){
+        fprintf(stderr, "bad arguments\n");
+        return 1;
+    }
+    for(int size : opt.sizes){
+        if(size <= 0){
+            fprintf(stderr, "message size must be positive\n");
+            return 1;
+        }
+    }
+
+    // 一轮结束时对端可能已经RST，往它写不能让整个进程退出
+    ::signal(SIGPIPE, SIG_IGN);
+    bench::Report report;
+    EventLoop loop;
+    for(int serverThreads : opt.serverThreads){
+        for(int size : opt.sizes){
+            TcpServer server(&loop, InetAddress(opt.port, "127.0.0.1"), "throughput_bench");
+            server.setConnectionCallback([](const TcpConnectionPtr &conn){
+                if(conn->connected()){
+                    conn->setTcpNoDelay(true);
+                }
+            });
+            server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+                conn->send(buf);
+            });
+            server.setThreadNum(serverThreads);
+            server.start();
+
+            std::thread driver([&](){
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                runClients(opt, serverThreads, size, &report);
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                loop.quit();
+            });
+            loop.loop();
+            driver.join();
+        }
+    }
+    return report.write(opt.format, opt.output) ? 0 : 1;
+}
@@ -0,0 +1,304 @@
+// UDP收包能力：若干客户端socket用sendmmsg向UdpServer猛发，统计服务端每个loop每秒收到的数据报数
+// sink模式服务端只收不回；echo模式服务端原样回发，每个客户端socket最多-w个数据报在途，同时统计回包速率
+// 服务端loop数给一个列表，逐个跑一轮，每轮重新建服务端
+// 客户端是普通线程上的非阻塞socket，发不动时让出CPU，不占用本库的EventLoop
+//
+// 用法：udp_bench [-s 服务端subloop数列表] [-m sink|echo] [-c 客户端socket数] [-t 客户端线程数]
+//                 [-b 数据报字节数] [-B 每批数据报数] [-w echo模式每个socket的在途数] [-G] [-R]
+//                 [-d 每轮秒数] [-f text|json|csv] [-o 结果文件] [-P 端口]
+// -G 服务端回包时打开GSO，-R 服务端打开GRO
+// 例：udp_bench -s 0,1,2,4 -m echo -f csv -o udp.csv
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ads_EventLoop.h"
+#include "ads_UdpServer.h"
+#include "bench_report.h"
+
+namespace
+{
+
+struct Options{
+    std::vector<int> serverThreads{0, 1, 2, 4};
+    bool echo = false;
+    int sockets = 8;
+    int clientThreads = 2;
+    int payload = 64;
+    int batch = 64;
+    int window = 32;
+    bool gso = false;
+    bool gro = false;
+    int seconds = 3;
+    bench::Report::Format format = bench::Report::kText;
+    std::string output;
+    uint16_t port = 8091;
+};
+
+// 一个发送线程负责的若干socket，计数只在该线程里写，结束后由主线程读
+struct Sender{
+    std::vector<int> fds;
+    std::vector<int> inflight;
+    std::vector<std::chrono::steady_clock::time_point> lastReply;
+    int64_t sent = 0;
+    int64_t replies = 0;
+    int64_t lost = 0;
+};
+
+int udpSocket(){
+    int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+    if(fd < 0){
+        return -1;
+    }
+    // 每个socket绑定不同的源端口，服务端按四元组哈希把它们分到各个loop
+    sockaddr_in local;
+    ::memset(&local, 0, sizeof local);
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ::bind(fd, reinterpret_cast<sockaddr *>(&local), sizeof local);
+    int size = 4 * 1024 * 1024;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof size);
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof size);
+    return fd;
+}
+
+void runSender(const Options &opt, Sender *sender, const std::atomic<bool> *running){
+    sockaddr_in server;
+    ::memset(&server, 0, sizeof server);
+    server.sin_family = AF_INET;
+    server.sin_port = htons(opt.port);
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // 所有数据报内容相同，共用一份；收回包只需要计数
+    std::string payload(opt.payload, 'u');
+    std::vector<iovec> iovs(opt.batch);
+    std::vector<mmsghdr> msgs(opt.batch);
+    std::vector<char> recvBuffer(opt.batch * 2048);
+    std::vector<iovec> recvIovs(opt.batch);
+    std::vector<mmsghdr> recvMsgs(opt.batch);
+    for(int i = 0; i < opt.batch; ++i){
+        iovs[i].iov_base = &payload[0];
+        iovs[i].iov_len = payload.size();
+        ::memset(&msgs[i], 0, sizeof msgs[i]);
+        msgs[i].msg_hdr.msg_name = &server;
+        msgs[i].msg_hdr.msg_namelen = sizeof server;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        recvIovs[i].iov_base = &recvBuffer[i * 2048];
+        recvIovs[i].iov_len = 2048;
+        ::memset(&recvMsgs[i], 0, sizeof recvMsgs[i]);
+        recvMsgs[i].msg_hdr.msg_iov = &recvIovs[i];
+        recvMsgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while(running->load(std::memory_order_relaxed)){
+        bool progress = false;
+        auto now = std::chrono::steady_clock::now();
+        for(size_t k = 0; k < sender->fds.size(); ++k){
+            int fd = sender->fds[k];
+            int count = opt.batch;
+            if(opt.echo){
+                // 回包丢了在途数就回不来，100ms没有回包就当作丢失重新开始
+                if(sender->inflight[k] > 0 && now - sender->lastReply[k] > std::chrono::milliseconds(100)){
+                    sender->lost += sender->inflight[k];
+                    sender->inflight[k] = 0;
+                    sender->lastReply[k] = now;
+                }
+                count = std::min(opt.batch, opt.window - sender->inflight[k]);
+            }
+            if(count > 0){
+                int n = ::sendmmsg(fd, msgs.data(), count, MSG_DONTWAIT);
+                if(n > 0){
+                    sender->sent += n;
+                    progress = true;
+                    if(opt.echo){
+                        if(sender->inflight[k] == 0){
+                            sender->lastReply[k] = now;
+                        }
+                        sender->inflight[k] += n;
+                    }
+                }
+            }
+            if(opt.echo){
+                int n = ::recvmmsg(fd, recvMsgs.data(), opt.batch, MSG_DONTWAIT, nullptr);
+                if(n > 0){
+                    sender->replies += n;
+                    sender->inflight[k] = std::max(0, sender->inflight[k] - n);
+                    sender->lastReply[k] = now;
+                    progress = true;
+                }
+            }
+        }
+        if(!progress){
+            std::this_thread::yield();
+        }
+    }
+}
+
+void runOnce(const Options &opt, EventLoop *loop, int serverThreads, bench::Report *report){
+    UdpServer server(loop, InetAddress(opt.port, "127.0.0.1"), "udp_bench");
+    server.setThreadNum(serverThreads);
+    server.setBatch(opt.batch);
+    server.setGso(opt.gso);
+    server.setGro(opt.gro);
+    server.setBufferSize(8 * 1024 * 1024, 8 * 1024 * 1024);
+    if(opt.echo){
+        server.setMessageCallback([](UdpSocket *socket, const char *data, size_t len, const InetAddress &peer, Timestamp){
+            socket->send(peer, data, len);
+        });
+    }
+    server.start();
+
+    std::vector<std::unique_ptr<Sender>> senders;
+    for(int i = 0; i < opt.clientThreads; ++i){
+        senders.emplace_back(new Sender);
+    }
+    int failed = 0;
+    for(int i = 0; i < opt.sockets; ++i){
+        int fd = udpSocket();
+        if(fd < 0){
+            ++failed;
+            continue;
+        }
+        Sender *sender = senders[i % senders.size()].get();
+        sender->fds.push_back(fd);
+        sender->inflight.push_back(0);
+        sender->lastReply.push_back(std::chrono::steady_clock::now());
+    }
+
+    std::atomic<bool> running(true);
+    std::vector<UdpStats> before;
+    server.stats(&before);
+    std::vector<std::thread> threads;
+    auto begin = std::chrono::steady_clock::now();
+    for(auto &sender : senders){
+        Sender *s = sender.get();
+        threads.emplace_back([&opt, s, &running](){ runSender(opt, s, &running); });
+    }
+    // 主线程的loop要一直转：serverThreads为0时数据报就在这里处理
+    std::thread driver([&](){
+        std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+        running = false;
+        for(std::thread &t : threads){
+            t.join();
+        }
+        loop->quit();
+    });
+    loop->loop();
+    driver.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    std::vector<UdpStats> after;
+    UdpStats total = server.stats(&after);
+    double minLoop = 0;
+    double maxLoop = 0;
+    std::string perLoop;
+    for(size_t i = 0; i < after.size(); ++i){
+        double pps = (after[i].received - before[i].received) / elapsed;
+        minLoop = i == 0 ? pps : std::min(minLoop, pps);
+        maxLoop = std::max(maxLoop, pps);
+        char buf[32];
+        snprintf(buf, sizeof buf, "%s%.0f", i == 0 ? "" : "/", pps);
+        perLoop += buf;
+    }
+    int64_t sent = 0;
+    int64_t replies = 0;
+    int64_t lost = 0;
+    for(auto &sender : senders){
+        sent += sender->sent;
+        replies += sender->replies;
+        lost += sender->lost;
+        for(int fd : sender->fds){
+            ::close(fd);
+        }
+    }
+
+    report->beginRow();
+    report->add("bench", "udp");
+    report->add("mode", opt.echo ? "echo" : "sink");
+    report->add("server_loops", static_cast<int>(after.size()));
+    report->add("client_sockets", opt.sockets);
+    report->add("payload", opt.payload);
+    report->add("batch", opt.batch);
+    report->add("seconds", elapsed);
+    report->add("client_sent_pps", sent / elapsed);
+    report->add("server_recv_pps", total.received / elapsed);
+    report->add("per_loop_pps", total.received / elapsed / std::max<size_t>(after.size(), 1));
+    report->add("loop_pps_min", minLoop);
+    report->add("loop_pps_max", maxLoop);
+    report->add("loop_pps", perLoop);
+    report->add("recv_batch_avg", total.recvCalls > 0 ? static_cast<double>(total.received) / total.recvCalls : 0.0);
+    report->add("server_sent_pps", total.sent / elapsed);
+    report->add("send_batch_avg", total.sendCalls > 0 ? static_cast<double>(total.sent) / total.sendCalls : 0.0);
+    report->add("client_reply_pps", replies / elapsed);
+    report->add("lost", lost);
+    report->add("dropped", static_cast<int64_t>(total.dropped));
+    report->add("truncated", static_cast<int64_t>(total.truncated));
+    report->add("failed", failed);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+    Options opt;
+    int c;
+    while((c = ::getopt(argc, argv, "s:m:c:t:b:B:w:GRd:f:o:P:")) != -1){
+        switch(c){
+            case 's': opt.serverThreads = bench::parseIntList(optarg); break;
+            case 'm':
+                if(strcmp(optarg, "echo") != 0 && strcmp(optarg, "sink") != 0){
+                    fprintf(stderr, "unknown mode %s\n", optarg);
+                    return 1;
+                }
+                opt.echo = strcmp(optarg, "echo") == 0;
+                break;
+            case 'c': opt.sockets = atoi(optarg); break;
+            case 't': opt.clientThreads = atoi(optarg); break;
+            case 'b': opt.payload = atoi(optarg); break;
+            case 'B': opt.batch = atoi(optarg); break;
+            case 'w': opt.window = atoi(optarg); break;
+            case 'G': opt.gso = true; break;
+            case 'R': opt.gro = true; break;
+            case 'd': opt.seconds = atoi(optarg); break;
+            case 'f':
+                if(!bench::Report::parseFormat(optarg, &opt.format)){
+                    fprintf(stderr, "unknown format %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'o': opt.output = optarg; break;
+            case 'P': opt.port = static_cast<uint16_t>(atoi(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-s server threads list] [-m sink|echo] [-c client sockets] [-t client threads]"
+                                " [-b payload bytes] [-B batch] [-w echo window] [-G] [-R] [-d seconds per run]"
+                                " [-f text|json|csv] [-o file] [-P port]\n", argv[0]);
+                return 1;
+        }
+    }
+    if(opt.serverThreads.empty() || opt.sockets <= 0 || opt.clientThreads <= 0 || opt.payload < 0
+       || opt.payload > 2048 || opt.batch <= 0 || opt.window <= 0){
+        fprintf(stderr, "bad arguments\n");
+        return 1;
+    }
+
+    bench::Report report;
+    EventLoop loop;
+    for(int serverThreads : opt.serverThreads){
+        runOnce(opt, &loop, serverThreads, &report);
+    }
+    return report.write(opt.format, opt.output) ? 0 : 1;
+}
@@ -0,0 +1,285 @@
+// 上游连接池压测：进程内起一个echo服务当上游，对比两种访问上游的方式
+//   -m pool    每个loop用UpstreamPool复用少量持久连接，请求管道化
+//   -m connect 每个请求新建一条连接，收到应答后关闭（不用连接池的做法）
+// 请求格式：4字节大端长度 + 负载，echo原样返回，用同一个FrameCodec切分
+//
+// 用法：upstream_pool_bench [-m pool|connect] [-t 客户端loop数] [-s 上游线程数] [-c 每loop并发请求数]
+//                           [-n 每loop连接数] [-p 管道深度] [-b 负载字节数] [-d 秒数]
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ads_EventLoop.h"
+#include "ads_EventLoopThread.h"
+#include "ads_TcpServer.h"
+#include "ads_TcpClient.h"
+#include "ads_UpstreamPool.h"
+#include "ads_Buffer.h"
+#include "bench_fixture.h"
+
+namespace
+{
+
+struct Options{
+    std::string mode = "pool";
+    int clientThreads = 2;
+    int serverThreads = 2;
+    int concurrency = 64;
+    int connectionsPerLoop = 4;
+    int pipeline = 64;
+    int payload = 64;
+    int seconds = 3;
+    uint16_t port = 8083;
+};
+
+size_t lengthPrefixedFrame(const Buffer *buf){
+    if(buf->readableBytes() < sizeof(uint32_t)){
+        return 0;
+    }
+    uint32_t be;
+    ::memcpy(&be, buf->peek(), sizeof be);
+    size_t length = sizeof(uint32_t) + ntohl(be);
+    return buf->readableBytes() >= length ? length : 0;
+}
+
+std::string makeRequest(int payload){
+    uint32_t be = htonl(static_cast<uint32_t>(payload));
+    std::string request(reinterpret_cast<const char *>(&be), sizeof be);
+    request.append(payload, 'x');
+    return request;
+}
+
+// 每个客户端loop一份，只在该loop线程里修改
+struct LoopStats{
+    int64_t completed = 0;
+    int64_t failed = 0;
+    std::vector<int64_t> latencies;     // 微秒
+};
+
+// 闭环请求方：一个请求完成后立刻发下一个，直到running为false
+class Driver{
+public:
+    Driver(EventLoop *loop, const Options &opt, const InetAddress &upstream,
+           UpstreamPool *pool, LoopStats *stats, const std::atomic_bool *running)
+        : loop_(loop)
+        , opt_(opt)
+        , upstream_(upstream)
+        , pool_(pool)
+        , stats_(stats)
+        , running_(running)
+        , request_(makeRequest(opt.payload))
+        , seq_(0)
+    {
+    }
+
+    void start(){
+        for(int i = 0; i < opt_.concurrency; ++i){
+            issue();
+        }
+    }
+
+private:
+    void issue(){
+        if(!*running_){
+            return;
+        }
+        Timestamp begin = Timestamp::now();
+        if(pool_ != nullptr){
+            pool_->call(request_, [this, begin](bool ok, const StringPiece &){ done(ok, begin); });
+        }
+        else{
+            issueShortConnection(begin);
+        }
+    }
+
+    void done(bool ok, Timestamp begin){
+        if(ok){
+            ++stats_->completed;
+            stats_->latencies.push_back(Timestamp::now().microSecondsSinceEpoch() - begin.microSecondsSinceEpoch());
+        }
+        else{
+            ++stats_->failed;
+        }
+        issue();
+    }
+
+    // 短连接：连上、发请求、收完应答就关闭，TcpClient在下一轮事件循环里释放
+    void issueShortConnection(Timestamp begin){
+        char name[64];
+        snprintf(name, sizeof name, "short-%lld", (long long)++seq_);
+        std::shared_ptr<TcpClient> client(new TcpClient(loop_, upstream_, name));
+        std::weak_ptr<TcpClient> weakClient(client);
+        std::string request = request_;
+        client->setConnectionCallback([request](const TcpConnectionPtr &conn){
+            if(conn->connected()){
+                conn->setTcpNoDelay(true);
+                conn->send(request);
+            }
+        });
+        client->setMessageCallback([this, begin, weakClient](const TcpConnectionPtr &, Buffer *buf, Timestamp){
+            if(lengthPrefixedFrame(buf) == 0){
+                return;
+            }
+            buf->retrieveAll();
+            std::shared_ptr<TcpClient> self = weakClient.lock();
+            if(self){
+                clients_.erase(self.get());
+                loop_->queueInLoop([self](){});
+            }
+            done(true, begin);
+        });
+        clients_[client.get()] = client;
+        client->connect();
+    }
+
+    EventLoop *loop_;
+    const Options &opt_;
+    InetAddress upstream_;
+    UpstreamPool *pool_;
+    LoopStats *stats_;
+    const std::atomic_bool *running_;
+    std::string request_;
+    int64_t seq_;
+    std::map<TcpClient *, std::shared_ptr<TcpClient>> clients_;     // 还没收到应答的短连接
+};
+
+void runClient(const Options &opt){
+    InetAddress upstream(opt.port, "127.0.0.1");
+    std::vector<std::unique_ptr<EventLoopThread>> threads;
+    std::vector<EventLoop *> loops;
+    for(int i = 0; i < opt.clientThreads; ++i){
+        threads.emplace_back(new EventLoopThread(EventLoopThread::ThreadInitCallback(), "frontend"));
+        loops.push_back(threads.back()->startLoop());
+    }
+
+    std::unique_ptr<UpstreamPool> pool;
+    if(opt.mode == "pool"){
+        std::promise<void> ready;
+        pool.reset(new UpstreamPool(loops, upstream, "bench", opt.connectionsPerLoop));
+        pool->setFrameCodec(lengthPrefixedFrame);
+        pool->setMaxPipeline(opt.pipeline);
+        pool->setReadyCallback([&ready](){ ready.set_value(); });
+        pool->start();
+        ready.get_future().wait();
+    }
+
+    std::atomic_bool running(true);
+    std::vector<LoopStats> stats(loops.size());
+    std::vector<std::unique_ptr<Driver>> drivers;
+    for(size_t i = 0; i < loops.size(); ++i){
+        drivers.emplace_back(new Driver(loops[i], opt, upstream, pool.get(), &stats[i], &running));
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < loops.size(); ++i){
+        Driver *driver = drivers[i].get();
+        loops[i]->runInLoop([driver](){ driver->start(); });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+    running = false;
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    // 先在各loop里拿到统计结果，再停连接池；短连接模式等残留请求结束
+    int64_t completed = 0;
+    int64_t failed = 0;
+    std::vector<int64_t> latencies;
+    for(size_t i = 0; i < loops.size(); ++i){
+        bench::runAndWait(loops[i], [&, i](){
+            completed += stats[i].completed;
+            failed += stats[i].failed;
+            latencies.insert(latencies.end(), stats[i].latencies.begin(), stats[i].latencies.end());
+        });
+    }
+    if(pool){
+        pool->stop();
+    }
+    else{
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    for(size_t i = 0; i < loops.size(); ++i){
+        bench::runAndWait(loops[i], [&drivers, i](){ drivers[i].reset(); });
+    }
+    pool.reset();
+    threads.clear();
+
+    std::sort(latencies.begin(), latencies.end());
+    double avg = 0;
+    for(int64_t us : latencies){
+        avg += us;
+    }
+    avg = latencies.empty() ? 0 : avg / latencies.size();
+    int64_t p99 = latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100];
+
+    printf("upstream_pool_bench: mode=%s client_loops=%d upstream_threads=%d concurrency=%d"
+           " conns_per_loop=%d pipeline=%d payload=%d\n",
+           opt.mode.c_str(), opt.clientThreads, opt.serverThreads, opt.concurrency,
+           opt.mode == "pool" ? opt.connectionsPerLoop : -1, opt.pipeline, opt.payload);
+    printf("  %lld requests in %.2fs, %lld failed\n", (long long)completed, elapsed, (long long)failed);
+    printf("  Requests/sec: %.0f\n", completed / elapsed);
+    printf("  Latency avg: %.1fus p99: %lldus\n", avg, (long long)p99);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+    Options opt;
+    int c;
+    while((c = ::getopt(argc, argv, "m:t:s:c:n:p:b:d:P:")) != -1){
+        switch(c){
+            case 'm': opt.mode = optarg; break;
+            case 't': opt.clientThreads = atoi(optarg); break;
+            case 's': opt.serverThreads = atoi(optarg); break;
+            case 'c': opt.concurrency = atoi(optarg); break;
+            case 'n': opt.connectionsPerLoop = atoi(optarg); break;
+            case 'p': opt.pipeline = atoi(optarg); break;
+            case 'b': opt.payload = atoi(optarg); break;
+            case 'd': opt.seconds = atoi(optarg); break;
+            case 'P': opt.port = static_cast<uint16_t>(atoi(optarg)); break;
+            default:
+                fprintf(stderr, "usage: %s [-m pool|connect] [-t client loops] [-s upstream threads]"
+                                " [-c concurrency per loop] [-n conns per loop] [-p pipeline]"
+                                " [-b payload bytes] [-d seconds] [-P port]\n", argv[0]);
+                return 1;
+        }
+    }
+    if(opt.mode != "pool" && opt.mode != "connect"){
+        fprintf(stderr, "unknown mode %s\n", opt.mode.c_str());
+        return 1;
+    }
+
+    // 上游echo服务跑在主线程的baseloop上
+    EventLoop loop;
+    TcpServer upstream(&loop, InetAddress(opt.port, "127.0.0.1"), "echo-upstream");
+    upstream.setConnectionCallback([](const TcpConnectionPtr &conn){
+        if(conn->connected()){
+            conn->setTcpNoDelay(true);
+        }
+    });
+    upstream.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp){
+        conn->send(buf);
+    });
+    upstream.setThreadNum(opt.serverThreads);
+    upstream.start();
+
+    std::thread client([&](){
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        runClient(opt);
+        loop.quit();
+    });
+    loop.loop();
+    client.join();
+    return 0;
+}
@@ -1,6 +1,10 @@
 #pragma once
 
 #include <functional>
+#include <atomic>
+#include <string>
+#include <stdint.h>
+#include <sys/types.h>
 #include <ads_noncopyable.h>
 
 #include "ads_Socket.h"
@@ -9,6 +13,26 @@
 class EventLoop;
 class InetAddress;
 
+// Acceptor计数的快照，可以跨多个Acceptor累加
+struct AcceptStats{
+    // 每次可读事件里accept到的连接数按2的幂分桶：1, 2-3, 4-7, 8-15, 16-31, 32+
+    static const int kBatchBuckets = 6;
+
+    uint64_t accepted = 0;      // 交给上层的连接数
+    uint64_t rejected = 0;      // 文件描述符耗尽时接受后立即关闭的连接数
+    uint64_t batches = 0;       // 至少accept到一个连接的可读事件数
+    uint64_t batchSizes[kBatchBuckets] = {0};
+
+    void merge(const AcceptStats &other){
+        accepted += other.accepted;
+        rejected += other.rejected;
+        batches += other.batches;
+        for(int i = 0; i < kBatchBuckets; ++i){
+            batchSizes[i] += other.batchSizes[i];
+        }
+    }
+};
+
 class Acceptor : noncopyable{
 public:
     // 定义了一个回调函数的类型，表示在有新连接时，回调函数的签名是: sockfd表示新连接的socket描述符，InetAddress表示新连接的地址信息
@@ -22,18 +46,40 @@ public:
 
     // 设置新连接到来时的回调函数, 将回调函数存储在newConnectionCallback_中
     void setNewConnectionCallback(const NewConnectionCallback &cb){NewConnectionCallback_ = cb;}
+    // 每次可读事件最多accept多少个连接，默认16；设为1就是原来一次一个的行为
+    void setAcceptBatch(int batch) {acceptBatch_ = batch > 0 ? batch : 1;}
+    // 计数用relaxed原子维护，任何线程都可以取快照
+    AcceptStats stats() const;
     // 是否在监听
     bool listenning() const {return listenning_;}
+    EventLoop *getLoop() const {return loop_;}
+    // 监听socket实际绑定的地址（getsockname），端口为0时从这里拿到内核分配的端口
+    InetAddress localAddress() const;
     // 调用底层socket接口，开始监听
     void listen();
 
 private:
 
     void handleRead();  //当有新连接时，EventLoop会调用这个方法处理新连接
+    // 文件描述符耗尽时，用预留的idleFd_腾出一个位置接受并立即关闭一个连接，队列已空返回false
+    bool rejectOne();
 
     EventLoop *loop_;   //事件循环对象指针，将Acceptor纳入到EventLoop中管理
     Socket acceptSocket_;   //封装了一个sockt用于接收新连接
     Channel acceptChannel_; //将acceptSocket_封装成一个Channel，用于监听新连接事件
     NewConnectionCallback NewConnectionCallback_; //储存新连接到来时的回调函数
     bool listenning_;  //判断是否正在监听
+    int acceptBatch_;
+    // 预留的空闲描述符（打开/dev/null），EMFILE时释放出来接受连接
+    // 否则监听socket一直可读（水平触发），loop会空转到100% CPU
+    int idleFd_;
+    // 监听的Unix域socket文件，析构时删除；不是文件路径地址时为空
+    std::string unixPath_;
+    // bind出来的socket文件的inode，析构时只删自己建的那个，路径已经被别人换掉就不动
+    ino_t unixInode_;
+
+    std::atomic<uint64_t> accepted_;
+    std::atomic<uint64_t> rejected_;
+    std::atomic<uint64_t> batches_;
+    std::atomic<uint64_t> batchSizes_[AcceptStats::kBatchBuckets];
 };
\ No newline at end of file
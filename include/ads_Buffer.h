@@ -1,32 +1,88 @@
 #pragma once
 
-#include <vector>
 #include <string>
 #include <algorithm>
 #include <stddef.h>
+#include <string.h>
 
+#include "ads_MemoryPool.h"
+
+// 存储从MemoryPool按大小分级分配，容量就是所在级别块的大小，扩容时换到更大的级别
+// 默认构造不分配存储，第一次写入数据时才按需要的大小分配；没有存储时buffer_指向一块共享的空区域，
+// 各个下标照常是kCheapPrepend，读写路径不用额外判断
 class Buffer{
 public:
     static const size_t kCheapPrepend = 8;
     static const size_t kInitialSize = 1024;
 
-    explicit Buffer(size_t initialSize = kInitialSize)
-        : buffer_(kCheapPrepend + initialSize)
+    Buffer()
+        : buffer_(kEmptyStorage)
+        , capacity_(kCheapPrepend)
+        , readerIndex_(kCheapPrepend)
+        , writerIndex_(kCheapPrepend)
+    {
+    }
+    // 预先分配initialSize字节的可写空间
+    explicit Buffer(size_t initialSize)
+        : buffer_(nullptr)
+        , capacity_(0)
         , readerIndex_(kCheapPrepend)
         , writerIndex_(kCheapPrepend)
     {
+        buffer_ = static_cast<char *>(MemoryPool::allocate(kCheapPrepend + initialSize, &capacity_));
+    }
+    Buffer(const Buffer &rhs)
+        : buffer_(kEmptyStorage)
+        , capacity_(kCheapPrepend)
+        , readerIndex_(rhs.readerIndex_)
+        , writerIndex_(rhs.writerIndex_)
+    {
+        if(rhs.allocated()){
+            buffer_ = static_cast<char *>(MemoryPool::allocate(rhs.capacity_, &capacity_));
+            ::memcpy(buffer_, rhs.buffer_, rhs.writerIndex_);
+        }
+    }
+    Buffer &operator=(const Buffer &rhs){
+        Buffer copy(rhs);
+        swap(copy);
+        return *this;
+    }
+    ~Buffer(){
+        freeStorage();
+    }
+
+    void swap(Buffer &rhs){
+        std::swap(buffer_, rhs.buffer_);
+        std::swap(capacity_, rhs.capacity_);
+        std::swap(readerIndex_, rhs.readerIndex_);
+        std::swap(writerIndex_, rhs.writerIndex_);
     }
 
     // 获取可读/可写区域大小
     size_t readableBytes() const {return writerIndex_ - readerIndex_;}
-    size_t writeableBytes() const { return buffer_.size() - writerIndex_;}
+    size_t writeableBytes() const { return capacity_ - writerIndex_;}
     size_t prependableBytes() const {return readerIndex_;}
+    // 占用的存储大小，还没有分配或者已经释放时为0
+    size_t capacity() const {return allocated() ? capacity_ : 0;}
+    bool allocated() const {return buffer_ != kEmptyStorage;}
+
+    // 可读数据为空时把存储还给MemoryPool，下次写入时重新分配；
+    // 否则在能省下至少一半空间时换成刚好放得下可读数据和reserve字节的块
+    void shrink(size_t reserve = 0);
 
     // 返回放弃可读数据首地址
     // 第一个const表示返回的指针所指向的内容不可修改，char *指针指向char类型数据
     // 第二个const修饰peek()为常量成员函数，表示不会修改类的成员变量
     const char *peek() const {return begin() + readerIndex_;}
 
+    // 在可读区域中查找"\r\n"，找不到返回nullptr
+    // start用于增量解析：已经扫描过的部分不必再扫一遍
+    const char *findCRLF() const {return findCRLF(peek());}
+    const char *findCRLF(const char *start) const{
+        const void *crlf = ::memmem(start, beginWrite() - start, kCRLF, 2);
+        return static_cast<const char *>(crlf);
+    }
+
     // 消费len长度的数据
     void retrieve(size_t len){
         if(len < readableBytes()){
@@ -36,6 +92,10 @@ public:
             retrieveAll();
         }
     }
+    // 消费到end为止的数据，end必须位于可读区域内
+    void retrieveUntil(const char *end){
+        retrieve(end - peek());
+    }
     //清空缓冲区
     void retrieveAll(){
         readerIndex_ = kCheapPrepend;
@@ -66,27 +126,47 @@ public:
         std::copy(data, data+len, beginWrite());
         writerIndex_ += len;
     }
+    void append(const std::string &str){
+        append(str.data(), str.size());
+    }
     char *beginWrite() {return begin() + writerIndex_;}
     const char *beginWrite() const {return begin() + writerIndex_;}
 
-    // 从fd上读数据
-    ssize_t readFd(int fd, int *saveErrno);
-    // 从fd上发数据
-    ssize_t writeFd(int fd, int *saveErrno);
+    // 从fd上读数据，一次最多读maxBytes字节，0表示读到缓冲区可写空间加64KB为止
+    ssize_t readFd(int fd, int *saveErrno, size_t maxBytes = 0);
+    // 从fd上发数据，一次最多写maxBytes字节，0表示全部可读数据
+    ssize_t writeFd(int fd, int *saveErrno, size_t maxBytes = 0);
 
 private:
-    // buffer_.begin() 返回 std::vector<char>::iterator（迭代器）。
-    // *buffer_.begin() 解引用迭代器，获得第一个元素的引用（char&）。
-    // &*buffer_.begin() 取得这个元素的地址，得到 指向 char 的指针。
+    static const char kCRLF[];
+    // 所有没有存储的Buffer共用，只用到它的地址，从不写入
+    static char kEmptyStorage[kCheapPrepend];
+
+    void freeStorage(){
+        if(allocated()){
+            MemoryPool::deallocate(buffer_);
+        }
+    }
+
     // 普通版，允许修改数据
-    char *begin() {return &*buffer_.begin();}
+    char *begin() {return buffer_;}
     // 常量版，用于 cosnt Buffer，只允许读取，防止修改数据
-    const char *begin() const {return &*buffer_.begin();}
+    const char *begin() const {return buffer_;}
 
     void makeSpace(size_t len){
         // 要是可写区域＋可读索引之前的区域  小于  需要的空间 + 预留空间，就扩容
         if(writeableBytes() + prependableBytes() < len + kCheapPrepend){
-            buffer_.resize(writerIndex_ + len);
+            // 和vector一样至少翻倍，避免连续append时反复搬数据；只搬可读部分
+            size_t readable = readableBytes();
+            size_t capacity = 0;
+            char *buffer = static_cast<char *>(
+                MemoryPool::allocate(std::max(kCheapPrepend + readable + len, capacity_ * 2), &capacity));
+            ::memcpy(buffer + kCheapPrepend, peek(), readable);
+            freeStorage();
+            buffer_ = buffer;
+            capacity_ = capacity;
+            readerIndex_ = kCheapPrepend;
+            writerIndex_ = readerIndex_ + readable;
         }
         else{
             size_t readable = readableBytes();
@@ -99,7 +179,8 @@ private:
         }
     }
 
-    std::vector<char> buffer_;
+    char *buffer_;
+    size_t capacity_;
     size_t readerIndex_;
     size_t writerIndex_;
 
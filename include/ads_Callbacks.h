@@ -11,6 +11,7 @@ using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
 using ConnectionCallback = std::function<void(const TcpConnectionPtr &)>;
 using CloseCallback = std::function<void(const TcpConnectionPtr &)>;
 using WriteCompleteCallback = std::function<void(const TcpConnectionPtr &)>;
+using TimerCallback = std::function<void()>;
 using HighWaterMarkCallback = std::function<void(const TcpConnectionPtr &, size_t)>;
 
 using MessageCallback = std::function<void(const TcpConnectionPtr &,
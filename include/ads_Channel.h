@@ -2,34 +2,67 @@
 
 #include <functional>
 #include <memory>
+#include <string>
 
 #include "ads_noncopyable.h"
 #include "ads_Timestamp.h"
+#include "ads_MemoryPool.h"
 
 // 前置声明 EventLoop 类，告诉编译器这个类在后面会被使用，但不需要知道其具体定义。
 // 这种做法可以减少不必要的头文件依赖，降低编译时间，增强封装性。
 class EventLoop;
 
+// Channel事件的接收者。每条连接一个Channel，回调都指向所属的TcpConnection，
+// 用虚函数分发时所有连接共用一张虚函数表，Channel里只存一个指针，不必每个Channel各存四五个std::function
+class ChannelHandler{
+public:
+    virtual void handleRead(Timestamp receiveTime) = 0;
+    virtual void handleWrite() = 0;
+    virtual void handleClose() = 0;
+    virtual void handleError() = 0;
+    // 只在记录慢回调等诊断信息时调用，返回空串时Channel用"fd=N"
+    virtual std::string channelName() const = 0;
+
+protected:
+    // 不通过ChannelHandler指针删除对象
+    ~ChannelHandler() {}
+};
+
 class Channel : noncopyable
 {
 public:
     using EventCallback = std::function<void()>;    //C++11代替typedef
     using ReadEventCallback = std::function<void(Timestamp)>;
+    // 只在记录慢回调等诊断信息时调用，返回所属对象的名字（如连接名）
+    using NameCallback = std::function<std::string()>;
 
     Channel(EventLoop *loop, int fd);
     ~Channel();
 
+    // 连接、Acceptor、TimerQueue、UdpSocket都把Channel作为成员；还要new的是Connector（客户端每次发起连接、
+    // 重连都new一个）和EventLoop的wakeupChannel_，仍从MemoryPool分配
+    static void *operator new(size_t size) {return MemoryPool::allocate(size);}
+    static void operator delete(void *p) {MemoryPool::deallocate(p);}
+
     // 防止channel被手动REMOVE掉 channe还在执行回调操作（250310没理解）
     // 绑定TcpConnetction，确保Channel在TcpConnection销毁前已销毁，避免执行回调函数导致野指针
     void tie(const std::shared_ptr<void> &);
     
     void remove();
 
-    // 设置回调函数
-    void setReadCallback(ReadEventCallback cb) {readCallback_ = std::move(cb);}
-    void setWriteCallback(EventCallback cb) {writeCallback_ = std::move(cb);}
-    void setCloseCallback(EventCallback cb) {closeCallback_ =  std::move(cb);}
-    void setErrorCallback(EventCallback cb) {errorCallback_ = std::move(cb);}
+    // 事件交给handler处理，handler要活得比Channel久；和下面的set*Callback二选一
+    void setHandler(ChannelHandler *handler) {handler_ = handler;}
+    // 设置回调函数：第一次设置时才分配存放这些std::function的对象，Acceptor、TimerQueue这类少数Channel用
+    void setReadCallback(ReadEventCallback cb);
+    void setWriteCallback(EventCallback cb);
+    void setCloseCallback(EventCallback cb);
+    void setErrorCallback(EventCallback cb);
+    void setNameCallback(NameCallback cb);
+
+    // 没有设置NameCallback时返回"fd=N"
+    std::string name() const;
+    // 本次发生的事件，如"IN HUP"
+    std::string reventsToString() const;
 
     // fd得到Poller通知后处理事件，handleEvent在EventLoop::loop()中被调用
     void handleEvent(Timestamp receiveTime);
@@ -57,8 +90,12 @@ public:
     EventLoop *ownerLoop() {return loop_;}
 private:
 
+    // 用std::function实现的ChannelHandler，定义在ads_Channel.cc
+    class CallbackHandler;
+
     void update();  // 调用了epoll_ctl()
     void handleEventWithGuard(Timestamp receiveTiome);
+    CallbackHandler *callbacks();
 
     static const int kNoneEvent;
     static const int kReadEvent;
@@ -71,13 +108,11 @@ private:
     int index_;         // 250310不懂
 
     std::weak_ptr<void> tie_;   // 弱引用（不增加引用次数，防止循环引用）TcpConnection，防止悬垂指针
-    bool tied_;
 
-    // Channel是个fd管家，封装了具体事件的回调函数
-    ReadEventCallback readCallback_;
-    EventCallback writeCallback_;
-    EventCallback closeCallback_;
-    EventCallback errorCallback_;
+    // Channel是个fd管家，事件分发给handler_；用set*Callback时handler_指向callbacks_
+    ChannelHandler *handler_;
+    std::unique_ptr<CallbackHandler> callbacks_;
+    bool tied_;
 
 };
 
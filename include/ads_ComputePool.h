@@ -0,0 +1,114 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <type_traits>
+
+#include "ads_noncopyable.h"
+#include "ads_EventLoop.h"
+
+class Thread;
+
+/** 计算线程池，和EventLoopThreadPool分开，专门跑解析、压缩、加解密这类耗CPU的任务，不阻塞IO线程
+ * 1. 每个工作线程一个双端队列：自己从尾部取（刚放进去的任务数据还在缓存里），空了就从别的线程头部偷；
+ * 2. IO线程提交的任务轮流放进各工作线程的队列，工作线程里再提交的任务放进自己的队列；
+ * 3. submit()在计算线程执行work，再用queueInLoop把结果交给done在指定loop里执行，
+ *    done里可以像在MessageCallback里一样直接操作连接；
+ * 4. 需要按连接保序时用Strand：同一个Strand上的任务串行、按提交顺序执行，结果也按顺序回到loop。
+ **/
+class ComputePool : noncopyable{
+public:
+    using Task = std::function<void()>;
+
+    // 串行执行器，一般每条连接一个，放在TcpConnection的context里
+    // 由makeStrand()创建，不能比ComputePool活得久
+    class Strand : noncopyable, public std::enable_shared_from_this<Strand>{
+    public:
+        // 任何线程都可以调用
+        void run(Task task);
+
+    private:
+        friend class ComputePool;
+        explicit Strand(ComputePool *pool)
+            : pool_(pool)
+            , running_(false)
+        {
+        }
+        void drain();
+
+        ComputePool *pool_;
+        std::mutex mutex_;
+        std::deque<Task> tasks_;
+        bool running_;      // 是否已有一个drain()在工作线程里排队或执行
+    };
+    using StrandPtr = std::shared_ptr<Strand>;
+
+    explicit ComputePool(const std::string &name = std::string("ComputePool"));
+    ~ComputePool();
+
+    // 需在start()之前设置
+    void setThreadNum(int numThreads) {numThreads_ = numThreads;}
+    // 第i个工作线程绑定到cpus[i % cpus.size()]，为空则不绑定
+    void setCpuList(const std::vector<int> &cpus) {cpus_ = cpus;}
+
+    void start();
+    // 执行完已经提交的任务后退出所有工作线程
+    void stop();
+
+    // 在某个工作线程里执行task，任何线程都可以调用；没有工作线程时直接在调用线程执行
+    void run(Task task);
+    StrandPtr makeStrand();
+
+    // work在计算线程执行，返回值交给done，done通过queueInLoop回到loop线程执行；work不能返回void
+    template <typename Work, typename Done>
+    void submit(EventLoop *loop, Work work, Done done){
+        run(makeJob(loop, std::move(work), std::move(done)));
+    }
+    // 同上，同一个strand上的work按提交顺序串行执行，done也按这个顺序在loop里执行
+    template <typename Work, typename Done>
+    void submit(const StrandPtr &strand, EventLoop *loop, Work work, Done done){
+        strand->run(makeJob(loop, std::move(work), std::move(done)));
+    }
+
+    size_t numThreads() const {return workers_.size();}
+    // 累计执行的任务数和偷取次数，任何线程都可以读
+    uint64_t executed() const;
+    uint64_t steals() const;
+
+private:
+    struct Worker;
+
+    template <typename Work, typename Done>
+    static Task makeJob(EventLoop *loop, Work work, Done done){
+        using Result = typename std::result_of<Work()>::type;
+        static_assert(!std::is_void<Result>::value, "ComputePool::submit() needs a work that returns a value");
+        return [loop, work, done](){
+            std::shared_ptr<Result> result = std::make_shared<Result>(work());
+            loop->queueInLoop([done, result](){ done(*result); });
+        };
+    }
+
+    void threadFunc(size_t index);
+    bool takeTask(size_t index, Task *task);
+    void push(size_t index, Task task);
+
+    std::string name_;
+    int numThreads_;
+    std::vector<int> cpus_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic_size_t next_;           // 外部线程提交时轮询选择队列
+
+    // 空闲的工作线程在这里睡眠，pending_和sleepers_配合避免丢失唤醒
+    std::mutex sleepMutex_;
+    std::condition_variable sleepCond_;
+    std::atomic_long pending_;          // 已放入队列还没被取走的任务数
+    std::atomic_int sleepers_;
+    std::atomic_bool stopping_;
+    bool started_;
+};
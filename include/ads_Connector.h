@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <random>
+
+#include "ads_noncopyable.h"
+#include "ads_InetAddress.h"
+#include "ads_TimerId.h"
+
+class Channel;
+class EventLoop;
+
+/** 主动发起连接，是TcpClient的底层，对应服务端的Acceptor
+ * 1. 非阻塞connect()，返回EINPROGRESS后把socket包装成Channel监听EPOLLOUT；
+ * 2. 可写时用SO_ERROR判断连接是否真正建立，成功就把sockfd交给newConnectionCallback_；
+ * 3. 失败则关闭socket，按指数退避（带随机抖动）用定时器稍后重试，
+ *    抖动让大量客户端不会在上游恢复的同一瞬间一起重连。
+ * 只在loop线程里使用；定时重试的回调持有shared_ptr，所以Connector必须由shared_ptr管理。
+ **/
+class Connector : noncopyable, public std::enable_shared_from_this<Connector>{
+public:
+    using NewConnectionCallback = std::function<void(int sockfd)>;
+
+    Connector(EventLoop *loop, const InetAddress &serverAddr);
+    ~Connector();
+
+    void setNewConnectionCallback(const NewConnectionCallback &cb) {newConnectionCallback_ = cb;}
+    // 退避时间：首次重试等initialMs毫秒，之后每次翻倍，最多maxMs毫秒
+    void setRetryDelay(int initialMs, int maxMs) {initRetryDelayMs_ = initialMs; retryDelayMs_ = initialMs; maxRetryDelayMs_ = maxMs;}
+
+    const InetAddress &serverAddress() const {return serverAddr_;}
+
+    void start();       // 可以在任意线程调用
+    void restart();     // 只能在loop线程调用，退避时间恢复为初始值
+    void stop();        // 可以在任意线程调用
+
+private:
+    enum States{
+        kDisconnected,
+        kConnecting,
+        kConnected,
+    };
+    static const int kInitRetryDelayMs = 500;
+    static const int kMaxRetryDelayMs = 30 * 1000;
+
+    void setState(States s) {state_ = s;}
+    void startInLoop();
+    void stopInLoop();
+    void connect();
+    void connecting(int sockfd);
+    void handleWrite();
+    void handleError();
+    void retry(int sockfd);
+    int removeAndResetChannel();
+    void resetChannel();
+
+    EventLoop *loop_;
+    InetAddress serverAddr_;
+    std::atomic_bool connect_;  // 用户是否希望保持连接（stop()后为false，不再重试），start()/stop()在任意线程写
+    States state_;
+    std::unique_ptr<Channel> channel_;  // 只在connect进行中存在
+    NewConnectionCallback newConnectionCallback_;
+    int initRetryDelayMs_;
+    int retryDelayMs_;
+    int maxRetryDelayMs_;
+    TimerId retryTimer_;
+    std::minstd_rand random_;   // 用于退避抖动
+};
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <vector>
-#include <unordered_map>
 #include <string>
+#include <memory>
+#include <atomic>
+#include <stdint.h>
 // 支持用户自定义哈希函数
 #include <functional>
 // 用于std::sort 和 std::upper_bound操作哈希值
@@ -11,67 +13,83 @@
 // 异常处理
 #include <stdexcept>
 
+#include "ads_noncopyable.h"
+
 // 实现一致性哈希算法，用于分布式系统中将键映射到服务器节点，最小化因节点增减而导致的键重新分配
-class ConsistenHash{
+// 查找不加锁：哈希环是只读的快照，增删节点时在锁内复制出一个新环，再用原子指针整体发布（RCU方式）
+// 旧环可能还有线程在读，不立即释放，保留到对象析构；节点增删很少发生，这部分内存可以忽略
+class ConsistenHash : noncopyable{
 public:
+    using HashFunction = std::function<size_t(const std::string &)>;
+
     // numReplicas: 每个物理节点的虚拟节点数量，提高负载均衡效果
     // hashFunc: 哈希函数，默认为std::hash<std::sting>
-    ConsistenHash(size_t numReplicas, std::function<size_t(const std::string &)> hashFunc = std::hash<std::string>)
+    ConsistenHash(size_t numReplicas, const HashFunction &hashFunc = std::hash<std::string>())
         : numReplicas_(numReplicas)
         , hashFunction_(hashFunc)
+        , ring_(nullptr)
     {
+        publish(std::unique_ptr<Ring>(new Ring));
     }
 
     // 向哈希环中添加一个节点，节点会赋值若干个虚拟节点，通过“node + index”计算出唯一的哈希值
-    // 哈希值会储存在哈希环上，并进行排序以便高效查找
-    void addNode(const std::string &node){
-        // 确保addNode是线程安全的
+    // index是调用者给节点的编号（如loops_的下标），getNode()直接返回它
+    void addNode(const std::string &node, size_t index){
+        // 写者之间互斥，读者不受影响
         std::lock_guard<std::mutex> lock(mutex_);
+        std::unique_ptr<Ring> ring(new Ring(*ring_.load(std::memory_order_relaxed)));
+        ring->nodes.push_back(std::make_pair(node, index));
         for(size_t i = 0; i < numReplicas_; ++i){
             // 生成多个哈希值，均匀分布节点。
             // 举例：拼接字符串成"server1_03"
             size_t hash = hashFunction_(node + "_0" + std::to_string(i));
-            // 记录哈希值节点的映射
-            circle_[hash] = node;
-            sortedHashes_.push_back(hash);
+            ring->points.push_back(std::make_pair(hash, index));
         }
-        //
-        std::sort(sortedHashes_.begin(), sortedHashes_.end());
+        std::sort(ring->points.begin(), ring->points.end());
+        publish(std::move(ring));
     }
 
-    // 伤处该节点的所有虚拟节点与对应的哈希值
+    // 删除该节点的所有虚拟节点
     void removeNode(const std::string &node){
         std::lock_guard<std::mutex> lock(mutex_);
-        for(size_t i = 0; i < numReplicas_; ++i){
-            // 
-            size_t hash = hashFunction_(node + "_0" + std::to_string(i));
-            // 从哈希环中删除该哈希
-            circle_.erase(hash);
-            auto it = std::finde(sortedHashes_.begin(), sortedHashes_.end(), hash);
-            if(it != sortedHashes_.end()){
-                // 从排序列表中删除
-                sortedHashes_.erase(it);
-            }
+        const Ring *old = ring_.load(std::memory_order_relaxed);
+        auto it = std::find_if(old->nodes.begin(), old->nodes.end(),
+                               [&node](const std::pair<std::string, size_t> &item){ return item.first == node; });
+        if(it == old->nodes.end()){
+            return;
         }
+        size_t index = it->second;
+        std::unique_ptr<Ring> ring(new Ring(*old));
+        ring->nodes.erase(ring->nodes.begin() + (it - old->nodes.begin()));
+        // 过滤后仍然有序，不用重新排序
+        ring->points.erase(std::remove_if(ring->points.begin(), ring->points.end(),
+                                          [index](const std::pair<size_t, size_t> &point){ return point.second == index; }),
+                           ring->points.end());
+        publish(std::move(ring));
     }
 
-    // 根据给定键找到最近节点
-    size_t getNode(const std::string &key){
-        std::lock_guard<std::mutex> lock(mutex_);
+    // 根据给定键找到最近节点，返回addNode()时给的编号，任何线程都可以无锁调用
+    size_t getNode(const std::string &key) const{
+        const Ring *ring = ring_.load(std::memory_order_acquire);
         // 环为空(无可用节点)时抛出异常
-        if(circle_.empty()){
+        if(ring->points.empty()){
             throw std::runtime_error("No nodes in consistent hash");
         }
-        
+
         size_t hash = hashFunction_(key);
         // 在已排序的哈希列表中找到第一个大于键哈希值的位置
-        auto it = std::upper_bound(sortedHashes_.begin(), sortedHashes_.end(), hash);
-        if(it == sortedHashes_.end()){
+        auto it = std::upper_bound(ring->points.begin(), ring->points.end(), hash,
+                                   [](size_t h, const std::pair<size_t, size_t> &point){ return h < point.first; });
+        if(it == ring->points.end()){
             // 如果超出环最大值，则回绕到第一个节点
-            it = sortedHashes_.begin();
+            it = ring->points.begin();
         }
-        return *it;
+        return it->second;
     }
+
+    bool empty() const {return ring_.load(std::memory_order_acquire)->nodes.empty();}
+    // 物理节点数
+    size_t size() const {return ring_.load(std::memory_order_acquire)->nodes.size();}
 /* key, node, hash三者关系：
 1.  假设有以下 3 个节点：server1 -> hash(100)；server2 -> hash(300)；server3 -> hash(500)
     哈希环示意图：
@@ -89,13 +107,40 @@ public:
 
 
 private:
+    // 一个版本的哈希环，发布后不再修改
+    struct Ring{
+        // (虚拟节点哈希值, 节点编号)，按哈希值排序，用于高效查找
+        std::vector<std::pair<size_t, size_t>> points;
+        // (节点名, 节点编号)
+        std::vector<std::pair<std::string, size_t>> nodes;
+    };
+
+    // 调用者持有mutex_（构造时除外）
+    void publish(std::unique_ptr<Ring> ring){
+        ring_.store(ring.get(), std::memory_order_release);
+        rings_.push_back(std::move(ring));
+    }
+
     size_t numReplicas_;    //控制虚拟节点数
     // 哈希函数，可默认也可自定义
-    std:: function<size_t(const std::string &)> hashFunction_;
-    // 储存哈希值到节点的映射
-    std::unordered_map<size_t, std::string> circle_;
-    // 排序后的哈希值，用于高效查找
-    std::vector<size_t> sortedHashes_;
-    // 保护circle_ 和 sortedHashes_，防止多线竞争
-    std::mutex mutex_;               
-};
\ No newline at end of file
+    HashFunction hashFunction_;
+    // 当前版本，读者只做一次acquire load
+    std::atomic<const Ring *> ring_;
+    // 所有发布过的版本，析构时统一释放
+    std::vector<std::unique_ptr<Ring>> rings_;
+    // 只串行化写者
+    std::mutex mutex_;
+};
+
+// Jump Consistent Hash（Lamping & Veach）：不需要环，也不占内存，O(ln n)
+// 桶数从n变成n+1时只有约1/(n+1)的key移动，但只能在末尾增删桶，适合loop数固定的线程池
+inline int32_t jumpConsistentHash(uint64_t key, int32_t numBuckets){
+    int64_t b = -1;
+    int64_t j = 0;
+    while(j < numBuckets){
+        b = j;
+        key = key * 2862933555777941757ULL + 1;
+        j = static_cast<int64_t>((b + 1) * (static_cast<double>(1LL << 31) / static_cast<double>((key >> 33) + 1)));
+    }
+    return static_cast<int32_t>(b);
+}
@@ -0,0 +1,400 @@
+#pragma once
+
+// 可选的C++20协程接口，只有头文件：库本身仍按C++11编译，用到协程的程序自己用-std=c++20编译
+#if __cplusplus < 202002L || !defined(__cpp_impl_coroutine)
+#error "ads_Coroutine.h requires C++20 coroutines (-std=c++20)"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <string.h>
+
+#include "ads_noncopyable.h"
+#include "ads_Callbacks.h"
+#include "ads_TcpConnection.h"
+#include "ads_EventLoop.h"
+#include "ads_Buffer.h"
+#include "ads_StringPiece.h"
+#include "ads_MemoryPool.h"
+#include "ads_Logger.h"
+
+/** 用协程顺序地写多步协议（读请求 -> 调上游 -> 回应答），不用在回调之间手动保存状态
+ *   CoTask<T>       惰性启动的协程，可以co_await另一个CoTask，结束时对称转移回等待者；
+ *   coSpawn(task)   在当前线程立即启动一个CoTask<void>，结束后自动释放；
+ *   CoConnection    把TcpConnection的回调变成可等待对象：readSome/readExactly/readUntil/write/sleepFor。
+ * 所有可等待对象都在连接所属loop的回调里恢复，协程始终跑在连接自己的loop线程上，所以不加锁。
+ * 协程帧从MemoryPool分配（每个协程一次）；连接上的回调在attach()时一次挂好，读写等待只在CoConnection里
+ * 记下句柄，不再为每次等待创建回调。写完成通知和普通回调版本一样，由TcpConnection排进loop。
+ **/
+
+template <typename T = void>
+class CoTask;
+
+class CoPromiseBase{
+public:
+    // 结束时如果有等待者就转移过去，被coSpawn分离的协程自己销毁帧
+    struct FinalAwaiter{
+        bool await_ready() noexcept {return false;}
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept{
+            CoPromiseBase &promise = h.promise();
+            if(promise.continuation_){
+                return promise.continuation_;
+            }
+            if(promise.detached_){
+                h.destroy();
+            }
+            return std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept {return {};}
+    FinalAwaiter final_suspend() noexcept {return {};}
+    void unhandled_exception(){
+        if(detached_){
+            // 没有人能接住这个异常
+            LOG_FATAL("coSpawn - coroutine exited with an exception\n");
+            std::terminate();
+        }
+        exception_ = std::current_exception();
+    }
+
+    static void *operator new(size_t size) {return MemoryPool::allocate(size);}
+    static void operator delete(void *p) {MemoryPool::deallocate(p);}
+
+    void setContinuation(std::coroutine_handle<> h) {continuation_ = h;}
+    void detach() {detached_ = true;}
+    void rethrowIfFailed(){
+        if(exception_){
+            std::rethrow_exception(exception_);
+        }
+    }
+
+private:
+    std::coroutine_handle<> continuation_;
+    std::exception_ptr exception_;
+    bool detached_ = false;
+};
+
+template <typename T>
+class CoTaskPromise : public CoPromiseBase{
+public:
+    CoTask<T> get_return_object();
+    void return_value(T value) {value_.emplace(std::move(value));}
+    T takeValue(){
+        rethrowIfFailed();
+        return std::move(*value_);
+    }
+
+private:
+    std::optional<T> value_;
+};
+
+template <>
+class CoTaskPromise<void> : public CoPromiseBase{
+public:
+    CoTask<void> get_return_object();
+    void return_void() {}
+    void takeValue() {rethrowIfFailed();}
+};
+
+template <typename T>
+class CoTask : noncopyable{
+public:
+    using promise_type = CoTaskPromise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit CoTask(Handle h) : handle_(h) {}
+    CoTask(CoTask &&rhs) noexcept : handle_(std::exchange(rhs.handle_, nullptr)) {}
+    ~CoTask(){
+        if(handle_){
+            handle_.destroy();
+        }
+    }
+
+    // co_await一个CoTask：启动它，结束后回到当前协程
+    bool await_ready() const noexcept {return !handle_ || handle_.done();}
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept{
+        handle_.promise().setContinuation(caller);
+        return handle_;
+    }
+    T await_resume() {return handle_.promise().takeValue();}
+
+    // 交出协程帧，由调用者负责启动和释放
+    Handle release() {return std::exchange(handle_, nullptr);}
+
+private:
+    Handle handle_;
+};
+
+template <typename T>
+inline CoTask<T> CoTaskPromise<T>::get_return_object(){
+    return CoTask<T>(CoTask<T>::Handle::from_promise(*this));
+}
+
+inline CoTask<void> CoTaskPromise<void>::get_return_object(){
+    return CoTask<void>(CoTask<void>::Handle::from_promise(*this));
+}
+
+// 在当前线程启动task，运行到第一个挂起点返回；task结束后协程帧自动释放
+inline void coSpawn(CoTask<void> task){
+    CoTask<void>::Handle h = task.release();
+    h.promise().detach();
+    h.resume();
+}
+
+// co_await sleepFor(loop, 秒数)：在loop线程里调用，到时后在loop线程恢复
+// 定时器节点由TimerQueue分配，这是唯一会分配内存的等待
+class SleepAwaiter{
+public:
+    SleepAwaiter(EventLoop *loop, double seconds)
+        : loop_(loop)
+        , seconds_(seconds)
+    {
+    }
+    bool await_ready() const noexcept {return seconds_ <= 0;}
+    void await_suspend(std::coroutine_handle<> h){
+        loop_->runAfter(seconds_, [h](){ h.resume(); });
+    }
+    void await_resume() const noexcept {}
+
+private:
+    EventLoop *loop_;
+    double seconds_;
+};
+
+inline SleepAwaiter sleepFor(EventLoop *loop, double seconds){
+    return SleepAwaiter(loop, seconds);
+}
+
+class CoConnection;
+using CoConnectionPtr = std::shared_ptr<CoConnection>;
+
+/** 一条连接上的协程读写，只在连接所属loop线程里使用，同一时刻只能有一个读或写在等待
+ * 读到的StringPiece直接指向连接的输入Buffer，一直有效到下一次读：交出去之后连接stopRead()，
+ * 中间co_await写、sleepFor或者别的协程时新数据留在内核里，Buffer不会移动；下一次读时才从Buffer中取走并startRead()。
+ * 连接断开后读返回空的StringPiece，write返回false。
+ * serve()把它挂到TcpConnection的context上，断开时摘掉，所以context不能再另作他用；
+ * 连接的stopRead()/startRead()也由它管理，session里不要再调用。
+ **/
+class CoConnection : noncopyable, public std::enable_shared_from_this<CoConnection>{
+public:
+    using Session = std::function<CoTask<void>(CoConnectionPtr)>;
+
+    // 用作TcpServer/TcpClient的ConnectionCallback：连上时创建CoConnection并启动session，断开时唤醒等待中的协程
+    static ConnectionCallback serve(Session session){
+        return [session](const TcpConnectionPtr &conn){
+            if(conn->connected()){
+                CoConnectionPtr cc = std::allocate_shared<CoConnection>(PoolAllocator<CoConnection>(), conn);
+                cc->attach();
+                coSpawn(session(cc));
+            }
+            else{
+                CoConnectionPtr cc = std::static_pointer_cast<CoConnection>(conn->getContext());
+                if(cc){
+                    cc->onClosed();
+                }
+            }
+        };
+    }
+
+    // 由serve()创建
+    explicit CoConnection(const TcpConnectionPtr &conn)
+        : conn_(conn)
+        , waiter_()
+        , mode_(kNone)
+        , closed_(false)
+        , readMode_(ReadAwaiter::kSome)
+        , consumed_(0)
+        , want_(0)
+        , scanned_(0)
+    {
+    }
+
+    const TcpConnectionPtr &connection() const {return conn_;}
+    EventLoop *getLoop() const {return conn_->getLoop();}
+    bool connected() const {return !closed_ && conn_->connected();}
+
+    class ReadAwaiter{
+    public:
+        bool await_ready() {return cc_->startRead(mode_, want_, delim_);}
+        void await_suspend(std::coroutine_handle<> h) {cc_->waiter_ = h;}
+        StringPiece await_resume() {return cc_->result_;}
+
+    private:
+        friend class CoConnection;
+        enum Mode{kSome, kExactly, kUntil};
+        ReadAwaiter(CoConnection *cc, Mode mode, size_t want, StringPiece delim)
+            : cc_(cc)
+            , mode_(mode)
+            , want_(want)
+            , delim_(delim)
+        {
+        }
+        CoConnection *cc_;
+        Mode mode_;
+        size_t want_;
+        StringPiece delim_;
+    };
+
+    class WriteAwaiter{
+    public:
+        // 数据已经全部写进内核就不挂起，否则等WriteCompleteCallback
+        bool await_ready() {return !cc_->connected() || !cc_->conn_->hasPendingWrite();}
+        void await_suspend(std::coroutine_handle<> h) {cc_->waitWrite(h);}
+        bool await_resume() {return cc_->connected();}
+
+    private:
+        friend class CoConnection;
+        explicit WriteAwaiter(CoConnection *cc) : cc_(cc) {}
+        CoConnection *cc_;
+    };
+
+    // 有数据就返回当前所有可读数据
+    ReadAwaiter readSome() {return ReadAwaiter(this, ReadAwaiter::kSome, 0, StringPiece());}
+    // 恰好n个字节，n必须大于0
+    ReadAwaiter readExactly(size_t n) {return ReadAwaiter(this, ReadAwaiter::kExactly, n, StringPiece());}
+    // 读到delim为止（包含delim），delim要在等待期间保持有效，一般用字面量
+    ReadAwaiter readUntil(StringPiece delim) {return ReadAwaiter(this, ReadAwaiter::kUntil, 0, delim);}
+    // 发送数据并等它写进内核，连接断开返回false
+    WriteAwaiter write(StringPiece data){
+        if(connected()){
+            conn_->send(data.data(), data.size());
+        }
+        return WriteAwaiter(this);
+    }
+    SleepAwaiter sleepFor(double seconds) {return SleepAwaiter(getLoop(), seconds);}
+
+    void shutdown() {conn_->shutdown();}
+    void forceClose() {conn_->forceClose();}
+
+private:
+    enum WaitMode{kNone, kRead, kWrite};
+
+    void attach(){
+        std::weak_ptr<CoConnection> weak(shared_from_this());
+        conn_->setContext(shared_from_this());
+        conn_->setMessageCallback([weak](const TcpConnectionPtr &, Buffer *, Timestamp){
+            CoConnectionPtr cc = weak.lock();
+            if(cc){
+                cc->onMessage();
+            }
+        });
+        // 和消息回调一样只在这里挂一次，没有写在等待时onWriteComplete()直接忽略
+        conn_->setWriteCompleteCallback([weak](const TcpConnectionPtr &){
+            CoConnectionPtr cc = weak.lock();
+            if(cc){
+                cc->onWriteComplete();
+            }
+        });
+    }
+
+    void waitWrite(std::coroutine_handle<> h){
+        mode_ = kWrite;
+        waiter_ = h;
+    }
+
+    // 先取走上一次读返回的数据并恢复读，再看这次能不能立即完成
+    bool startRead(ReadAwaiter::Mode mode, size_t want, StringPiece delim){
+        if(consumed_ > 0){
+            conn_->inputBuffer()->retrieve(consumed_);
+            consumed_ = 0;
+            conn_->startRead();
+        }
+        readMode_ = mode;
+        want_ = want;
+        delim_ = delim;
+        scanned_ = 0;
+        // 断开前已经收到的数据照样可以读完
+        if(tryRead()){
+            return true;
+        }
+        if(closed_){
+            result_ = StringPiece();
+            return true;
+        }
+        mode_ = kRead;
+        return false;
+    }
+
+    // 可读数据满足本次读就设置result_，并停止读直到下一次读，保证result_不失效
+    bool tryRead(){
+        Buffer *buf = conn_->inputBuffer();
+        size_t readable = buf->readableBytes();
+        size_t length = 0;
+        if(readMode_ == ReadAwaiter::kSome){
+            length = readable;
+        }
+        else if(readMode_ == ReadAwaiter::kExactly){
+            length = readable >= want_ ? want_ : 0;
+        }
+        else if(readable >= delim_.size() && !delim_.empty()){
+            // 增量查找：上次扫过且不可能构成delim开头的部分不再扫
+            const void *hit = ::memmem(buf->peek() + scanned_, readable - scanned_, delim_.data(), delim_.size());
+            if(hit != nullptr){
+                length = static_cast<const char *>(hit) - buf->peek() + delim_.size();
+            }
+            else{
+                scanned_ = readable - delim_.size() + 1;
+            }
+        }
+        if(length == 0){
+            return false;
+        }
+        result_ = StringPiece(buf->peek(), length);
+        consumed_ = length;
+        conn_->stopRead();
+        return true;
+    }
+
+    void resume(){
+        std::coroutine_handle<> h = waiter_;
+        waiter_ = nullptr;
+        mode_ = kNone;
+        h.resume();
+    }
+
+    void onMessage(){
+        if(mode_ == kRead && tryRead()){
+            resume();
+        }
+    }
+
+    void onWriteComplete(){
+        // 之前立即完成的写也会排一个回调过来，只有输出真的发完才唤醒
+        if(mode_ == kWrite && !conn_->hasPendingWrite()){
+            resume();
+        }
+    }
+
+    void onClosed(){
+        CoConnectionPtr self = shared_from_this();
+        closed_ = true;
+        // 断开引用环：context -> CoConnection -> TcpConnection
+        conn_->setContext(std::shared_ptr<void>());
+        if(mode_ == kRead && !tryRead()){
+            result_ = StringPiece();
+        }
+        if(mode_ != kNone){
+            resume();
+        }
+    }
+
+    TcpConnectionPtr conn_;
+    std::coroutine_handle<> waiter_;
+    WaitMode mode_;
+    bool closed_;
+
+    // 当前读请求
+    ReadAwaiter::Mode readMode_;
+    size_t consumed_;       // 上次读返回的字节数，下次读时从Buffer取走
+    size_t want_;
+    StringPiece delim_;
+    size_t scanned_;
+    StringPiece result_;
+};
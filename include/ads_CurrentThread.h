@@ -26,4 +26,9 @@ namespace CurrentThread{
         }
         return t_cachedTid;
     }
+
+    // 把当前线程绑定到一个CPU上，失败返回false（如cpu超出范围或不在cgroup允许的集合里）
+    bool bindToCpu(int cpu);
+    // 当前线程此刻所在的CPU，取不到返回-1
+    int cpu();
 }
@@ -5,19 +5,82 @@
 #include <atomic>
 #include <memory>
 #include <mutex>
+#include <string>
 
 #include "ads_noncopyable.h"
 #include "ads_Timestamp.h"
 #include "ads_CurrentThread.h"
+#include "ads_Callbacks.h"
+#include "ads_TimerId.h"
+#include "ads_Histogram.h"
 
 class Channel;
 class Poller;
+class TimerQueue;
+
+// 每个loop对外发布的负载计数，供EventLoopThreadPool挑选subloop时参考
+// 写者和读者都用relaxed原子操作：只用于负载均衡，读到稍旧的值没有关系
+// 独占一条cache line，避免和EventLoop其他成员伪共享
+struct alignas(64) LoopLoad{
+    std::atomic_int connections{0};     // 当前属于该loop的TcpConnection数，创建/析构时增减
+    std::atomic_int busyPermille{0};    // 最近一个统计窗口内loop不在poll中等待的时间占比（千分比）
+    std::atomic_int queueDepth{0};      // 等待执行的任务数，包括上一轮预算用完留下的
+    std::atomic_int cpu{-1};            // loop线程最近一次所在的CPU，每个统计窗口刷新一次
+};
+
+// loop运行统计，全部是从loop()开始的累计值，两次快照相减得到一段时间内的速率
+// loop线程只对自己的副本做普通自增，每个统计窗口（100ms）和loop退出时拷贝发布一次
+// 忙的loop发布的数据最多旧一个窗口，空闲的loop要等下次从poll醒来才更新
+struct LoopMetrics{
+    uint64_t loops = 0;             // 合并了几个loop的数据，单个loop的快照为1
+    uint64_t iterations = 0;        // 循环轮数
+    uint64_t pollWaitMicros = 0;    // 阻塞在poll里的时间
+    uint64_t busyMicros = 0;        // 从poll返回到本轮结束的时间
+    uint64_t events = 0;            // poll返回的活跃Channel总数
+    uint64_t maxEvents = 0;         // 单轮最多的活跃Channel数
+    uint64_t functors = 0;          // 执行过的pendingFunctors总数
+    uint64_t functorDrains = 0;     // 有任务可执行的doPendingFunctors次数
+    uint64_t functorMicros = 0;     // 执行pendingFunctors花的时间
+    uint64_t maxFunctorBatch = 0;   // 单次doPendingFunctors最多执行的任务数
+    uint64_t functorBudgetHits = 0; // 因为预算用完而把任务留到下一轮的次数
+    uint64_t functorsCarried = 0;   // 留到下一轮的任务数（同一个任务被留几轮就计几次）
+    uint64_t queueAgeMicros = 0;    // 任务从入队到开始执行的等待时间之和
+    uint64_t maxQueueAgeMicros = 0; // 单个任务最长的等待时间
+    uint64_t readyReads = 0;        // 从就绪列表执行的推迟读（见queueReadyRead）
+    uint64_t wakeups = 0;           // 通过eventfd被唤醒的次数（wakeup()调用次数，内核会把连续的几次合并）
+
+    // 计数相加，最大值取最大
+    void merge(const LoopMetrics &other);
+    std::string toString() const;
+};
+
+// loop里回调耗时的分布（纳秒），和LoopMetrics一起发布
+struct LoopHistograms{
+    Histogram handlers;     // 每次Channel::handleEvent
+    Histogram functors;     // 每个pendingFunctor
+    Histogram queueAge;     // 每个pendingFunctor从入队到开始执行的等待时间
+
+    void merge(const LoopHistograms &other){
+        handlers.merge(other.handlers);
+        functors.merge(other.functors);
+        queueAge.merge(other.queueAge);
+    }
+};
 
 class EventLoop : noncopyable
 {
 public:
     using Functor = std::function<void()>;
 
+    // 任务优先级：每轮先执行kHighPriority的任务，再执行kNormalPriority的，同一优先级内按入队顺序。
+    // 连接的建立和销毁用kHighPriority，不会排在大量跨线程send后面；
+    // 和同一连接上别的任务有先后要求的（如send之后的shutdown）要用同一个优先级
+    enum Priority{
+        kHighPriority,
+        kNormalPriority,
+        kNumPriorities,
+    };
+
     EventLoop();
     ~EventLoop();
 
@@ -30,9 +93,32 @@ public:
     void wakeup();
 
     // 在当前loop中执行
-    void runInLoop(Functor cb);
+    void runInLoop(Functor cb, Priority priority = kNormalPriority);
     //把上层注册的回调函数cb放入队列中 唤醒loop所在线程执行cb
-    void queueInLoop(Functor cb);
+    void queueInLoop(Functor cb, Priority priority = kNormalPriority);
+    // 每轮执行排队任务的预算：最多maxTasks个、最多maxMicros微秒，0表示不限（默认都不限）。
+    // 预算用完时剩下的任务留到下一轮，下一轮的poll不等待，先处理已经就绪的IO事件再接着执行；
+    // 每轮至少执行一个任务。任何线程都可以调用
+    void setFunctorBudget(size_t maxTasks, int64_t maxMicros);
+    // 在本轮的Channel回调和pendingFunctors都执行完、下一次poll之前执行cb，只能在loop线程调用
+    // 用于把一轮里对同一个连接的多次小写合并成一次系统调用；执行期间再登记的cb在同一轮里接着执行
+    void runBeforePoll(Functor cb);
+    // 就绪列表：读预算用完、socket里可能还有数据的连接登记一个回调，下一轮poll返回后、处理新就绪的Channel之前
+    // 按登记顺序执行，执行时再登记的排到下一轮，这样几条忙连接轮流各读一次；列表非空时poll不等待。只能在loop线程调用
+    void queueReadyRead(Functor cb);
+    // 按时间分配读预算时在读之前调用：本轮已经有过读、且从poll返回到现在超过budgetNanos时返回false，
+    // 调用者应该把这次读推迟到就绪列表；每轮至少放行一次读。0表示不限。只能在loop线程调用
+    bool admitRead(int64_t budgetNanos);
+
+    // 定时器，可以跨线程调用，回调总是在loop所在线程执行
+    // 在time时刻执行cb
+    TimerId runAt(Timestamp time, TimerCallback cb);
+    // delay秒之后执行cb
+    TimerId runAfter(double delay, TimerCallback cb);
+    // 每隔interval秒执行一次cb
+    TimerId runEvery(double interval, TimerCallback cb);
+    // 取消定时器，已经执行过的一次性定时器取消是无害的
+    void cancel(TimerId timerId);
 
     // EventLoop的方法 => Poller的方法
     void updateChannel(Channel *channel);
@@ -43,11 +129,31 @@ public:
 
     // 判断EventLoop对象是否在自己的线程里
     bool isInLoopThread() const {return threadId_ == CurrentThread::tid();}
+
+    // 负载计数，任何线程都可以读
+    LoopLoad &load() {return load_;}
+    const LoopLoad &load() const {return load_;}
+    // loop线程最近所在的CPU，绑核后就是绑定的那个；还没开始loop()时为-1
+    int cpu() const {return load_.cpu.load(std::memory_order_relaxed);}
+    // 最近一次发布的运行统计，任何线程都可以调用
+    LoopMetrics metrics() const;
+    LoopHistograms histograms() const;
+
+    // 单个Channel回调或pendingFunctor超过这个时间就打一条LOG_ERROR，对所有loop生效，0表示不检查
+    // 默认50ms，任何线程都可以调用
+    static void setSlowHandlerThreshold(int64_t micros);
 private:
     // 给eventfd返回的文件描述符wakeupFd_绑定的事件回调 当wakeup()时 即有事件发生时 调用handleRead()读wakeupFd_的8字节 同时唤醒阻塞的epoll_wait
     void handleRead(); 
     // 执行上层回调
     void doPendingFunctors();
+    void doBeforePollFunctors();
+    void doReadyReads();
+    // 一轮循环结束时累计忙碌时间，窗口到期就发布busyPermille
+    void updateBusyTime(Timestamp busyBegin);
+    void publishMetrics();
+    // 记录一次Channel回调的耗时，超过阈值时报告连接名和事件
+    void recordHandler(Channel *channel, int64_t nanos);
 
     using ChannelList = std::vector<Channel *>;
 
@@ -58,6 +164,7 @@ private:
 
     Timestamp pollReturnTime_;  // Poller返回发生事件的Channels的时间点
     std::unique_ptr<Poller> poller_;  // poller_封装了epoll的操作
+    std::unique_ptr<TimerQueue> timerQueue_;  // 定时器队列，timerfd注册在poller_上，所以声明在poller_之后
     
     // 用于线程间通信的文件描述符，通过eventfd创建
     // 作用：当mainLoop获取一个新用户的Channel 需通过轮询算法选择一个subLoop 通过该成员唤醒subLoop处理Channel
@@ -66,9 +173,37 @@ private:
 
     ChannelList activeChannels_; // 返回Poller检测到当前由事件发生的所有Channel列表
 
+    // 排队的任务和它的入队时间，用于统计等待时间
+    struct Task{
+        Functor functor;
+        int64_t enqueueNanos;
+    };
+
     std::atomic_bool callingPendingFunctors_; // 标识当前是否在执行任务回调
-    std::vector<Functor> pendingFunctors_;    // 存储loop需要执行的所有回调操作(pendingFunctors_中保存的是其他线程希望你这个EventLoop线程执行的函数)
+    // 存储loop需要执行的所有回调操作(pendingFunctors_中保存的是其他线程希望你这个EventLoop线程执行的函数)，每个优先级一个队列
+    std::vector<Task> pendingFunctors_[kNumPriorities];
+    size_t carriedFunctors_;                   // 上一轮留下、还没执行的任务数，和pendingFunctors_一起由mutex_保护
     std::mutex mutex_;                         // 互斥算，用于保护上面vector容器的线程安全操作
+    // 从pendingFunctors_取出、正在执行或留到下一轮的任务，readyHead_之前的已经执行过，只在loop线程访问
+    std::vector<Task> readyFunctors_[kNumPriorities];
+    size_t readyHead_[kNumPriorities];
+    std::atomic<size_t> functorBudgetTasks_;
+    std::atomic<int64_t> functorBudgetNanos_;
+    std::vector<Functor> beforePollFunctors_; // runBeforePoll()登记的回调，只在loop线程访问
+    std::vector<Functor> readyReads_;         // queueReadyRead()登记的回调，只在loop线程访问
+    int64_t iterationBeginNanos_;             // 本轮poll返回的时间，admitRead()用
+    int readsThisIteration_;                  // 本轮admitRead()放行的读次数
+
+    LoopLoad load_;
+    Timestamp busyWindowStart_;     // 当前统计窗口的起点，只在loop线程访问
+    int64_t busyWindowMicros_;      // 当前窗口内累计的忙碌微秒数
+
+    LoopMetrics metrics_;           // 只在loop线程读写
+    Timestamp iterationEnd_;        // 上一轮结束的时间，到下一次poll返回之间算作等待
+    mutable std::mutex metricsMutex_;
+    LoopMetrics publishedMetrics_;  // 发布给其他线程的副本，由metricsMutex_保护
+    LoopHistograms histograms_;             // 同metrics_，只在loop线程读写
+    LoopHistograms publishedHistograms_;    // 由metricsMutex_保护
 
 };
 
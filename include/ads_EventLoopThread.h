@@ -22,6 +22,10 @@ public:
                     const std::string &name = std::string());
     ~EventLoopThread();
 
+    // 在startLoop()之前设置：线程先绑到这个CPU上再创建EventLoop，
+    // 按Linux默认的first-touch策略，EventLoop、Poller和该线程MemoryPool缓存的内存都落在本地NUMA节点
+    void setCpu(int cpu) {cpu_ = cpu;}
+
     EventLoop *startLoop();
 
 
@@ -38,4 +42,5 @@ private:
     std::condition_variable cond_;
     // 线程初始化回调，在EventLoop启动后执行额外的初始化逻辑
     ThreadInitCallback callback_;
+    int cpu_;                   // 绑定的CPU，-1表示不绑定
 };
\ No newline at end of file
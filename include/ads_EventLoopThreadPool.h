@@ -4,18 +4,34 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <random>
 
 #include "ads_noncopyable.h"
-// 250320 发现问题
-// #include "ads_ConsistenHash.h"
+#include "ads_ConsistenHash.h"
+#include "ads_EventLoop.h"
 
-class EventLoop;
 class EventLoopThread;
 
 class EventLoopThreadPool : noncopyable{
 public:
     using ThreadInitCallback = std::function<void(EventLoop *)>;
 
+    // getNextLoop()挑选subloop的策略，负载数据来自各loop发布的LoopLoad
+    enum SelectPolicy{
+        kRoundRobin,            // 轮询
+        kLeastConnections,      // 连接数最少
+        kPowerOfTwoChoices,     // 随机挑两个，取连接数少的，避免所有新连接同时涌向同一个最空闲的loop
+        kLeastBusy,             // 最近忙碌时间占比加上任务队列长度最小
+    };
+    // 自定义策略：从loops中返回一个，返回nullptr时退回轮询
+    using LoopSelector = std::function<EventLoop *(const std::vector<EventLoop *> &loops)>;
+
+    // getNextLoop(key)使用的哈希方式
+    enum HashPolicy{
+        kRingHash,      // 一致性哈希环，带虚拟节点
+        kJumpHash,      // Jump Consistent Hash，无额外内存
+    };
+
     // baseLoop → 主线程中的 EventLoop（若线程数 numThreads_ == 1，直接使用 baseLoop_）。
     // 线程池需要绑定一个baseLoop，主线程的baseloop用于监听连接，多线程时baseLoop接收连接并分发给子线程的EventLoop处理
     // nameArg → 线程池的名称（给 EventLoopThread 命名）。
@@ -23,18 +39,33 @@ public:
     ~EventLoopThreadPool();
 
     void setThreadNum(int numThreads) {numThreads_ = numThreads;}
+    // 需在start()之前设置
+    void setHashPolicy(HashPolicy policy) {hashPolicy_ = policy;}
+    void setSelectPolicy(SelectPolicy policy) {selectPolicy_ = policy;}
+    // 设置后优先于SelectPolicy
+    void setLoopSelector(const LoopSelector &selector) {selector_ = selector;}
+    // 第i个subloop线程绑定到cpus[i % cpus.size()]，为空则不绑定；需在start()之前设置
+    void setCpuList(const std::vector<int> &cpus) {cpus_ = cpus;}
+    // 解析"0-3,8,10-11"这样的CPU列表，格式错误返回空
+    static std::vector<int> parseCpuList(const std::string &list);
 
     // 启动线程池，创建多个 EventLoopThread。
     void start(const ThreadInitCallback &cb = ThreadInitCallback());
 
-    // 获取下一个EventLoop进行负载均衡，若是多线程，会轮询/一致性哈希分配任务
-    // 250320 发现错误
-    // EventLoop *getNextLoop(const std::string &key);
+    // 获取下一个EventLoop进行负载均衡，若是多线程，按SelectPolicy分配任务；只在baseLoop线程调用
     EventLoop *getNextLoop();
+    // 同一个key（如会话id、对端IP）总是落到同一个loop，利于缓存局部性；start()之后任何线程都可以无锁调用
+    EventLoop *getNextLoop(const std::string &key);
 
     // 获取所有EventLoop指针
     std::vector<EventLoop *> getAllLoops();
 
+    // 合并getAllLoops()中各loop最近发布的运行统计，perLoop不为空时按同样顺序给出每个loop的快照
+    // start()之后任何线程都可以调用
+    LoopMetrics metrics(std::vector<LoopMetrics> *perLoop = nullptr);
+    // 同上，合并各loop的回调耗时直方图
+    LoopHistograms histograms(std::vector<LoopHistograms> *perLoop = nullptr);
+
     bool started() const {return started_;}
     const std::string name() const {return name_;}
 
@@ -47,9 +78,14 @@ private:
 
     // getNextLoop()轮询时的索引
     int next_;
-    // 用于基于key选择EventLoop
-    // 250320 发现问题
-    // ConsistenHash hash_;
+    SelectPolicy selectPolicy_;
+    LoopSelector selector_;
+    // kPowerOfTwoChoices用的随机数，和next_一样只在baseLoop线程使用
+    std::minstd_rand random_;
+    // 用于基于key选择EventLoop，节点编号就是loops_的下标
+    ConsistenHash hash_;
+    HashPolicy hashPolicy_;
+    std::vector<int> cpus_;
 
     // 线程池名称，通常由用户指定，池中EventLoopThread的名称依赖于线程池的名称
     std::string name_;
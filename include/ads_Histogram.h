@@ -0,0 +1,74 @@
+#pragma once
+
+#include <time.h>
+#include <stdint.h>
+#include <string>
+#include <functional>
+
+// 单调时钟纳秒数，走vDSO不进内核，用来给回调计时
+inline int64_t monotonicNanos(){
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
+/** 对数分桶的延迟直方图（HDR Histogram的简化版），记录纳秒
+ * 1. 每个2的幂区间再均分成16个桶，相对误差不超过1/16，0~31纳秒精确记录；
+ * 2. 超过kMaxValue（约137秒）的值记在最后一个桶里；
+ * 3. 桶数固定，record()只是算下标加一，不加锁不分配，由使用者保证单线程写；
+ * 4. 桶的划分对所有实例相同，merge()直接按桶相加，多个loop的数据可以合并后再算分位数。
+ **/
+class Histogram{
+public:
+    static const int kSubBucketBits = 4;
+    static const int kSubBuckets = 1 << kSubBucketBits;
+    static const int kMaxShift = 32;
+    static const int64_t kMaxValue = (static_cast<int64_t>(kSubBuckets) << (kMaxShift + 1)) - 1;
+    static const int kNumBuckets = (kMaxShift + 2) * kSubBuckets;
+
+    Histogram();
+
+    void record(int64_t value){
+        if(value < 0){
+            value = 0;
+        }
+        ++counts_[bucketIndex(value)];
+        ++count_;
+        sum_ += value;
+        if(value < min_){
+            min_ = value;
+        }
+        if(value > max_){
+            max_ = value;
+        }
+    }
+    void merge(const Histogram &other);
+    void reset();
+
+    uint64_t count() const {return count_;}
+    int64_t min() const {return count_ == 0 ? 0 : min_;}
+    int64_t max() const {return max_;}
+    double mean() const {return count_ == 0 ? 0.0 : static_cast<double>(sum_) / count_;}
+    // 第p百分位（0~100）所在桶的上界，不会超过max()
+    int64_t percentile(double p) const;
+
+    // 按从小到大遍历非空桶，[low, high]是桶覆盖的取值范围
+    using BucketCallback = std::function<void(int64_t low, int64_t high, uint64_t count)>;
+    void forEachBucket(const BucketCallback &cb) const;
+
+    // "count=.. mean=..us p50=..us p90=.. p99=.. p999=.. max=.."
+    std::string toString() const;
+    // 导出非空桶，每行"low_ns,high_ns,count"，第一行是表头
+    std::string toCsv() const;
+
+    static int bucketIndex(int64_t value);
+    static int64_t bucketLow(int index);
+    static int64_t bucketHigh(int index);
+
+private:
+    uint64_t counts_[kNumBuckets];
+    uint64_t count_;
+    int64_t sum_;
+    int64_t min_;
+    int64_t max_;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "ads_HttpRequest.h"
+
+class Buffer;
+
+/** 增量式HTTP/1.1请求解析器，每个连接一个
+ * 直接在连接的inputBuffer_上解析，不拷贝数据：
+ *   1. 解析过程中不retrieve，所有位置都记成相对buf->peek()的偏移量，
+ *      这样数据不完整时Buffer扩容/搬移数据也不会让已解析的结果失效；
+ *   2. 记录已扫描过的位置，下次数据到来时从断点继续，不会重复扫描；
+ *   3. 请求完整后才把偏移量换算成指向Buffer的StringPiece，填进HttpRequest。
+ * 用法：parseRequest()返回true且gotAll()时处理request()，然后
+ *      buf->retrieve(requestLength())并reset()，接着解析管道中的下一个请求。
+ **/
+class HttpContext{
+public:
+    enum ParseState{
+        kExpectRequestLine,
+        kExpectHeaders,
+        kExpectBody,
+        kExpectChunkSize,
+        kExpectChunkData,
+        kExpectTrailers,
+        kGotAll,
+    };
+
+    // 请求行+头部的上限，以及请求体的上限，超过即视为错误请求，防止恶意客户端撑爆内存
+    static const size_t kMaxHeaderBytes = 64 * 1024;
+    static const size_t kMaxBodyBytes = 8 * 1024 * 1024;
+    // chunk大小行（十六进制长度加可选的扩展）的上限；trailer合计也按kMaxHeaderBytes限制
+    static const size_t kMaxChunkLineBytes = 256;
+
+    HttpContext();
+
+    // 返回false表示请求格式错误，应回400并关闭连接；返回true时用gotAll()判断请求是否完整
+    bool parseRequest(Buffer *buf, Timestamp receiveTime);
+
+    bool gotAll() const {return state_ == kGotAll;}
+    // 当前请求在buf中占用的字节数，只在gotAll()后有意义
+    size_t requestLength() const {return consumed_;}
+    const HttpRequest &request() const {return request_;}
+
+    // 准备解析下一个请求，保留各容器的容量
+    void reset();
+
+private:
+    // 相对buf->peek()的[offset, offset+length)
+    struct Span{
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    bool processRequestLine(const char *base, const char *begin, const char *end);
+    bool processHeader(const char *base, const char *begin, const char *end);
+    bool processChunkSize(const char *begin, const char *end);
+    void fillRequest(const char *base, Timestamp receiveTime);
+
+    static Span makeSpan(const char *base, const char *begin, const char *end){
+        Span span;
+        span.offset = static_cast<uint32_t>(begin - base);
+        span.length = static_cast<uint32_t>(end - begin);
+        return span;
+    }
+    static StringPiece toPiece(const char *base, Span span){
+        return StringPiece(base + span.offset, span.length);
+    }
+
+    ParseState state_;
+    size_t consumed_;   // 当前请求已解析完的字节数
+    size_t scanned_;    // 查找"\r\n"的起点，已扫描过的数据不再重复扫描
+
+    HttpRequest::Method method_;
+    HttpRequest::Version version_;
+    Span path_;
+    Span query_;
+    Span body_;
+    std::vector<std::pair<Span, Span>> headerSpans_;
+
+    bool chunked_;
+    bool hasContentLength_;
+    size_t contentLength_;
+    size_t chunkRemaining_;
+    size_t trailersBegin_;  // trailer开始的位置，用来限制trailer的总长度
+    // chunked请求体在Buffer里不连续，只能拼接到这里；clear()不释放容量，稳定后不再分配
+    std::string chunkedBody_;
+
+    HttpRequest request_;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+
+#include "ads_StringPiece.h"
+#include "ads_Timestamp.h"
+
+class HttpContext;
+
+// 一个完整的HTTP请求。method以外的字段都是指向连接inputBuffer_的视图，不做std::string拷贝，
+// 只在HttpServer的HttpCallback执行期间有效；需要保留的话请自己toString()
+class HttpRequest{
+public:
+    enum Method{
+        kInvalid,
+        kGet,
+        kPost,
+        kHead,
+        kPut,
+        kDelete,
+    };
+    enum Version{
+        kUnknown,
+        kHttp10,
+        kHttp11,
+    };
+
+    using Header = std::pair<StringPiece, StringPiece>;
+    using HeaderList = std::vector<Header>;
+
+    HttpRequest()
+        : method_(kInvalid)
+        , version_(kUnknown)
+    {
+    }
+
+    Method method() const {return method_;}
+    const char *methodString() const;
+    Version version() const {return version_;}
+
+    StringPiece path() const {return path_;}
+    // '?'之后的部分，不含'?'
+    StringPiece query() const {return query_;}
+    StringPiece body() const {return body_;}
+    Timestamp receiveTime() const {return receiveTime_;}
+
+    // 按字段名查找（大小写不敏感），没有则返回空视图
+    StringPiece getHeader(const StringPiece &field) const;
+    const HeaderList &headers() const {return headers_;}
+
+    // HTTP/1.1默认长连接，除非带"Connection: close"；HTTP/1.0只有显式"Connection: Keep-Alive"才保持
+    bool keepAlive() const;
+
+private:
+    // 只有解析器负责填充请求
+    friend class HttpContext;
+
+    void reset(){
+        method_ = kInvalid;
+        version_ = kUnknown;
+        path_ = StringPiece();
+        query_ = StringPiece();
+        body_ = StringPiece();
+        // clear()保留vector容量，长连接上的后续请求不用再分配内存
+        headers_.clear();
+    }
+
+    Method method_;
+    Version version_;
+    StringPiece path_;
+    StringPiece query_;
+    StringPiece body_;
+    Timestamp receiveTime_;
+    HeaderList headers_;
+};
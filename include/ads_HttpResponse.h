@@ -0,0 +1,98 @@
+#pragma once
+
+#include <sys/types.h>
+#include <string>
+
+#include "ads_noncopyable.h"
+#include "ads_StringPiece.h"
+
+class Buffer;
+
+// HTTP响应。HttpServer给每个连接复用同一个HttpResponse对象，reset()只清空内容不释放容量，
+// 所以长连接上稳态不会再分配内存
+class HttpResponse : noncopyable{
+public:
+    enum HttpStatusCode{
+        kUnknown,
+        k200Ok = 200,
+        k204NoContent = 204,
+        k301MovedPermanently = 301,
+        k400BadRequest = 400,
+        k404NotFound = 404,
+        k413PayloadTooLarge = 413,
+        k500InternalServerError = 500,
+    };
+
+    explicit HttpResponse(bool close)
+        : statusCode_(kUnknown)
+        , closeConnection_(close)
+        , chunked_(false)
+        , headOnly_(false)
+        , fileFd_(-1)
+        , fileOffset_(0)
+        , fileLength_(0)
+    {
+    }
+
+    void setStatusCode(HttpStatusCode code) {statusCode_ = code;}
+    // 不设置则使用状态码对应的标准短语
+    void setStatusMessage(const std::string &message) {statusMessage_ = message;}
+
+    void setCloseConnection(bool on) {closeConnection_ = on;}
+    bool closeConnection() const {return closeConnection_;}
+
+    void setContentType(const StringPiece &contentType) {addHeader("Content-Type", contentType);}
+    // 头部直接按"key: value\r\n"拼进一个字符串，省去map的节点分配
+    void addHeader(const StringPiece &key, const StringPiece &value);
+
+    void setBody(const StringPiece &body) {body_.assign(body.data(), body.size());}
+    void appendBody(const StringPiece &data) {body_.append(data.data(), data.size());}
+
+    // 以Transfer-Encoding: chunked发送，每次addChunk()追加一个分块，适合边生成边输出的内容
+    void setChunked(bool on) {chunked_ = on;}
+    bool chunked() const {return chunked_;}
+    void addChunk(const StringPiece &data);
+
+    // HEAD请求：头部照常（包括Content-Length），但不带body
+    void setHeadOnly(bool on) {headOnly_ = on;}
+
+    // 静态文件快速通道：响应体由HttpServer通过TcpConnection::sendFile()零拷贝发送。
+    // fd的所有权转交给HttpServer，发送完成或连接断开后由HttpServer关闭
+    void setFile(int fd, off_t offset, size_t length);
+    bool hasFile() const {return fileFd_ >= 0;}
+    int fileFd() const {return fileFd_;}
+    off_t fileOffset() const {return fileOffset_;}
+    size_t fileLength() const {return fileLength_;}
+    // HttpServer接管fd后调用，之后reset()不再关闭它
+    int releaseFile();
+
+    // 1xx、204、304不能带body，也不能有Content-Length或Transfer-Encoding（RFC 7230 3.3）
+    bool bodyAllowed() const{
+        int code = statusCode_;
+        return code >= 200 && code != 204 && code != 304;
+    }
+
+    // 把状态行、头部和body追加到output，文件body不在此处输出
+    void appendToBuffer(Buffer *output) const;
+
+    // 为同一连接上的下一个请求复用
+    void reset(bool close);
+
+    ~HttpResponse();
+
+    // 分块编码的辅助函数，供需要自己往Buffer里写chunk的调用者使用
+    static void appendChunk(Buffer *output, const StringPiece &data);
+    static void appendLastChunk(Buffer *output);
+
+private:
+    HttpStatusCode statusCode_;
+    std::string statusMessage_;
+    bool closeConnection_;
+    bool chunked_;
+    bool headOnly_;
+    std::string headers_;
+    std::string body_;      // chunked时保存的是已经编码好的分块
+    int fileFd_;
+    off_t fileOffset_;
+    size_t fileLength_;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "ads_noncopyable.h"
+#include "ads_TcpServer.h"
+
+class HttpRequest;
+class HttpResponse;
+
+/** 基于TcpServer的HTTP/1.1服务器
+ * 1. 长连接：按请求的Connection头和版本决定是否保持连接；
+ * 2. 管道化：一次onMessage里把inputBuffer_中所有完整请求依次解析处理，
+ *    响应按请求顺序追加到同一个Buffer，最后只调用一次send()，减少系统调用；
+ * 3. 请求体支持Content-Length和chunked，响应可以用chunked；
+ * 4. 静态文件：HttpResponse::setFile()后由TcpConnection::sendFile()零拷贝发送，
+ *    TcpConnection保证文件与前后响应的字节顺序不乱。
+ * HttpCallback在连接所属的subloop线程中执行，不要在里面阻塞。
+ **/
+class HttpServer : noncopyable{
+public:
+    using HttpCallback = std::function<void(const HttpRequest &, HttpResponse *)>;
+
+    HttpServer(EventLoop *loop,
+               const InetAddress &listenAddr,
+               const std::string &name,
+               TcpServer::Option option = TcpServer::kNoReusePort);
+
+    void setHttpCallback(const HttpCallback &cb) {httpCallback_ = cb;}
+    void setThreadNum(int numThreads) {server_.setThreadNum(numThreads);}
+    // 流水线请求的多个响应在一轮里合并成一次写，需在start()之前设置
+    void setCoalesceWrites(bool on) {server_.setCoalesceWrites(on);}
+    // keep-alive连接空闲后回收读写缓冲区，见TcpServer::setIdleBufferRelease()，需在start()之前设置
+    void setIdleBufferRelease(double seconds) {server_.setIdleBufferRelease(seconds);}
+    // 每轮执行排队任务的预算，见TcpServer::setFunctorBudget()，需在start()之前设置
+    void setFunctorBudget(size_t maxTasks, int64_t maxMicros) {server_.setFunctorBudget(maxTasks, maxMicros);}
+    // 每条连接的读预算，见TcpServer::setReadBudget()，需在start()之前设置
+    void setReadBudget(size_t maxBytes, int64_t maxMicros) {server_.setReadBudget(maxBytes, maxMicros);}
+    // 字节限速，见TcpServer::setSendRateLimit()等，需在start()之前设置
+    void setSendRateLimit(double bytesPerSecond, double burst) {server_.setSendRateLimit(bytesPerSecond, burst);}
+    void setPeerRecvLimit(double bytesPerSecond, double burst) {server_.setPeerRecvLimit(bytesPerSecond, burst);}
+    void setServerSendLimit(double bytesPerSecond, double burst) {server_.setServerSendLimit(bytesPerSecond, burst);}
+    void setServerRecvLimit(double bytesPerSecond, double burst) {server_.setServerRecvLimit(bytesPerSecond, burst);}
+    // 同一对端IP每秒最多处理多少个请求，空闲后最多连续burst个；超出时照常处理已经收到的请求，
+    // 然后暂停读这条连接，直到令牌补上。0表示不限（默认），需在start()之前设置
+    void setPeerRequestLimit(double requestsPerSecond, double burst);
+    LoopMetrics loopMetrics(std::vector<LoopMetrics> *perLoop = nullptr) {return server_.loopMetrics(perLoop);}
+    LoopHistograms loopHistograms(std::vector<LoopHistograms> *perLoop = nullptr) {return server_.loopHistograms(perLoop);}
+    void start();
+
+private:
+    void onConnection(const TcpConnectionPtr &conn);
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+    void onWriteComplete(const TcpConnectionPtr &conn);
+
+    TcpServer server_;
+    HttpCallback httpCallback_;
+    std::unique_ptr<PeerBuckets> requestBuckets_;
+};
@@ -2,41 +2,68 @@
 
 #include <arpa/inet.h>  //包含了 IP 地址转换相关的函数（如 inet_pton、inet_ntop 等
 #include <netinet/in.h> //定义了与 sockaddr_in 结构体和网络地址相关的常量和数据结构（如 htons、ntohs 等）。这个头文件是 Linux/Unix 网络编程的基础
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stddef.h>
 #include <string>
 
-// 这个InetAddress类是muduo库中用于封装 IPv4 套接字地址（socket address） 的一个工具类，方便在网络编程中管理和操作地址信息
+// 这个InetAddress类是muduo库中用于封装 套接字地址（socket address） 的一个工具类，方便在网络编程中管理和操作地址信息
 // InetAddress类的主要功能是将 IP 地址和端口号封装成一个对象，方便在网络编程中传递和使用
 // InetAddress 简化了对 sockaddr_in 的操作，避免直接操作底层的 C 语言接口。
+// 除了IPv4，还可以是IPv6地址、Unix域socket的文件路径或抽象命名空间（Linux特有，名字不落在文件系统上），
+// Socket、Acceptor、Connector按family()创建对应的socket，bind/connect时用getSockAddr()和getSockLen()
 class InetAddress{
 public:
     // explicit 关键字防止构造函数被隐式转换调用，防止发生隐式转换带来的歧义问题。
     // uint16_t port = 0：默认端口号为 0（表示由操作系统自动分配端口）。std::string ip = "127.0.0.1"：默认 IP 地址为 127.0.0.1（本地主机）
+    // ip中含有':'时按IPv6地址解析，如"::1"
     explicit InetAddress(uint16_t port = 0, std::string ip = "127.0.0.1");
-    // 允许通过一个 sockaddr_in 结构体直接初始化 InetAddress 对象。使用 成员初始化列表 直接对 addr_ 进行赋值。
-    explicit InetAddress(const sockaddr_in &addr)
-        : addr_(addr)
-        {
-        }
-    
+    // 允许通过一个 sockaddr_in 结构体直接初始化 InetAddress 对象。
+    explicit InetAddress(const sockaddr_in &addr);
+    explicit InetAddress(const sockaddr_in6 &addr6);
+    // accept/getsockname/recvfrom得到的任意family的地址，len是内核返回的地址长度
+    InetAddress(const sockaddr *addr, socklen_t len) {setSockAddr(addr, len);}
+
+    // Unix域socket地址：文件路径，或者抽象命名空间里的名字；长度不能达到sizeof(sun_path)，超长LOG_FATAL
+    static InetAddress fromUnixPath(const std::string &path);
+    static InetAddress fromAbstract(const std::string &name);
+    // 解析"unix:/tmp/a.sock"、"unix:@name"（抽象命名空间）、"[::1]:8080"、"127.0.0.1:8080"，失败（包括Unix路径超长）返回false
+    static bool parse(const std::string &spec, InetAddress *out);
+
+    sa_family_t family() const {return addr_.sin_family;}
+    bool isIpv6() const {return family() == AF_INET6;}
+    bool isUnix() const {return family() == AF_UNIX;}
+    // 绑定在文件路径上的Unix域地址（不含抽象命名空间和未命名的地址），监听方退出时要删掉这个文件
+    bool isUnixPath() const {return isUnix() && len_ > offsetof(sockaddr_un, sun_path) && addrUn_.sun_path[0] != '\0';}
+
     // 获取 IP 地址。 将 sockaddr_in 结构体中的 IP 地址转换为字符串格式（如 "192.168.1.1"）。const 关键字表示这个成员函数是只读的，不会修改类的成员变量。
+    // Unix域地址返回路径，抽象命名空间的名字前面加'@'，未命名的地址（如客户端）返回空串
     std::string toIp() const;
     // 获取 IP 地址和 端口号。将 sockaddr_in 结构体中的 IP 和端口号转换为 "192.168.1.1:8080" 格式。
+    // IPv6为"[::1]:8080"，Unix域为"unix:/tmp/a.sock"、"unix:@name"
     std::string toIpPort() const;
-    // 返回 sockaddr_in 结构体中的端口号（通过 ntohs() 将网络字节序转换为主机字节序）。
+    // 返回 sockaddr_in 结构体中的端口号（通过 ntohs() 将网络字节序转换为主机字节序）。Unix域地址返回0
     uint16_t toPort() const; 
 
-    // 返回 sockaddr_in 结构体的指针。const 表示调用这个函数不会修改对象的状态。
+    // 返回地址结构体的指针，配合getSockLen()传给bind/connect/sendto
     /* 两个const:
-     * 1.返回类型中的 const：表示返回的指针指向的数据（即 sockaddr_in 结构体）是 常量的，调用者不能通过返回的指针来修改数据。
+     * 1.返回类型中的 const：表示返回的指针指向的数据（即 sockaddr 结构体）是 常量的，调用者不能通过返回的指针来修改数据。
      * 2.函数声明末尾的 const：表示这个函数是一个 常量成员函数，即在函数内部不会修改对象的状态（不会修改任何成员变量）。
      */
-    const sockaddr_in *getSockAddr() const {return &addr_;}
+    const sockaddr *getSockAddr() const {return reinterpret_cast<const sockaddr *>(&addr_);}
+    socklen_t getSockLen() const {return len_;}
 
     // 通过一个 sockaddr_in 结构体来修改 InetAddress 对象的地址信息。
-    void setSockAddr(const sockaddr_in &addr) {addr_ = addr;}
+    void setSockAddr(const sockaddr_in &addr);
+    void setSockAddr(const sockaddr *addr, socklen_t len);
 
 private:
-    // sockaddr_in 是一个用于存储 IPv4 地址 的结构体
-    // 定义在 <netinet/in.h> 中。addr_ 用于保存 IP 地址和端口号。
-    sockaddr_in addr_;  
+    // sockaddr_in 是一个用于存储 IPv4 地址 的结构体，sockaddr_in6存IPv6地址，sockaddr_un存Unix域地址
+    // 三者开头都是family字段，按family()区分
+    union{
+        sockaddr_in addr_;
+        sockaddr_in6 addr6_;
+        sockaddr_un addrUn_;
+    };
+    socklen_t len_;     // 有效的地址长度，Unix域地址的长度随路径长短变化
 };
\ No newline at end of file
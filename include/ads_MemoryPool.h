@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h>
+#include <new>
+
+#include "ads_noncopyable.h"
+
+/** 按大小分级的线程本地内存池，给连接建立/销毁路径上的小对象和Buffer存储用
+ * 1. 分级：块大小按2的幂及其1.5倍分级（64B ~ 128KB），更大的请求直接走malloc；
+ * 2. 线程本地：每个线程（即每个loop）一组空闲链表，本线程分配、本线程释放不加锁；
+ * 3. 归还原主：每个块头记录分配它的线程缓存，别的线程释放时无锁压进原主的远程释放栈，
+ *    原主下次本地链表为空时一次性取回。连接在baseloop创建、在subloop销毁时内存不会单向流走；
+ * 4. 限额：每级本地缓存和远程释放栈各有上限，超出的直接free，突发流量过后RSS能降回来，
+ *    原主不再分配某一级时别的线程还回来的块也不会一直压在栈里。
+ * 线程退出时把自己缓存的块全部free，之后别的线程还回来的块也直接free。
+ **/
+class MemoryPool : noncopyable{
+public:
+    // 返回至少size字节、16字节对齐的内存；usable非空时返回实际可用的字节数（本级块的大小）
+    static void *allocate(size_t size, size_t *usable = nullptr);
+    // 任何线程都可以调用，p可以为nullptr
+    static void deallocate(void *p);
+
+    // 关闭后新的分配直接走malloc，用于对比测试；已经分配的块照常释放
+    static void setEnabled(bool on);
+    static bool enabled();
+};
+
+// 让std::allocate_shared从MemoryPool分配，控制块和对象在同一个块里
+template <typename T>
+class PoolAllocator{
+public:
+    using value_type = T;
+
+    PoolAllocator() = default;
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U> &) {}
+
+    T *allocate(size_t n){
+        static_assert(alignof(T) <= 16, "MemoryPool only guarantees 16-byte alignment");
+        return static_cast<T *>(MemoryPool::allocate(n * sizeof(T)));
+    }
+    void deallocate(T *p, size_t){
+        MemoryPool::deallocate(p);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T> &, const PoolAllocator<U> &) {return true;}
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T> &, const PoolAllocator<U> &) {return false;}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string.h>
+#include <strings.h>
+#include <string>
+
+// 只读字符串视图：只保存指针和长度，不拷贝数据（C++11没有std::string_view）
+// 视图指向的内存由别人持有，使用者要保证视图活得不比原数据久
+class StringPiece{
+public:
+    StringPiece()
+        : ptr_(nullptr)
+        , length_(0)
+    {
+    }
+    StringPiece(const char *str)
+        : ptr_(str)
+        , length_(::strlen(str))
+    {
+    }
+    StringPiece(const char *offset, size_t len)
+        : ptr_(offset)
+        , length_(len)
+    {
+    }
+    StringPiece(const std::string &str)
+        : ptr_(str.data())
+        , length_(str.size())
+    {
+    }
+
+    const char *data() const {return ptr_;}
+    size_t size() const {return length_;}
+    bool empty() const {return length_ == 0;}
+    const char *begin() const {return ptr_;}
+    const char *end() const {return ptr_ + length_;}
+    char operator[](size_t i) const {return ptr_[i];}
+
+    bool operator==(const StringPiece &x) const{
+        return length_ == x.length_ && ::memcmp(ptr_, x.ptr_, length_) == 0;
+    }
+    bool operator!=(const StringPiece &x) const {return !(*this == x);}
+
+    // HTTP头部字段名大小写不敏感
+    bool equalsIgnoreCase(const StringPiece &x) const{
+        return length_ == x.length_ && ::strncasecmp(ptr_, x.ptr_, length_) == 0;
+    }
+
+    std::string toString() const {return std::string(ptr_, length_);}
+
+private:
+    const char *ptr_;
+    size_t length_;
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <memory>
+#include <atomic>
+
+#include "ads_noncopyable.h"
+#include "ads_Callbacks.h"
+#include "ads_InetAddress.h"
+#include "ads_TcpConnection.h"
+
+class Connector;
+class EventLoop;
+using ConnectorPtr = std::shared_ptr<Connector>;
+
+/** TCP客户端，对应服务端的TcpServer
+ * 由Connector负责非阻塞connect和失败重试，连上以后创建与服务端完全相同的TcpConnection，
+ * 所以ConnectionCallback、MessageCallback、Buffer等代码可以直接复用。
+ * 一个TcpClient同一时刻最多一条连接，所有回调都在loop_线程中执行。
+ **/
+class TcpClient : noncopyable{
+public:
+    TcpClient(EventLoop *loop,
+              const InetAddress &serverAddr,
+              const std::string &nameArg);
+    ~TcpClient();
+
+    void connect();
+    // 半关闭已建立的连接
+    void disconnect();
+    // 停止连接/重试，已建立的连接不受影响
+    void stop();
+
+    TcpConnectionPtr connection() const{
+        std::unique_lock<std::mutex> lock(mutex_);
+        return connection_;
+    }
+
+    EventLoop *getLoop() const {return loop_;}
+    bool retry() const {return retry_;}
+    // 连接建立后又断开时，是否自动重连
+    void enableRetry() {retry_ = true;}
+    // connect失败时的退避时间，见Connector::setRetryDelay
+    void setRetryDelay(int initialMs, int maxMs);
+
+    const std::string &name() const {return name_;}
+
+    void setConnectionCallback(const ConnectionCallback &cb) {connectionCallback_ = cb;}
+    void setMessageCallback(const MessageCallback &cb) {messageCallback_ = cb;}
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb) {writeCompleteCallback_ = cb;}
+
+private:
+    // Connector连上之后在loop_线程中调用
+    void newConnection(int sockfd);
+    // 连接断开时在loop_线程中调用
+    void removeConnection(const TcpConnectionPtr &conn);
+
+    EventLoop *loop_;
+    ConnectorPtr connector_;
+    const std::string name_;
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+    WriteCompleteCallback writeCompleteCallback_;
+    std::atomic_bool retry_;
+    std::atomic_bool connect_;
+    int nextConnId_;    // 只在loop_线程中使用
+    mutable std::mutex mutex_;
+    TcpConnectionPtr connection_;   // 由mutex_保护，connection()可能在其他线程调用
+};
@@ -3,53 +3,147 @@
 #include <memory>
 #include <string>
 #include <atomic>
+#include <vector>
+#include <mutex>
+#include <stdint.h>
 
 #include "ads_noncopyable.h"
 #include "ads_InetAddress.h"
 #include "ads_Callbacks.h"
 #include "ads_Buffer.h"
 #include "ads_Timestamp.h"
+#include "ads_Socket.h"
+#include "ads_Channel.h"
 
-class Channel;
 class EventLoop;
-class Socket;
+class TokenBucket;
 
 
 // 如果TcpConnection对象是由shared_prt<TcpConnection>管理的，那么在类的成员函数内部，如果想要获取一个只想自身的shared_ptr<TcpConnection>
 // 不能直接用this创建，否则会导致多个shared_ptr共享原始指针，从而导致引用技术错误，可能导致对象提前释放或内存泄漏
 // 提供 shared_from_this()，在类内部安全地获取 shared_ptr。
-class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnection>
+// 每条连接占用的内存：Socket和Channel直接放在对象里，Channel的事件通过ChannelHandler虚函数分发回来，
+// 用户回调放在一张各连接共享的HandlerTable里，地址压缩存放，名字和文件发送队列用到时才分配
+class TcpConnection : noncopyable, private ChannelHandler, public std::enable_shared_from_this<TcpConnection>
 {
 public:
+    // 用户回调表。TcpServer的所有连接共用一张；单条连接调用set*Callback时先复制一份再改，不影响别的连接
+    struct HandlerTable{
+        ConnectionCallback connectionCallback;          // 有新连接时的回调
+        MessageCallback messageCallback;                // 有新读写消息时的回调
+        WriteCompleteCallback writeCompleteCallback;    // 消息发送完成后的回调
+        HighWaterMarkCallback highWaterMarkCallback;    // 高水位回调
+        CloseCallback closeCallback;                    // 关闭连接的回调
+        // 高水位阈值，即数据缓冲区达到 64MB 时触发高水位回调。
+        size_t highWaterMark = 64 * 1024 * 1024;
+        // 名字前缀，如"ServerName-127.0.0.1:8080#"，连接名由它和id()拼出
+        std::string namePrefix;
+        // 读预算（见setReadBudget），0表示不限
+        size_t readBudgetBytes = 0;
+        int64_t readBudgetMicros = 0;
+        // 所有连接共用的收发限速桶（字节），为空表示不限，见TcpServer::setServerSendLimit/setServerRecvLimit
+        std::shared_ptr<TokenBucket> sendLimiter;
+        std::shared_ptr<TokenBucket> recvLimiter;
+    };
+
+    // 读公平性统计，设置了读预算或限速的连接才记录
+    struct ReadStats{
+        uint64_t reads = 0;         // 读到数据的次数，每次调用一次messageCallback
+        uint64_t bytes = 0;
+        uint64_t budgetHits = 0;    // 一次读满字节预算、让出给别的连接的次数
+        uint64_t deferred = 0;      // 轮到时本轮的时间预算已经用完、没读就排进就绪列表的次数
+        uint64_t waitMicros = 0;    // 在就绪列表里等待的时间之和
+        uint64_t maxWaitMicros = 0;
+    };
+
     TcpConnection(EventLoop *loop,
                   const std::string &nameArg,
                   int sockfd,
                   const InetAddress &localAddr,
                   const InetAddress &peerAddr);
+    // TcpServer用：回调和名字前缀来自共享的table，名字在第一次调用name()时才拼出来，accept时不构造字符串
+    TcpConnection(EventLoop *loop,
+                  const std::shared_ptr<HandlerTable> &table,
+                  int sockfd,
+                  const InetAddress &localAddr,
+                  const InetAddress &peerAddr);
     ~TcpConnection();
 
     EventLoop *getLoop() const {return loop_;}
-    const std::string &name() const {return name_;}
-    const InetAddress &localAddress() const {return localAddr_;}
-    const InetAddress &peerAddress() const {return peerAddr_;} 
+    // TcpServer连接注册表中的64位id，在connectEstablished之前设置；TcpClient的连接为0
+    uint64_t id() const {return id_;}
+    const std::string &name() const;
+    // 地址是压缩存放的，每次返回一个新构造的InetAddress
+    InetAddress localAddress() const {return localAddr_.get();}
+    InetAddress peerAddress() const {return peerAddr_.get();}
 
     bool connected() const {return state_ == kConnected;}
 
     // 发送数据，非阻塞
     // ，const void *data 允许 sendInLoop 函数接收 任何类型的指针，并且 不修改数据（const 关键字表明数据不可修改）。
     void send(const std::string &buf);
+    void send(const void *data, size_t len);
+    // 发送buf中全部可读数据并清空buf，用于把多条消息攒在一起一次性发出
+    void send(Buffer *buf);
     // 零拷贝发送文件
+    // 文件内容与send()的数据严格按调用顺序发出；fileDescriptor由调用者持有，需等写完成回调后再关闭
     void sendFile(int fileDescriptor, off_t offset, size_t count);
+    // outputBuffer_中还有数据或者文件还没发完
+    bool hasPendingWrite() const {return outputBuffer_.readableBytes() > 0 || hasPendingFiles();}
+    // 合并写：打开后send()只追加到outputBuffer_，本轮事件处理完、下一次poll之前一次性写出，
+    // 一个请求回多条小消息时只有一次系统调用、更少的小TCP段；默认关闭，只能在loop线程设置
+    void setCoalesceWrites(bool on) {coalesceWrites_ = on;}
+    bool coalesceWrites() const {return coalesceWrites_;}
+    // 立刻把outputBuffer_里攒着的数据写出去，给合并写模式下对延迟敏感的消息用；任何线程都可以调用
+    void flush();
     
     // 半关闭，只关闭写端
     void shutdown();
+    // 不等数据发完，直接关闭连接
+    void forceClose();
+    // 关闭Nagle算法，小包请求/应答场景降低延迟
+    void setTcpNoDelay(bool on);
 
-    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb;}
-    void setMessageCallback(const MessageCallback &cb) {messageCallback_ = cb;}
-    void setWriteCompleteCallback(const WriteCompleteCallback &cb) {writeCompleteCallback_ = cb;}
-    void setCloseCallback(const CloseCallback &cb) {closeCallback_ = cb;}
+    // 只改这条连接的回调：回调表和别的连接共享时先复制一份
+    void setConnectionCallback(const ConnectionCallback &cb) {ownTable()->connectionCallback = cb;}
+    void setMessageCallback(const MessageCallback &cb) {ownTable()->messageCallback = cb;}
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb) {ownTable()->writeCompleteCallback = cb;}
+    void setCloseCallback(const CloseCallback &cb) {ownTable()->closeCallback = cb;}
     void setHightWaterMarkCallback(const HighWaterMarkCallback &cb, size_t highWaterMark)
-    {highWaterMarkCallback_ = cb; highWaterMark_ = highWaterMark;}
+    {HandlerTable *table = ownTable(); table->highWaterMarkCallback = cb; table->highWaterMark = highWaterMark;}
+    // 读预算：一次可读事件最多读maxBytes字节；本轮loop处理事件超过maxMicros微秒后不再读（每轮至少读一次）。
+    // 用完预算、socket里可能还有数据的连接暂停监听可读，排进EventLoop的就绪列表，下一轮和别的忙连接轮流读，
+    // 读空后再交还epoll。一条连接全速发送时不会让同一个loop上的其他连接一直等。时间预算拆不开单次读，
+    // 一般和字节预算一起用。0表示不限（默认），只能在loop线程调用
+    void setReadBudget(size_t maxBytes, int64_t maxMicros)
+    {HandlerTable *table = ownTable(); table->readBudgetBytes = maxBytes; table->readBudgetMicros = maxMicros;}
+    // 只能在loop线程调用；没有设置读预算或限速时全为0
+    ReadStats readStats() const {return flow_ ? flow_->stats : ReadStats();}
+
+    // 发送限速：这条连接每秒最多发bytesPerSecond字节，空闲后最多一次发burst字节；0表示不限（默认）。
+    // 令牌不够时数据留在outputBuffer_里，停止监听可写，由loop定时器在令牌补上后恢复；
+    // 和共用的sendLimiter同时生效，取两者中较紧的。只能在loop线程调用（或连接建立之前）
+    void setSendRateLimit(double bytesPerSecond, double burst);
+    // 接收限速桶，通常是同一对端IP的连接共用的（见TcpServer::setPeerRecvLimit）；为空表示不限。
+    // 令牌不够时暂停读，由loop定时器恢复；和共用的recvLimiter同时生效。只能在loop线程调用（或连接建立之前）
+    void setRecvLimiter(const std::shared_ptr<TokenBucket> &bucket);
+    // 暂停读micros微秒，到时间后恢复，期间收到的数据留在内核里（对端最终会被TCP流控挡住）；
+    // 给按消息计数的上层限速用，比如HttpServer每个请求扣一个令牌、欠账时暂停读。只能在loop线程调用
+    void pauseReading(int64_t micros);
+    // 停止读，直到startRead()：stopRead()只记一个标志，之后真有数据到来时才停止监听可读，
+    // 期间数据留在内核里，inputBuffer_不再变化。CoConnection借它保证交出去的StringPiece有效。只能在loop线程调用
+    void stopRead() {reading_ = false;}
+    void startRead();
+
+    // 上层协议（如HttpServer）挂在连接上的私有状态，生命周期与连接相同
+    void setContext(const std::shared_ptr<void> &context) {context_ = context;}
+    const std::shared_ptr<void> &getContext() const {return context_;}
+
+    Buffer *inputBuffer() {return &inputBuffer_;}
+    Buffer *outputBuffer() {return &outputBuffer_;}
+    // 空闲回收，由TcpServer在loop线程里按固定周期调用：距上次调用有过读写就只清掉标记，
+    // 否则把两个缓冲区的存储还给MemoryPool（有未处理的数据时缩到刚好放得下）
+    void releaseIdleBuffers();
 
     // 连接建立
     void connectEstablished();
@@ -64,42 +158,129 @@ private:
         kConnected,
         kDisconnecting,
     };
+    // 地址的紧凑存储：IPv4/IPv6地址（以及没有路径的Unix域地址）直接放在sockaddr_in6大小的空间里，
+    // 放不下的（带路径的Unix域地址）单独分配一个InetAddress
+    class PackedAddress : noncopyable{
+    public:
+        explicit PackedAddress(const InetAddress &addr);
+        ~PackedAddress();
+        InetAddress get() const;
+    private:
+        union{
+            sockaddr_in6 inet_;
+            InetAddress *other_;
+        };
+        socklen_t len_;     // 0表示地址在other_里
+    };
+
+    // 等待发送的文件：bytesBefore表示轮到该文件之前还要先发outputBuffer_中的多少字节，
+    // 以此保证文件与send()的数据按调用顺序交错发出
+    struct PendingFile{
+        int fd;
+        off_t offset;
+        size_t remaining;
+        size_t bytesBefore;
+    };
+    // 连接上通常没有文件，第一次sendFile()时才分配
+    struct FileQueue{
+        std::vector<PendingFile> files;
+        size_t bytesBeforeFiles = 0;    // 所有files的bytesBefore之和
+    };
+    // 读预算和限速的状态，设置了其中之一的连接才分配
+    struct FlowControl{
+        ReadStats stats;
+        bool ready = false;         // 已经排在就绪列表里，期间不监听可读
+        bool readPaused = false;    // 接收令牌不够或者pauseReading()，等定时器恢复，期间不监听可读
+        bool writeTimer = false;    // 发送令牌不够，已经登记了恢复写的定时器
+        int64_t readyNanos = 0;     // 排进就绪列表的时间
+        int64_t resumeReadNanos = 0;    // 暂停读到什么时候
+        std::unique_ptr<TokenBucket> sendBucket;
+        std::shared_ptr<TokenBucket> recvBucket;
+    };
+
     void setState(StateE state) {state_ = state;}
+    void init();
+    HandlerTable *ownTable();
+    bool hasPendingFiles() const {return files_ && !files_->files.empty();}
 
-    // 可读事件，调用messageCallbak_
-    void handleRead(Timestamp receiveTime);
-    void handleWrite();     // 写事件，发送缓冲区数据
-    void handleClose();     // 连接关闭
-    void handleError();     // 错误处理
+    // ChannelHandler：可读事件，调用messageCallback
+    void handleRead(Timestamp receiveTime) override;
+    void handleWrite() override;     // 写事件，发送缓冲区数据
+    void handleClose() override;     // 连接关闭
+    void handleError() override;     // 错误处理
+    std::string channelName() const override {return name();}
+
+    // 读一次并调用messageCallback，maxBytes为0表示不限，返回readFd的结果
+    ssize_t readInput(Timestamp receiveTime, size_t maxBytes);
+    // 暂停监听可读，排到就绪列表末尾
+    void deferRead();
+    // 轮到就绪列表里的这条连接
+    void readReady();
+    FlowControl *flow();
+    // 是否有发送限速，没有时写路径和原来一样
+    bool sendLimited() const {return handlers_->sendLimiter || (flow_ && flow_->sendBucket);}
+    bool recvLimited() const {return handlers_->recvLimiter || (flow_ && flow_->recvBucket);}
+    // 现在按限速最多能发/收多少字节；不够一批时为0，*waitNanos给出攒够一批要等多久（总大于0），
+    // 发送的一批是待发的全部字节（含文件），最多半个burst，避免定时器每次只换来几个字节
+    size_t sendAllowance(int64_t nowNanos, int64_t *waitNanos) const;
+    size_t recvAllowance(int64_t nowNanos, size_t want, int64_t *waitNanos) const;
+    // 待发送的字节数：outputBuffer_加上排队文件剩下的部分
+    size_t pendingWriteBytes() const;
+    void chargeSend(size_t n, int64_t nowNanos);
+    void chargeRecv(size_t n, int64_t nowNanos);
+    // 发送令牌用完：停止监听可写，登记定时器在waitNanos后恢复
+    void throttleWrite(int64_t waitNanos);
+    void resumeWrite();
+    // 限速时数据只进outputBuffer_，由handleWrite按令牌发出
+    void scheduleShapedWrite();
+    void resumeRead();
+    // 没有stopRead()、没有排在就绪列表里、也没有暂停读时重新监听可读
+    void rearmReading();
 
     void sendInLoop(const void *data, size_t len);
+    void sendInLoop(const std::string &data) {sendInLoop(data.data(), data.size());}
     void sendFileInLoop(int fileDescriptor, off_t offset, size_t count);
+    // 合并写模式下登记在EventLoop::runBeforePoll()里，也是flush()的实现
+    void flushInLoop();
+    // 在handleWrite中按顺序推进outputBuffer_和待发送文件，最多发*allowance字节并从中扣掉，返回false表示出错
+    bool writeWithFiles(size_t *allowance);
     void shutdownInLoop();
+    void forceCloseInLoop();
+
+    friend class TcpServer;
 
     // TcpServer中，若为单Reactor程则loop_为baseloop，若为多Reactor则loop_为subloop
     EventLoop *loop_;
-    const std::string name_;
+    uint64_t id_;
+    // 这些回调，用户通过写入TcpServer注册，TcpServer把整张表共享给它的所有连接
+    std::shared_ptr<HandlerTable> handlers_;
+    // 延迟构造的名字，由nameOnce_保证只构造一次
+    mutable std::unique_ptr<std::string> name_;
+    mutable std::once_flag nameOnce_;
     std::atomic_int state_;
-    // 连接是否在监听读事件
+    // stopRead()之后为false，handleRead不再读
     bool reading_;
+    bool coalesceWrites_;
+    // 本轮已经登记过flushInLoop，同一轮里的后续send()不再重复登记
+    bool flushQueued_;
+    // 上次releaseIdleBuffers()之后有过读写
+    bool active_;
 
     // 管理底层socket和epoll，与Acceptor类似    Acceptor => mainloop    TcpConnection => subloop
-    std::unique_ptr<Socket> socket_;
-    std::unique_ptr<Channel> channel_;
-
-    const InetAddress localAddr_;
-    const InetAddress peerAddr_;
+    // 析构时channel_先于socket_，fd在Channel从Poller移除之后才关闭
+    Socket socket_;
+    Channel channel_;
 
-    // 这些回调，用户通过写入TcpServer注册，TcpServer再将注册的回调传给TcpConnection，TcpConnection再将回调注册到Channel中
-    ConnectionCallback connectionCallback_;         // 有新连接时的回调
-    MessageCallback messageCallback_;               // 有新读写消息时的回调
-    WriteCompleteCallback writeCompleteCallback_;  // 消息发送完成后的回调
-    HighWaterMarkCallback highWaterMarkCallback_;   // 高水位回调
-    CloseCallback closeCallback_;                   // 关闭连接的回调
-    size_t highWaterMark_;     //高水位阈值
+    const PackedAddress localAddr_;
+    const PackedAddress peerAddr_;
 
     // 数据缓冲区
     Buffer inputBuffer_;
     Buffer outputBuffer_;
 
+    std::unique_ptr<FileQueue> files_;
+    std::unique_ptr<FlowControl> flow_;
+
+    std::shared_ptr<void> context_;
+
 };
\ No newline at end of file
@@ -6,7 +6,7 @@
 #include <string>
 #include <memory>          // std::unique_ptr  std::shared_ptr 智能指针，避免手动管理对象生命周期。 
 #include <atomic>          // 保证 多线程 访问 started_ 变量时的 原子性，避免竞态条件。
-#include <unordered_map>   // 哈希表，用于存储所有的 TCP 连接。
+#include <vector>
 
 #include "ads_EventLoop.h"
 #include "ads_Acceptor.h"
@@ -16,12 +16,18 @@
 #include "ads_Callbacks.h"
 #include "ads_TcpConnection.h"
 #include "ads_Buffer.h"
+#include "ads_TokenBucket.h"
 
+// 连接注册表：每个loop一个分片（ConnectionShard），accept和close只访问连接所属loop的分片，不加锁、不经过baseloop
+// 连接用64位id标识，名字在第一次调用TcpConnection::name()时才构造
 class TcpServer{
 public:
     using ThreadInitCallback = std::function<void(EventLoop *)>;
 
     // 端口复用选项，决定是否允许多个套接字绑定同一端口。
+    // kNoReusePort：baseloop上一个Acceptor，accept之后把连接交给subloop
+    // kReusePort：每个subloop各有一个SO_REUSEPORT的Acceptor，由内核把连接分散到各个监听socket，
+    //             subloop自己accept自己处理，没有跨线程的转交，此时挑选策略和setRouteByPeerIp()不起作用
     enum Option{
         kNoReusePort,
         kReusePort,
@@ -35,15 +41,52 @@ public:
 
     // 用于在 线程池 中，每个线程的 EventLoop 初始化时调用。
     void setThreadInitCallback(const ThreadInitCallback &cb) {threadInitCallback_ = cb;}
+    // 下面三个回调放进所有连接共享的回调表，需在start()之前设置
     // 有 新连接 时调用（accept 一个连接）
-    void setConnectionCallback(const ConnectionCallback &cb) {connectionCallback_ = cb;}
+    void setConnectionCallback(const ConnectionCallback &cb) {handlers_->connectionCallback = cb;}
     // 收到 消息 时调用
-    void setMessageCallback(const MessageCallback &cb) {messageCallback_ = cb;}
+    void setMessageCallback(const MessageCallback &cb) {handlers_->messageCallback = cb;}
     // 发送 完成 时调用
-    void setWriteCompleteCallback(const WriteCompleteCallback &cb) {writeCompleteCallback_ = cb;}
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb) {handlers_->writeCompleteCallback = cb;}
 
     // 设置 工作线程数量，底层采用 one loop per thread 模型，每个线程拥有一个 EventLoop。
     void setThreadNum(int numThreads);
+    // 按对端IP一致性哈希选择subloop，同一IP的连接总在同一个loop里，优先于挑选策略，需在start()之前设置
+    void setRouteByPeerIp(bool on) {routeByPeerIp_ = on;}
+    // 新连接挑选subloop的策略，需在start()之前设置
+    void setLoopSelectPolicy(EventLoopThreadPool::SelectPolicy policy) {threadPool_->setSelectPolicy(policy);}
+    void setLoopSelector(const EventLoopThreadPool::LoopSelector &selector) {threadPool_->setLoopSelector(selector);}
+    // 每次可读事件最多accept的连接数，需在start()之前设置
+    void setAcceptBatch(int batch);
+    // 新连接打开合并写（见TcpConnection::setCoalesceWrites），需在start()之前设置
+    void setCoalesceWrites(bool on) {coalesceWrites_ = on;}
+    // 每隔seconds秒在各loop里检查一遍连接，两次检查之间没有读写的连接释放读写缓冲区的存储（见TcpConnection::releaseIdleBuffers），
+    // 所以连接空闲seconds到2*seconds秒后缓冲区被回收；0表示不回收（默认），需在start()之前设置
+    void setIdleBufferRelease(double seconds) {idleBufferRelease_ = seconds;}
+    // 处理连接的各loop每轮执行排队任务的预算（见EventLoop::setFunctorBudget），0表示不限，需在start()之前设置
+    void setFunctorBudget(size_t maxTasks, int64_t maxMicros) {functorBudgetTasks_ = maxTasks; functorBudgetMicros_ = maxMicros;}
+    // 每条连接的读预算（见TcpConnection::setReadBudget），一条连接全速发送时不会饿死同一个loop上的其他连接；
+    // 0表示不限（默认），需在start()之前设置
+    void setReadBudget(size_t maxBytes, int64_t maxMicros) {handlers_->readBudgetBytes = maxBytes; handlers_->readBudgetMicros = maxMicros;}
+    // 限速，单位都是字节，burst是空闲后一次最多能收发多少；rate为0表示不限（默认），都需在start()之前设置
+    // 每条连接的发送带宽（见TcpConnection::setSendRateLimit）
+    void setSendRateLimit(double bytesPerSecond, double burst) {sendRate_ = bytesPerSecond; sendBurst_ = burst;}
+    // 同一对端IP的所有连接合计的接收速率，超出时暂停读这些连接
+    void setPeerRecvLimit(double bytesPerSecond, double burst);
+    // 整个服务器合计的发送/接收速率，所有loop共用一个无锁的令牌桶
+    void setServerSendLimit(double bytesPerSecond, double burst);
+    void setServerRecvLimit(double bytesPerSecond, double burst);
+    // 所有Acceptor计数之和，在baseloop线程调用
+    AcceptStats acceptStats() const;
+    // getNextLoop(key)使用的哈希方式，需在start()之前设置
+    void setHashPolicy(EventLoopThreadPool::HashPolicy policy) {threadPool_->setHashPolicy(policy);}
+    // 第i个subloop线程绑定到cpus[i % cpus.size()]，可用EventLoopThreadPool::parseCpuList()解析"0-3,8"，需在start()之前设置
+    void setCpuList(const std::vector<int> &cpus) {threadPool_->setCpuList(cpus);}
+    // baseloop（accept所在的loop）所在线程绑定的CPU，start()时在baseloop线程里生效，-1不绑定
+    void setBaseLoopCpu(int cpu) {baseLoopCpu_ = cpu;}
+    // 处理连接的各loop（没有subloop时就是baseloop）合并后的运行统计，start()之后任何线程都可以调用
+    LoopMetrics loopMetrics(std::vector<LoopMetrics> *perLoop = nullptr) {return threadPool_->metrics(perLoop);}
+    LoopHistograms loopHistograms(std::vector<LoopHistograms> *perLoop = nullptr) {return threadPool_->histograms(perLoop);}
 
     // 启动服务器，如果没有监听，就开始监听新连接。
     // 这个函数是 线程安全 的，可以被多个线程调用，但仅第一次调用会生效。
@@ -53,33 +96,57 @@ public:
 private:
     // 处理新的Tcp连接
     void newConnection(int sockfd, const InetAddress &peerAddr);
+    // 把新连接交给ioLoop。kReusePort模式下由subloop自己的Acceptor在ioLoop线程里直接调用
+    void createConnection(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr);
+    // 在ioLoop线程中创建TcpConnection
+    void createConnectionInLoop(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr);
+    // 在ioLoop线程中把连接登记到该loop的分片，分配id后建立连接
+    void connectEstablishedInLoop(size_t shardIndex, const TcpConnectionPtr &conn);
     void removeConnection(const TcpConnectionPtr &conn);
     // 在 EventLoop 线程 中安全地移除连接。
     void removeConnectionInLoop(const TcpConnectionPtr &conn);
+    // ioLoop在ioLoops_中的下标，也就是它的分片下标
+    size_t shardIndexOf(EventLoop *ioLoop) const;
 
-    // 存储所有的 TCP 连接，key 是连接 ID，value 是 TcpConnectionPtr（std::shared_ptr<TcpConnection>）。
-    using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
+    class ConnectionShard;
 
     // 服务器主循环baseloop_（通常在 主线程 运行）。
     EventLoop *loop_;
 
     const std::string ipPort_;  // 存储ip和端口信息
     const std::string name_;    // 存储服务器名称
+    const InetAddress listenAddr_;
+    const Option option_;
 
     // acceptor_ 是 监听套接字，负责接受新连接。Acceptor 运行在 main Reactor，接受连接后，交给 sub Reactor 处理。
+    // kReusePort模式且有subloop时，start()会换成下面每个subloop各自的Acceptor
     std::unique_ptr<Acceptor> acceptor_;
+    // kReusePort模式下每个subloop的Acceptor：在调用start()的线程里创建并bind，listen和析构在各自的loop线程里
+    std::vector<std::unique_ptr<Acceptor>> loopAcceptors_;
     // threadPool_ 负责 管理工作线程池，实现 one loop per thread。
     std::shared_ptr<EventLoopThreadPool> threadPool_;
 
     ThreadInitCallback threadInitCallback_;
-    ConnectionCallback connectionCallback_;
-    MessageCallback messageCallback_;
-    WriteCompleteCallback writeCompleteCallback_;
+    // 用户回调、removeConnection和连接名前缀"ServerName-127.0.0.1:8080#"，所有连接共享这一张表
+    std::shared_ptr<TcpConnection::HandlerTable> handlers_;
 
     int numThreads_;     // 线程池中线程数量
+    int acceptBatch_;
+    int baseLoopCpu_;
+    bool routeByPeerIp_; // 新连接按对端IP粘性分配，否则轮询
+    bool coalesceWrites_;
+    double idleBufferRelease_;
+    double sendRate_;
+    double sendBurst_;
+    // 按对端IP的接收限速桶，新连接在baseloop或ioLoop里取，PeerBuckets内部加锁
+    std::unique_ptr<PeerBuckets> peerRecvBuckets_;
+    size_t functorBudgetTasks_;
+    int64_t functorBudgetMicros_;
     std::atomic_int started_;    // 是否已启动，保证线程安全
-    int nextConnId_;     // 下一个连接的ID，用于生成唯一连接名称
-    ConnectionMap connections_;    // 存储 所有的 TCP 连接，可以快速查找和管理。
-    
+
+    // start()之后不再变化：ioLoops_[i]的连接都登记在shards_[i]里，shards_[i]只在ioLoops_[i]线程访问
+    std::vector<EventLoop *> ioLoops_;
+    std::vector<std::unique_ptr<ConnectionShard>> shards_;
+
 };
 
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+
+#include "ads_noncopyable.h"
+#include "ads_Timestamp.h"
+#include "ads_Callbacks.h"
+
+// 一个定时任务：到期时间、回调、以及可选的重复间隔，由TimerQueue管理
+class Timer : noncopyable{
+public:
+    Timer(TimerCallback cb, Timestamp when, double interval)
+        : callback_(std::move(cb))
+        , expiration_(when)
+        , interval_(interval)
+        , repeat_(interval > 0.0)
+        , sequence_(++numCreated_)
+    {
+    }
+
+    void run() const {callback_();}
+
+    Timestamp expiration() const {return expiration_;}
+    bool repeat() const {return repeat_;}
+    int64_t sequence() const {return sequence_;}
+
+    // 重复定时器在每次到期后重新计算下一次到期时间
+    void restart(Timestamp now);
+
+private:
+    const TimerCallback callback_;
+    Timestamp expiration_;
+    const double interval_;     // 重复间隔，单位秒
+    const bool repeat_;
+    // 全局唯一序号：Timer地址可能被复用，TimerId靠地址+序号才能唯一确定一个定时器
+    const int64_t sequence_;
+
+    static std::atomic<int64_t> numCreated_;
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+class Timer;
+
+// 定时器的句柄，用于EventLoop::cancel()，可以随意拷贝
+class TimerId{
+public:
+    TimerId()
+        : timer_(nullptr)
+        , sequence_(0)
+    {
+    }
+    TimerId(Timer *timer, int64_t seq)
+        : timer_(timer)
+        , sequence_(seq)
+    {
+    }
+
+private:
+    friend class TimerQueue;
+
+    Timer *timer_;
+    int64_t sequence_;
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <set>
+#include <vector>
+#include <utility>
+#include <memory>
+
+#include "ads_noncopyable.h"
+#include "ads_Timestamp.h"
+#include "ads_Callbacks.h"
+#include "ads_Channel.h"
+
+class EventLoop;
+class Timer;
+class TimerId;
+
+/** 定时器队列，每个EventLoop一个
+ * 用timerfd把定时事件变成一个普通的可读fd，和其它Channel一起在epoll_wait中等待，
+ * timerfd始终设置为最早到期的那个定时器的时间。
+ * addTimer/cancel可以跨线程调用，真正修改队列都放到loop线程执行，所以不需要锁。
+ **/
+class TimerQueue : noncopyable{
+public:
+    explicit TimerQueue(EventLoop *loop);
+    ~TimerQueue();
+
+    // interval > 0 表示重复定时器
+    TimerId addTimer(TimerCallback cb, Timestamp when, double interval);
+    void cancel(TimerId timerId);
+
+private:
+    // 按到期时间排序，时间相同时用Timer地址区分
+    using Entry = std::pair<Timestamp, Timer *>;
+    using TimerList = std::set<Entry>;
+    // 按Timer地址+序号索引，用于cancel
+    using ActiveTimer = std::pair<Timer *, int64_t>;
+    using ActiveTimerSet = std::set<ActiveTimer>;
+
+    void addTimerInLoop(Timer *timer);
+    void cancelInLoop(TimerId timerId);
+    // timerfd可读时调用
+    void handleRead();
+    // 取出所有已到期的定时器
+    std::vector<Entry> getExpired(Timestamp now);
+    // 重复定时器重新入队，其它的删除，然后重设timerfd
+    void reset(const std::vector<Entry> &expired, Timestamp now);
+    // 插入定时器，返回它是否成为了最早到期的那个
+    bool insert(Timer *timer);
+
+    EventLoop *loop_;
+    const int timerfd_;
+    Channel timerfdChannel_;
+    TimerList timers_;
+
+    ActiveTimerSet activeTimers_;
+    bool callingExpiredTimers_;
+    // 定时器回调里取消自己（或其它同批到期的定时器）时记在这里，避免reset()把它重新加回去
+    ActiveTimerSet cancelingTimers_;
+};
@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <string>
+#include <stdint.h>
 
 class Timestamp{
 public:
@@ -9,9 +10,36 @@ public:
     // explicit 关键字防止构造函数被隐式转换调用，防止发生隐式转换带来的歧义问题。
     explicit Timestamp(int64_t microSecondsSinceEpoch);
     static Timestamp now();
+    // 无效时间戳，定时器等场景用它表示"没有"
+    static Timestamp invalid() {return Timestamp();}
     std::string toString() const;
+
+    int64_t microSecondsSinceEpoch() const {return microSecondsSinceEpoch_;}
+    bool valid() const {return microSecondsSinceEpoch_ > 0;}
+
+    static const int kMicroSecondsPerSecond = 1000 * 1000;
 private:
     // 它保存时间戳的值，表示从纪元以来的微秒数。
     // 使用 int64_t 类型是因为时间戳的值可能非常大，并且微秒级别的时间计算需要足够大的存储范围。
     int64_t microSecondsSinceEpoch_;
-};
\ No newline at end of file
+};
+
+inline bool operator<(Timestamp lhs, Timestamp rhs){
+    return lhs.microSecondsSinceEpoch() < rhs.microSecondsSinceEpoch();
+}
+
+inline bool operator==(Timestamp lhs, Timestamp rhs){
+    return lhs.microSecondsSinceEpoch() == rhs.microSecondsSinceEpoch();
+}
+
+// 两个时间点相差的秒数
+inline double timeDifference(Timestamp high, Timestamp low){
+    int64_t diff = high.microSecondsSinceEpoch() - low.microSecondsSinceEpoch();
+    return static_cast<double>(diff) / Timestamp::kMicroSecondsPerSecond;
+}
+
+// timestamp之后seconds秒的时间点
+inline Timestamp addTime(Timestamp timestamp, double seconds){
+    int64_t delta = static_cast<int64_t>(seconds * Timestamp::kMicroSecondsPerSecond);
+    return Timestamp(timestamp.microSecondsSinceEpoch() + delta);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "ads_noncopyable.h"
+
+class InetAddress;
+
+/** 令牌桶，用于限速；时间用monotonicNanos()
+ * 按GCRA的方式存放：不记令牌数，只记"桶被取空到哪个时刻"（tat_），取令牌就是把这个时刻往后推，
+ * 状态只有一个int64，取令牌是一次CAS，多个loop线程共用同一个桶时不加锁。
+ * tat_不晚于now表示桶是满的；now + burst之后的部分表示欠账。
+ **/
+class TokenBucket : noncopyable{
+public:
+    // rate: 每秒补充的令牌数；burst: 桶容量，即空闲之后一次最多能取多少，至少为1
+    TokenBucket(double rate, double burst);
+
+    double rate() const {return rate_;}
+    double burst() const {return burst_;}
+
+    // 桶是满的（很久没有取过）
+    bool full(int64_t nowNanos) const {return tat_.load(std::memory_order_relaxed) <= nowNanos;}
+    // 现在能取多少令牌，只看不取
+    double available(int64_t nowNanos) const;
+    // 还要等多少纳秒才有n个令牌（n超过burst时按burst算），0表示现在就有
+    int64_t waitNanos(double n, int64_t nowNanos) const;
+    // 取n个令牌，不够也取（记作欠账），返回还清欠账要等的纳秒数，0表示没有欠账
+    // 用于先用后付的场合：读到多少字节、处理了一个请求之后再扣
+    int64_t consume(double n, int64_t nowNanos);
+    // 够n个才取走，返回是否取到
+    bool tryConsume(double n, int64_t nowNanos);
+
+private:
+    const double rate_;
+    const double burst_;
+    const double nanosPerToken_;
+    const int64_t burstNanos_;
+    std::atomic<int64_t> tat_;
+};
+
+/** 按对端IP分配令牌桶：同一IP的所有连接（不管在哪个loop）共用一个桶，断开重连拿到的还是原来那个
+ * get()加锁，只在建立连接时调用；取到的桶本身是无锁的。
+ * 没有连接在用、而且已经补满的桶和新建的没有区别，表里的桶数翻倍时顺带清掉它们。
+ **/
+class PeerBuckets : noncopyable{
+public:
+    PeerBuckets(double rate, double burst);
+
+    // Unix域地址没有IP，所有连接共用一个桶
+    std::shared_ptr<TokenBucket> get(const InetAddress &peer);
+    size_t size() const;
+
+private:
+    void prune(int64_t nowNanos);
+
+    const double rate_;
+    const double burst_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<TokenBucket>> buckets_;
+    size_t pruneThreshold_;
+};
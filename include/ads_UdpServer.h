@@ -0,0 +1,67 @@
+#pragma once
+
+// UdpServer：每个loop一个绑定在同一端口上的UdpSocket（SO_REUSEPORT），内核按四元组哈希把数据报分给它们
+// 没有连接的概念，也就没有accept和跨线程的转交，回调直接在收到数据报的loop线程里执行
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <atomic>
+#include <vector>
+
+#include "ads_EventLoop.h"
+#include "ads_EventLoopThreadPool.h"
+#include "ads_InetAddress.h"
+#include "ads_UdpSocket.h"
+#include "ads_noncopyable.h"
+
+class UdpServer : noncopyable{
+public:
+    using ThreadInitCallback = std::function<void(EventLoop *)>;
+
+    UdpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg);
+    ~UdpServer();
+
+    // 以下设置都需在start()之前
+    void setThreadInitCallback(const ThreadInitCallback &cb) {threadInitCallback_ = cb;}
+    void setMessageCallback(const UdpSocket::MessageCallback &cb) {messageCallback_ = cb;}
+    // subloop个数，0表示只用baseloop
+    void setThreadNum(int numThreads) {threadPool_->setThreadNum(numThreads);}
+    // 每次recvmmsg/sendmmsg最多处理的数据报数，以及单个数据报的最大长度
+    void setBatch(int batch) {batch_ = batch;}
+    void setMaxDatagram(size_t maxDatagram) {maxDatagram_ = maxDatagram;}
+    // 内核支持时打开UDP GRO/GSO，不支持时输出日志后照常工作
+    void setGro(bool on) {gro_ = on;}
+    void setGso(bool on) {gso_ = on;}
+    // 内核收发缓冲区大小，0表示用系统默认值
+    void setBufferSize(int rcvbuf, int sndbuf) {rcvbuf_ = rcvbuf; sndbuf_ = sndbuf;}
+
+    // 在baseloop线程调用（baseloop可以还没开始loop()），仅第一次调用生效；返回时各loop的socket都已经绑定好并开始收
+    void start();
+
+    // 各loop的UdpSocket计数之和，perLoop不为空时按loop顺序给出每个socket的快照；start()之后任何线程都可以调用
+    UdpStats stats(std::vector<UdpStats> *perLoop = nullptr) const;
+    LoopMetrics loopMetrics(std::vector<LoopMetrics> *perLoop = nullptr) {return threadPool_->metrics(perLoop);}
+    // 实际绑定的地址，监听端口0时可以从这里取得端口
+    InetAddress localAddress() const;
+    const std::string &name() const {return name_;}
+
+private:
+    EventLoop *loop_;
+    const std::string name_;
+    const InetAddress listenAddr_;
+    std::shared_ptr<EventLoopThreadPool> threadPool_;
+
+    ThreadInitCallback threadInitCallback_;
+    UdpSocket::MessageCallback messageCallback_;
+    int batch_;
+    size_t maxDatagram_;
+    bool gro_;
+    bool gso_;
+    int rcvbuf_;
+    int sndbuf_;
+    std::atomic_int started_;
+
+    // start()之后不再变化，sockets_[i]只在它所属的loop线程里创建、使用和析构
+    std::vector<std::unique_ptr<UdpSocket>> sockets_;
+};
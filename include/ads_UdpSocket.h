@@ -0,0 +1,146 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "ads_noncopyable.h"
+#include "ads_Socket.h"
+#include "ads_Channel.h"
+#include "ads_InetAddress.h"
+#include "ads_Timestamp.h"
+
+class EventLoop;
+
+// UdpSocket计数的快照，可以跨多个socket累加
+struct UdpStats{
+    uint64_t received = 0;      // 交给上层的数据报数（GRO合并的包按拆开后的段计）
+    uint64_t receivedBytes = 0;
+    uint64_t recvCalls = 0;     // 至少收到一个数据报的recvmmsg调用数
+    uint64_t truncated = 0;     // 超过maxDatagram被截断而丢弃的数据报
+    uint64_t sent = 0;          // 已交给内核的数据报数（GSO合并的包按段计）
+    uint64_t sentBytes = 0;
+    uint64_t sendCalls = 0;     // 成功的sendmmsg调用数
+    uint64_t dropped = 0;       // 发送队列满或内核拒绝而丢弃的数据报
+
+    void merge(const UdpStats &other){
+        received += other.received;
+        receivedBytes += other.receivedBytes;
+        recvCalls += other.recvCalls;
+        truncated += other.truncated;
+        sent += other.sent;
+        sentBytes += other.sentBytes;
+        sendCalls += other.sendCalls;
+        dropped += other.dropped;
+    }
+};
+
+/** 挂在EventLoop上的非阻塞UDP socket
+ * 收：可读时用recvmmsg一次收一批，数据报落在预先分配好的一组槽位里（每个槽位maxDatagram字节），
+ *     槽位每批复用，回调拿到的指针只在回调期间有效；
+ * 发：send()只是追加到发送队列，读回调里产生的回复在这一批处理完后用sendmmsg一次发出；
+ *     读回调之外的发送打开写事件，下一轮poll时一起发出；内核发送缓冲区满时留在队列里等可写。
+ * 内核支持时可以打开GRO（收到的合并包按段拆开交给回调）和GSO（发往同一对端、长度相同的
+ * 相邻数据报合成一个sendmmsg条目，由内核或网卡分段）。
+ * 除stats()和send()外都只能在loop线程调用。
+ **/
+class UdpSocket : noncopyable{
+public:
+    // data只在回调期间有效
+    using MessageCallback = std::function<void(UdpSocket *, const char *data, size_t len,
+                                               const InetAddress &peer, Timestamp receiveTime)>;
+
+    static const int kDefaultBatch = 64;
+    static const size_t kDefaultMaxDatagram = 2048;
+    // 发送队列最多积压的数据报数，超出的直接丢弃并计入dropped
+    static const size_t kMaxPending = 65536;
+
+    // batch: 每次recvmmsg/sendmmsg最多处理的数据报数
+    // maxDatagram: 单个数据报的最大长度，超过的被截断并丢弃
+    UdpSocket(EventLoop *loop, const InetAddress &bindAddr, bool reuseport,
+              int batch = kDefaultBatch, size_t maxDatagram = kDefaultMaxDatagram);
+    ~UdpSocket();
+
+    void setMessageCallback(const MessageCallback &cb) {messageCallback_ = cb;}
+    // 打开UDP_GRO，内核不支持返回false；收缓冲区的槽位随之扩大到64KB
+    bool setGro(bool on);
+    // 发送时合并同一对端、长度相同的相邻数据报（UDP_SEGMENT），内核不支持返回false
+    bool setGso(bool on);
+    // 调整内核收发缓冲区大小（SO_RCVBUF/SO_SNDBUF），0表示不改
+    void setBufferSize(int rcvbuf, int sndbuf);
+
+    // 开始/停止监听可读事件
+    void start();
+    void stop();
+
+    // 任何线程都可以调用；别的线程调用时复制一份数据交给loop线程，此时要保证UdpSocket活得比这次投递久
+    void send(const InetAddress &peer, const void *data, size_t len);
+    // 立刻把发送队列交给内核
+    void flush();
+
+    // 计数用relaxed原子维护，任何线程都可以取快照
+    UdpStats stats() const;
+    EventLoop *getLoop() const {return loop_;}
+    int fd() const {return socket_.fd();}
+    const InetAddress &localAddress() const {return localAddr_;}
+
+private:
+    struct Pending{
+        sockaddr_in6 peer;  // 放得下IPv4和IPv6地址
+        socklen_t peerLen;
+        size_t offset;      // 在sendArena_中的位置
+        size_t len;
+    };
+
+    void handleRead(Timestamp receiveTime);
+    void handleWrite();
+    void sendInLoop(const sockaddr *peer, socklen_t peerLen, const void *data, size_t len);
+    // 把recv槽位按当前slotSize_重新分配
+    void resetRecvSlots();
+    // 从pending_[first]开始填sendMsgs_，返回条目数，groups_[i]记录第i个条目覆盖几个数据报
+    int buildSendBatch(size_t first);
+    // 丢掉已经发出的前n个数据报，剩下的移到队列开头
+    void consumePending(size_t n);
+    void updateWriting();
+
+    EventLoop *loop_;
+    Socket socket_;
+    Channel channel_;
+    InetAddress localAddr_;
+    MessageCallback messageCallback_;
+    const int batch_;
+    const size_t maxDatagram_;
+    size_t slotSize_;
+    bool gro_;
+    bool gso_;
+    bool inRead_;      // 正在handleRead里分发，回复先攒着，分发完一起发
+
+    // 收：batch_个槽位及其对应的iovec/地址/控制信息，每次recvmmsg复用
+    std::vector<char> recvSlots_;
+    std::vector<iovec> recvIovecs_;
+    std::vector<sockaddr_in6> recvAddrs_;
+    std::vector<mmsghdr> recvMsgs_;
+    std::vector<char> recvControl_;
+
+    // 发：数据首尾相接放在sendArena_里，pending_按顺序记录每个数据报
+    std::vector<char> sendArena_;
+    std::vector<Pending> pending_;
+    std::vector<iovec> sendIovecs_;
+    std::vector<mmsghdr> sendMsgs_;
+    std::vector<char> sendControl_;
+    std::vector<size_t> groups_;
+
+    std::atomic<uint64_t> received_;
+    std::atomic<uint64_t> receivedBytes_;
+    std::atomic<uint64_t> recvCalls_;
+    std::atomic<uint64_t> truncated_;
+    std::atomic<uint64_t> sent_;
+    std::atomic<uint64_t> sentBytes_;
+    std::atomic<uint64_t> sendCalls_;
+    std::atomic<uint64_t> dropped_;
+};
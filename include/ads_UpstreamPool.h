@@ -0,0 +1,85 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+
+#include "ads_noncopyable.h"
+#include "ads_InetAddress.h"
+#include "ads_Callbacks.h"
+#include "ads_StringPiece.h"
+
+class EventLoop;
+class Buffer;
+
+/** 到同一个上游的持久连接池，每个EventLoop一份，互不共享，所以发请求和收响应都不加锁
+ * 1. 选择：在本loop的健康连接里选在途请求最少的一条（least-outstanding）；
+ * 2. 管道化：一条连接上可以有多个在途请求，上游按顺序应答，
+ *    用FrameCodec从输入缓冲切出一个个响应，按FIFO与请求一一对应；
+ * 3. 健康剔除：连接断开、或最老的在途请求超时，就让它的在途请求全部失败，
+ *    强制关闭连接并由TcpClient重连，期间不再选中它；
+ * 4. 预热：start()时为每个loop建好connectionsPerLoop条连接，全部连上后调用ReadyCallback。
+ * 所有连接都满了时请求在本loop排队，队列也满了则立即失败。
+ * 析构/stop()要在这些loop退出之前进行。
+ **/
+class UpstreamPool : noncopyable{
+public:
+    // 从buf开头切出一个完整响应，返回其长度；不完整返回0
+    using FrameCodec = std::function<size_t(const Buffer *buf)>;
+    // ok为false表示请求失败（连接断开、超时、排队溢出），response只在回调期间有效
+    using ResponseCallback = std::function<void(bool ok, const StringPiece &response)>;
+    using ReadyCallback = std::function<void()>;
+
+    UpstreamPool(const std::vector<EventLoop *> &loops,
+                 const InetAddress &upstreamAddr,
+                 const std::string &name,
+                 int connectionsPerLoop);
+    ~UpstreamPool();
+
+    void setFrameCodec(const FrameCodec &codec) {codec_ = codec;}
+    void setReadyCallback(const ReadyCallback &cb) {readyCallback_ = cb;}
+    // 单条连接最多的在途请求数
+    void setMaxPipeline(int n) {maxPipeline_ = n;}
+    // 每个loop排队等待连接的请求数上限
+    void setMaxQueued(size_t n) {maxQueued_ = n;}
+    // 最老的在途请求超过这个时间没有应答，就剔除该连接；排队超过这个时间的请求以失败回调结束
+    void setRequestTimeout(double seconds) {requestTimeout_ = seconds;}
+
+    // 预热：每个loop发起connectionsPerLoop条连接
+    void start();
+    // 关闭所有连接，未完成的请求以失败回调结束。会等待各loop执行完毕，不要在这些loop线程里调用
+    void stop();
+
+    // 必须在某个池内loop的线程里调用，只使用该loop自己的连接
+    void call(const StringPiece &request, const ResponseCallback &cb);
+
+    // 本loop当前可用的连接数，只能在loop线程调用
+    int healthyConnections() const;
+    bool ready() const {return ready_;}
+
+private:
+    class LoopPool;
+
+    LoopPool *localPool() const;
+    void onConnectionUp();
+
+    const InetAddress upstreamAddr_;
+    const std::string name_;
+    const int connectionsPerLoop_;
+    FrameCodec codec_;
+    ReadyCallback readyCallback_;
+    int maxPipeline_;
+    size_t maxQueued_;
+    double requestTimeout_;
+
+    // 构造后只读，任何线程查找都不需要加锁
+    std::vector<std::unique_ptr<LoopPool>> pools_;
+    std::unordered_map<EventLoop *, LoopPool *> poolOfLoop_;
+
+    std::atomic_int connectedOnce_;     // 预热期间已连上的连接数
+    std::atomic_bool ready_;
+    bool started_;
+};
@@ -1,7 +1,12 @@
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <unistd.h>
+#include <stddef.h>
+#include <fcntl.h>
 #include <errno.h>
+#include <string.h>
 
 #include "ads_Acceptor.h"
 #include "ads_Logger.h"
@@ -9,15 +14,26 @@
 
 // 静态辅助函数 创建非阻塞的socket
 /* 创建socket：int socket(int domain, int type, int protocol);
- * AF_INET：使用 IPv4 地址族。
- * SOCK_STREAM：使用 TCP 协议（面向连接，可靠传输）。
+ * family：地址族，AF_INET 是 IPv4，AF_INET6 是 IPv6，AF_UNIX 是本机的Unix域socket。
+ * SOCK_STREAM：面向连接的字节流（IP地址族下就是 TCP）。
  * SOCK_NONBLOCK：将 socket 设置为非阻塞模式。
  * 非阻塞模式下，调用 accept()、read() 等操作如果没有数据，立即返回 EAGAIN 错误，而不是阻塞等待。
  * SOCK_CLOEXEC：在 fork() 执行 exec 时自动关闭 socket（防止文件描述符泄漏）。
- * IPPROTO_TCP：使用 TCP 协议。
+ * 0：由地址族决定协议，IP地址族下是 TCP，Unix域没有协议可选。
  */
-static int createNonblocking(){
-    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+// Unix域socket文件上还有进程在监听：能连上，或者对方的accept队列满了
+static bool unixListenerAlive(const InetAddress &addr){
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0){
+        return false;
+    }
+    bool alive = ::connect(fd, addr.getSockAddr(), addr.getSockLen()) == 0 || errno == EAGAIN;
+    ::close(fd);
+    return alive;
+}
+
+static int createNonblocking(sa_family_t family){
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if(sockfd < 0){
         /* LOG_FATAL 是一个宏或日志函数，输出致命级别的错误消息，并可能会终止程序。
          * __FILE__、__FUNCTION__、__LINE__ 分别表示：
@@ -33,19 +49,63 @@ static int createNonblocking(){
 
 Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport)
     : loop_(loop)
-    , acceptSocket_(createNonblocking())
+    , acceptSocket_(createNonblocking(listenAddr.family()))
     , acceptChannel_(loop, acceptSocket_.fd())
     , listenning_(false)
+    , acceptBatch_(16)
+    , idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC))
+    , unixInode_(0)
+    , accepted_(0)
+    , rejected_(0)
+    , batches_(0)
 {
+    for(auto &count : batchSizes_){
+        count.store(0, std::memory_order_relaxed);
+    }
     // 设置socket选项，SO_REUSEADDR表示允许重用 TIME_WAIT 状态的端口。常见于服务重启时，避免"地址已被占用"的问题。
     acceptSocket_.setReuseAddr(true);
     // 设置socket选项，SO_REUSEPORT表示允许多个 socket (进程/线程)绑定到同一个端口，用于负载均衡。
-    acceptSocket_.setReusePort(true);
+    // 只在调用者要求时打开，否则同一端口被重复绑定时不会报错，很难发现
+    acceptSocket_.setReusePort(reuseport);
+    // Unix域socket绑定在文件上，上次进程异常退出时留下的socket文件会让bind失败，先删掉。
+    // 只删没人监听的socket文件：路径写错指到普通文件时不能删，另一个服务器正在用时也不能抢过来，
+    // 这两种情况下不删，bind会失败
+    bool ownsUnixPath = false;
+    if(listenAddr.isUnixPath()){
+        std::string path = listenAddr.toIp();
+        struct stat st;
+        if(::lstat(path.c_str(), &st) != 0){
+            ownsUnixPath = true;
+        }
+        else if(!S_ISSOCK(st.st_mode)){
+            LOG_FATAL("Acceptor: %s exists and is not a socket\n", path.c_str());
+        }
+        else if(unixListenerAlive(listenAddr)){
+            LOG_FATAL("Acceptor: %s is in use by another listener\n", path.c_str());
+        }
+        else{
+            ::unlink(path.c_str());
+            ownsUnixPath = true;
+        }
+    }
     // 将 socket 绑定到指定的 IP 地址和端口。调用 bind() 系统调用。如果绑定失败，可能是由于地址被占用或权限不足。
     acceptSocket_.bindAddress(listenAddr);
+    // 确实绑定上了才记下文件和它的inode，析构时删除
+    if(ownsUnixPath){
+        sockaddr_un local;
+        socklen_t len = sizeof local;
+        struct stat st;
+        if(::getsockname(acceptSocket_.fd(), reinterpret_cast<sockaddr *>(&local), &len) == 0
+           && len > offsetof(sockaddr_un, sun_path) + 1
+           && ::lstat(listenAddr.toIp().c_str(), &st) == 0){
+            unixPath_ = listenAddr.toIp();
+            unixInode_ = st.st_ino;
+        }
+    }
     // TcpServer::start() => Acceptor.listen() 如果有新用户连接 要执行一个回调(accept()生成新的文件描述符 => connfd => 打包成Channel => 唤醒subloop)
     // baseloop监听到有事件发生 => acceptChannel_(listenfd) => 执行该回调函数
     acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
+    acceptChannel_.setNameCallback([](){ return std::string("acceptor"); });
 }
 
 Acceptor::~Acceptor(){
@@ -59,6 +119,13 @@ Acceptor::~Acceptor(){
      * 3. 防止事件“悬挂”
      * 如果不及时删除 socket，可能在 epoll_wait() 中出现无效事件，导致程序异常或 busy loop（空轮询）。
     */
+    ::close(idleFd_);
+    if(!unixPath_.empty()){
+        struct stat st;
+        if(::lstat(unixPath_.c_str(), &st) == 0 && S_ISSOCK(st.st_mode) && st.st_ino == unixInode_){
+            ::unlink(unixPath_.c_str());
+        }
+    }
 }
 
 void Acceptor::listen(){
@@ -75,30 +142,94 @@ void Acceptor::listen(){
      */
 }
 
+// 一次可读事件里循环accept，直到EAGAIN或达到acceptBatch_，连接风暴时不必每个连接都走一遍epoll_wait
+// 达到上限就先返回，让同一个loop上的其他连接也能得到处理，剩下的连接下一轮再接（水平触发）
 void Acceptor::handleRead(){
-    // InetAddress 是 muduo 封装的一个类，封装了IP 地址和端口号。
-    // accept() 系统调用会将客户端的 IP 和端口号写入 peerAddr。peerAddr 用于保存新连接客户端的地址信息。
-    InetAddress peerAddr; 
-    // 调用封装在 acceptSocket_（类型为 Socket）中的 .accept() 方法。.accept() 方法内部调用 accept() 系统调用，接受新的客户端连接。
-    // 如果连接成功，返回新的 socket 文件描述符（connfd）。如果失败，返回 -1，并设置 errno 表示错误原因。
-    int connfd = acceptSocket_.accept(&peerAddr);
+    int batch = 0;
+    for(int i = 0; i < acceptBatch_; ++i){
+        // InetAddress 是 muduo 封装的一个类，封装了IP 地址和端口号。
+        // accept() 系统调用会将客户端的 IP 和端口号写入 peerAddr。peerAddr 用于保存新连接客户端的地址信息。
+        InetAddress peerAddr;
+        // 调用封装在 acceptSocket_（类型为 Socket）中的 .accept() 方法。.accept() 方法内部调用 accept() 系统调用，接受新的客户端连接。
+        // 如果连接成功，返回新的 socket 文件描述符（connfd）。如果失败，返回 -1，并设置 errno 表示错误原因。
+        int connfd = acceptSocket_.accept(&peerAddr);
 
-    if(connfd >= 0){
-        if(NewConnectionCallback_){
-            // NewConnectionCallback_ 是用户在 Acceptor 中设置的回调函数。在 TcpServer 的构造函数中设置。
-            NewConnectionCallback_(connfd, peerAddr);
+        if(connfd >= 0){
+            ++batch;
+            if(NewConnectionCallback_){
+                // NewConnectionCallback_ 是用户在 Acceptor 中设置的回调函数。在 TcpServer 的构造函数中设置。
+                NewConnectionCallback_(connfd, peerAddr);
+            }
+            else{
+                // 如果未设置回调函数，说明上层未定义如何处理新连接。为避免文件描述符泄漏，直接关闭新连接。
+                ::close(connfd);
+            }
+            continue;
         }
-        else{
-            // 如果未设置回调函数，说明上层未定义如何处理新连接。为避免文件描述符泄漏，直接关闭新连接。
-            ::close(connfd);
+
+        int savedErrno = errno;
+        // 已经没有待接受的连接了
+        if(savedErrno == EAGAIN || savedErrno == EWOULDBLOCK){
+            break;
         }
-    }
-    else{
-        // 如果 accept() 返回 -1，输出错误日志。errno 表示具体的错误类型。
-        LOG_ERROR("%s:%s:%d accept error:%d\n", __FILE__, __FUNCTION__, __LINE__, errno);
-        // EMFILE 表示当前进程打开的文件描述符数量已达到上限。
-        if(errno == EMFILE){
+        // 对端在accept之前就断开了，或者被信号打断，继续接下一个
+        if(savedErrno == ECONNABORTED || savedErrno == EINTR || savedErrno == EPROTO){
+            continue;
+        }
+        // EMFILE 表示当前进程打开的文件描述符数量已达到上限，ENFILE 是整个系统达到上限
+        if(savedErrno == EMFILE || savedErrno == ENFILE){
             LOG_ERROR("%s:%s:%d sockfd reached limit\n", __FILE__, __FUNCTION__, __LINE__);
+            // 描述符耗尽时accept不管队列里有没有连接都会失败，拒绝不到连接说明队列已经空了
+            if(rejectOne()){
+                continue;
+            }
+            break;
+        }
+        // 其他错误输出日志，等下一次可读事件
+        LOG_ERROR("%s:%s:%d accept error:%d\n", __FILE__, __FUNCTION__, __LINE__, savedErrno);
+        break;
+    }
+
+    if(batch > 0){
+        accepted_.fetch_add(batch, std::memory_order_relaxed);
+        batches_.fetch_add(1, std::memory_order_relaxed);
+        int bucket = 0;
+        while(bucket < AcceptStats::kBatchBuckets - 1 && (batch >> (bucket + 1)) != 0){
+            ++bucket;
         }
-    }    
-}
\ No newline at end of file
+        batchSizes_[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// 关掉预留的描述符腾出一个位置，accept之后立刻关闭，对端会收到FIN，而不是一直挂在全连接队列里
+bool Acceptor::rejectOne(){
+    ::close(idleFd_);
+    int connfd = ::accept(acceptSocket_.fd(), nullptr, nullptr);
+    if(connfd >= 0){
+        ::close(connfd);
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+    }
+    idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    return connfd >= 0;
+}
+
+AcceptStats Acceptor::stats() const{
+    AcceptStats stats;
+    stats.accepted = accepted_.load(std::memory_order_relaxed);
+    stats.rejected = rejected_.load(std::memory_order_relaxed);
+    stats.batches = batches_.load(std::memory_order_relaxed);
+    for(int i = 0; i < AcceptStats::kBatchBuckets; ++i){
+        stats.batchSizes[i] = batchSizes_[i].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+InetAddress Acceptor::localAddress() const{
+    sockaddr_storage local;
+    ::memset(&local, 0, sizeof local);
+    socklen_t len = sizeof local;
+    if(::getsockname(acceptSocket_.fd(), reinterpret_cast<sockaddr *>(&local), &len) < 0){
+        LOG_ERROR("Acceptor::localAddress - getsockname fail errno=%d\n", errno);
+    }
+    return InetAddress(reinterpret_cast<const sockaddr *>(&local), len);
+}
@@ -1,9 +1,38 @@
 #include <errno.h>
 #include <sys/uio.h>
 #include <unistd.h>
+#include <algorithm>
 
 #include "ads_Buffer.h"
 
+const char Buffer::kCRLF[] = "\r\n";
+char Buffer::kEmptyStorage[Buffer::kCheapPrepend];
+
+void Buffer::shrink(size_t reserve){
+    size_t readable = readableBytes();
+    if(readable == 0 && reserve == 0){
+        freeStorage();
+        buffer_ = kEmptyStorage;
+        capacity_ = kCheapPrepend;
+        readerIndex_ = kCheapPrepend;
+        writerIndex_ = kCheapPrepend;
+        return;
+    }
+    size_t needed = kCheapPrepend + readable + reserve;
+    // 分级的块大小相邻两级最多差一倍，不到一半时换块不一定能换到更小的级别
+    if(!allocated() || needed * 2 > capacity_){
+        return;
+    }
+    size_t capacity = 0;
+    char *buffer = static_cast<char *>(MemoryPool::allocate(needed, &capacity));
+    ::memcpy(buffer + kCheapPrepend, peek(), readable);
+    freeStorage();
+    buffer_ = buffer;
+    capacity_ = capacity;
+    readerIndex_ = kCheapPrepend;
+    writerIndex_ = readerIndex_ + readable;
+}
+
 /* 从fd上读取数据 Poller工作在LT模式
  * Buffer的大小是预设的，但从fd读数据时不知道tcp数据最终大小
  * 
@@ -14,9 +43,10 @@
  *      提高性能：减少 syscall 的开销，在网络编程中提高吞吐量。
  */
 // saveErrno是指向errno的指针，用于存储deadv()失败时的错误码
-ssize_t Buffer::readFd(int fd, int *saveErrno){
+ssize_t Buffer::readFd(int fd, int *saveErrno, size_t maxBytes){
     // 栈上的额外空间，在buffer_扩容时暂存数据，65536/1024 = 64kB
-    char extrabuf[65536] = {0};
+    // 还没有分配存储的Buffer整个读进这里，再按实际读到的大小分配；不用清零，readv只会覆盖写入
+    char extrabuf[65536];
 
     /**
      * iovec 结构体用于 分散/聚集 I/O（Scatter/Gather I/O），可让 readv() 一次读取到多个缓冲区：
@@ -27,18 +57,19 @@ ssize_t Buffer::readFd(int fd, int *saveErrno){
      */
     // 分配两个连续的缓冲区
     struct iovec vec[2];
-    const size_t writeable = writeableBytes();
+    // 有读预算时两段加起来不超过maxBytes
+    const size_t writeable = maxBytes > 0 ? std::min(writeableBytes(), maxBytes) : writeableBytes();
 
     vec[0].iov_base = begin() + writerIndex_;
     vec[0].iov_len = writeable;
     vec[1].iov_base = extrabuf;
-    vec[1].iov_len = sizeof(extrabuf);
+    vec[1].iov_len = maxBytes > 0 ? std::min(sizeof(extrabuf), maxBytes - writeable) : sizeof(extrabuf);
 
     // when there is enough space in this buffer, don't read into extrabuf.
     // when extrabuf is used, we read 128k-1 bytes at most.
-    // 如果 Buffer 空间足够大（大于 extrabuf），只使用 vec[0]（iovcnt = 1）。
+    // 如果 Buffer 空间足够大（大于 extrabuf），或者预算在 Buffer 里就放得下，只使用 vec[0]（iovcnt = 1）。
     // 如果 Buffer 空间不够，就同时使用 vec[0] 和 vec[1]（iovcnt = 2）。
-    const int iovcnt = (writeable < sizeof(extrabuf) ? 2 : 1);
+    const int iovcnt = (writeable < sizeof(extrabuf) && vec[1].iov_len > 0 ? 2 : 1);
     // readv()从fd读入数据，依次存入vec[0]和vec[1]指定的缓冲区
     const ssize_t n = ::readv(fd, vec, iovcnt);
 
@@ -46,22 +77,23 @@ ssize_t Buffer::readFd(int fd, int *saveErrno){
         // 读数据错误
         *saveErrno = errno;
     }
-    else if(n <= writeable){
+    else if(static_cast<size_t>(n) <= writeable){
         // buffer_够大，直接放进buffer_更新writerIndex_
         writerIndex_ += n;
     }
     else{
         // buffer_不够大，先填满buffer_，更新writerIndex_
         // 再把多的数据暂存栈上的extrabuf，待Buffer扩容后，从extrabuf上append进Buffer
-        writerIndex_ = buffer_.size();
-        append(extrabuf, n - sizeof(extrabuf));
+        // 注意要追加的是超出buffer_可写部分的n - writeable字节
+        writerIndex_ = capacity_;
+        append(extrabuf, n - writeable);
     }
     return n;   //返回读取数据的字节数
     
 }
 
-ssize_t Buffer::writeFd(int fd, int *saveErrno){
-    ssize_t n = ::write(fd, peek(), readableBytes());
+ssize_t Buffer::writeFd(int fd, int *saveErrno, size_t maxBytes){
+    ssize_t n = ::write(fd, peek(), maxBytes > 0 ? std::min(readableBytes(), maxBytes) : readableBytes());
     if(n < 0){
         *saveErrno = errno;
     }
@@ -8,6 +8,42 @@ const int Channel::kNoneEvent = 0;  //空事件
 const int Channel::kReadEvent = EPOLLIN | EPOLLPRI; //读事件
 const int Channel::kWriteEvent = EPOLLOUT;  //写事件
 
+// 每条连接一个Channel，大小直接计入每条连接的内存，加成员之前先想想能不能放到别处
+static_assert(sizeof(void *) != 8 || sizeof(Channel) <= 64, "Channel grew past 64 bytes");
+
+class Channel::CallbackHandler : public ChannelHandler{
+public:
+    void handleRead(Timestamp receiveTime) override{
+        if(readCallback){
+            readCallback(receiveTime);
+        }
+    }
+    void handleWrite() override{
+        if(writeCallback){
+            writeCallback();
+        }
+    }
+    void handleClose() override{
+        if(closeCallback){
+            closeCallback();
+        }
+    }
+    void handleError() override{
+        if(errorCallback){
+            errorCallback();
+        }
+    }
+    std::string channelName() const override{
+        return nameCallback ? nameCallback() : std::string();
+    }
+
+    ReadEventCallback readCallback;
+    EventCallback writeCallback;
+    EventCallback closeCallback;
+    EventCallback errorCallback;
+    NameCallback nameCallback;
+};
+
 //
 Channel::Channel(EventLoop *loop, int fd)
     : loop_(loop)
@@ -15,6 +51,7 @@ Channel::Channel(EventLoop *loop, int fd)
     , events_(0)
     , revents_(0)
     , index_(-1)
+    , handler_(nullptr)
     , tied_(false)
 {    
 }
@@ -23,6 +60,20 @@ Channel::~Channel()
 {
 }
 
+Channel::CallbackHandler *Channel::callbacks(){
+    if(!callbacks_){
+        callbacks_.reset(new CallbackHandler);
+        handler_ = callbacks_.get();
+    }
+    return callbacks_.get();
+}
+
+void Channel::setReadCallback(ReadEventCallback cb) {callbacks()->readCallback = std::move(cb);}
+void Channel::setWriteCallback(EventCallback cb) {callbacks()->writeCallback = std::move(cb);}
+void Channel::setCloseCallback(EventCallback cb) {callbacks()->closeCallback = std::move(cb);}
+void Channel::setErrorCallback(EventCallback cb) {callbacks()->errorCallback = std::move(cb);}
+void Channel::setNameCallback(NameCallback cb) {callbacks()->nameCallback = std::move(cb);}
+
 // 
 /** 
  * TcpConnection中注册了Channel对应的回调函数，传入的回调函数均为TcpConnection对象
@@ -49,6 +100,40 @@ void Channel::remove(){
     loop_->removeChannel(this);
 }
 
+std::string Channel::name() const{
+    std::string name;
+    if(handler_ != nullptr){
+        name = handler_->channelName();
+    }
+    return name.empty() ? "fd=" + std::to_string(fd_) : name;
+}
+
+std::string Channel::reventsToString() const{
+    std::string s;
+    if(revents_ & EPOLLIN){
+        s += "IN ";
+    }
+    if(revents_ & EPOLLPRI){
+        s += "PRI ";
+    }
+    if(revents_ & EPOLLOUT){
+        s += "OUT ";
+    }
+    if(revents_ & EPOLLHUP){
+        s += "HUP ";
+    }
+    if(revents_ & EPOLLRDHUP){
+        s += "RDHUP ";
+    }
+    if(revents_ & EPOLLERR){
+        s += "ERR ";
+    }
+    if(!s.empty()){
+        s.pop_back();
+    }
+    return s;
+}
+
 void Channel::handleEvent(Timestamp receiveTime){
     if(tied_){
         std::shared_ptr<void> gurd = tie_.lock();
@@ -65,31 +150,25 @@ void Channel::handleEvent(Timestamp receiveTime){
 void Channel::handleEventWithGuard(Timestamp receiveTime){
     LOG_INFO("channel handleEvent revent:%d\n", revents_);
 
+    if(handler_ == nullptr){
+        return;
+    }
     // 语法： &是按位与运算，revents_ & EPOLLHUP表示判断revents_是否包含EPOLLHUP事件
-    //       if(closeCallback_)检查回调函数是否有效
     // 关闭
     if((revents_ & EPOLLHUP) && !(revents_ & EPOLLIN)){
         //EPOLLHUP表示fd被挂起，当TcpConnection对应Channel 通过shutdown 关闭写端 epoll触发EPOLLHUP
-        if(closeCallback_){
-            closeCallback_();
-        }
+        handler_->handleClose();
     }
     // 错误
     if(revents_ & EPOLLERR){
-        if(errorCallback_){
-            errorCallback_();
-        }
+        handler_->handleError();
     }
     // 读
     if(revents_ & (EPOLLIN | EPOLLPRI)){
-        if(readCallback_){
-            readCallback_(receiveTime);
-        }
+        handler_->handleRead(receiveTime);
     }
     // 写
     if(revents_ & EPOLLOUT){
-        if(writeCallback_){
-            writeCallback_();
-        }
+        handler_->handleWrite();
     }
 }
\ No newline at end of file
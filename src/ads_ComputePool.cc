@@ -0,0 +1,205 @@
+#include <stdio.h>
+
+#include "ads_ComputePool.h"
+#include "ads_Thread.h"
+#include "ads_CurrentThread.h"
+#include "ads_Logger.h"
+
+namespace
+{
+// 当前线程所属的ComputePool和它在其中的下标，不是工作线程时为nullptr
+thread_local ComputePool *t_pool = nullptr;
+thread_local size_t t_index = 0;
+
+// Strand一次最多连续执行的任务数，之后重新排队，不让一条连接长期占住一个工作线程
+const int kStrandBatch = 16;
+}
+
+struct ComputePool::Worker{
+    std::mutex mutex;
+    std::deque<Task> tasks;             // 尾部是自己刚放进去的，偷取从头部拿
+    std::unique_ptr<Thread> thread;
+    std::atomic<uint64_t> executed{0};
+    std::atomic<uint64_t> steals{0};
+};
+
+void ComputePool::Strand::run(Task task){
+    bool schedule = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(task));
+        if(!running_){
+            running_ = true;
+            schedule = true;
+        }
+    }
+    if(schedule){
+        std::shared_ptr<Strand> self = shared_from_this();
+        pool_->run([self](){ self->drain(); });
+    }
+}
+
+void ComputePool::Strand::drain(){
+    for(int i = 0; i < kStrandBatch; ++i){
+        Task task;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if(tasks_.empty()){
+                running_ = false;
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+    // 还有任务，running_保持true，重新排到池里，顺序不变
+    std::shared_ptr<Strand> self = shared_from_this();
+    pool_->run([self](){ self->drain(); });
+}
+
+ComputePool::ComputePool(const std::string &name)
+    : name_(name)
+    , numThreads_(0)
+    , next_(0)
+    , pending_(0)
+    , sleepers_(0)
+    , stopping_(false)
+    , started_(false)
+{
+}
+
+ComputePool::~ComputePool(){
+    stop();
+}
+
+void ComputePool::start(){
+    if(started_){
+        return;
+    }
+    started_ = true;
+    // 先把所有队列建好再启动线程，偷取时workers_不会再变化
+    for(int i = 0; i < numThreads_; ++i){
+        workers_.emplace_back(new Worker);
+    }
+    for(int i = 0; i < numThreads_; ++i){
+        char buf[name_.size() + 32];
+        snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i);
+        workers_[i]->thread.reset(new Thread(std::bind(&ComputePool::threadFunc, this, static_cast<size_t>(i)), buf));
+        workers_[i]->thread->start();
+    }
+}
+
+void ComputePool::stop(){
+    if(!started_ || stopping_){
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        stopping_ = true;
+    }
+    sleepCond_.notify_all();
+    for(const auto &worker : workers_){
+        worker->thread->join();
+    }
+}
+
+ComputePool::StrandPtr ComputePool::makeStrand(){
+    return StrandPtr(new Strand(this));
+}
+
+void ComputePool::run(Task task){
+    // 没有工作线程或者已经停止，就地执行
+    if(workers_.empty() || stopping_){
+        task();
+        return;
+    }
+    size_t index = t_pool == this ? t_index : next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    push(index, std::move(task));
+}
+
+void ComputePool::push(size_t index, Task task){
+    Worker &worker = *workers_[index];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back(std::move(task));
+    }
+    // 先加pending_再看sleepers_，工作线程先加sleepers_再看pending_，两边至少有一方看到对方
+    pending_.fetch_add(1);
+    if(sleepers_.load() > 0){
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        sleepCond_.notify_one();
+    }
+}
+
+bool ComputePool::takeTask(size_t index, Task *task){
+    Worker &self = *workers_[index];
+    {
+        std::lock_guard<std::mutex> lock(self.mutex);
+        if(!self.tasks.empty()){
+            *task = std::move(self.tasks.back());
+            self.tasks.pop_back();
+            pending_.fetch_sub(1);
+            return true;
+        }
+    }
+    // 自己的队列空了，从下一个开始依次偷
+    for(size_t i = 1; i < workers_.size(); ++i){
+        Worker &victim = *workers_[(index + i) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if(!victim.tasks.empty()){
+            *task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            pending_.fetch_sub(1);
+            self.steals.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ComputePool::threadFunc(size_t index){
+    t_pool = this;
+    t_index = index;
+    if(!cpus_.empty()){
+        int cpu = cpus_[index % cpus_.size()];
+        if(!CurrentThread::bindToCpu(cpu)){
+            LOG_ERROR("ComputePool %s - bind worker %zu to cpu %d failed\n", name_.c_str(), index, cpu);
+        }
+    }
+
+    Worker &self = *workers_[index];
+    while(true){
+        Task task;
+        if(takeTask(index, &task)){
+            task();
+            self.executed.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        // 停止时也要先把剩下的任务做完
+        if(stopping_ && pending_.load() == 0){
+            break;
+        }
+        sleepers_.fetch_add(1);
+        sleepCond_.wait(lock, [this](){ return pending_.load() > 0 || stopping_; });
+        sleepers_.fetch_sub(1);
+    }
+    t_pool = nullptr;
+}
+
+uint64_t ComputePool::executed() const{
+    uint64_t n = 0;
+    for(const auto &worker : workers_){
+        n += worker->executed.load(std::memory_order_relaxed);
+    }
+    return n;
+}
+
+uint64_t ComputePool::steals() const{
+    uint64_t n = 0;
+    for(const auto &worker : workers_){
+        n += worker->steals.load(std::memory_order_relaxed);
+    }
+    return n;
+}
@@ -0,0 +1,214 @@
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
+#include "ads_Connector.h"
+#include "ads_Channel.h"
+#include "ads_EventLoop.h"
+#include "ads_Logger.h"
+
+// 与Acceptor中的同名函数一样：按地址族创建非阻塞、exec时关闭的流式socket（IP地址族下是TCP）
+static int createNonblocking(sa_family_t family){
+    int sockfd = ::socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(sockfd < 0){
+        LOG_FATAL("%s:%s:%d connect socket create error:%d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+// 非阻塞connect的结果要通过SO_ERROR取得
+static int getSocketError(int sockfd){
+    int optval;
+    socklen_t optlen = sizeof optval;
+    if(::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0){
+        return errno;
+    }
+    return optval;
+}
+
+// 连本机端口时，如果服务端没起来，内核可能把客户端的临时端口分配成目标端口，自己连上自己
+// Unix域socket没有临时端口，不会自连
+static bool isSelfConnect(int sockfd){
+    sockaddr_storage local;
+    sockaddr_storage peer;
+    socklen_t addrlen = sizeof(local);
+    ::memset(&local, 0, sizeof local);
+    ::memset(&peer, 0, sizeof peer);
+    if(::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0){
+        return false;
+    }
+    addrlen = sizeof(peer);
+    if(::getpeername(sockfd, (sockaddr *)&peer, &addrlen) < 0){
+        return false;
+    }
+    if(local.ss_family == AF_INET){
+        const sockaddr_in *l = (const sockaddr_in *)&local;
+        const sockaddr_in *p = (const sockaddr_in *)&peer;
+        return l->sin_port == p->sin_port && l->sin_addr.s_addr == p->sin_addr.s_addr;
+    }
+    if(local.ss_family == AF_INET6){
+        const sockaddr_in6 *l = (const sockaddr_in6 *)&local;
+        const sockaddr_in6 *p = (const sockaddr_in6 *)&peer;
+        return l->sin6_port == p->sin6_port && ::memcmp(&l->sin6_addr, &p->sin6_addr, sizeof l->sin6_addr) == 0;
+    }
+    return false;
+}
+
+Connector::Connector(EventLoop *loop, const InetAddress &serverAddr)
+    : loop_(loop)
+    , serverAddr_(serverAddr)
+    , connect_(false)
+    , state_(kDisconnected)
+    , initRetryDelayMs_(kInitRetryDelayMs)
+    , retryDelayMs_(kInitRetryDelayMs)
+    , maxRetryDelayMs_(kMaxRetryDelayMs)
+    , random_(static_cast<unsigned>(Timestamp::now().microSecondsSinceEpoch()) ^ static_cast<unsigned>(reinterpret_cast<uintptr_t>(this)))
+{
+    LOG_DEBUG("Connector ctor[%p]\n", this);
+}
+
+Connector::~Connector(){
+    LOG_DEBUG("Connector dtor[%p]\n", this);
+}
+
+void Connector::start(){
+    connect_ = true;
+    loop_->runInLoop(std::bind(&Connector::startInLoop, shared_from_this()));
+}
+
+void Connector::startInLoop(){
+    if(connect_){
+        connect();
+    }
+    else{
+        LOG_DEBUG("Connector::startInLoop do not connect\n");
+    }
+}
+
+void Connector::stop(){
+    connect_ = false;
+    loop_->queueInLoop(std::bind(&Connector::stopInLoop, shared_from_this()));
+}
+
+void Connector::stopInLoop(){
+    loop_->cancel(retryTimer_);
+    if(state_ == kConnecting){
+        setState(kDisconnected);
+        int sockfd = removeAndResetChannel();
+        ::close(sockfd);
+    }
+}
+
+void Connector::restart(){
+    setState(kDisconnected);
+    retryDelayMs_ = initRetryDelayMs_;
+    connect_ = true;
+    startInLoop();
+}
+
+void Connector::connect(){
+    int sockfd = createNonblocking(serverAddr_.family());
+    int ret = ::connect(sockfd, serverAddr_.getSockAddr(), serverAddr_.getSockLen());
+    int savedErrno = (ret == 0) ? 0 : errno;
+    switch(savedErrno){
+        // 连接成功或正在进行，等EPOLLOUT
+        case 0:
+        case EINPROGRESS:
+        case EINTR:
+        case EISCONN:
+            connecting(sockfd);
+            break;
+
+        // 暂时性错误，稍后重试
+        case EAGAIN:
+        case EADDRINUSE:
+        case EADDRNOTAVAIL:
+        case ECONNREFUSED:
+        case ENETUNREACH:
+            retry(sockfd);
+            break;
+
+        // 参数或权限错误，重试也没用
+        default:
+            LOG_ERROR("Connector::connect error:%d to %s\n", savedErrno, serverAddr_.toIpPort().c_str());
+            ::close(sockfd);
+            break;
+    }
+}
+
+void Connector::connecting(int sockfd){
+    setState(kConnecting);
+    channel_.reset(new Channel(loop_, sockfd));
+    channel_->setWriteCallback(std::bind(&Connector::handleWrite, this));
+    channel_->setErrorCallback(std::bind(&Connector::handleError, this));
+    // 非阻塞connect完成（成功或失败）时socket变为可写
+    channel_->enableWriting();
+}
+
+// Channel只负责connect阶段，连接建立后sockfd交给TcpConnection，由它创建自己的Channel
+int Connector::removeAndResetChannel(){
+    channel_->disableALL();
+    channel_->remove();
+    int sockfd = channel_->fd();
+    // 此时还在Channel::handleEvent里，不能直接释放channel_，放到本轮事件处理完之后
+    loop_->queueInLoop(std::bind(&Connector::resetChannel, shared_from_this()));
+    return sockfd;
+}
+
+void Connector::resetChannel(){
+    channel_.reset();
+}
+
+void Connector::handleWrite(){
+    if(state_ == kConnecting){
+        int sockfd = removeAndResetChannel();
+        int err = getSocketError(sockfd);
+        if(err){
+            LOG_ERROR("Connector::handleWrite - SO_ERROR = %d %s\n", err, strerror(err));
+            retry(sockfd);
+        }
+        else if(isSelfConnect(sockfd)){
+            LOG_ERROR("Connector::handleWrite - Self connect\n");
+            retry(sockfd);
+        }
+        else{
+            setState(kConnected);
+            if(connect_ && newConnectionCallback_){
+                newConnectionCallback_(sockfd);
+            }
+            else{
+                ::close(sockfd);
+            }
+        }
+    }
+}
+
+void Connector::handleError(){
+    LOG_ERROR("Connector::handleError state=%d\n", state_);
+    if(state_ == kConnecting){
+        int sockfd = removeAndResetChannel();
+        int err = getSocketError(sockfd);
+        LOG_ERROR("Connector::handleError - SO_ERROR = %d %s\n", err, strerror(err));
+        retry(sockfd);
+    }
+}
+
+// 指数退避 + 抖动：实际等待时间在[delay/2, delay]之间随机
+void Connector::retry(int sockfd){
+    ::close(sockfd);
+    setState(kDisconnected);
+    if(connect_){
+        int half = retryDelayMs_ / 2;
+        int delayMs = half + static_cast<int>(random_() % static_cast<unsigned>(retryDelayMs_ - half + 1));
+        LOG_INFO("Connector::retry - Retry connecting to %s in %d milliseconds.\n",
+                 serverAddr_.toIpPort().c_str(), delayMs);
+        retryTimer_ = loop_->runAfter(delayMs / 1000.0,
+                                      std::bind(&Connector::startInLoop, shared_from_this()));
+        retryDelayMs_ = std::min(retryDelayMs_ * 2, maxRetryDelayMs_);
+    }
+    else{
+        LOG_DEBUG("Connector::retry do not connect\n");
+    }
+}
@@ -1,3 +1,6 @@
+#include <pthread.h>
+#include <sched.h>
+
 #include "ads_CurrentThread.h"
 
 namespace CurrentThread{
@@ -13,4 +16,19 @@ namespace CurrentThread{
             // 将tid缓存到t_cachedTid中，系统调用获取 tid 的代价高，缓存后可以在后续调用中直接返回，避免重复系统调用，提升性能。
         }
     }
-}
\ No newline at end of file
+
+    bool bindToCpu(int cpu){
+        if(cpu < 0 || cpu >= CPU_SETSIZE){
+            return false;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return ::pthread_setaffinity_np(::pthread_self(), sizeof set, &set) == 0;
+    }
+
+    int cpu(){
+        // glibc走vDSO，不陷入内核
+        return ::sched_getcpu();
+    }
+}
@@ -3,11 +3,15 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <memory>
+#include <algorithm>
+#include <iterator>
+#include <stdio.h>
 
 #include "ads_EventLoop.h"
 #include "ads_Logger.h"
 #include "ads_Channel.h"
 #include "ads_Poller.h"
+#include "ads_TimerQueue.h"
 
 // __thread 是 GCC 和 Clang 支持的线程局部存储（TLS）机制,每个线程都有一个独立的 t_loopInThisThread 变量，互不干扰。
 // 通过 __thread 限制每个线程只能拥有一个 EventLoop 实例。one loop per thread
@@ -16,6 +20,12 @@ __thread EventLoop *t_loopInThisThread = nullptr;
 // 定义默认的Poller IO复用接口的超时时间 10s
 const int kPollTimeMs = 10000;
 
+// 忙碌时间统计窗口 100ms，窗口越短越灵敏，但抖动也越大
+const int64_t kBusyWindowMicros = 100 * 1000;
+
+// 慢回调阈值（纳秒），所有loop共用
+std::atomic<int64_t> g_slowHandlerNanos(50 * 1000 * 1000);
+
 /* 创建线程之后主线程和子线程谁先运行是不确定的。
  * 通过一个eventfd在线程之间传递数据的好处是多个线程无需上锁就可以实现同步。
  * eventfd 是 Linux 提供的用于线程或进程间通信的机制。它创建了一个文件描述符，允许通过写入和读取进行事件通知
@@ -44,12 +54,25 @@ int createEventfd(){
 EventLoop::EventLoop()
     : looping_(false)
     , quit_(false)
-    , callingPendingFunctors_(false)
     , threadId_(CurrentThread::tid())
     , poller_(Poller::newDefaultPoller(this))
+    , timerQueue_(new TimerQueue(this))
     , wakeupFd_(createEventfd())                    //创建 eventfd，用于跨线程通信
     , wakeupChannel_(new Channel(this, wakeupFd_))  //封装 eventfd，便于在 Poller 中监听事件
+    , callingPendingFunctors_(false)
+    , carriedFunctors_(0)
+    , functorBudgetTasks_(0)
+    , functorBudgetNanos_(0)
+    , iterationBeginNanos_(0)
+    , readsThisIteration_(0)
+    , busyWindowStart_(Timestamp::now())
+    , busyWindowMicros_(0)
 {
+    metrics_.loops = 1;
+    publishedMetrics_.loops = 1;
+    for(int i = 0; i < kNumPriorities; ++i){
+        readyHead_[i] = 0;
+    }
     LOG_DEBUG("EventLoop created %p in thread %d\n", this, threadId_);
     // 如果当前线程已存在 EventLoop，直接报错退出。如果当前线程没有 EventLoop，将当前对象记录在 t_loopInThisThread。
     // 保证每个线程最多只能存在一个 EventLoop。
@@ -81,17 +104,33 @@ void EventLoop::loop(){
     looping_ = true;
     quit_ = false;
 
-    LOG_INFO("EventLoop %p star looping\n", this);
+    load_.cpu.store(CurrentThread::cpu(), std::memory_order_relaxed);
+    LOG_INFO("EventLoop %p star looping on cpu %d\n", this, cpu());
 
+    iterationEnd_ = Timestamp::now();
     while(!quit_){
         // 每次循环开始前，清空上一轮出发的事件列表。防止脏数据干扰本轮事件处理
         activeChannels_.clear();
-        // 等待内核返回已触发的IO事件，超时事件为10s
-        pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
-        // 遍历所有活跃Channel
+        // 等待内核返回已触发的IO事件，超时事件为10s；上一轮有任务或推迟的读因为预算留下时不等待，只取已经就绪的事件
+        pollReturnTime_ = poller_->poll(carriedFunctors_ > 0 || !readyReads_.empty() ? 0 : kPollTimeMs, &activeChannels_);
+        // 上一轮结束到poll返回基本都耗在epoll_wait里，不再单独取一次时间
+        metrics_.pollWaitMicros += pollReturnTime_.microSecondsSinceEpoch() - iterationEnd_.microSecondsSinceEpoch();
+        metrics_.events += activeChannels_.size();
+        metrics_.maxEvents = std::max<uint64_t>(metrics_.maxEvents, activeChannels_.size());
+        iterationBeginNanos_ = monotonicNanos();
+        readsThisIteration_ = 0;
+        // 上一轮推迟的读等得最久，先于本轮新就绪的Channel
+        if(!readyReads_.empty()){
+            doReadyReads();
+        }
+        // 遍历所有活跃Channel，前一个回调的结束时间就是下一个的开始时间，每个Channel只读一次时钟
+        int64_t begin = monotonicNanos();
         for(Channel *channel : activeChannels_){
             // 调用channel->handleEvent()处理具体事件
             channel->handleEvent(pollReturnTime_);
+            int64_t end = monotonicNanos();
+            recordHandler(channel, end - begin);
+            begin = end;
         }
         // 调用doPendingFunctors()执行其他线程提交的异步任务
         /**
@@ -103,7 +142,13 @@ void EventLoop::loop(){
          * wakeup()通过eventfd触发事件，促使epoll_wait()立即返回
          **/
         doPendingFunctors();
+        // 事件和异步任务里攒下的写在这里统一发出
+        doBeforePollFunctors();
+        // 从poll返回到这里都算忙碌时间
+        ++metrics_.iterations;
+        updateBusyTime(pollReturnTime_);
     }
+    publishMetrics();
     LOG_INFO("EventLoop %p stop looping.\n", this);
     looping_ = false;
 }
@@ -152,23 +197,33 @@ void EventLoop::handleRead(){
     if(n != sizeof(one)){
         LOG_ERROR("EventLoop::handleRead() reads %lu bytes instead of 8\n", n);
     }
+    else{
+        // eventfd计数器的值就是上次读之后wakeup()的次数
+        metrics_.wakeups += one;
+    }
 }
 
 // 在当前loop中执行cb
-void EventLoop::runInLoop(Functor cb){
+void EventLoop::runInLoop(Functor cb, Priority priority){
     if(isInLoopThread()){   //在当前EventLoop中执行回调
         cb();
     }
     else{
-        queueInLoop(cb);    //在非当前EventLoop的线程中执行cb，需要唤醒Eventloop所在线程执行cb
+        queueInLoop(std::move(cb), priority);    //在非当前EventLoop的线程中执行cb，需要唤醒Eventloop所在线程执行cb
     }
 }
 
 // 把cb放入队列 唤醒loop所在线程执行cb
-void EventLoop::queueInLoop(Functor cb){
+void EventLoop::queueInLoop(Functor cb, Priority priority){
+    Task task{std::move(cb), monotonicNanos()};
     {
         std::unique_lock<std::mutex> lock(mutex_);   //加锁保证线程安全
-        pendingFunctors_.emplace_back(cb);  //将任务加入新队列
+        pendingFunctors_[priority].push_back(std::move(task));  //将任务加入新队列
+        size_t depth = carriedFunctors_;
+        for(int i = 0; i < kNumPriorities; ++i){
+            depth += pendingFunctors_[i].size();
+        }
+        load_.queueDepth.store(static_cast<int>(depth), std::memory_order_relaxed);
     }
     // || callingPendingFunctors_：当前线程在执行其他任务（即在 doPendingFunctors() 中执行任务）。
     // 如果在这个过程中有新的任务加入，queueInLoop() 仍然会触发 wakeup()，让 epoll_wait() 立即返回。这样下一个事件循环就会立刻执行新任务。
@@ -177,6 +232,55 @@ void EventLoop::queueInLoop(Functor cb){
     }
 }
 
+void EventLoop::setFunctorBudget(size_t maxTasks, int64_t maxMicros){
+    functorBudgetTasks_.store(maxTasks, std::memory_order_relaxed);
+    functorBudgetNanos_.store(maxMicros * 1000, std::memory_order_relaxed);
+}
+
+void EventLoop::runBeforePoll(Functor cb){
+    beforePollFunctors_.emplace_back(std::move(cb));
+}
+
+void EventLoop::queueReadyRead(Functor cb){
+    readyReads_.emplace_back(std::move(cb));
+}
+
+bool EventLoop::admitRead(int64_t budgetNanos){
+    if(budgetNanos > 0 && readsThisIteration_ > 0 && monotonicNanos() - iterationBeginNanos_ >= budgetNanos){
+        return false;
+    }
+    ++readsThisIteration_;
+    return true;
+}
+
+void EventLoop::doReadyReads(){
+    // 执行期间再登记的进新的readyReads_，留到下一轮
+    std::vector<Functor> functors;
+    functors.swap(readyReads_);
+    for(const Functor &functor : functors){
+        functor();
+    }
+    metrics_.readyReads += functors.size();
+}
+
+TimerId EventLoop::runAt(Timestamp time, TimerCallback cb){
+    return timerQueue_->addTimer(std::move(cb), time, 0.0);
+}
+
+TimerId EventLoop::runAfter(double delay, TimerCallback cb){
+    Timestamp time(addTime(Timestamp::now(), delay));
+    return runAt(time, std::move(cb));
+}
+
+TimerId EventLoop::runEvery(double interval, TimerCallback cb){
+    Timestamp time(addTime(Timestamp::now(), interval));
+    return timerQueue_->addTimer(std::move(cb), time, interval);
+}
+
+void EventLoop::cancel(TimerId timerId){
+    timerQueue_->cancel(timerId);
+}
+
 // EventLooop 的方法 => Poller 的方法
 void EventLoop::updateChannel(Channel *channel){
     poller_->updateChannel(channel);
@@ -188,32 +292,208 @@ bool EventLoop::hasChannel(Channel *channel){
     return poller_->hasChannel(channel);
 }
 
+void EventLoop::updateBusyTime(Timestamp busyBegin){
+    Timestamp now = Timestamp::now();
+    int64_t busy = now.microSecondsSinceEpoch() - busyBegin.microSecondsSinceEpoch();
+    busyWindowMicros_ += busy;
+    metrics_.busyMicros += busy;
+    iterationEnd_ = now;
+    int64_t window = now.microSecondsSinceEpoch() - busyWindowStart_.microSecondsSinceEpoch();
+    // 空闲的loop会在poll里等很久，醒来时窗口已经很长，算出来的占比自然很低
+    if(window >= kBusyWindowMicros){
+        int permille = static_cast<int>(std::min<int64_t>(busyWindowMicros_ * 1000 / window, 1000));
+        load_.busyPermille.store(permille, std::memory_order_relaxed);
+        load_.cpu.store(CurrentThread::cpu(), std::memory_order_relaxed);
+        busyWindowStart_ = now;
+        busyWindowMicros_ = 0;
+        publishMetrics();
+    }
+}
+
+void EventLoop::publishMetrics(){
+    std::lock_guard<std::mutex> lock(metricsMutex_);
+    publishedMetrics_ = metrics_;
+    publishedHistograms_ = histograms_;
+}
+
+LoopMetrics EventLoop::metrics() const{
+    std::lock_guard<std::mutex> lock(metricsMutex_);
+    return publishedMetrics_;
+}
+
+LoopHistograms EventLoop::histograms() const{
+    std::lock_guard<std::mutex> lock(metricsMutex_);
+    return publishedHistograms_;
+}
+
+void EventLoop::setSlowHandlerThreshold(int64_t micros){
+    g_slowHandlerNanos.store(micros * 1000, std::memory_order_relaxed);
+}
+
+void EventLoop::recordHandler(Channel *channel, int64_t nanos){
+    histograms_.handlers.record(nanos);
+    int64_t threshold = g_slowHandlerNanos.load(std::memory_order_relaxed);
+    if(threshold > 0 && nanos >= threshold){
+        // 回调结束后Channel还在：连接的销毁总是queueInLoop到本轮的doPendingFunctors里
+        LOG_ERROR("EventLoop %p slow handler %.3fms [%s] events %s\n",
+                  this, nanos / 1e6, channel->name().c_str(), channel->reventsToString().c_str());
+    }
+}
+
+void LoopMetrics::merge(const LoopMetrics &other){
+    loops += other.loops;
+    iterations += other.iterations;
+    pollWaitMicros += other.pollWaitMicros;
+    busyMicros += other.busyMicros;
+    events += other.events;
+    maxEvents = std::max(maxEvents, other.maxEvents);
+    functors += other.functors;
+    functorDrains += other.functorDrains;
+    functorMicros += other.functorMicros;
+    maxFunctorBatch = std::max(maxFunctorBatch, other.maxFunctorBatch);
+    functorBudgetHits += other.functorBudgetHits;
+    functorsCarried += other.functorsCarried;
+    queueAgeMicros += other.queueAgeMicros;
+    maxQueueAgeMicros = std::max(maxQueueAgeMicros, other.maxQueueAgeMicros);
+    readyReads += other.readyReads;
+    wakeups += other.wakeups;
+}
+
+std::string LoopMetrics::toString() const{
+    uint64_t total = pollWaitMicros + busyMicros;
+    char buf[512];
+    snprintf(buf, sizeof buf,
+             "loops=%llu iterations=%llu busy=%.1f%% poll_wait_us=%llu busy_us=%llu"
+             " events=%llu (%.2f/iter, max %llu) functors=%llu in %llu drains (max %llu, %llu us)"
+             " queue_age=%.1fus (max %llu us) budget_hits=%llu carried=%llu ready_reads=%llu wakeups=%llu",
+             (unsigned long long)loops, (unsigned long long)iterations,
+             total == 0 ? 0.0 : busyMicros * 100.0 / total,
+             (unsigned long long)pollWaitMicros, (unsigned long long)busyMicros,
+             (unsigned long long)events, iterations == 0 ? 0.0 : static_cast<double>(events) / iterations,
+             (unsigned long long)maxEvents, (unsigned long long)functors, (unsigned long long)functorDrains,
+             (unsigned long long)maxFunctorBatch, (unsigned long long)functorMicros,
+             functors == 0 ? 0.0 : static_cast<double>(queueAgeMicros) / functors, (unsigned long long)maxQueueAgeMicros,
+             (unsigned long long)functorBudgetHits, (unsigned long long)functorsCarried,
+             (unsigned long long)readyReads, (unsigned long long)wakeups);
+    return buf;
+}
+
 void EventLoop::doPendingFunctors(){
-    // 创建一个临时vector容器来存储执行的回调任务
-    std::vector<Functor> functors;
     // 标志位，表示当前正在执行回调函数，防止其他线程并发修改pendingFunctors_
     callingPendingFunctors_ = true;
 
     {
         // 临界区的作用域为 {} 内部，出了作用域后自动释放锁，减少锁的持有时间，提升效率。
         std::unique_lock<std::mutex> lock(mutex_);
-        // 交换两个vector容器，将当前loop需要执行的回调函数交换到局部变量functors中
-        functors.swap(pendingFunctors_);
+        // 把新任务接到readyFunctors_后面；上一轮没有留下任务时直接交换两个vector容器
+        for(int i = 0; i < kNumPriorities; ++i){
+            std::vector<Task> &pending = pendingFunctors_[i];
+            std::vector<Task> &ready = readyFunctors_[i];
+            if(pending.empty()){
+                continue;
+            }
+            if(ready.empty()){
+                ready.swap(pending);
+            }
+            else{
+                ready.insert(ready.end(), std::make_move_iterator(pending.begin()), std::make_move_iterator(pending.end()));
+                pending.clear();
+            }
+        }
         /*
          * 避免死锁风险：
          * 如果 functor() 本身调用了 queueInLoop()，而 queueInLoop() 需要再次获取 mutex_ 锁，可能会导致死锁。
-         * swap 提前移出了 pendingFunctors_ 的内容，避免 functor() 的递归操作影响原始容器。
+         * 取出之后pendingFunctors_只接收新任务，functor() 的递归操作不影响正在执行的readyFunctors_。
          */
     }
 
+    size_t total = 0;
+    for(int i = 0; i < kNumPriorities; ++i){
+        total += readyFunctors_[i].size() - readyHead_[i];
+    }
     // 遍历执行回调函数, 在非临界区完成，保证执行过程中不阻塞其他线程调用queueInLoop()
-    for(const Functor &functor: functors){
-        functor();
+    size_t remaining = 0;
+    if(total > 0){
+        int64_t threshold = g_slowHandlerNanos.load(std::memory_order_relaxed);
+        size_t maxTasks = functorBudgetTasks_.load(std::memory_order_relaxed);
+        int64_t maxNanos = functorBudgetNanos_.load(std::memory_order_relaxed);
+        int64_t drainBegin = monotonicNanos();
+        int64_t begin = drainBegin;
+        size_t ran = 0;
+        bool exhausted = false;
+        for(int i = 0; i < kNumPriorities && !exhausted; ++i){
+            std::vector<Task> &ready = readyFunctors_[i];
+            size_t &head = readyHead_[i];
+            while(head < ready.size()){
+                // 每轮至少执行一个任务
+                if(ran > 0 && ((maxTasks > 0 && ran >= maxTasks) || (maxNanos > 0 && begin - drainBegin >= maxNanos))){
+                    exhausted = true;
+                    break;
+                }
+                Task task(std::move(ready[head++]));
+                int64_t age = begin - task.enqueueNanos;
+                histograms_.queueAge.record(age);
+                metrics_.queueAgeMicros += age / 1000;
+                metrics_.maxQueueAgeMicros = std::max<uint64_t>(metrics_.maxQueueAgeMicros, age / 1000);
+                task.functor();
+                int64_t end = monotonicNanos();
+                histograms_.functors.record(end - begin);
+                ++ran;
+                if(threshold > 0 && end - begin >= threshold){
+                    // functor没有名字，只能报出它在这一批里的位置
+                    LOG_ERROR("EventLoop %p slow pending functor %.3fms (%zu of %zu)\n",
+                              this, (end - begin) / 1e6, ran, total);
+                }
+                begin = end;
+            }
+            if(head == ready.size()){
+                ready.clear();
+                head = 0;
+            }
+            else if(head > ready.size() / 2){
+                // 留下的任务挪到开头，避免一直有任务留下时vector只增不减
+                ready.erase(ready.begin(), ready.begin() + head);
+                head = 0;
+            }
+        }
+        remaining = total - ran;
+        metrics_.functors += ran;
+        ++metrics_.functorDrains;
+        metrics_.functorMicros += (begin - drainBegin) / 1000;
+        metrics_.maxFunctorBatch = std::max<uint64_t>(metrics_.maxFunctorBatch, ran);
+        if(remaining > 0){
+            ++metrics_.functorBudgetHits;
+            metrics_.functorsCarried += remaining;
+        }
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        carriedFunctors_ = remaining;
+        size_t depth = remaining;
+        for(int i = 0; i < kNumPriorities; ++i){
+            depth += pendingFunctors_[i].size();
+        }
+        load_.queueDepth.store(static_cast<int>(depth), std::memory_order_relaxed);
     }
 
     // 标志回调执行完毕，允许其他线程继续将任务插入pendingFunctors_并触发回调
     callingPendingFunctors_ = false;
 }
+void EventLoop::doBeforePollFunctors(){
+    // 这些回调里queueInLoop()的任务（如写完成回调）要在下一轮立刻执行，不能等poll超时，
+    // 和doPendingFunctors()一样置位callingPendingFunctors_，让queueInLoop()唤醒一次
+    callingPendingFunctors_ = true;
+    while(!beforePollFunctors_.empty()){
+        std::vector<Functor> functors;
+        functors.swap(beforePollFunctors_);
+        for(Functor &functor : functors){
+            functor();
+        }
+    }
+    callingPendingFunctors_ = false;
+}
+
 /*
 问题：
     如果当前线程要去执行消费该线程EventLoop对应的任务队列里的回调函数，此时又有新的回调函数想加入到该队列中，
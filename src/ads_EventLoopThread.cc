@@ -1,5 +1,6 @@
 #include "ads_EventLoopThread.h"
 #include "ads_EventLoop.h"
+#include "ads_Logger.h"
 
 EventLoopThread::EventLoopThread(const ThreadInitCallback &cb,
                                  const std::string &name)
@@ -10,6 +11,7 @@ EventLoopThread::EventLoopThread(const ThreadInitCallback &cb,
     , mutex_()
     , cond_()
     , callback_(cb)
+    , cpu_(-1)
 {
 }
 
@@ -60,6 +62,10 @@ EventLoopThread::startLoop()
 
 // 下面这个方法 是在单独的新线程里运行的
 void EventLoopThread::threadFunc(){
+    // 先绑核再构造EventLoop，之后这个线程第一次触碰的内存都分配在本地节点上
+    if(cpu_ >= 0 && !CurrentThread::bindToCpu(cpu_)){
+        LOG_ERROR("EventLoopThread::threadFunc - bind to cpu %d failed\n", cpu_);
+    }
     // 在新线程中创建一个 EventLoop 对象，但它会在当前线程内运行，这符合one loop per thread 的设计。
     EventLoop loop;
 
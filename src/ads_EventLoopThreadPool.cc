@@ -1,7 +1,9 @@
 #include <memory>
+#include <stdio.h>
 
 #include "ads_EventLoopThreadPool.h"
 #include "ads_EventLoopThread.h"
+#include "ads_EventLoop.h"
 #include "ads_Logger.h"
 
 
@@ -13,9 +15,11 @@ EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop, const std::string
     , started_(false)
     , numThreads_(0)
     , next_(0)
-    // 一致性哈希对象，默认3个虚拟点
-    // 删掉了
-    //, hash_(3)
+    , selectPolicy_(kRoundRobin)
+    , random_(static_cast<unsigned>(reinterpret_cast<uintptr_t>(this)))
+    // 一致性哈希对象，每个loop 100个虚拟节点，loop数不多时分布也比较均匀
+    , hash_(100)
+    , hashPolicy_(kRingHash)
 {
 }
 
@@ -33,13 +37,15 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb){
         // name_ + int 需要sizeof(buf) + 32bits
         snprintf(buf, sizeof(buf), "%s%d", name_.c_str(), i);
         EventLoopThread *t = new EventLoopThread(cb, buf);
+        if(!cpus_.empty()){
+            t->setCpu(cpus_[i % cpus_.size()]);
+        }
         threads_.push_back(std::unique_ptr<EventLoopThread>(t));
         // EventLoopThread::startLoop返回一个EventLoop *
         loops_.push_back(t->startLoop());
-        // hash_.addNode(buf);：将每个线程的名称（如 "WorkerPool0", "WorkerPool1", ...）
-        // 作为节点添加到一致性哈希中。这使得后续的请求可以根据一致性哈希分配到特定的 EventLoop。
-        // 删掉了
-        // hash_.addNote(buf);
+        // hash_.addNode(buf, i);：将每个线程的名称（如 "WorkerPool0", "WorkerPool1", ...）
+        // 作为节点添加到一致性哈希中，编号就是它在loops_中的下标。这使得后续的请求可以根据一致性哈希分配到特定的 EventLoop。
+        hash_.addNode(buf, i);
     }
 
     // numThreads_ == 0：当没有额外的 EventLoopThread 时，线程池只有主线程的 baseLoop_。这种情况下，baseLoop_ 用于处理所有的 IO 事件。
@@ -49,31 +55,121 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb){
     }
 }
 
-// 如果工作在多线程中，baseLoop_(mainLoop)会默认以轮询的方式分配Channel给subLoop
-/* 250320 发现错误，这里调用了getNode()但getNode()返回的是节点对应的哈希值，无法作为索引返回loops_[index]
+std::vector<int> EventLoopThreadPool::parseCpuList(const std::string &list){
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while(pos < list.size()){
+        size_t end = list.find(',', pos);
+        if(end == std::string::npos){
+            end = list.size();
+        }
+        std::string item = list.substr(pos, end - pos);
+        int first = -1;
+        int last = -1;
+        char tail;
+        int n = ::sscanf(item.c_str(), "%d-%d%c", &first, &last, &tail);
+        if(n == 1){
+            last = first;
+        }
+        if((n != 1 && n != 2) || first < 0 || last < first){
+            LOG_ERROR("EventLoopThreadPool::parseCpuList - bad cpu list \"%s\"\n", list.c_str());
+            return std::vector<int>();
+        }
+        for(int cpu = first; cpu <= last; ++cpu){
+            cpus.push_back(cpu);
+        }
+        pos = end + 1;
+    }
+    return cpus;
+}
+
+// 按key粘性分配。getNode()返回的是addNode()时登记的loops_下标
+// loops_在start()之后不再变化，哈希环也是无锁读取，所以这里不需要加锁
 EventLoop *EventLoopThreadPool::getNextLoop(const std::string &key){
-    size_t index = hash_.getNode(key);
+    if(loops_.empty()){
+        return baseLoop_;
+    }
+    size_t index;
+    if(hashPolicy_ == kJumpHash){
+        index = jumpConsistentHash(std::hash<std::string>()(key), static_cast<int32_t>(loops_.size()));
+    }
+    else{
+        index = hash_.getNode(key);
+    }
     if(index >= loops_.size()){
-        LOG_ERROR("EventLoopThreadPool::getNextLoop ERROR");
+        LOG_ERROR("EventLoopThreadPool::getNextLoop index %zu out of range\n", index);
         return baseLoop_;
     }
     return loops_[index];
 }
-*/
+
+// 负载读数都是relaxed原子，各loop随时在改，这里只求大致均衡
+static int connectionsOf(EventLoop *loop){
+    return loop->load().connections.load(std::memory_order_relaxed);
+}
+
+// 每个排队的任务按千分之一的忙碌时间计
+static int busyScoreOf(EventLoop *loop){
+    const LoopLoad &load = loop->load();
+    return load.busyPermille.load(std::memory_order_relaxed) + load.queueDepth.load(std::memory_order_relaxed);
+}
+
 // 若工作中多线程中，baseLoop_(mainLoop)会默认以轮询的方式分配Channel给subLoop
 EventLoop *EventLoopThreadPool::getNextLoop(){
     // 如果只设置了一个线程，则getNextLoop()每次都返回当前的baseLoop_
     EventLoop *loop = baseLoop_;
+    if(loops_.empty()){
+        return loop;
+    }
 
-    // 通过轮询获取下个处理事件的loop，没设置多线程数量则不会进去
-    if(!loops_.empty()){
-        loop = loops_[next_];
-        ++next_;
-        // 轮询
-        if(next_ >= loops_.size()){
-            next_ = 0;
+    if(selector_){
+        loop = selector_(loops_);
+        if(loop != nullptr){
+            return loop;
         }
     }
+
+    switch(selectPolicy_){
+        case kLeastConnections:
+        case kLeastBusy:{
+            // loop数量一般就是CPU核数，直接扫一遍
+            bool byConnections = selectPolicy_ == kLeastConnections;
+            // 从next_开始扫，分数相同时也能轮流分配
+            size_t start = next_;
+            next_ = (next_ + 1) % loops_.size();
+            loop = loops_[start];
+            int best = byConnections ? connectionsOf(loop) : busyScoreOf(loop);
+            for(size_t i = 1; i < loops_.size(); ++i){
+                EventLoop *candidate = loops_[(start + i) % loops_.size()];
+                int score = byConnections ? connectionsOf(candidate) : busyScoreOf(candidate);
+                if(score < best){
+                    best = score;
+                    loop = candidate;
+                }
+            }
+            return loop;
+        }
+        case kPowerOfTwoChoices:{
+            if(loops_.size() == 1){
+                return loops_[0];
+            }
+            size_t a = random_() % loops_.size();
+            // 保证b和a不同
+            size_t b = (a + 1 + random_() % (loops_.size() - 1)) % loops_.size();
+            return connectionsOf(loops_[b]) < connectionsOf(loops_[a]) ? loops_[b] : loops_[a];
+        }
+        case kRoundRobin:
+        default:
+            break;
+    }
+
+    // 通过轮询获取下个处理事件的loop
+    loop = loops_[next_];
+    ++next_;
+    // 轮询
+    if(next_ >= loops_.size()){
+        next_ = 0;
+    }
     return loop;
 }
 
@@ -87,3 +183,28 @@ std::vector<EventLoop *> EventLoopThreadPool::getAllLoops(){
     }
 }
 
+LoopMetrics EventLoopThreadPool::metrics(std::vector<LoopMetrics> *perLoop){
+    LoopMetrics total;
+    total.loops = 0;
+    for(EventLoop *loop : getAllLoops()){
+        LoopMetrics m = loop->metrics();
+        total.merge(m);
+        if(perLoop){
+            perLoop->push_back(m);
+        }
+    }
+    return total;
+}
+
+LoopHistograms EventLoopThreadPool::histograms(std::vector<LoopHistograms> *perLoop){
+    LoopHistograms total;
+    for(EventLoop *loop : getAllLoops()){
+        LoopHistograms h = loop->histograms();
+        total.merge(h);
+        if(perLoop){
+            perLoop->push_back(h);
+        }
+    }
+    return total;
+}
+
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <string.h>
+#include <limits>
+#include <algorithm>
+
+#include "ads_Histogram.h"
+
+const int Histogram::kSubBucketBits;
+const int Histogram::kSubBuckets;
+const int Histogram::kMaxShift;
+const int64_t Histogram::kMaxValue;
+const int Histogram::kNumBuckets;
+
+Histogram::Histogram(){
+    reset();
+}
+
+void Histogram::reset(){
+    ::memset(counts_, 0, sizeof counts_);
+    count_ = 0;
+    sum_ = 0;
+    min_ = std::numeric_limits<int64_t>::max();
+    max_ = 0;
+}
+
+// 小于2*kSubBuckets的值一个值一个桶；更大的值取最高位之后的kSubBucketBits位作为桶内下标
+int Histogram::bucketIndex(int64_t value){
+    if(value > kMaxValue){
+        value = kMaxValue;
+    }
+    if(value < 2 * kSubBuckets){
+        return static_cast<int>(value);
+    }
+    int highestBit = 63 - __builtin_clzll(static_cast<uint64_t>(value));
+    int shift = highestBit - kSubBucketBits;
+    return shift * kSubBuckets + static_cast<int>(value >> shift);
+}
+
+int64_t Histogram::bucketLow(int index){
+    if(index < 2 * kSubBuckets){
+        return index;
+    }
+    int shift = index / kSubBuckets - 1;
+    return static_cast<int64_t>(index % kSubBuckets + kSubBuckets) << shift;
+}
+
+int64_t Histogram::bucketHigh(int index){
+    if(index < 2 * kSubBuckets){
+        return index;
+    }
+    int shift = index / kSubBuckets - 1;
+    return bucketLow(index) + (static_cast<int64_t>(1) << shift) - 1;
+}
+
+void Histogram::merge(const Histogram &other){
+    for(int i = 0; i < kNumBuckets; ++i){
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+}
+
+int64_t Histogram::percentile(double p) const{
+    if(count_ == 0){
+        return 0;
+    }
+    // 排在第rank个（从1数起）的样本落在哪个桶
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * count_ + 0.5);
+    rank = std::max<uint64_t>(1, std::min(rank, count_));
+    uint64_t seen = 0;
+    for(int i = 0; i < kNumBuckets; ++i){
+        seen += counts_[i];
+        if(seen >= rank){
+            return std::min(bucketHigh(i), max_);
+        }
+    }
+    return max_;
+}
+
+void Histogram::forEachBucket(const BucketCallback &cb) const{
+    for(int i = 0; i < kNumBuckets; ++i){
+        if(counts_[i] != 0){
+            cb(bucketLow(i), bucketHigh(i), counts_[i]);
+        }
+    }
+}
+
+std::string Histogram::toString() const{
+    char buf[256];
+    snprintf(buf, sizeof buf, "count=%llu mean=%.1fus p50=%.1fus p90=%.1fus p99=%.1fus p999=%.1fus max=%.1fus",
+             (unsigned long long)count_, mean() / 1000.0,
+             percentile(50) / 1000.0, percentile(90) / 1000.0, percentile(99) / 1000.0,
+             percentile(99.9) / 1000.0, max() / 1000.0);
+    return buf;
+}
+
+std::string Histogram::toCsv() const{
+    std::string csv("low_ns,high_ns,count\n");
+    forEachBucket([&csv](int64_t low, int64_t high, uint64_t count){
+        char line[80];
+        snprintf(line, sizeof line, "%lld,%lld,%llu\n", (long long)low, (long long)high, (unsigned long long)count);
+        csv += line;
+    });
+    return csv;
+}
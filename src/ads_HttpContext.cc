@@ -0,0 +1,317 @@
+#include <algorithm>
+
+#include "ads_HttpContext.h"
+#include "ads_Buffer.h"
+
+const size_t HttpContext::kMaxHeaderBytes;
+const size_t HttpContext::kMaxBodyBytes;
+const size_t HttpContext::kMaxChunkLineBytes;
+
+HttpContext::HttpContext()
+    : state_(kExpectRequestLine)
+    , consumed_(0)
+    , scanned_(0)
+    , method_(HttpRequest::kInvalid)
+    , version_(HttpRequest::kUnknown)
+    , path_()
+    , query_()
+    , body_()
+    , chunked_(false)
+    , hasContentLength_(false)
+    , contentLength_(0)
+    , chunkRemaining_(0)
+    , trailersBegin_(0)
+{
+}
+
+void HttpContext::reset(){
+    state_ = kExpectRequestLine;
+    consumed_ = 0;
+    scanned_ = 0;
+    method_ = HttpRequest::kInvalid;
+    version_ = HttpRequest::kUnknown;
+    path_ = Span();
+    query_ = Span();
+    body_ = Span();
+    headerSpans_.clear();
+    chunked_ = false;
+    hasContentLength_ = false;
+    contentLength_ = 0;
+    chunkRemaining_ = 0;
+    trailersBegin_ = 0;
+    chunkedBody_.clear();
+    request_.reset();
+}
+
+// 请求行：METHOD SP request-target SP HTTP-version
+bool HttpContext::processRequestLine(const char *base, const char *begin, const char *end){
+    const char *space = std::find(begin, end, ' ');
+    if(space == end){
+        return false;
+    }
+    StringPiece method(begin, space - begin);
+    if(method == "GET"){
+        method_ = HttpRequest::kGet;
+    }
+    else if(method == "POST"){
+        method_ = HttpRequest::kPost;
+    }
+    else if(method == "HEAD"){
+        method_ = HttpRequest::kHead;
+    }
+    else if(method == "PUT"){
+        method_ = HttpRequest::kPut;
+    }
+    else if(method == "DELETE"){
+        method_ = HttpRequest::kDelete;
+    }
+    else{
+        return false;
+    }
+
+    const char *start = space + 1;
+    space = std::find(start, end, ' ');
+    if(space == end || start == space){
+        return false;
+    }
+    const char *question = std::find(start, space, '?');
+    path_ = makeSpan(base, start, question);
+    if(question != space){
+        query_ = makeSpan(base, question + 1, space);
+    }
+
+    StringPiece version(space + 1, end - space - 1);
+    if(version == "HTTP/1.1"){
+        version_ = HttpRequest::kHttp11;
+    }
+    else if(version == "HTTP/1.0"){
+        version_ = HttpRequest::kHttp10;
+    }
+    else{
+        return false;
+    }
+    return true;
+}
+
+// 头部行：field-name ":" OWS field-value OWS
+// 顺带识别Content-Length和Transfer-Encoding，决定后面怎么读请求体
+bool HttpContext::processHeader(const char *base, const char *begin, const char *end){
+    const char *colon = std::find(begin, end, ':');
+    if(colon == end || colon == begin){
+        return false;
+    }
+    const char *valueBegin = colon + 1;
+    while(valueBegin < end && (*valueBegin == ' ' || *valueBegin == '\t')){
+        ++valueBegin;
+    }
+    const char *valueEnd = end;
+    while(valueEnd > valueBegin && (valueEnd[-1] == ' ' || valueEnd[-1] == '\t')){
+        --valueEnd;
+    }
+
+    StringPiece field(begin, colon - begin);
+    StringPiece value(valueBegin, valueEnd - valueBegin);
+    // 请求体长度有歧义的请求一律拒绝（RFC 7230 3.3.3），否则前后两个解析者对边界的理解不同，可以夹带请求：
+    // 同时带Content-Length和Transfer-Encoding，或者多个Content-Length的值不一致
+    if(field.equalsIgnoreCase("Content-Length")){
+        size_t length = 0;
+        if(value.empty() || chunked_){
+            return false;
+        }
+        for(char c : value){
+            if(c < '0' || c > '9'){
+                return false;
+            }
+            length = length * 10 + (c - '0');
+            if(length > kMaxBodyBytes){
+                return false;
+            }
+        }
+        if(hasContentLength_ && length != contentLength_){
+            return false;
+        }
+        hasContentLength_ = true;
+        contentLength_ = length;
+    }
+    else if(field.equalsIgnoreCase("Transfer-Encoding")){
+        // 只支持chunked，它必须是最后一个编码：取最后一个逗号之后的部分，去掉空白后整个比较
+        const char *token = valueEnd;
+        while(token > valueBegin && token[-1] != ','){
+            --token;
+        }
+        while(token < valueEnd && (*token == ' ' || *token == '\t')){
+            ++token;
+        }
+        if(hasContentLength_ || !StringPiece(token, valueEnd - token).equalsIgnoreCase("chunked")){
+            return false;
+        }
+        chunked_ = true;
+    }
+
+    headerSpans_.push_back(std::make_pair(makeSpan(base, begin, colon),
+                                          makeSpan(base, valueBegin, valueEnd)));
+    return true;
+}
+
+// chunk-size [BWS] [; chunk-ext]，十六进制，至少一位；空白只能出现在数字之后
+bool HttpContext::processChunkSize(const char *begin, const char *end){
+    size_t size = 0;
+    const char *p = begin;
+    for(; p < end; ++p){
+        char c = *p;
+        int digit;
+        if(c >= '0' && c <= '9'){
+            digit = c - '0';
+        }
+        else if(c >= 'a' && c <= 'f'){
+            digit = c - 'a' + 10;
+        }
+        else if(c >= 'A' && c <= 'F'){
+            digit = c - 'A' + 10;
+        }
+        else{
+            break;
+        }
+        size = size * 16 + digit;
+        if(chunkedBody_.size() + size > kMaxBodyBytes){
+            return false;
+        }
+    }
+    if(p == begin){
+        return false;
+    }
+    while(p < end && (*p == ' ' || *p == '\t')){
+        ++p;
+    }
+    if(p < end && *p != ';'){
+        return false;
+    }
+    chunkRemaining_ = size;
+    return true;
+}
+
+void HttpContext::fillRequest(const char *base, Timestamp receiveTime){
+    request_.method_ = method_;
+    request_.version_ = version_;
+    request_.path_ = toPiece(base, path_);
+    request_.query_ = toPiece(base, query_);
+    request_.receiveTime_ = receiveTime;
+    for(const auto &header : headerSpans_){
+        request_.headers_.push_back(HttpRequest::Header(toPiece(base, header.first),
+                                                        toPiece(base, header.second)));
+    }
+    if(chunked_){
+        request_.body_ = StringPiece(chunkedBody_);
+    }
+    else{
+        request_.body_ = toPiece(base, body_);
+    }
+}
+
+bool HttpContext::parseRequest(Buffer *buf, Timestamp receiveTime){
+    if(state_ == kGotAll){
+        return true;
+    }
+    const char *base = buf->peek();
+    const size_t readable = buf->readableBytes();
+
+    while(state_ != kGotAll){
+        if(state_ == kExpectBody){
+            if(readable - consumed_ < contentLength_){
+                return true;
+            }
+            body_ = makeSpan(base, base + consumed_, base + consumed_ + contentLength_);
+            consumed_ += contentLength_;
+            state_ = kGotAll;
+            break;
+        }
+        if(state_ == kExpectChunkData){
+            // chunk数据后面必须紧跟"\r\n"
+            if(readable - consumed_ < chunkRemaining_ + 2){
+                return true;
+            }
+            const char *data = base + consumed_;
+            if(data[chunkRemaining_] != '\r' || data[chunkRemaining_ + 1] != '\n'){
+                return false;
+            }
+            chunkedBody_.append(data, chunkRemaining_);
+            consumed_ += chunkRemaining_ + 2;
+            scanned_ = consumed_;
+            state_ = kExpectChunkSize;
+            continue;
+        }
+
+        // 其余状态都是按行处理
+        const char *crlf = buf->findCRLF(base + scanned_);
+        if(crlf == nullptr){
+            // '\r'可能是最后一个字节，下次从它开始找
+            scanned_ = std::max(consumed_, readable > 0 ? readable - 1 : 0);
+            // 迟迟等不到行尾的请求头、chunk大小行、trailer，直接判为错误
+            if(state_ == kExpectChunkSize){
+                return readable - consumed_ <= kMaxChunkLineBytes;
+            }
+            if(state_ == kExpectTrailers){
+                return readable - trailersBegin_ <= kMaxHeaderBytes;
+            }
+            return readable <= kMaxHeaderBytes;
+        }
+        const char *lineBegin = base + consumed_;
+        consumed_ = crlf + 2 - base;
+        scanned_ = consumed_;
+
+        if(state_ == kExpectRequestLine){
+            // 容忍请求之间多余的空行（RFC 7230 3.5）
+            if(crlf == lineBegin){
+                continue;
+            }
+            if(!processRequestLine(base, lineBegin, crlf)){
+                return false;
+            }
+            state_ = kExpectHeaders;
+        }
+        else if(state_ == kExpectHeaders){
+            if(crlf != lineBegin){
+                if(!processHeader(base, lineBegin, crlf)){
+                    return false;
+                }
+                if(consumed_ > kMaxHeaderBytes){
+                    return false;
+                }
+            }
+            else if(chunked_){
+                state_ = kExpectChunkSize;
+            }
+            else if(contentLength_ > 0){
+                state_ = kExpectBody;
+            }
+            else{
+                state_ = kGotAll;
+            }
+        }
+        else if(state_ == kExpectChunkSize){
+            if(static_cast<size_t>(crlf - lineBegin) > kMaxChunkLineBytes || !processChunkSize(lineBegin, crlf)){
+                return false;
+            }
+            // 大小为0的chunk表示结束，后面可能还有trailer
+            if(chunkRemaining_ == 0){
+                state_ = kExpectTrailers;
+                trailersBegin_ = consumed_;
+            }
+            else{
+                state_ = kExpectChunkData;
+            }
+        }
+        else if(state_ == kExpectTrailers){
+            // trailer字段直接忽略，遇到空行请求结束
+            if(crlf == lineBegin){
+                state_ = kGotAll;
+            }
+            else if(consumed_ - trailersBegin_ > kMaxHeaderBytes){
+                return false;
+            }
+        }
+    }
+
+    fillRequest(base, receiveTime);
+    return true;
+}
@@ -0,0 +1,36 @@
+#include "ads_HttpRequest.h"
+
+const char *HttpRequest::methodString() const{
+    switch(method_){
+        case kGet:
+            return "GET";
+        case kPost:
+            return "POST";
+        case kHead:
+            return "HEAD";
+        case kPut:
+            return "PUT";
+        case kDelete:
+            return "DELETE";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+// 头部一般只有十来个，线性查找比建哈希表更快，也不用分配内存
+StringPiece HttpRequest::getHeader(const StringPiece &field) const{
+    for(const Header &header : headers_){
+        if(header.first.equalsIgnoreCase(field)){
+            return header.second;
+        }
+    }
+    return StringPiece();
+}
+
+bool HttpRequest::keepAlive() const{
+    StringPiece connection = getHeader("Connection");
+    if(version_ == kHttp11){
+        return !connection.equalsIgnoreCase("close");
+    }
+    return connection.equalsIgnoreCase("Keep-Alive");
+}
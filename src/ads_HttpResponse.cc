@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <unistd.h>
+
+#include "ads_HttpResponse.h"
+#include "ads_Buffer.h"
+
+static const char *defaultStatusMessage(HttpResponse::HttpStatusCode code){
+    switch(code){
+        case HttpResponse::k200Ok:
+            return "OK";
+        case HttpResponse::k204NoContent:
+            return "No Content";
+        case HttpResponse::k301MovedPermanently:
+            return "Moved Permanently";
+        case HttpResponse::k400BadRequest:
+            return "Bad Request";
+        case HttpResponse::k404NotFound:
+            return "Not Found";
+        case HttpResponse::k413PayloadTooLarge:
+            return "Payload Too Large";
+        case HttpResponse::k500InternalServerError:
+            return "Internal Server Error";
+        default:
+            return "Unknown";
+    }
+}
+
+HttpResponse::~HttpResponse(){
+    if(fileFd_ >= 0){
+        ::close(fileFd_);
+    }
+}
+
+void HttpResponse::addHeader(const StringPiece &key, const StringPiece &value){
+    headers_.append(key.data(), key.size());
+    headers_.append(": ", 2);
+    headers_.append(value.data(), value.size());
+    headers_.append("\r\n", 2);
+}
+
+void HttpResponse::addChunk(const StringPiece &data){
+    // 空分块会被当成结束标志，直接跳过
+    if(data.empty()){
+        return;
+    }
+    char buf[32];
+    int n = snprintf(buf, sizeof buf, "%zx\r\n", data.size());
+    body_.append(buf, n);
+    body_.append(data.data(), data.size());
+    body_.append("\r\n", 2);
+}
+
+void HttpResponse::setFile(int fd, off_t offset, size_t length){
+    if(fileFd_ >= 0){
+        ::close(fileFd_);
+    }
+    fileFd_ = fd;
+    fileOffset_ = offset;
+    fileLength_ = length;
+}
+
+int HttpResponse::releaseFile(){
+    int fd = fileFd_;
+    fileFd_ = -1;
+    return fd;
+}
+
+void HttpResponse::appendToBuffer(Buffer *output) const{
+    char buf[64];
+    int n = snprintf(buf, sizeof buf, "HTTP/1.1 %d ", statusCode_);
+    output->append(buf, n);
+    if(statusMessage_.empty()){
+        output->append(defaultStatusMessage(statusCode_), ::strlen(defaultStatusMessage(statusCode_)));
+    }
+    else{
+        output->append(statusMessage_);
+    }
+    output->append("\r\n", 2);
+
+    if(closeConnection_){
+        static const char kClose[] = "Connection: close\r\n";
+        output->append(kClose, sizeof(kClose) - 1);
+    }
+    else{
+        static const char kKeepAlive[] = "Connection: Keep-Alive\r\n";
+        output->append(kKeepAlive, sizeof(kKeepAlive) - 1);
+    }
+
+    // 不能带body的状态码不写分帧头部
+    const bool bodyAllowed = this->bodyAllowed();
+    if(bodyAllowed && chunked_){
+        static const char kChunked[] = "Transfer-Encoding: chunked\r\n";
+        output->append(kChunked, sizeof(kChunked) - 1);
+    }
+    else if(bodyAllowed){
+        size_t length = fileFd_ >= 0 ? fileLength_ : body_.size();
+        n = snprintf(buf, sizeof buf, "Content-Length: %zu\r\n", length);
+        output->append(buf, n);
+    }
+
+    output->append(headers_);
+    output->append("\r\n", 2);
+
+    if(!bodyAllowed || headOnly_ || fileFd_ >= 0){
+        return;
+    }
+    output->append(body_);
+    if(chunked_){
+        appendLastChunk(output);
+    }
+}
+
+void HttpResponse::reset(bool close){
+    statusCode_ = kUnknown;
+    statusMessage_.clear();
+    closeConnection_ = close;
+    chunked_ = false;
+    headOnly_ = false;
+    headers_.clear();
+    body_.clear();
+    setFile(-1, 0, 0);
+}
+
+void HttpResponse::appendChunk(Buffer *output, const StringPiece &data){
+    if(data.empty()){
+        return;
+    }
+    char buf[32];
+    int n = snprintf(buf, sizeof buf, "%zx\r\n", data.size());
+    output->append(buf, n);
+    output->append(data.data(), data.size());
+    output->append("\r\n", 2);
+}
+
+void HttpResponse::appendLastChunk(Buffer *output){
+    static const char kLastChunk[] = "0\r\n\r\n";
+    output->append(kLastChunk, sizeof(kLastChunk) - 1);
+}
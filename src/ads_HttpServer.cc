@@ -0,0 +1,152 @@
+#include <unistd.h>
+#include <vector>
+
+#include "ads_HttpServer.h"
+#include "ads_HttpContext.h"
+#include "ads_HttpRequest.h"
+#include "ads_HttpResponse.h"
+#include "ads_Logger.h"
+
+namespace
+{
+
+// 挂在TcpConnection上下文里的每连接状态，解析器、响应对象和输出缓冲都在连接的生命周期内复用
+struct HttpSession{
+    HttpSession()
+        : response(false)
+    {
+    }
+    ~HttpSession(){
+        closeFiles();
+    }
+
+    void closeFiles(){
+        for(int fd : files){
+            ::close(fd);
+        }
+        files.clear();
+    }
+
+    HttpContext context;
+    HttpResponse response;
+    std::shared_ptr<TokenBucket> requestBucket;     // 同一对端IP共用的请求限速桶
+    Buffer output;              // 一批管道化请求的响应先攒在这里，再一次性send()
+    std::vector<int> files;     // 正在通过sendFile发送的文件，写完成后关闭
+};
+
+void defaultHttpCallback(const HttpRequest &, HttpResponse *resp){
+    resp->setStatusCode(HttpResponse::k404NotFound);
+    resp->setCloseConnection(true);
+}
+
+const char kBadRequest[] = "HTTP/1.1 400 Bad Request\r\n"
+                           "Connection: close\r\n"
+                           "Content-Length: 0\r\n\r\n";
+
+} // namespace
+
+HttpServer::HttpServer(EventLoop *loop,
+                       const InetAddress &listenAddr,
+                       const std::string &name,
+                       TcpServer::Option option)
+    : server_(loop, listenAddr, name, option)
+    , httpCallback_(defaultHttpCallback)
+{
+    server_.setConnectionCallback(
+        std::bind(&HttpServer::onConnection, this, std::placeholders::_1));
+    server_.setMessageCallback(
+        std::bind(&HttpServer::onMessage, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    server_.setWriteCompleteCallback(
+        std::bind(&HttpServer::onWriteComplete, this, std::placeholders::_1));
+}
+
+void HttpServer::start(){
+    LOG_INFO("HttpServer starts listening\n");
+    server_.start();
+}
+
+void HttpServer::setPeerRequestLimit(double requestsPerSecond, double burst){
+    requestBuckets_.reset(requestsPerSecond > 0 ? new PeerBuckets(requestsPerSecond, burst) : nullptr);
+}
+
+void HttpServer::onConnection(const TcpConnectionPtr &conn){
+    if(conn->connected()){
+        std::shared_ptr<HttpSession> session = std::make_shared<HttpSession>();
+        if(requestBuckets_){
+            session->requestBucket = requestBuckets_->get(conn->peerAddress());
+        }
+        conn->setContext(session);
+    }
+}
+
+void HttpServer::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime){
+    HttpSession *session = static_cast<HttpSession *>(conn->getContext().get());
+    // 已经决定关闭的连接不再处理后续请求
+    if(session == nullptr || !conn->connected()){
+        buf->retrieveAll();
+        return;
+    }
+    bool close = false;
+    int requests = 0;
+
+    // 把当前已收到的所有完整请求都处理掉，响应按顺序追加到session->output
+    while(!close){
+        if(!session->context.parseRequest(buf, receiveTime)){
+            session->output.append(kBadRequest, sizeof(kBadRequest) - 1);
+            buf->retrieveAll();
+            close = true;
+            break;
+        }
+        if(!session->context.gotAll()){
+            break;
+        }
+
+        const HttpRequest &req = session->context.request();
+        HttpResponse &resp = session->response;
+        resp.reset(!req.keepAlive());
+        resp.setHeadOnly(req.method() == HttpRequest::kHead);
+        httpCallback_(req, &resp);
+        resp.appendToBuffer(&session->output);
+
+        // 不能带body的状态码，文件留给resp.reset()关闭
+        if(resp.hasFile() && resp.bodyAllowed()){
+            int fd = resp.releaseFile();
+            session->files.push_back(fd);
+            // 文件之前的响应先交给TcpConnection，文件排在它们后面，之后的响应又排在文件后面
+            conn->send(&session->output);
+            if(req.method() != HttpRequest::kHead){
+                conn->sendFile(fd, resp.fileOffset(), resp.fileLength());
+            }
+        }
+        close = resp.closeConnection();
+
+        // request的视图指向buf，必须在回调和appendToBuffer之后才能回收
+        buf->retrieve(session->context.requestLength());
+        session->context.reset();
+        ++requests;
+    }
+
+    // 已经收到的请求照常处理完，再按欠账暂停读：缓冲区里剩下的是不完整的请求，恢复读之后会接着收
+    if(session->requestBucket && requests > 0 && !close){
+        int64_t debt = session->requestBucket->consume(requests, monotonicNanos());
+        if(debt > 0){
+            conn->pauseReading((debt + 999) / 1000);
+        }
+    }
+
+    if(session->output.readableBytes() > 0){
+        conn->send(&session->output);
+    }
+    if(close){
+        // 已经排队的数据发完后再关闭写端
+        conn->shutdown();
+    }
+}
+
+// 只有outputBuffer_和文件队列都空了，才说明之前交出去的文件都发完了
+void HttpServer::onWriteComplete(const TcpConnectionPtr &conn){
+    HttpSession *session = static_cast<HttpSession *>(conn->getContext().get());
+    if(session != nullptr && !conn->hasPendingWrite()){
+        session->closeFiles();
+    }
+}
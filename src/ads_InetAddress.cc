@@ -1,13 +1,24 @@
 #include <strings.h>
 #include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
 
 #include "ads_InetAddress.h"
+#include "ads_Logger.h"
 
 InetAddress::InetAddress(uint16_t port, std::string ip){
     // memset(void *s, int c, size_t n) —— 用于将内存块设置为指定的值。
-    // &addr_ —— 指向要清空的内存（即 sockaddr_in 结构体）。0 —— 用 0 填充内存。sizeof(addr_) —— 填充的字节长度。
-    // 目的是将 sockaddr_in 结构体的内存置为 0，防止其中存在未定义数据（初始化操作）
-    ::memset(&addr_, 0, sizeof(addr_));
+    // &addrUn_ —— 指向要清空的内存（union里最大的 sockaddr_un）。0 —— 用 0 填充内存。sizeof(addrUn_) —— 填充的字节长度。
+    // 目的是将整个地址结构体的内存置为 0，防止其中存在未定义数据（初始化操作）
+    ::memset(&addrUn_, 0, sizeof(addrUn_));
+    if(ip.find(':') != std::string::npos){
+        addr6_.sin6_family = AF_INET6;
+        addr6_.sin6_port = htons(port);
+        ::inet_pton(AF_INET6, ip.c_str(), &addr6_.sin6_addr);
+        len_ = sizeof(sockaddr_in6);
+        return;
+    }
     // 设置地址族为 IPv4
     addr_.sin_family = AF_INET;
     // htons(uint16_t hostshort) —— 将 主机字节序（主机端存储方式）转换为 网络字节序（大端字节序）。在不同架构主机之间保证兼容性
@@ -15,6 +26,7 @@ InetAddress::InetAddress(uint16_t port, std::string ip){
     // ::inet_addr(const char *cp) —— 将点分十进制的 IP 地址（如 "192.168.1.1") 转换为 in_addr_t 类型的二进制格式（网络字节序）。
     // ip.c_str() —— 将 std::string 转换为 C 字符串（即 const char *）。
     addr_.sin_addr.s_addr = inet_addr(ip.c_str());
+    len_ = sizeof(sockaddr_in);
 
     // 推荐使用以下
     /*
@@ -24,9 +36,120 @@ InetAddress::InetAddress(uint16_t port, std::string ip){
      */
 }
 
+InetAddress::InetAddress(const sockaddr_in &addr){
+    setSockAddr(addr);
+}
+
+InetAddress::InetAddress(const sockaddr_in6 &addr6){
+    setSockAddr(reinterpret_cast<const sockaddr *>(&addr6), sizeof(addr6));
+}
+
+// 文件路径要留一个结尾的'\0'；抽象命名空间的名字前面有一个'\0'。两种情况名字都必须短于sun_path
+static bool unixNameFits(const std::string &name){
+    return name.size() < sizeof(sockaddr_un().sun_path);
+}
+
+InetAddress InetAddress::fromUnixPath(const std::string &path){
+    // 截断后bind会在截断的路径上建socket并且成功，所以超长直接报错
+    if(!unixNameFits(path)){
+        LOG_FATAL("InetAddress::fromUnixPath path too long (%zu bytes): %s\n", path.size(), path.c_str());
+    }
+    sockaddr_un addr;
+    ::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    size_t n = path.size();
+    ::memcpy(addr.sun_path, path.data(), n);
+    return InetAddress(reinterpret_cast<const sockaddr *>(&addr), static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + n + 1));
+}
+
+InetAddress InetAddress::fromAbstract(const std::string &name){
+    if(!unixNameFits(name)){
+        LOG_FATAL("InetAddress::fromAbstract name too long (%zu bytes): %s\n", name.size(), name.c_str());
+    }
+    sockaddr_un addr;
+    ::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    // 抽象命名空间：sun_path以'\0'开头，名字的长度由地址长度决定，不以'\0'结尾
+    size_t n = name.size();
+    ::memcpy(addr.sun_path + 1, name.data(), n);
+    return InetAddress(reinterpret_cast<const sockaddr *>(&addr), static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + n));
+}
+
+bool InetAddress::parse(const std::string &spec, InetAddress *out){
+    if(spec.compare(0, 5, "unix:") == 0){
+        std::string path = spec.substr(5);
+        if(path.empty()){
+            return false;
+        }
+        std::string name = path[0] == '@' ? path.substr(1) : path;
+        if(!unixNameFits(name)){
+            return false;
+        }
+        *out = path[0] == '@' ? fromAbstract(name) : fromUnixPath(path);
+        return true;
+    }
+    std::string host;
+    std::string port;
+    if(!spec.empty() && spec[0] == '['){
+        // [::1]:8080
+        size_t close = spec.find("]:");
+        if(close == std::string::npos){
+            return false;
+        }
+        host = spec.substr(1, close - 1);
+        port = spec.substr(close + 2);
+    }
+    else{
+        size_t colon = spec.rfind(':');
+        if(colon == std::string::npos || spec.find(':') != colon){
+            return false;
+        }
+        host = spec.substr(0, colon);
+        port = spec.substr(colon + 1);
+    }
+    char *end = nullptr;
+    long value = ::strtol(port.c_str(), &end, 10);
+    if(port.empty() || *end != '\0' || value < 0 || value > 65535){
+        return false;
+    }
+    // 先用inet_pton检查地址格式，构造函数里的inet_addr对非法地址不报错
+    unsigned char buf[sizeof(in6_addr)];
+    bool v6 = host.find(':') != std::string::npos;
+    if(::inet_pton(v6 ? AF_INET6 : AF_INET, host.c_str(), buf) != 1){
+        return false;
+    }
+    *out = InetAddress(static_cast<uint16_t>(value), host);
+    return true;
+}
+
+void InetAddress::setSockAddr(const sockaddr_in &addr){
+    setSockAddr(reinterpret_cast<const sockaddr *>(&addr), sizeof(addr));
+}
+
+void InetAddress::setSockAddr(const sockaddr *addr, socklen_t len){
+    ::memset(&addrUn_, 0, sizeof(addrUn_));
+    len = std::min<socklen_t>(len, sizeof(addrUn_));
+    ::memcpy(&addrUn_, addr, len);
+    len_ = len;
+}
+
 std::string InetAddress::toIp() const{
     // 定义一个长度为 64 的缓冲区，初始化列表为0，保证内容干净
     char buf[64] = {0};
+    if(isUnix()){
+        size_t pathLen = len_ > offsetof(sockaddr_un, sun_path) ? len_ - offsetof(sockaddr_un, sun_path) : 0;
+        if(pathLen == 0){
+            return std::string();
+        }
+        if(addrUn_.sun_path[0] == '\0'){
+            return "@" + std::string(addrUn_.sun_path + 1, pathLen - 1);
+        }
+        return std::string(addrUn_.sun_path, ::strnlen(addrUn_.sun_path, pathLen));
+    }
+    if(isIpv6()){
+        ::inet_ntop(AF_INET6, &addr6_.sin6_addr, buf, sizeof(buf));
+        return buf;
+    }
     // inet_ntop（network to presentation）将网络格式（即二进制）转换为人类可读的点分十进制格式。
     //inet_ntop() 的返回值是指向 buf 的指针（即转换后的 IP 字符串）。如果转换失败，返回 nullptr。把网络字符
     ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof(buf));
@@ -34,7 +157,17 @@ std::string InetAddress::toIp() const{
 }
 
 std::string InetAddress::toIpPort() const{
-    char buf[64] = {0};
+    if(isUnix()){
+        return "unix:" + toIp();
+    }
+    char buf[80] = {0};
+    if(isIpv6()){
+        buf[0] = '[';
+        ::inet_ntop(AF_INET6, &addr6_.sin6_addr, buf + 1, sizeof(buf) - 1);
+        size_t end = strlen(buf);
+        snprintf(buf + end, sizeof(buf) - end, "]:%u", ntohs(addr6_.sin6_port));
+        return buf;
+    }
     ::inet_ntop(AF_INET, &addr_.sin_addr, buf, sizeof(buf));
     // ::strlen(buf) 是一个 C 标准库函数，用于返回字符串 buf 的长度（不包括末尾的 '\0'）。end 保存当前字符串的长度。
     size_t end = strlen(buf);
@@ -46,7 +179,10 @@ std::string InetAddress::toIpPort() const{
 }
 
 uint16_t InetAddress::toPort() const{
-    return ntohs(addr_.sin_port);
+    if(isUnix()){
+        return 0;
+    }
+    return ntohs(isIpv6() ? addr6_.sin6_port : addr_.sin_port);
 }
 
 
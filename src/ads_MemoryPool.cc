@@ -0,0 +1,215 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "ads_MemoryPool.h"
+
+namespace
+{
+
+// 每级块的可用字节数（不含块头），2的幂和它的1.5倍交替
+const size_t kClassSizes[] = {
+    48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096,
+    6144, 8192, 12288, 16384, 24576, 32768, 49152, 65536, 98304, 131072,
+};
+const int kNumClasses = sizeof kClassSizes / sizeof kClassSizes[0];
+// 不分级，直接malloc/free
+const uint32_t kNoClass = UINT32_MAX;
+// 每个线程每一级最多缓存这么多字节，超出的块直接free
+const size_t kMaxCachedBytes = 2 * 1024 * 1024;
+
+// 空闲块的链表指针借用块本身的空间，块头保持不变
+struct FreeBlock{
+    FreeBlock *next;
+};
+
+struct ThreadCache{
+    FreeBlock *local[kNumClasses];
+    size_t localCount[kNumClasses];
+    // 其他线程还回来的块，多个生产者无锁压栈，本线程整体取走
+    std::atomic<FreeBlock *> remote[kNumClasses];
+    // 远程释放栈里大约有多少块，超过maxCached()后别的线程直接free。
+    // 压栈和计数不是原子的一步，取走时减掉取到的块数，可能短暂为负，所以用有符号数
+    std::atomic<long> remoteCount[kNumClasses];
+};
+
+// 放在每个块前面，16字节保证返回的地址和malloc一样对齐
+struct BlockHeader{
+    ThreadCache *owner;     // 分配它的线程缓存，不分级的块为nullptr
+    uint32_t sizeClass;
+    uint32_t padding;
+};
+static_assert(sizeof(BlockHeader) == 16, "BlockHeader must keep 16-byte alignment");
+
+// 线程退出后远程释放栈换成这个哨兵，之后还回来的块直接free
+FreeBlock g_closed;
+std::atomic_bool g_enabled(true);
+
+size_t maxCached(uint32_t sizeClass){
+    return std::max<size_t>(kMaxCachedBytes / kClassSizes[sizeClass], 8);
+}
+
+void freeBlock(FreeBlock *block){
+    ::free(reinterpret_cast<BlockHeader *>(block) - 1);
+}
+
+void releaseCache(ThreadCache *cache){
+    for(int c = 0; c < kNumClasses; ++c){
+        FreeBlock *list = cache->remote[c].exchange(&g_closed, std::memory_order_acq_rel);
+        while(list != nullptr){
+            FreeBlock *next = list->next;
+            freeBlock(list);
+            list = next;
+        }
+        while(cache->local[c] != nullptr){
+            FreeBlock *next = cache->local[c]->next;
+            freeBlock(cache->local[c]);
+            cache->local[c] = next;
+        }
+        cache->localCount[c] = 0;
+    }
+}
+
+// 线程退出时释放缓存的块；ThreadCache本身不释放，因为还在外面的块的块头指向它
+struct CacheHolder{
+    ThreadCache *cache;
+    bool exited;
+    ~CacheHolder(){
+        if(cache != nullptr){
+            releaseCache(cache);
+        }
+        cache = nullptr;
+        exited = true;
+    }
+};
+
+thread_local CacheHolder t_holder = {nullptr, false};
+
+ThreadCache *localCache(){
+    if(t_holder.cache == nullptr && !t_holder.exited){
+        ThreadCache *cache = new ThreadCache;
+        for(int c = 0; c < kNumClasses; ++c){
+            cache->local[c] = nullptr;
+            cache->localCount[c] = 0;
+            cache->remote[c].store(nullptr, std::memory_order_relaxed);
+            cache->remoteCount[c].store(0, std::memory_order_relaxed);
+        }
+        t_holder.cache = cache;
+    }
+    return t_holder.cache;
+}
+
+uint32_t classOf(size_t size){
+    const size_t *it = std::lower_bound(kClassSizes, kClassSizes + kNumClasses, size);
+    return it == kClassSizes + kNumClasses ? kNoClass : static_cast<uint32_t>(it - kClassSizes);
+}
+
+void *mallocBlock(ThreadCache *owner, uint32_t sizeClass, size_t size){
+    BlockHeader *header = static_cast<BlockHeader *>(::malloc(sizeof(BlockHeader) + size));
+    if(header == nullptr){
+        throw std::bad_alloc();
+    }
+    header->owner = owner;
+    header->sizeClass = sizeClass;
+    return header + 1;
+}
+
+// 本地链表空了，把别的线程还回来的块一次性取回
+void reclaimRemote(ThreadCache *cache, uint32_t sizeClass){
+    FreeBlock *list = cache->remote[sizeClass].exchange(nullptr, std::memory_order_acquire);
+    long taken = 0;
+    while(list != nullptr){
+        FreeBlock *next = list->next;
+        ++taken;
+        if(cache->localCount[sizeClass] < maxCached(sizeClass)){
+            list->next = cache->local[sizeClass];
+            cache->local[sizeClass] = list;
+            ++cache->localCount[sizeClass];
+        }
+        else{
+            freeBlock(list);
+        }
+        list = next;
+    }
+    cache->remoteCount[sizeClass].fetch_sub(taken, std::memory_order_relaxed);
+}
+
+} // namespace
+
+void *MemoryPool::allocate(size_t size, size_t *usable){
+    uint32_t sizeClass = g_enabled.load(std::memory_order_relaxed) ? classOf(size) : kNoClass;
+    ThreadCache *cache = sizeClass != kNoClass ? localCache() : nullptr;
+    if(cache == nullptr){
+        if(usable != nullptr){
+            *usable = size;
+        }
+        return mallocBlock(nullptr, kNoClass, size);
+    }
+
+    if(usable != nullptr){
+        *usable = kClassSizes[sizeClass];
+    }
+    if(cache->local[sizeClass] == nullptr){
+        reclaimRemote(cache, sizeClass);
+    }
+    FreeBlock *block = cache->local[sizeClass];
+    if(block == nullptr){
+        return mallocBlock(cache, sizeClass, kClassSizes[sizeClass]);
+    }
+    cache->local[sizeClass] = block->next;
+    --cache->localCount[sizeClass];
+    return block;
+}
+
+void MemoryPool::deallocate(void *p){
+    if(p == nullptr){
+        return;
+    }
+    BlockHeader *header = static_cast<BlockHeader *>(p) - 1;
+    ThreadCache *owner = header->owner;
+    uint32_t sizeClass = header->sizeClass;
+    if(owner == nullptr){
+        ::free(header);
+        return;
+    }
+
+    FreeBlock *block = static_cast<FreeBlock *>(p);
+    if(owner == t_holder.cache){
+        // 本线程分配的，放回本地链表
+        if(owner->localCount[sizeClass] >= maxCached(sizeClass)){
+            ::free(header);
+            return;
+        }
+        block->next = owner->local[sizeClass];
+        owner->local[sizeClass] = block;
+        ++owner->localCount[sizeClass];
+        return;
+    }
+
+    // 别的线程分配的，压进原主的远程释放栈；原主可能很久不再分配这一级，栈里已经攒够一个线程的缓存上限就直接free
+    if(owner->remoteCount[sizeClass].load(std::memory_order_relaxed) >= static_cast<long>(maxCached(sizeClass))){
+        ::free(header);
+        return;
+    }
+    FreeBlock *head = owner->remote[sizeClass].load(std::memory_order_relaxed);
+    do{
+        if(head == &g_closed){
+            ::free(header);
+            return;
+        }
+        block->next = head;
+    }while(!owner->remote[sizeClass].compare_exchange_weak(head, block,
+                                                           std::memory_order_release,
+                                                           std::memory_order_relaxed));
+    owner->remoteCount[sizeClass].fetch_add(1, std::memory_order_relaxed);
+}
+
+void MemoryPool::setEnabled(bool on){
+    g_enabled.store(on, std::memory_order_relaxed);
+}
+
+bool MemoryPool::enabled(){
+    return g_enabled.load(std::memory_order_relaxed);
+}
@@ -17,7 +17,7 @@ void Socket::bindAddress(const InetAddress &localaddr){
      * sockaddr* 是一个通用的 套接字地址 结构体指针，用于表示各种类型的套接字地址。
      * bind成功返回 0 ，失败返回 -1 ，并设置 errno 错误码。
      */
-    if(0 != ::bind(sockfd_, (sockaddr *)localaddr.getSockAddr(), sizeof(sockaddr_in))){
+    if(0 != ::bind(sockfd_, localaddr.getSockAddr(), localaddr.getSockLen())){
         LOG_FATAL("bind sockfa:%d fail\n", sockfd_);
     }
 }
@@ -39,14 +39,15 @@ void Socket::listen(){
 
 // 返回新创建的已连接 socket 文件描述符（connfd）。失败，返回 -1。
 int Socket::accept(InetAddress *peeraddr){
-    sockaddr_in addr;
+    // sockaddr_storage放得下任何family的地址，监听socket可能是IPv4、IPv6或Unix域
+    sockaddr_storage addr;
     socklen_t addrlen = sizeof(addr);
     // SOCK_NONBLOCK → 将新 socket 设置为非阻塞。SOCK_CLOEXEC → 设置 close-on-exec 标志，避免子进程继承该 socket。
     // 如果不设置 SOCK_CLOEXEC，子进程会继承已连接的 socket 文件描述符：即使父进程关闭了 socket，子进程仍持有描述符，可能导致端口被占用或资源泄漏。服务器需要在 fork() 后自行关闭不必要的描述符。
     int connfd = ::accept4(sockfd_, (sockaddr *)&addr, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
 
     if(connfd >= 0){
-        peeraddr->setSockAddr(addr);
+        peeraddr->setSockAddr((sockaddr *)&addr, addrlen);
     }
     return connfd;
 }
@@ -0,0 +1,149 @@
+#include <sys/socket.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "ads_TcpClient.h"
+#include "ads_Connector.h"
+#include "ads_EventLoop.h"
+#include "ads_Buffer.h"
+#include "ads_Logger.h"
+#include "ads_MemoryPool.h"
+
+static EventLoop *CheckLoopNotNull(EventLoop *loop){
+    if(loop == nullptr){
+        LOG_FATAL("%s:%s:%d loop is null!\n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    return loop;
+}
+
+// 用户没设置回调时的默认行为：打印连接状态，丢弃收到的数据
+static void defaultConnectionCallback(const TcpConnectionPtr &conn){
+    LOG_INFO("TcpClient %s -> %s is %s\n", conn->localAddress().toIpPort().c_str(),
+             conn->peerAddress().toIpPort().c_str(), conn->connected() ? "UP" : "DOWN");
+}
+
+static void defaultMessageCallback(const TcpConnectionPtr &, Buffer *buf, Timestamp){
+    buf->retrieveAll();
+}
+
+// TcpClient已经析构后连接才断开时使用的closeCallback
+static void removeConnectionDetached(EventLoop *loop, const TcpConnectionPtr &conn){
+    loop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn), EventLoop::kHighPriority);
+}
+
+TcpClient::TcpClient(EventLoop *loop,
+                     const InetAddress &serverAddr,
+                     const std::string &nameArg)
+    : loop_(CheckLoopNotNull(loop))
+    , connector_(new Connector(loop, serverAddr))
+    , name_(nameArg)
+    , connectionCallback_(defaultConnectionCallback)
+    , messageCallback_(defaultMessageCallback)
+    , retry_(false)
+    , connect_(true)
+    , nextConnId_(1)
+{
+    connector_->setNewConnectionCallback(std::bind(&TcpClient::newConnection, this, std::placeholders::_1));
+    LOG_INFO("TcpClient::TcpClient[%s] - connector %p\n", name_.c_str(), connector_.get());
+}
+
+TcpClient::~TcpClient(){
+    LOG_INFO("TcpClient::~TcpClient[%s] - connector %p\n", name_.c_str(), connector_.get());
+    TcpConnectionPtr conn;
+    bool unique = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        unique = connection_.unique();
+        conn = connection_;
+    }
+    if(conn){
+        // 连接可能比TcpClient活得久，把closeCallback换成不依赖this的版本
+        CloseCallback cb = std::bind(&removeConnectionDetached, loop_, std::placeholders::_1);
+        loop_->runInLoop(std::bind(&TcpConnection::setCloseCallback, conn, cb));
+        // 没有别人持有这条连接，直接关掉
+        if(unique){
+            conn->forceClose();
+        }
+    }
+    else{
+        // 还在连接/重试中，停掉Connector。它的回调持有shared_ptr，等回调清空后自然析构
+        connector_->stop();
+    }
+}
+
+void TcpClient::setRetryDelay(int initialMs, int maxMs){
+    connector_->setRetryDelay(initialMs, maxMs);
+}
+
+void TcpClient::connect(){
+    LOG_INFO("TcpClient::connect[%s] - connecting to %s\n", name_.c_str(),
+             connector_->serverAddress().toIpPort().c_str());
+    connect_ = true;
+    connector_->start();
+}
+
+void TcpClient::disconnect(){
+    connect_ = false;
+    std::unique_lock<std::mutex> lock(mutex_);
+    if(connection_){
+        connection_->shutdown();
+    }
+}
+
+void TcpClient::stop(){
+    connect_ = false;
+    connector_->stop();
+}
+
+void TcpClient::newConnection(int sockfd){
+    sockaddr_storage peer;
+    sockaddr_storage local;
+    ::memset(&peer, 0, sizeof peer);
+    ::memset(&local, 0, sizeof local);
+    socklen_t peerLen = sizeof(peer);
+    if(::getpeername(sockfd, (sockaddr *)&peer, &peerLen) < 0){
+        LOG_ERROR("sockets::getPeerAddr");
+    }
+    socklen_t localLen = sizeof(local);
+    if(::getsockname(sockfd, (sockaddr *)&local, &localLen) < 0){
+        LOG_ERROR("sockets::getLocalAddr");
+    }
+    InetAddress peerAddr((sockaddr *)&peer, peerLen);
+    InetAddress localAddr((sockaddr *)&local, localLen);
+
+    // 如ClientName:127.0.0.1:8080#1
+    char buf[160] = {0};
+    snprintf(buf, sizeof buf, ":%s#%d", peerAddr.toIpPort().c_str(), nextConnId_);
+    ++nextConnId_;
+    std::string connName = name_ + buf;
+
+    TcpConnectionPtr conn = std::allocate_shared<TcpConnection>(PoolAllocator<TcpConnection>(),
+                                                                loop_,
+                                                                connName,
+                                                                sockfd,
+                                                                localAddr,
+                                                                peerAddr);
+    conn->setConnectionCallback(connectionCallback_);
+    conn->setMessageCallback(messageCallback_);
+    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setCloseCallback(std::bind(&TcpClient::removeConnection, this, std::placeholders::_1));
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connection_ = conn;
+    }
+    conn->connectEstablished();
+}
+
+void TcpClient::removeConnection(const TcpConnectionPtr &conn){
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connection_.reset();
+    }
+    // 和TcpServer一样，connectDestroyed()放到本轮事件处理完之后执行
+    loop_->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn), EventLoop::kHighPriority);
+    if(retry_ && connect_){
+        LOG_INFO("TcpClient::removeConnection[%s] - Reconnecting to %s\n", name_.c_str(),
+                 connector_->serverAddress().toIpPort().c_str());
+        connector_->restart();
+    }
+}
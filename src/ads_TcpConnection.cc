@@ -1,4 +1,6 @@
 #include <functional>
+#include <algorithm>
+#include <stdint.h>
 #include <string>
 #include <errno.h>
 #include <sys/types.h>
@@ -15,9 +17,8 @@
 
 #include "ads_TcpConnection.h"
 #include "ads_Logger.h"
-#include "ads_Socket.h"
-#include "ads_Channel.h"
 #include "ads_EventLoop.h"
+#include "ads_TokenBucket.h"
 
 
 static EventLoop *CheckLoopNotNull(EventLoop *loop){
@@ -27,88 +28,474 @@ static EventLoop *CheckLoopNotNull(EventLoop *loop){
         return loop;  
 }
 
+// 缓冲区读写空以后，容量超过这个值就立刻把存储还给MemoryPool，一次突发不会让连接一直占着大块内存；
+// 不超过的留着给后续消息用，等空闲回收
+static const size_t kRetainedCapacity = 64 * 1024;
+
+// 每条连接一个，大小直接决定百万连接时的内存；加成员之前先想想能不能放进HandlerTable或者用到时再分配
+static_assert(sizeof(void *) != 8 || sizeof(TcpConnection) <= 320, "TcpConnection grew past 320 bytes");
+
+// 共用桶和连接自己的桶里较少的那个，都为空时不限（SIZE_MAX）。
+// 桶里不够一批（want字节，最多半个burst）时返回0，*waitNanos给出攒够一批要等多久（至少一个令牌的时间）：
+// 令牌刚补上一点就去读写，每次只换来几个字节，定时器和系统调用都白白空转
+static size_t allowanceOf(TokenBucket *shared, TokenBucket *own, int64_t nowNanos, size_t want, int64_t *waitNanos){
+    double allowance = static_cast<double>(SIZE_MAX);
+    *waitNanos = 0;
+    TokenBucket *buckets[2] = {shared, own};
+    for(TokenBucket *bucket : buckets){
+        if(bucket != nullptr){
+            double batch = std::max(std::min(static_cast<double>(want), bucket->burst() / 2), 1.0);
+            double available = bucket->available(nowNanos);
+            if(available < batch){
+                allowance = 0;
+                int64_t wait = std::max(bucket->waitNanos(batch, nowNanos), static_cast<int64_t>(1e9 / bucket->rate()));
+                *waitNanos = std::max(*waitNanos, wait);
+            }
+            else{
+                allowance = std::min(allowance, available);
+            }
+        }
+    }
+    return allowance >= static_cast<double>(SIZE_MAX) ? SIZE_MAX : static_cast<size_t>(allowance);
+}
+
+static void chargeBuckets(TokenBucket *shared, TokenBucket *own, size_t n, int64_t nowNanos){
+    if(shared != nullptr){
+        shared->consume(static_cast<double>(n), nowNanos);
+    }
+    if(own != nullptr){
+        own->consume(static_cast<double>(n), nowNanos);
+    }
+}
+
+static void releaseIfDrained(Buffer *buf){
+    if(buf->readableBytes() == 0 && buf->capacity() > kRetainedCapacity){
+        buf->shrink();
+    }
+}
+
 TcpConnection::TcpConnection(EventLoop *loop,
                              const std::string &nameArg,
                              int sockfd,
                              const InetAddress &localAddr,
                              const InetAddress &peerAddr)
     : loop_(CheckLoopNotNull(loop))
-    , name_(nameArg)
+    , id_(0)
+    , handlers_(std::make_shared<HandlerTable>())
+    , name_(new std::string(nameArg))
     , state_(kConnecting)
     , reading_(true)
-    , socket_(new Socket(sockfd))
-    , channel_(new Channel(loop, sockfd))
+    , coalesceWrites_(false)
+    , flushQueued_(false)
+    , active_(false)
+    , socket_(sockfd)
+    , channel_(loop, sockfd)
     , localAddr_(localAddr)
     , peerAddr_(peerAddr)
-    // 高水位阈值，即数据缓冲区达到 64MB 时触发高水位回调。
-    , highWaterMark_(64 * 1024 *1024)
 {
-    // 绑定Channel回调
-    // std::placeholders::_1：占位符，对应 handleRead(Timestamp recvTime) 的参数。
-    channel_->setReadCallback(
-        std::bind(&TcpConnection::handleRead, this, std::placeholders::_1));
-    channel_->setWriteCallback(
-        std::bind(&TcpConnection::handleWrite, this));
-    channel_->setCloseCallback(
-        std::bind(&TcpConnection::handleClose, this));
-    channel_->setErrorCallback(
-        std::bind(&TcpConnection::handleError, this));
-
     // const char* std::string::c_str() const noexcept; 
-    // name_.c_str()作用是 将 std::string 转换为 C 风格字符串（const char*）。
+    // name_->c_str()作用是 将 std::string 转换为 C 风格字符串（const char*）。
     // .c_str()不会创建新数据，而是直接指向 std::string 的内部存储。
-    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name_.c_str(), sockfd);
+    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name_->c_str(), sockfd);
+    init();
+}
+
+TcpConnection::TcpConnection(EventLoop *loop,
+                             const std::shared_ptr<HandlerTable> &table,
+                             int sockfd,
+                             const InetAddress &localAddr,
+                             const InetAddress &peerAddr)
+    : loop_(CheckLoopNotNull(loop))
+    , id_(0)
+    , handlers_(table)
+    , state_(kConnecting)
+    , reading_(true)
+    , coalesceWrites_(false)
+    , flushQueued_(false)
+    , active_(false)
+    , socket_(sockfd)
+    , channel_(loop, sockfd)
+    , localAddr_(localAddr)
+    , peerAddr_(peerAddr)
+{
+    // 名字还没有构造，只记录fd
+    LOG_INFO("TcpConnection::ctor at fd=%d\n", sockfd);
+    init();
+}
+
+// 两个构造函数共用的部分
+void TcpConnection::init(){
+    // Channel的读写关闭错误事件都回到本对象的handleXXX，慢回调日志里的名字来自channelName()
+    channel_.setHandler(this);
+
     // 让 内核定期发送 keep-alive 探测包，检测 连接是否存活。如果对端异常断开（如断网），避免 死连接 占用资源。
-    socket_->setKeepAlive(true);
+    socket_.setKeepAlive(true);
+    // 在选中loop的线程里立刻计数，连续accept的一批连接不会因为connectEstablished还没执行而都挤到同一个loop
+    loop_->load().connections.fetch_add(1, std::memory_order_relaxed);
 }
 
 TcpConnection::~TcpConnection()
 {
-    LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d\n", name_.c_str(), channel_->fd(), (int)state_);
+    loop_->load().connections.fetch_sub(1, std::memory_order_relaxed);
+    // 日志里不强制构造延迟的名字，TcpServer的连接用id区分
+    LOG_INFO("TcpConnection::dtor[%s] id=%llu at fd=%d state=%d\n",
+             name_ ? name_->c_str() : "", (unsigned long long)id_, channel_.fd(), (int)state_);
+}
+
+const std::string &TcpConnection::name() const{
+    // 可能在多个线程里第一次被调用，call_once保证只构造一次且构造完成后其他线程才能看到
+    std::call_once(nameOnce_, [this](){
+        if(!name_){
+            name_.reset(new std::string(handlers_->namePrefix + std::to_string(id_)));
+        }
+    });
+    return *name_;
+}
+
+TcpConnection::HandlerTable *TcpConnection::ownTable(){
+    // 只有自己持有时直接改；TcpServer和别的连接也持有时复制一份，之后这条连接用自己的表
+    if(handlers_.use_count() > 1){
+        handlers_ = std::make_shared<HandlerTable>(*handlers_);
+    }
+    return handlers_.get();
+}
+
+TcpConnection::PackedAddress::PackedAddress(const InetAddress &addr)
+    : len_(addr.getSockLen())
+{
+    if(len_ <= sizeof inet_){
+        ::memcpy(&inet_, addr.getSockAddr(), len_);
+    }
+    else{
+        len_ = 0;
+        other_ = new InetAddress(addr);
+    }
+}
+
+TcpConnection::PackedAddress::~PackedAddress(){
+    if(len_ == 0){
+        delete other_;
+    }
+}
+
+InetAddress TcpConnection::PackedAddress::get() const{
+    if(len_ == 0){
+        return *other_;
+    }
+    return InetAddress(reinterpret_cast<const sockaddr *>(&inet_), len_);
 }
 
 
 // 当客户端发送数据时，服务器检测到EPOLLIN事件，调用handleRead()读取数据
 void TcpConnection::handleRead(Timestamp receiveTime){
+    // stopRead()期间不读，数据留在内核里，等startRead()重新监听
+    if(!reading_){
+        channel_.disableReading();
+        return;
+    }
+    const size_t maxBytes = handlers_->readBudgetBytes;
+    const int64_t maxMicros = handlers_->readBudgetMicros;
+    const bool limited = recvLimited();
+    if(maxBytes == 0 && maxMicros == 0 && !limited){
+        readInput(receiveTime, 0);
+        return;
+    }
+
+    FlowControl *state = flow();
+    // pauseReading()之后从就绪列表过来的，等定时器恢复
+    if(state->readPaused){
+        return;
+    }
+    // 本轮处理事件的时间已经超过预算，这次不读，排到就绪列表末尾
+    if(!loop_->admitRead(maxMicros * 1000)){
+        ++state->stats.deferred;
+        deferRead();
+        return;
+    }
+    size_t limit = maxBytes;
+    int64_t now = 0;
+    if(limited){
+        // 令牌不够就先不读，数据留在内核里
+        now = monotonicNanos();
+        int64_t wait = 0;
+        size_t allowance = recvAllowance(now, maxBytes > 0 ? maxBytes : 65536, &wait);
+        if(allowance == 0){
+            pauseReading((wait + 999) / 1000);
+            return;
+        }
+        if(limit == 0 || allowance < limit){
+            limit = allowance;
+        }
+    }
+    ssize_t n = readInput(receiveTime, limit);
+    if(limited && n > 0){
+        chargeRecv(n, now);
+    }
+    // 读满了预算，socket里很可能还有数据：先让别的连接读，下一轮从就绪列表接着读
+    if(maxBytes > 0 && n == static_cast<ssize_t>(maxBytes) && (state_ == kConnected || state_ == kDisconnecting)){
+        ++state->stats.budgetHits;
+        deferRead();
+    }
+}
+
+ssize_t TcpConnection::readInput(Timestamp receiveTime, size_t maxBytes){
     int saveErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &saveErrno);
+    ssize_t n = inputBuffer_.readFd(channel_.fd(), &saveErrno, maxBytes);
     //有数据到达
     if(n > 0){
+        active_ = true;
+        if(flow_){
+            ++flow_->stats.reads;
+            flow_->stats.bytes += n;
+        }
         // 通知上层应用有数据可读，调用用户注册的onMessage回调
         // sahre_from_this()确保TcpCOnnection在处理回调期间不会被销毁
         // 用户可以在onMessage()里面解析inputBuffer，执行其业务逻辑
-        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        handlers_->messageCallback(shared_from_this(), &inputBuffer_, receiveTime);
+        releaseIfDrained(&inputBuffer_);
     }
     // 读取0说明客户端断开了
     else if(n == 0){
         handleClose();
     }
-    // n < 0说明出错了
-    else{
+    // n < 0说明出错了；从就绪列表来读时socket可能已经读空，EAGAIN不算错误
+    else if(saveErrno != EAGAIN && saveErrno != EWOULDBLOCK){
         // 常见的错误：ECONNRESET：对端异常关闭 EAGAIN：数据未准备好 EINTR：被信号中断
         errno = saveErrno;
         LOG_ERROR("TcpConnection::handleRead");
         handleError();
     }
+    return n;
+}
+
+TcpConnection::FlowControl *TcpConnection::flow(){
+    if(!flow_){
+        flow_.reset(new FlowControl);
+    }
+    return flow_.get();
+}
+
+void TcpConnection::deferRead(){
+    if(flow_->ready){
+        return;
+    }
+    flow_->ready = true;
+    flow_->readyNanos = monotonicNanos();
+    // 排队期间epoll不再报告可读，避免同一轮里既从就绪列表读又从epoll读
+    if(channel_.isReading()){
+        channel_.disableReading();
+    }
+    // 排队期间连接可能已经被移除，用weak_ptr不延长它的生命周期
+    std::weak_ptr<TcpConnection> weak(shared_from_this());
+    loop_->queueReadyRead([weak](){
+        TcpConnectionPtr conn = weak.lock();
+        if(conn){
+            conn->readReady();
+        }
+    });
+}
+
+void TcpConnection::readReady(){
+    flow_->ready = false;
+    uint64_t wait = (monotonicNanos() - flow_->readyNanos) / 1000;
+    flow_->stats.waitMicros += wait;
+    flow_->stats.maxWaitMicros = std::max(flow_->stats.maxWaitMicros, wait);
+    if(state_ != kConnected && state_ != kDisconnecting){
+        return;
+    }
+    handleRead(loop_->pollReturnTime());
+    // 没有再次排队、也没有因为限速暂停，说明socket已经读空，交还给epoll
+    rearmReading();
+}
+
+void TcpConnection::rearmReading(){
+    if(reading_ && (!flow_ || (!flow_->ready && !flow_->readPaused))
+       && (state_ == kConnected || state_ == kDisconnecting) && !channel_.isReading()){
+        channel_.enableReading();
+    }
+}
+
+void TcpConnection::setRecvLimiter(const std::shared_ptr<TokenBucket> &bucket){
+    if(bucket || flow_){
+        flow()->recvBucket = bucket;
+    }
+}
+
+void TcpConnection::setSendRateLimit(double bytesPerSecond, double burst){
+    if(bytesPerSecond > 0){
+        flow()->sendBucket.reset(new TokenBucket(bytesPerSecond, burst));
+    }
+    else if(flow_){
+        flow_->sendBucket.reset();
+    }
+}
+
+size_t TcpConnection::recvAllowance(int64_t nowNanos, size_t want, int64_t *waitNanos) const{
+    return allowanceOf(handlers_->recvLimiter.get(), flow_ ? flow_->recvBucket.get() : nullptr, nowNanos, want, waitNanos);
+}
+
+size_t TcpConnection::sendAllowance(int64_t nowNanos, int64_t *waitNanos) const{
+    return allowanceOf(handlers_->sendLimiter.get(), flow_ ? flow_->sendBucket.get() : nullptr,
+                       nowNanos, pendingWriteBytes(), waitNanos);
+}
+
+size_t TcpConnection::pendingWriteBytes() const{
+    size_t bytes = outputBuffer_.readableBytes();
+    if(files_){
+        for(const PendingFile &file : files_->files){
+            bytes += file.remaining;
+        }
+    }
+    return bytes;
+}
+
+void TcpConnection::chargeRecv(size_t n, int64_t nowNanos){
+    chargeBuckets(handlers_->recvLimiter.get(), flow_ ? flow_->recvBucket.get() : nullptr, n, nowNanos);
+}
+
+void TcpConnection::chargeSend(size_t n, int64_t nowNanos){
+    chargeBuckets(handlers_->sendLimiter.get(), flow_ ? flow_->sendBucket.get() : nullptr, n, nowNanos);
+}
+
+void TcpConnection::startRead(){
+    reading_ = true;
+    // 只有stopRead()期间真的停止过监听才需要重新打开
+    rearmReading();
+}
+
+void TcpConnection::pauseReading(int64_t micros){
+    FlowControl *state = flow();
+    int64_t until = monotonicNanos() + micros * 1000;
+    if(state->readPaused){
+        // 已经在暂停，只把恢复时间往后推，定时器到时会再等剩下的部分
+        state->resumeReadNanos = std::max(state->resumeReadNanos, until);
+        return;
+    }
+    state->readPaused = true;
+    state->resumeReadNanos = until;
+    if(channel_.isReading()){
+        channel_.disableReading();
+    }
+    std::weak_ptr<TcpConnection> weak(shared_from_this());
+    loop_->runAfter(micros / 1e6, [weak](){
+        TcpConnectionPtr conn = weak.lock();
+        if(conn){
+            conn->resumeRead();
+        }
+    });
+}
+
+void TcpConnection::resumeRead(){
+    int64_t left = flow_->resumeReadNanos - monotonicNanos();
+    if(left > 0){
+        std::weak_ptr<TcpConnection> weak(shared_from_this());
+        loop_->runAfter(left / 1e9, [weak](){
+            TcpConnectionPtr conn = weak.lock();
+            if(conn){
+                conn->resumeRead();
+            }
+        });
+        return;
+    }
+    flow_->readPaused = false;
+    rearmReading();
+}
+
+void TcpConnection::throttleWrite(int64_t waitNanos){
+    if(channel_.isWriting()){
+        channel_.disableWriting();
+    }
+    if(flow()->writeTimer){
+        return;
+    }
+    flow_->writeTimer = true;
+    std::weak_ptr<TcpConnection> weak(shared_from_this());
+    loop_->runAfter(waitNanos / 1e9, [weak](){
+        TcpConnectionPtr conn = weak.lock();
+        if(conn){
+            conn->resumeWrite();
+        }
+    });
+}
+
+void TcpConnection::resumeWrite(){
+    flow_->writeTimer = false;
+    if(state_ != kDisconnected && hasPendingWrite() && !channel_.isWriting()){
+        channel_.enableWriting();
+    }
+}
+
+void TcpConnection::scheduleShapedWrite(){
+    // 等定时器或者已经在等可写时，由它们接着发
+    if((flow_ && flow_->writeTimer) || channel_.isWriting() || !hasPendingWrite()){
+        return;
+    }
+    int64_t wait = 0;
+    if(sendAllowance(monotonicNanos(), &wait) == 0){
+        throttleWrite(wait);
+    }
+    else{
+        channel_.enableWriting();
+    }
 }
 
 void TcpConnection::handleWrite(){
     // 检查Channel是否仍在监听EPOLLOUT事件
-    if(channel_->isWriting()){
-        int saveErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &saveErrno);
+    if(channel_.isWriting()){
+        // 限速时这次最多发allowance字节，一个字节都不能发就等定时器
+        const bool limited = sendLimited();
+        int64_t now = 0;
+        size_t allowance = SIZE_MAX;
+        if(limited){
+            now = monotonicNanos();
+            int64_t wait = 0;
+            allowance = sendAllowance(now, &wait);
+            if(allowance == 0){
+                throttleWrite(wait);
+                return;
+            }
+        }
+        const size_t granted = allowance;
+        bool ok = true;
+        if(!hasPendingFiles()){
+            int saveErrno = 0;
+            ssize_t n = outputBuffer_.writeFd(channel_.fd(), &saveErrno, allowance);
+            if(n > 0){
+                // 移动readerIndex_，表示已经读取n字节
+                outputBuffer_.retrieve(n);
+                allowance -= n;
+            }
+            else{
+                ok = false;
+            }
+        }
+        else{
+            // 有文件在排队，按"缓冲区数据 -> 文件 -> 缓冲区数据"的顺序推进
+            ok = writeWithFiles(&allowance);
+        }
+        if(limited){
+            chargeSend(granted - allowance, now);
+            // 令牌用完了还有数据，等补上再发
+            if(ok && allowance == 0 && hasPendingWrite()){
+                int64_t wait = 0;
+                // 这期间又攒够了一批就接着等可写，否则等定时器
+                if(sendAllowance(monotonicNanos(), &wait) == 0){
+                    throttleWrite(wait);
+                }
+                return;
+            }
+        }
 
-        if(n > 0){
-            // 移动readerIndex_，表示已经读取n字节
-            outputBuffer_.retrieve(n);
-            // 如果Buffer可读空间已为空
-            if(outputBuffer_.readableBytes() == 0){
+        if(ok){
+            // 如果Buffer可读空间已为空，且没有待发送的文件
+            if(!hasPendingWrite()){
                 // 停止监听写事件，避免 busy-loop（一直触发 EPOLLOUT 但没有数据要发送）。
-                channel_->disableWriting();
+                channel_.disableWriting();
+                releaseIfDrained(&outputBuffer_);
                 // 触发用户注册的写完成回调
-                if(writeCompleteCallback_){
+                if(handlers_->writeCompleteCallback){
                     // 保证回调在loop_所在线程执行；避免在别的线程执行，并发访问TcpConnection导致数据竞争
-                    loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+                    loop_->queueInLoop(std::bind(handlers_->writeCompleteCallback, shared_from_this()));
                 }
                 // 如果连接正在关闭，说明用户调用了shutdown()，但仍有数据未发送；
                 // 现在数据已经发送完了，可以关闭socket了
@@ -123,15 +510,72 @@ void TcpConnection::handleWrite(){
         }
     }
     else{
-        LOG_ERROR("TcpConnection fd=%d is down, no more writing", channel_->fd());
+        LOG_ERROR("TcpConnection fd=%d is down, no more writing", channel_.fd());
     }
 }
 
+// 一次可写事件里尽量多地推进：先发队首文件之前的缓冲区数据，再sendfile队首文件，如此往复，直到内核发送缓冲区写满
+// 只在有文件排队时调用，files_已经分配
+bool TcpConnection::writeWithFiles(size_t *allowance){
+    std::vector<PendingFile> &pendingFiles = files_->files;
+    while(*allowance > 0){
+        if(!pendingFiles.empty() && pendingFiles.front().bytesBefore == 0){
+            PendingFile &file = pendingFiles.front();
+            size_t chunk = std::min(file.remaining, *allowance);
+            ssize_t n = ::sendfile(channel_.fd(), file.fd, &file.offset, chunk);
+            if(n > 0){
+                file.remaining -= n;
+                *allowance -= n;
+                if(static_cast<size_t>(n) < chunk){
+                    // 只发出去一部分，说明内核发送缓冲区满了，等下一次EPOLLOUT
+                    return true;
+                }
+                // 文件还没发完说明限速的额度用完了，循环在这里结束
+                if(file.remaining == 0){
+                    pendingFiles.erase(pendingFiles.begin());
+                }
+            }
+            else if(n == 0){
+                // 文件比调用者声明的短，丢弃剩下的部分，否则会一直卡在这里
+                LOG_ERROR("TcpConnection::writeWithFiles file fd=%d ended early\n", file.fd);
+                pendingFiles.erase(pendingFiles.begin());
+            }
+            else{
+                return errno == EWOULDBLOCK;
+            }
+        }
+        else if(outputBuffer_.readableBytes() > 0){
+            // 队首文件之前的数据要先发完，不能越过文件
+            size_t limit = std::min(outputBuffer_.readableBytes(), *allowance);
+            if(!pendingFiles.empty()){
+                limit = std::min(limit, pendingFiles.front().bytesBefore);
+            }
+            ssize_t n = ::write(channel_.fd(), outputBuffer_.peek(), limit);
+            if(n <= 0){
+                return n < 0 && errno == EWOULDBLOCK;
+            }
+            outputBuffer_.retrieve(n);
+            *allowance -= n;
+            if(!pendingFiles.empty()){
+                pendingFiles.front().bytesBefore -= n;
+                files_->bytesBeforeFiles -= n;
+            }
+            if(static_cast<size_t>(n) < limit){
+                return true;
+            }
+        }
+        else{
+            return true;
+        }
+    }
+    return true;
+}
+
 // 处理连接关闭的回调函数，当TCP连接 对端关闭 或者 异常断开 时，Poller检测到EPOLLHUP 或 EPOLLRDHUP事件，触发这个回调
 void TcpConnection::handleClose(){
-    LOG_INFO("TcpConnection::handleClose fd=%d state=%d\n", channel_->fd(), (int)state_);
+    LOG_INFO("TcpConnection::handleClose fd=%d state=%d\n", channel_.fd(), (int)state_);
     setState(kDisconnected);
-    channel_->disableALL();
+    channel_.disableALL();
 
     // 获取 TcpConnection 智能指针
     // TcpConnection 是 通过 std::shared_ptr 管理的。
@@ -139,12 +583,12 @@ void TcpConnection::handleClose(){
     // 通过 shared_from_this() 延长 TcpConnection 生命周期，直到回调函数执行完毕，保证安全。
     TcpConnectionPtr connPtr(shared_from_this());
     // 触发用户注册的连接回调
-    connectionCallback_(connPtr);
+    handlers_->connectionCallback(connPtr);
     // 执行关闭连接的回调 最终清理连接资源。
     // closeCallback_ 是 TcpServer::removeConnection()，它的作用是：
     //    从 TcpServer 维护的连接池中移除当前连接。
     //    回收 TcpConnection 资源，防止内存泄漏。
-    closeCallback_(connPtr);
+    handlers_->closeCallback(connPtr);
 }
 
 // 触发EPOLLERR事件，EventLoop调用handleError()
@@ -160,14 +604,14 @@ void TcpConnection::handleError(){
      * optlen：optval变量大大小
      */
     // 在 epoll 触发 EPOLLERR 事件 时，不能直接通过 errno 获取 socket 的错误，而是要 查询 SO_ERROR 选项，才能拿到具体的错误原因。
-    if(::getsockopt(channel_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0){
+    if(::getsockopt(channel_.fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0){
         // getsockopt返回附属表示调用失败，此时errno存储的是getsockopt()调用失败的错误代码
         err = errno;
     }
     else{
         err = optval;
     }
-    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d\n", name_.c_str(), err);
+    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d\n", name().c_str(), err);
 }
 
 // 用于向对端发送数据
@@ -180,10 +624,10 @@ void TcpConnection::send(const std::string &buf){
         }
         // loop_在其他线程，则调用runInLoop()将任务投递到loop_线程里执行，保证sendInLoop()允许在loop_线程，防止并发访问TcpConnection导致数据竞争问题
         else{
-            // 在 send() 里：
-            //    直接用 this 是安全的，因为 TcpConnection 在 loop_ 里执行，生命周期通常不会被意外释放。
-            //    不使用 shared_from_this() 可以避免额外的 shared_ptr 计数增加，减少 TcpConnection 被不必要地延长生命周期。
-            loop_->runInLoop(std::bind(&TcpConnection::sendInLoop, this, buf.c_str(), buf.size()));
+            // 跨线程时必须把数据拷贝一份绑进回调：buf是调用者的引用，等loop_线程真正执行时它可能已经被销毁了
+            // 这里用shared_from_this()，保证任务执行前TcpConnection不会被析构
+            void (TcpConnection::*fp)(const std::string &) = &TcpConnection::sendInLoop;
+            loop_->runInLoop(std::bind(fp, shared_from_this(), buf));
         }
     }
     // 250319 adangmmm's add
@@ -192,6 +636,35 @@ void TcpConnection::send(const std::string &buf){
     }
 }
 
+void TcpConnection::send(const void *data, size_t len){
+    if(state_ == kConnected){
+        if(loop_->isInLoopThread()){
+            sendInLoop(data, len);
+        }
+        else{
+            send(std::string(static_cast<const char *>(data), len));
+        }
+    }
+    else{
+        LOG_ERROR("TcpConnection::send - not connected");
+    }
+}
+
+void TcpConnection::send(Buffer *buf){
+    if(state_ == kConnected){
+        if(loop_->isInLoopThread()){
+            sendInLoop(buf->peek(), buf->readableBytes());
+            buf->retrieveAll();
+        }
+        else{
+            send(buf->retrieveAllAsString());
+        }
+    }
+    else{
+        LOG_ERROR("TcpConnection::send - not connected");
+    }
+}
+
 // 实际执行数据发送的方法，在EventLoop线程中运行，并直接操作write系统调用或者使用缓冲区进行数据管理
 // 发送数据 应用写的快 而内核发送数据慢 需要把待发送数据写入缓冲区，而且设置了水位回调
 void TcpConnection::sendInLoop(const void *data, size_t len){
@@ -203,18 +676,44 @@ void TcpConnection::sendInLoop(const void *data, size_t len){
         LOG_ERROR("disconnected, give up writing");
         return; //252319 adnagmmm's add
     }
+    active_ = true;
 
-    // 如果channel_之前没有在写，并且outputBuffer_没有待发的数据
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0){
+    // 限速：数据只进outputBuffer_，由handleWrite按令牌发出
+    if(sendLimited()){
+        size_t oldLen = outputBuffer_.readableBytes();
+        if(oldLen + len >= handlers_->highWaterMark && oldLen < handlers_->highWaterMark && handlers_->highWaterMarkCallback){
+            loop_->queueInLoop(std::bind(handlers_->highWaterMarkCallback, shared_from_this(), oldLen + len));
+        }
+        outputBuffer_.append(static_cast<const char *>(data), len);
+        scheduleShapedWrite();
+        return;
+    }
+
+    // 合并写：不在等可写事件时先攒在outputBuffer_里，本轮结束前由flushInLoop()一次写出
+    if(coalesceWrites_ && !channel_.isWriting()){
+        size_t oldLen = outputBuffer_.readableBytes();
+        if(oldLen + len >= handlers_->highWaterMark && oldLen < handlers_->highWaterMark && handlers_->highWaterMarkCallback){
+            loop_->queueInLoop(std::bind(handlers_->highWaterMarkCallback, shared_from_this(), oldLen + len));
+        }
+        outputBuffer_.append(static_cast<const char *>(data), len);
+        if(!flushQueued_){
+            flushQueued_ = true;
+            loop_->runBeforePoll(std::bind(&TcpConnection::flushInLoop, shared_from_this()));
+        }
+        return;
+    }
+
+    // 如果channel_之前没有在写，并且outputBuffer_没有待发的数据（也没有排队的文件）
+    if (!channel_.isWriting() && !hasPendingWrite()){
         // 说明可以直接尝试写入socket，避免不必要的缓冲区操作，提升效率
-        nwrote = ::write(channel_->fd(), data, len);
+        nwrote = ::write(channel_.fd(), data, len);
         // 写入成功
         if(nwrote >= 0){
             remaining = len - nwrote;   //还剩多少
             // 如果都写完了没剩，且用户注册的写完成回调函数存在
-            if(remaining == 0 && writeCompleteCallback_){
+            if(remaining == 0 && handlers_->writeCompleteCallback){
                 // 则放入loop_回调队列中，通知用户写入完成
-                loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+                loop_->queueInLoop(std::bind(handlers_->writeCompleteCallback, shared_from_this()));
             }
         }
         // 写入失败
@@ -245,17 +744,80 @@ void TcpConnection::sendInLoop(const void *data, size_t len){
         // 判断条件2：但原本的数据 oldLen 还没超过高水位，即：这次写入导致了数据量第一次超过阈值。
         //           确保 "高水位回调" 只在数据量第一次超过阈值时触发，而不是每次都触发。
 
-        if(oldLen + remaining >= highWaterMark_ && oldLen < highWaterMark_ && highWaterMarkCallback_){
-            loop_->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
+        if(oldLen + remaining >= handlers_->highWaterMark && oldLen < handlers_->highWaterMark && handlers_->highWaterMarkCallback){
+            loop_->queueInLoop(std::bind(handlers_->highWaterMarkCallback, shared_from_this(), oldLen + remaining));
         }
         outputBuffer_.append((char *)data + nwrote, remaining);
         // 让 poller 监听可写事件，等内核缓冲区有空间时，通知 channel_，触发 handleWrite() 继续发送 outputBuffer_ 里的数据。
-        if(!channel_->isWriting()){
-            channel_->enableWriting();
+        if(!channel_.isWriting()){
+            channel_.enableWriting();
+        }
+    }
+}
+
+void TcpConnection::flush(){
+    if(loop_->isInLoopThread()){
+        flushInLoop();
+    }
+    else{
+        loop_->runInLoop(std::bind(&TcpConnection::flushInLoop, shared_from_this()));
+    }
+}
+
+// outputBuffer_是一整块连续内存，一轮里攒下的多条消息用一次write()就能全部交给内核
+void TcpConnection::flushInLoop(){
+    flushQueued_ = false;
+    // 正在等可写事件时剩下的数据由handleWrite()负责
+    if(state_ == kDisconnected || channel_.isWriting() || !hasPendingWrite()){
+        return;
+    }
+    if(sendLimited()){
+        scheduleShapedWrite();
+        return;
+    }
+    bool ok = true;
+    if(!hasPendingFiles()){
+        int saveErrno = 0;
+        ssize_t n = outputBuffer_.writeFd(channel_.fd(), &saveErrno);
+        if(n > 0){
+            outputBuffer_.retrieve(n);
         }
+        else if(n < 0 && saveErrno != EWOULDBLOCK){
+            ok = false;
+        }
+    }
+    else{
+        size_t allowance = SIZE_MAX;
+        ok = writeWithFiles(&allowance);
+    }
+    if(!ok){
+        // 对端已经关闭或重置，读事件会走handleClose()
+        LOG_ERROR("TcpConnection::flushInLoop");
+        return;
+    }
+    if(hasPendingWrite()){
+        // 内核发送缓冲区满了，剩下的等可写事件
+        channel_.enableWriting();
+        return;
+    }
+    releaseIfDrained(&outputBuffer_);
+    if(handlers_->writeCompleteCallback){
+        loop_->queueInLoop(std::bind(handlers_->writeCompleteCallback, shared_from_this()));
+    }
+    if(state_ == kDisconnecting){
+        shutdownInLoop();
     }
 }
 
+void TcpConnection::releaseIdleBuffers(){
+    if(active_){
+        active_ = false;
+        return;
+    }
+    inputBuffer_.shrink();
+    outputBuffer_.shrink();
+}
+
 void TcpConnection::sendFile(int fileDescriptor, off_t offset, size_t count){
     if(connected()){
         if(loop_->isInLoopThread()){
@@ -282,15 +844,17 @@ void TcpConnection::sendFileInLoop(int fileDescriptor, off_t offset, size_t coun
         return;
     }
 
-    if(!channel_->isWriting() && outputBuffer_.readableBytes() == 0){
-        // 从 fileDescriptor 中读取数据，并通过 socket_->fd() 发送到网络上。
+    // 限速时文件也排进队列，由handleWrite按令牌发出
+    const bool limited = sendLimited();
+    if(!limited && !channel_.isWriting() && !hasPendingWrite()){
+        // 从 fileDescriptor 中读取数据，并通过 socket_.fd() 发送到网络上。
         // 将文件内容直接拷贝到套接字的发送缓冲区，避免了在用户空间和内核空间之间的额外内存拷贝。
         // 为什么用socket_而非channel_，存疑250319
-        bytesSent = sendfile(socket_->fd(), fileDescriptor, &offset, remaining);
+        bytesSent = sendfile(socket_.fd(), fileDescriptor, &offset, remaining);
         if(bytesSent >= 0){
             remaining = count - bytesSent;
-            if(remaining == 0 && writeCompleteCallback_){
-                loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+            if(remaining == 0 && handlers_->writeCompleteCallback){
+                loop_->queueInLoop(std::bind(handlers_->writeCompleteCallback, shared_from_this()));
             }
         }
         else{
@@ -303,9 +867,25 @@ void TcpConnection::sendFileInLoop(int fileDescriptor, off_t offset, size_t coun
         }
     }
 
-    // 处理剩余数据
+    // 处理剩余数据：记下文件在输出流中的位置（排在outputBuffer_现有数据之后），
+    // 交给handleWrite在EPOLLOUT时继续发送，而不是反复queueInLoop空转
     if(!faultError && remaining > 0){
-        loop_->queueInLoop(std::bind(&TcpConnection::sendFileInLoop, shared_from_this(), fileDescriptor, offset, count));
+        PendingFile file;
+        file.fd = fileDescriptor;
+        file.offset = offset;   // sendfile已经把offset推进到了未发送的位置
+        file.remaining = remaining;
+        if(!files_){
+            files_.reset(new FileQueue);
+        }
+        file.bytesBefore = outputBuffer_.readableBytes() - files_->bytesBeforeFiles;
+        files_->bytesBeforeFiles += file.bytesBefore;
+        files_->files.push_back(file);
+        if(limited){
+            scheduleShapedWrite();
+        }
+        else if(!channel_.isWriting()){
+            channel_.enableWriting();
+        }
     }
 }
 
@@ -317,11 +897,30 @@ void TcpConnection::shutdown(){
 }
 
 void TcpConnection::shutdownInLoop(){
-    if(!channel_->isWriting()){
-        socket_->shutdownWrite();
+    // 合并写模式下数据可能还攒在outputBuffer_里没有开始写，要等flushInLoop()写完再关
+    if(!channel_.isWriting() && !hasPendingWrite()){
+        socket_.shutdownWrite();
+    }
+}
+
+void TcpConnection::setTcpNoDelay(bool on){
+    socket_.setTcpNoDelay(on);
+}
+
+void TcpConnection::forceClose(){
+    if(state_ == kConnected || state_ == kDisconnecting){
+        setState(kDisconnecting);
+        // 用shared_from_this()：任务执行前连接可能已经被上层释放
+        loop_->queueInLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
     }
 }
 
+void TcpConnection::forceCloseInLoop(){
+    if(state_ == kConnected || state_ == kDisconnecting){
+        // 和对端关闭走同一条路径：通知用户，再由closeCallback_让上层移除连接
+        handleClose();
+    }
+}
 
 // 建立连接
 void TcpConnection::connectEstablished(){
@@ -329,12 +928,12 @@ void TcpConnection::connectEstablished(){
     setState(kConnected);
     // 绑定生命周期，确保channel在TcpConnection销毁前销毁
     // 回到Channel定义中看。确保TcpConnection在channel的handleEventWithGuard()调用完毕后，再销毁)
-    channel_->tie(shared_from_this());
+    channel_.tie(shared_from_this());
     // 让poller监听EPOLLIN事件
-    channel_->enableReading();
+    channel_.enableReading();
 
     // 建立连接，执行用户注册的回调
-    connectionCallback_(shared_from_this());
+    handlers_->connectionCallback(shared_from_this());
 }
 // 连接销毁
 void TcpConnection::connectDestroyed(){
@@ -343,11 +942,11 @@ void TcpConnection::connectDestroyed(){
     if(state_ == kConnected){
         setState(kDisconnected);
         // 取消 poller 对 channel_ 的所有监听。避免 TcpConnection 销毁后，channel_ 仍然收到事件，导致野指针访问。
-        channel_->disableALL();
+        channel_.disableALL();
         // 执行 用户的关闭回调，通知上层应用 连接已关闭，可以进行资源清理。
         // 调用相同的回调 connectionCallback_，但由于 TcpConnection 状态不同（kConnected vs kDisconnected），用户可以在回调函数内根据 TcpConnection 当前状态执行不同逻辑。
-        connectionCallback_(shared_from_this());
+        handlers_->connectionCallback(shared_from_this());
     }
     // 彻底把 channel_ 从 poller 中移除，确保不再监听任何事件。
-    channel_->remove();
+    channel_.remove();
 }
\ No newline at end of file
@@ -1,9 +1,11 @@
 #include <functional>
+#include <future>
 #include <string.h>
 
 #include <ads_TcpServer.h>
 #include <ads_TcpConnection.h>
 #include <ads_Logger.h>
+#include <ads_MemoryPool.h>
 
 
 static EventLoop *CheckLoopNotNull(EventLoop *loop){
@@ -13,6 +15,100 @@ static EventLoop *CheckLoopNotNull(EventLoop *loop){
     return loop;
 }
 
+/** 一个loop的连接表：槽位数组 + 空闲槽位栈，只在所属loop线程里访问，所以不加锁
+ * 连接id = [分片下标 8位][槽位 24位][代数 32位]
+ * 槽位被复用时代数加一，拿着旧id删除不会误删新连接；id本身也就足够在日志里区分连接
+ **/
+class TcpServer::ConnectionShard : noncopyable{
+public:
+    static const int kShardBits = 8;
+    static const int kSlotBits = 24;
+    static const size_t kMaxShards = size_t(1) << kShardBits;
+    static const uint32_t kMaxSlots = uint32_t(1) << kSlotBits;
+
+    explicit ConnectionShard(size_t shardIndex)
+        : shardIndex_(shardIndex)
+        , size_(0)
+    {
+    }
+
+    static size_t shardOf(uint64_t id) {return static_cast<size_t>(id >> (64 - kShardBits));}
+
+    // 返回分配的id，槽位用完返回0
+    uint64_t add(const TcpConnectionPtr &conn){
+        uint32_t slot;
+        if(!freeSlots_.empty()){
+            slot = freeSlots_.back();
+            freeSlots_.pop_back();
+        }
+        else if(slots_.size() < kMaxSlots){
+            slot = static_cast<uint32_t>(slots_.size());
+            slots_.push_back(Slot());
+        }
+        else{
+            return 0;
+        }
+        Slot &entry = slots_[slot];
+        entry.conn = conn;
+        ++size_;
+        return (static_cast<uint64_t>(shardIndex_) << (64 - kShardBits))
+             | (static_cast<uint64_t>(slot) << 32)
+             | entry.generation;
+    }
+
+    void remove(uint64_t id){
+        uint32_t slot = static_cast<uint32_t>(id >> 32) & (kMaxSlots - 1);
+        if(slot >= slots_.size()){
+            return;
+        }
+        Slot &entry = slots_[slot];
+        if(entry.generation != static_cast<uint32_t>(id) || !entry.conn){
+            return;
+        }
+        entry.conn.reset();
+        ++entry.generation;
+        freeSlots_.push_back(slot);
+        --size_;
+    }
+
+    // 取出所有连接并清空
+    void takeAll(std::vector<TcpConnectionPtr> *conns){
+        for(Slot &entry : slots_){
+            if(entry.conn){
+                conns->push_back(std::move(entry.conn));
+            }
+        }
+        slots_.clear();
+        freeSlots_.clear();
+        size_ = 0;
+    }
+
+    size_t size() const {return size_;}
+
+    void releaseIdleBuffers(){
+        for(Slot &entry : slots_){
+            if(entry.conn){
+                entry.conn->releaseIdleBuffers();
+            }
+        }
+    }
+
+    // 空闲回收定时器，只在所属loop线程设置和取消
+    TimerId idleTimer;
+
+private:
+    struct Slot{
+        Slot() : generation(1) {}     // 从1开始，保证id不为0
+        TcpConnectionPtr conn;
+        uint32_t generation;
+    };
+
+    const size_t shardIndex_;
+    std::vector<Slot> slots_;
+    std::vector<uint32_t> freeSlots_;
+    size_t size_;
+};
+
 TcpServer::TcpServer(EventLoop *loop,
                      const InetAddress &listenAddr,
                      const std::string &nameArg,
@@ -21,13 +117,27 @@ TcpServer::TcpServer(EventLoop *loop,
     : loop_(CheckLoopNotNull(loop))
     , ipPort_(listenAddr.toIpPort())
     , name_(nameArg)
-    , acceptor_(new Acceptor(loop, listenAddr, option == kNoReusePort))
+    , listenAddr_(listenAddr)
+    , option_(option)
+    , acceptor_(new Acceptor(loop, listenAddr, option == kReusePort))
     , threadPool_(new EventLoopThreadPool(loop, nameArg))
-    , connectionCallback_()
-    , messageCallback_()
-    , nextConnId_(1)
+    , handlers_(std::make_shared<TcpConnection::HandlerTable>())
+    , numThreads_(0)
+    , acceptBatch_(16)
+    , baseLoopCpu_(-1)
+    , routeByPeerIp_(false)
+    , coalesceWrites_(false)
+    , idleBufferRelease_(0)
+    , sendRate_(0)
+    , sendBurst_(0)
+    , functorBudgetTasks_(0)
+    , functorBudgetMicros_(0)
     , started_(0)
 {
+    handlers_->namePrefix = nameArg + "-" + ipPort_ + "#";
+    // removeConnection 是 TcpServer 的成员函数，因此需要一个 TcpServer 实例才能调用。
+    // this 代表当前 TcpServer 对象，使 removeConnection 绑定到该对象。
+    handlers_->closeCallback = std::bind(&TcpServer::removeConnection, this, std::placeholders::_1);
     // Acceptor 监听到新连接 后会调用 newConnection(sockfd, peerAddr)。
     // 这里使用 std::bind 绑定 TcpServer::newConnection，并传递 sockfd 和 peerAddr。
     acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this, std::placeholders::_1, std::placeholders::_2));
@@ -35,27 +145,42 @@ TcpServer::TcpServer(EventLoop *loop,
 
 TcpServer::~TcpServer()
 {
-    for(auto &item : connections_){
-        // item 代表 每个键值对，item.second代表TcpConnectionPtr（连接对象的 shared_ptr）
-        TcpConnectionPtr conn(item.second);
-        // reset() 会让 connections_ 里的 shared_ptr 失效（引用计数减 1）。原始智能指针复位
-        // 但是 conn 仍然持有该 shared_ptr，确保 TcpConnection 不会立即销毁。
-        // connections_ 里不再保存该连接（从哈希表中移除 shared_ptr）。
-        // 仍然让 conn 在 getLoop()->runInLoop() 中 延迟销毁，保证正确的线程上下文。
-        item.second.reset();
-        // getLoop() 获取 conn 所属的 EventLoop（sub Reactor）。
-        // runInLoop() 确保 connectDestroyed() 在 正确的线程 执行（避免跨线程调用）。
-        // connectDestroyed() 负责 关闭连接、释放资源。
-        conn->getLoop()->runInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
-        /**
-         * 首先TcpServer::connections_是一个unordered_map<string, TcpConnectionPtr>，其中TcpConnectionPtr的含义是指向TcpConnection的shared_ptr。
-            在一开始，每一个TcpConnection对象都被一个共享智能指针TcpConnetionPtr持有，当执行了TcpConnectionPtr conn(item.second)时，这个TcpConnetion对象就被conn和这个item.second共同持有，但是这个conn的生存周期很短，只要离开了当前的这一次for循环，conn就会被释放。
-            紧接着调用item.second.reset()释放掉TcpServer中保存的该TcpConnectino对象的智能指针。此时在当前情况下，只剩下conn还持有这个TcpConnection对象，因此当前TcpConnection对象还不会被析构。
-            接着调用了conn->getLoop()->runInLoop(bind(&TcpConnection::connectDestroyed, conn));这句话的含义是让Sub EventLoop线程去执行TcpConnection::connectDestroyed()函数。当你把这个conn的成员函数传进去的时候，conn所指向的资源的引用计数会加1。因为传给runInLoop的不只有函数，还有这个函数所属的对象conn。
-            Sub EventLoop线程开始运行TcpConnection::connectDestroyed()函数。
-            Main EventLoop线程当前这一轮for循环跑完，共享智能指针conn离开代码块，因此被析构，但是TcpConnection对象还不会被释放，因为还有一个共享智能指针指向这个TcpConnection对象，而且这个智能指针在TcpConnection::connectDestroyed()中，只不过这个智能指针你看不到，它在这个函数中是一个隐式的this的存在。当这个函数执行完后，智能指针就真的被释放了。到此，就没有任何智能指针指向这个TcpConnection对象了。TcpConnection对象就彻底被析构删除了。
-        */
+    // subloop的Acceptor要在各自的loop线程里析构，此时subloop还在运行（threadPool_在后面才析构）
+    for(auto &acceptor : loopAcceptors_){
+        std::promise<void> done;
+        acceptor->getLoop()->runInLoop([&acceptor, &done](){
+            acceptor.reset();
+            done.set_value();
+        });
+        done.get_future().wait();
     }
+
+    // 每个分片在自己的loop线程里清空：取出连接，逐个执行connectDestroyed()
+    // connectDestroyed()会关闭监听并通知用户，TcpConnection随最后一个shared_ptr释放
+    for(size_t i = 0; i < shards_.size(); ++i){
+        ConnectionShard *shard = shards_[i].get();
+        EventLoop *ioLoop = ioLoops_[i];
+        bool idleRelease = idleBufferRelease_ > 0;
+        std::promise<void> done;
+        ioLoop->runInLoop([shard, ioLoop, idleRelease, &done](){
+            if(idleRelease){
+                ioLoop->cancel(shard->idleTimer);
+            }
+            std::vector<TcpConnectionPtr> conns;
+            shard->takeAll(&conns);
+            for(const TcpConnectionPtr &conn : conns){
+                conn->connectDestroyed();
+            }
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+    /**
+     * 以前connections_是一个unordered_map<string, TcpConnectionPtr>，这里逐个reset()后用
+     * conn->getLoop()->runInLoop(bind(&TcpConnection::connectDestroyed, conn))投递到subloop，
+     * 靠绑定在任务里的shared_ptr保证connectDestroyed()执行完之前连接不被析构。
+     * 现在分片只允许所属loop线程访问，所以整个取出和销毁过程都放到那个loop里做，并等它完成。
+     */
 }
 
 // 设置 EventLoopThreadPool 的线程数量，即 subloop 的个数（Worker 线程数）
@@ -64,36 +189,122 @@ void TcpServer::setThreadNum(int numThreads){
     threadPool_->setThreadNum(numThreads_);
 }
 
+void TcpServer::setAcceptBatch(int batch){
+    acceptBatch_ = batch;
+    if(acceptor_){
+        acceptor_->setAcceptBatch(batch);
+    }
+}
+
+void TcpServer::setPeerRecvLimit(double bytesPerSecond, double burst){
+    peerRecvBuckets_.reset(bytesPerSecond > 0 ? new PeerBuckets(bytesPerSecond, burst) : nullptr);
+}
+
+void TcpServer::setServerSendLimit(double bytesPerSecond, double burst){
+    handlers_->sendLimiter = bytesPerSecond > 0 ? std::make_shared<TokenBucket>(bytesPerSecond, burst) : nullptr;
+}
+
+void TcpServer::setServerRecvLimit(double bytesPerSecond, double burst){
+    handlers_->recvLimiter = bytesPerSecond > 0 ? std::make_shared<TokenBucket>(bytesPerSecond, burst) : nullptr;
+}
+
+AcceptStats TcpServer::acceptStats() const{
+    AcceptStats stats;
+    if(acceptor_){
+        stats.merge(acceptor_->stats());
+    }
+    for(const auto &acceptor : loopAcceptors_){
+        stats.merge(acceptor->stats());
+    }
+    return stats;
+}
+
 void TcpServer::start(){
     // fetch_add(1) 原子操作：
     // 读取 started_ 的当前值。加 1（fetch_add 返回加之前的值）。
     // 只有 started_ == 0 时才会执行 start() 的逻辑，否则直接返回。
     // 目的：防止 start() 被多次调用，避免重复启动服务器。
     if(started_.fetch_add(1) == 0){
+        if(baseLoopCpu_ >= 0){
+            int cpu = baseLoopCpu_;
+            loop_->runInLoop([cpu](){
+                if(!CurrentThread::bindToCpu(cpu)){
+                    LOG_ERROR("TcpServer::start - bind base loop to cpu %d failed\n", cpu);
+                }
+            });
+        }
         // threadInitCallback_ 是 用户自定义的回调，可以用来初始化 subloop。
         threadPool_->start(threadInitCallback_);
-        // acceptor_ 是 std::unique_ptr<Acceptor>，需要 get() 获取原始指针。
-        loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        // 每个loop一个连接分片
+        ioLoops_ = threadPool_->getAllLoops();
+        if(functorBudgetTasks_ > 0 || functorBudgetMicros_ > 0){
+            for(EventLoop *ioLoop : ioLoops_){
+                ioLoop->setFunctorBudget(functorBudgetTasks_, functorBudgetMicros_);
+            }
+        }
+        if(ioLoops_.size() > ConnectionShard::kMaxShards){
+            LOG_FATAL("TcpServer::start [%s] - too many loops %zu\n", name_.c_str(), ioLoops_.size());
+        }
+        for(size_t i = 0; i < ioLoops_.size(); ++i){
+            shards_.emplace_back(new ConnectionShard(i));
+        }
+        if(idleBufferRelease_ > 0){
+            double interval = idleBufferRelease_;
+            for(size_t i = 0; i < ioLoops_.size(); ++i){
+                ConnectionShard *shard = shards_[i].get();
+                EventLoop *ioLoop = ioLoops_[i];
+                ioLoop->runInLoop([shard, ioLoop, interval](){
+                    shard->idleTimer = ioLoop->runEvery(interval, [shard](){ shard->releaseIdleBuffers(); });
+                });
+            }
+        }
+        // Unix域socket没有SO_REUSEPORT的分流效果，多个Acceptor绑同一个路径只会互相删掉socket文件，退回baseloop accept
+        if(option_ == kReusePort && listenAddr_.isUnix()){
+            LOG_ERROR("TcpServer::start [%s] - kReusePort ignored for %s\n", name_.c_str(), ipPort_.c_str());
+        }
+        if(option_ == kReusePort && numThreads_ > 0 && !listenAddr_.isUnix()){
+            // 每个subloop绑定一个自己的监听socket，内核按四元组哈希把新连接分给它们
+            // 端口为0时各自bind会各拿一个临时端口，改用acceptor_已经绑到的端口，让它们共用同一个
+            InetAddress bindAddr = listenAddr_.toPort() == 0 ? acceptor_->localAddress() : listenAddr_;
+            for(EventLoop *ioLoop : threadPool_->getAllLoops()){
+                Acceptor *acceptor = new Acceptor(ioLoop, bindAddr, true);
+                acceptor->setAcceptBatch(acceptBatch_);
+                loopAcceptors_.emplace_back(acceptor);
+                acceptor->setNewConnectionCallback(
+                    std::bind(&TcpServer::createConnection, this, ioLoop, std::placeholders::_1, std::placeholders::_2));
+                ioLoop->runInLoop(std::bind(&Acceptor::listen, acceptor));
+            }
+            // baseloop不再监听，它的socket还没listen，关掉即可；Channel要在baseloop线程里释放
+            loop_->runInLoop([this](){ acceptor_.reset(); });
+        }
+        else{
+            // acceptor_ 是 std::unique_ptr<Acceptor>，需要 get() 获取原始指针。
+            loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        }
     }
 }
 
 // 当Acceptor监听到新连接是，acceptor_执行这个会掉，将新连接sockfd分配给subLoop，创建TcpConnection，并设置相应回调
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr){
-    // 轮询选择一个subLoop来管理新的连接
-    EventLoop *ioLoop = threadPool_->getNextLoop();
-
-    // 生成新连接的名称
-    char buf[64] = {0};
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_;
-    // 如ServerName-127.0.0.1:8080#2
-    std::string connName = name_ + buf;
-    LOG_INFO("TcpServer::newConnection [%s] - new connection [%s] from %s\n",
-              name_.c_str(), connName.c_str(), ipPort_.c_str());
+    // 按挑选策略（默认轮询）选择一个subLoop来管理新的连接，或者按对端IP固定到某个subLoop
+    EventLoop *ioLoop = routeByPeerIp_ ? threadPool_->getNextLoop(peerAddr.toIp())
+                                       : threadPool_->getNextLoop();
+    createConnection(ioLoop, sockfd, peerAddr);
+}
+
+void TcpServer::createConnection(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr){
+    // TcpConnection在ioLoop线程里构造，它的内存从ioLoop的MemoryPool分配、由ioLoop线程第一次写入，
+    // 绑核后就落在ioLoop所在的NUMA节点上；baseloop只负责accept和转交
+    // 构造之前先替ioLoop记上这条连接，否则同一批accept的连接在挑选时都还看不到，会被派给同一个loop
+    ioLoop->load().connections.fetch_add(1, std::memory_order_relaxed);
+    // kReusePort模式下已经在ioLoop线程，直接执行；建立连接是控制任务，排在ioLoop里积压的send前面
+    ioLoop->runInLoop(std::bind(&TcpServer::createConnectionInLoop, this, ioLoop, sockfd, peerAddr), EventLoop::kHighPriority);
+}
 
+void TcpServer::createConnectionInLoop(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr){
     // 获取sockfd绑定的本地IP和端口
-    // sockaddr_in 是 IPv4 套接字地址结构
-    sockaddr_in local; 
+    // sockaddr_storage 放得下 IPv4、IPv6 和 Unix域 的任意一种地址
+    sockaddr_storage local; 
     // 清空 local 结构体，确保所有字节初始化为 0，避免出现脏数据
     ::memset(&local, 0, sizeof(local));
     socklen_t addrlen = sizeof(local);   // socklen_t 是 sockaddr 结构体长度 的类型
@@ -105,39 +316,69 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr){
         LOG_ERROR("sockets::getLocalAddr");
     }
     // 封装一下local
-    InetAddress localAddr(local);
-
-    // 创建TcpConnection
-    TcpConnectionPtr conn(new TcpConnection(ioLoop,
-                                            connName,
-                                            sockfd,
-                                            localAddr,
-                                            peerAddr));
-    connections_[connName] = conn;  //放入哈希表
-
-    // 设置回调，用户设置给TcpServer -> TcpConnectcion。至于Channel则是绑定TcpConnection 里的handlexxx，而handlexxx又包含了下面设置的回调
-    conn->setConnectionCallback(connectionCallback_);
-    conn->setMessageCallback(messageCallback_);
-    conn->setWriteCompleteCallback(writeCompleteCallback_);
-    // removeConnection 是 TcpServer 的成员函数，因此需要一个 TcpServer 实例才能调用。
-    // this 代表当前 TcpServer 对象，使 removeConnection 绑定到该对象。
-    conn->setCloseCallback(std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
+    InetAddress localAddr((sockaddr *)&local, addrlen);
+
+    // 创建TcpConnection，名字延迟到第一次name()时再由前缀和id拼出，如ServerName-127.0.0.1:8080#<id>
+    // allocate_shared让控制块和对象合成一次分配，并且从本线程的MemoryPool空闲链表里取
+    TcpConnectionPtr conn = std::allocate_shared<TcpConnection>(PoolAllocator<TcpConnection>(),
+                                                                ioLoop,
+                                                                handlers_,
+                                                                sockfd,
+                                                                localAddr,
+                                                                peerAddr);
+    // 构造函数已经计数，撤掉createConnection()里的预占
+    ioLoop->load().connections.fetch_sub(1, std::memory_order_relaxed);
+
+    // 用户设置给TcpServer的回调已经在共享的handlers_里，不再逐个复制给每条连接。
+    // 至于Channel则是把事件交给TcpConnection的handlexxx，而handlexxx再调用表里的回调
+    conn->setCoalesceWrites(coalesceWrites_);
+    if(sendRate_ > 0){
+        conn->setSendRateLimit(sendRate_, sendBurst_);
+    }
+    if(peerRecvBuckets_){
+        conn->setRecvLimiter(peerRecvBuckets_->get(peerAddr));
+    }
 
-    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+    // 登记到ioLoop自己的分片里
+    connectEstablishedInLoop(shardIndexOf(ioLoop), conn);
+}
+
+size_t TcpServer::shardIndexOf(EventLoop *ioLoop) const{
+    // loop个数一般不超过CPU核数，顺序查找足够快
+    for(size_t i = 0; i < ioLoops_.size(); ++i){
+        if(ioLoops_[i] == ioLoop){
+            return i;
+        }
+    }
+    LOG_FATAL("TcpServer::shardIndexOf [%s] - unknown loop %p\n", name_.c_str(), ioLoop);
+    return 0;
+}
+
+void TcpServer::connectEstablishedInLoop(size_t shardIndex, const TcpConnectionPtr &conn){
+    uint64_t id = shards_[shardIndex]->add(conn);
+    if(id == 0){
+        // 本loop的槽位用完了。Channel还没注册到Poller，也没有通知用户，连接随conn析构关闭socket
+        LOG_ERROR("TcpServer::newConnection [%s] - too many connections in loop %zu\n", name_.c_str(), shardIndex);
+        return;
+    }
+    conn->id_ = id;
+    LOG_INFO("TcpServer::newConnection [%s] - new connection id=%llu\n", name_.c_str(), (unsigned long long)id);
+    conn->connectEstablished();
 }
 
 void TcpServer::removeConnection(const TcpConnectionPtr &conn){
-    // 将 removeConnectionInLoop(conn) 投递到 loop_ 线程执行，防止多线程并发访问 connections_
-    loop_->runInLoop(std::bind(&TcpServer::removeConnectionInLoop, this, conn));
+    // 连接登记在所属subloop的分片里，直接在那个loop里移除，不必再绕到baseloop
+    conn->getLoop()->runInLoop(std::bind(&TcpServer::removeConnectionInLoop, this, conn), EventLoop::kHighPriority);
 }
 
 void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn){
-    LOG_INFO("TcpServer::removeConnecitonInLoop [%s] - connection %s\n",
-             name_.c_str(), conn->name().c_str());
-    // 在当前server的loop线程中访问connections_，移除该conn，避免多线程并发访问connections_
-    connections_.erase(conn->name());
+    LOG_INFO("TcpServer::removeConnecitonInLoop [%s] - connection id=%llu\n",
+             name_.c_str(), (unsigned long long)conn->id());
+    // id里带着分片下标，removeConnection已经保证在该分片的loop线程
+    shards_[ConnectionShard::shardOf(conn->id())]->remove(conn->id());
     // 获取conn所属subLoop
     EventLoop *ioLoop = conn->getLoop();
     // queueInLoop() 保证 connectDestroyed() 在 conn 所属的 subLoop 中安全执行，避免多线程问题。
-    ioLoop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    // 连接已经关闭，发给它的任务执行了也没用，销毁先做
+    ioLoop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn), EventLoop::kHighPriority);
 }
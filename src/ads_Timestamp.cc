@@ -1,4 +1,5 @@
 #include <time.h>
+#include <sys/time.h>
 
 #include "ads_Timestamp.h"
 
@@ -12,16 +13,19 @@ Timestamp::Timestamp(int64_t microSecondsSinceEpoch)
 }
 
 Timestamp Timestamp::now(){
-    // time() 函数返回自Unix纪元（1970年1月1日）以来的秒数
-    // 通过 time() 函数获取当前时间，然后转换为 Timestamp 对象返回
-    return Timestamp(time(NULL));
+    // gettimeofday() 返回自Unix纪元（1970年1月1日）以来的秒数和微秒数
+    // 定时器需要微秒精度，time() 只能精确到秒
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return Timestamp(static_cast<int64_t>(tv.tv_sec) * kMicroSecondsPerSecond + tv.tv_usec);
 }
 
 std::string Timestamp::toString() const{
     char buf[128] = {0};
     // tm 是一个结构体，用于保存时间信息。localtime() 函数将 time_t 类型的时间转换为 tm 结构体类型的时间。
     // localtime() 函数返回的是一个指向静态分配的 tm 结构体的指针，因此不需要手动释放内存。
-    tm *tm_time = localtime(&microSecondsSinceEpoch_);
+    time_t seconds = static_cast<time_t>(microSecondsSinceEpoch_ / kMicroSecondsPerSecond);
+    tm *tm_time = localtime(&seconds);
     // snprintf() 是一个安全的字符串格式化函数，它将格式化后的字符串写入 buf 中，最大写入 128 个字符。
     snprintf(buf, 128, "%4d/%02d/%02d %02d:%02d:%02d",
              tm_time->tm_year + 1900,
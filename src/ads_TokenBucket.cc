@@ -0,0 +1,91 @@
+#include <math.h>
+#include <algorithm>
+
+#include "ads_TokenBucket.h"
+#include "ads_InetAddress.h"
+#include "ads_Histogram.h"
+
+TokenBucket::TokenBucket(double rate, double burst)
+    : rate_(rate)
+    , burst_(std::max(burst, 1.0))
+    , nanosPerToken_(1e9 / rate)
+    , burstNanos_(static_cast<int64_t>(burst_ * nanosPerToken_))
+    , tat_(0)
+{
+}
+
+double TokenBucket::available(int64_t nowNanos) const{
+    int64_t tat = std::max(tat_.load(std::memory_order_relaxed), nowNanos);
+    int64_t room = nowNanos + burstNanos_ - tat;
+    return room > 0 ? room / nanosPerToken_ : 0.0;
+}
+
+int64_t TokenBucket::waitNanos(double n, int64_t nowNanos) const{
+    int64_t tat = std::max(tat_.load(std::memory_order_relaxed), nowNanos);
+    int64_t need = tat + static_cast<int64_t>(std::min(n, burst_) * nanosPerToken_) - (nowNanos + burstNanos_);
+    return need > 0 ? need : 0;
+}
+
+int64_t TokenBucket::consume(double n, int64_t nowNanos){
+    const int64_t cost = static_cast<int64_t>(::llround(n * nanosPerToken_));
+    int64_t old = tat_.load(std::memory_order_relaxed);
+    int64_t next;
+    do{
+        next = std::max(old, nowNanos) + cost;
+    }while(!tat_.compare_exchange_weak(old, next, std::memory_order_relaxed));
+    int64_t debt = next - (nowNanos + burstNanos_);
+    return debt > 0 ? debt : 0;
+}
+
+bool TokenBucket::tryConsume(double n, int64_t nowNanos){
+    const int64_t cost = static_cast<int64_t>(::llround(n * nanosPerToken_));
+    int64_t old = tat_.load(std::memory_order_relaxed);
+    int64_t next;
+    do{
+        next = std::max(old, nowNanos) + cost;
+        if(next - nowNanos > burstNanos_){
+            return false;
+        }
+    }while(!tat_.compare_exchange_weak(old, next, std::memory_order_relaxed));
+    return true;
+}
+
+PeerBuckets::PeerBuckets(double rate, double burst)
+    : rate_(rate)
+    , burst_(burst)
+    , pruneThreshold_(1024)
+{
+}
+
+std::shared_ptr<TokenBucket> PeerBuckets::get(const InetAddress &peer){
+    std::string ip = peer.toIp();
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = buckets_.find(ip);
+    if(it != buckets_.end()){
+        return it->second;
+    }
+    if(buckets_.size() >= pruneThreshold_){
+        prune(monotonicNanos());
+        pruneThreshold_ = std::max<size_t>(1024, buckets_.size() * 2);
+    }
+    std::shared_ptr<TokenBucket> bucket = std::make_shared<TokenBucket>(rate_, burst_);
+    buckets_.emplace(std::move(ip), bucket);
+    return bucket;
+}
+
+size_t PeerBuckets::size() const{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return buckets_.size();
+}
+
+void PeerBuckets::prune(int64_t nowNanos){
+    for(auto it = buckets_.begin(); it != buckets_.end(); ){
+        // 只有表里这一份引用、并且已经补满
+        if(it->second.use_count() == 1 && it->second->full(nowNanos)){
+            it = buckets_.erase(it);
+        }
+        else{
+            ++it;
+        }
+    }
+}
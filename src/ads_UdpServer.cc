@@ -0,0 +1,92 @@
+#include <future>
+
+#include "ads_UdpServer.h"
+#include "ads_Logger.h"
+
+static EventLoop *CheckLoopNotNull(EventLoop *loop){
+    if(loop == nullptr){
+        LOG_FATAL("%s:%s:%d mainLoop is null!\n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    return loop;
+}
+
+UdpServer::UdpServer(EventLoop *loop, const InetAddress &listenAddr, const std::string &nameArg)
+    : loop_(CheckLoopNotNull(loop))
+    , name_(nameArg)
+    , listenAddr_(listenAddr)
+    , threadPool_(new EventLoopThreadPool(loop, nameArg))
+    , batch_(UdpSocket::kDefaultBatch)
+    , maxDatagram_(UdpSocket::kDefaultMaxDatagram)
+    , gro_(false)
+    , gso_(false)
+    , rcvbuf_(0)
+    , sndbuf_(0)
+    , started_(0)
+{
+}
+
+UdpServer::~UdpServer(){
+    // 每个socket在自己的loop线程里析构，此时subloop还在运行（threadPool_在后面才析构）
+    for(auto &socket : sockets_){
+        std::promise<void> done;
+        socket->getLoop()->runInLoop([&socket, &done](){
+            socket.reset();
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+}
+
+void UdpServer::start(){
+    if(started_.fetch_add(1) != 0){
+        return;
+    }
+    threadPool_->start(threadInitCallback_);
+    std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+    // 只有一个socket时不打开SO_REUSEPORT，端口被别的进程占着时bind会失败，而不是悄悄分走一半流量
+    bool reuseport = loops.size() > 1;
+    sockets_.resize(loops.size());
+    for(size_t i = 0; i < loops.size(); ++i){
+        EventLoop *ioLoop = loops[i];
+        std::unique_ptr<UdpSocket> *slot = &sockets_[i];
+        // 监听端口0时后面的socket要绑到第一个socket分到的端口上
+        InetAddress bindAddr = i == 0 ? listenAddr_ : sockets_[0]->localAddress();
+        // 在loop线程里创建，收发槽位由该线程第一次写入，绑核后落在它的NUMA节点上
+        std::promise<void> done;
+        ioLoop->runInLoop([this, ioLoop, slot, bindAddr, reuseport, &done](){
+            UdpSocket *socket = new UdpSocket(ioLoop, bindAddr, reuseport, batch_, maxDatagram_);
+            if(gro_ && !socket->setGro(true)){
+                LOG_ERROR("UdpServer::start [%s] - UDP GRO not supported\n", name_.c_str());
+            }
+            if(gso_ && !socket->setGso(true)){
+                LOG_ERROR("UdpServer::start [%s] - UDP GSO not supported\n", name_.c_str());
+            }
+            socket->setBufferSize(rcvbuf_, sndbuf_);
+            socket->setMessageCallback(messageCallback_);
+            socket->start();
+            slot->reset(socket);
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+    LOG_INFO("UdpServer::start [%s] - %zu sockets on %s\n", name_.c_str(), sockets_.size(), localAddress().toIpPort().c_str());
+}
+
+UdpStats UdpServer::stats(std::vector<UdpStats> *perLoop) const{
+    UdpStats total;
+    if(perLoop != nullptr){
+        perLoop->clear();
+    }
+    for(const auto &socket : sockets_){
+        UdpStats stats = socket->stats();
+        total.merge(stats);
+        if(perLoop != nullptr){
+            perLoop->push_back(stats);
+        }
+    }
+    return total;
+}
+
+InetAddress UdpServer::localAddress() const{
+    return sockets_.empty() ? listenAddr_ : sockets_.front()->localAddress();
+}
@@ -0,0 +1,416 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#include "ads_UdpSocket.h"
+#include "ads_EventLoop.h"
+#include "ads_Logger.h"
+
+// 一次可读事件最多调用几次recvmmsg，收满了也先返回，让同一个loop上的其他fd也能得到处理（水平触发）
+static const int kMaxRecvRounds = 4;
+// 打开GRO后内核可能把多个数据报合成一个最大64KB的包交上来
+static const size_t kGroSlotSize = 65535;
+// 一个GSO条目最多的段数和总字节数（内核上限是64段、IPv4一个UDP包65507字节）
+static const size_t kMaxGsoSegments = 64;
+static const size_t kMaxGsoBytes = 65000;
+
+static int createUdpNonblocking(sa_family_t family){
+    int sockfd = ::socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_UDP);
+    if(sockfd < 0){
+        LOG_FATAL("%s:%s:%d udp socket create error:%d\n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+// 地址都来自InetAddress或内核，未用到的字节都是0，可以直接按字节比较
+static bool samePeer(const sockaddr_in6 &a, socklen_t aLen, const sockaddr_in6 &b, socklen_t bLen){
+    return aLen == bLen && ::memcmp(&a, &b, aLen) == 0;
+}
+
+UdpSocket::UdpSocket(EventLoop *loop, const InetAddress &bindAddr, bool reuseport, int batch, size_t maxDatagram)
+    : loop_(loop)
+    , socket_(createUdpNonblocking(bindAddr.family()))
+    , channel_(loop, socket_.fd())
+    , localAddr_(bindAddr)
+    , batch_(batch > 0 ? batch : 1)
+    , maxDatagram_(maxDatagram > 0 ? maxDatagram : kDefaultMaxDatagram)
+    , slotSize_(maxDatagram_)
+    , gro_(false)
+    , gso_(false)
+    , inRead_(false)
+    , recvIovecs_(batch_)
+    , recvAddrs_(batch_)
+    , recvMsgs_(batch_)
+    , recvControl_(batch_ * CMSG_SPACE(sizeof(int)))
+    , sendIovecs_(batch_)
+    , sendMsgs_(batch_)
+    , sendControl_(batch_ * CMSG_SPACE(sizeof(uint16_t)))
+    , groups_(batch_)
+    , received_(0)
+    , receivedBytes_(0)
+    , recvCalls_(0)
+    , truncated_(0)
+    , sent_(0)
+    , sentBytes_(0)
+    , sendCalls_(0)
+    , dropped_(0)
+{
+    socket_.setReuseAddr(true);
+    socket_.setReusePort(reuseport);
+    socket_.bindAddress(bindAddr);
+    // 绑定端口0时取回内核分配的端口
+    sockaddr_in6 local;
+    socklen_t addrlen = sizeof(local);
+    if(::getsockname(socket_.fd(), (sockaddr *)&local, &addrlen) == 0){
+        localAddr_.setSockAddr((sockaddr *)&local, addrlen);
+    }
+    resetRecvSlots();
+
+    channel_.setReadCallback(std::bind(&UdpSocket::handleRead, this, std::placeholders::_1));
+    channel_.setWriteCallback(std::bind(&UdpSocket::handleWrite, this));
+    channel_.setNameCallback([this](){ return "udp-" + localAddr_.toIpPort(); });
+}
+
+UdpSocket::~UdpSocket(){
+    // 尽量把还没发出去的数据交给内核
+    if(!pending_.empty()){
+        flush();
+    }
+    channel_.disableALL();
+    channel_.remove();
+}
+
+bool UdpSocket::setGro(bool on){
+#ifdef UDP_GRO
+    int optval = on ? 1 : 0;
+    if(::setsockopt(socket_.fd(), IPPROTO_UDP, UDP_GRO, &optval, sizeof(optval)) < 0){
+        LOG_ERROR("UdpSocket::setGro fd=%d error:%d\n", socket_.fd(), errno);
+        return false;
+    }
+    gro_ = on;
+    slotSize_ = on ? std::max(kGroSlotSize, maxDatagram_) : maxDatagram_;
+    resetRecvSlots();
+    return true;
+#else
+    return !on;
+#endif
+}
+
+bool UdpSocket::setGso(bool on){
+#ifdef UDP_SEGMENT
+    if(on){
+        // 设置socket级的段长为0（不分段）来探测内核是否支持，真正的段长随每个条目的控制信息给出
+        int optval = 0;
+        if(::setsockopt(socket_.fd(), IPPROTO_UDP, UDP_SEGMENT, &optval, sizeof(optval)) < 0){
+            LOG_ERROR("UdpSocket::setGso fd=%d error:%d\n", socket_.fd(), errno);
+            return false;
+        }
+    }
+    gso_ = on;
+    return true;
+#else
+    return !on;
+#endif
+}
+
+void UdpSocket::setBufferSize(int rcvbuf, int sndbuf){
+    if(rcvbuf > 0){
+        ::setsockopt(socket_.fd(), SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+    if(sndbuf > 0){
+        ::setsockopt(socket_.fd(), SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    }
+}
+
+void UdpSocket::start(){
+    channel_.enableReading();
+}
+
+void UdpSocket::stop(){
+    channel_.disableReading();
+}
+
+void UdpSocket::resetRecvSlots(){
+    recvSlots_.assign(batch_ * slotSize_, 0);
+    recvSlots_.shrink_to_fit();
+    for(int i = 0; i < batch_; ++i){
+        recvIovecs_[i].iov_base = recvSlots_.data() + i * slotSize_;
+        recvIovecs_[i].iov_len = slotSize_;
+        msghdr &hdr = recvMsgs_[i].msg_hdr;
+        ::memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_name = &recvAddrs_[i];
+        hdr.msg_iov = &recvIovecs_[i];
+        hdr.msg_iovlen = 1;
+    }
+}
+
+void UdpSocket::handleRead(Timestamp receiveTime){
+    const size_t controlSpace = CMSG_SPACE(sizeof(int));
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    uint64_t calls = 0;
+    uint64_t truncated = 0;
+    inRead_ = true;
+    for(int round = 0; round < kMaxRecvRounds; ++round){
+        // recvmmsg会改写这几个字段，每次调用前复位
+        for(int i = 0; i < batch_; ++i){
+            msghdr &hdr = recvMsgs_[i].msg_hdr;
+            hdr.msg_namelen = sizeof(sockaddr_in6);
+            hdr.msg_control = gro_ ? &recvControl_[i * controlSpace] : nullptr;
+            hdr.msg_controllen = gro_ ? controlSpace : 0;
+            hdr.msg_flags = 0;
+        }
+        int n = ::recvmmsg(socket_.fd(), recvMsgs_.data(), batch_, MSG_DONTWAIT, nullptr);
+        if(n < 0){
+            int savedErrno = errno;
+            if(savedErrno != EAGAIN && savedErrno != EWOULDBLOCK && savedErrno != EINTR){
+                LOG_ERROR("UdpSocket::handleRead fd=%d recvmmsg error:%d\n", socket_.fd(), savedErrno);
+            }
+            break;
+        }
+        ++calls;
+        for(int i = 0; i < n; ++i){
+            const msghdr &hdr = recvMsgs_[i].msg_hdr;
+            if(hdr.msg_flags & MSG_TRUNC){
+                ++truncated;
+                continue;
+            }
+            const char *data = recvSlots_.data() + i * slotSize_;
+            size_t len = recvMsgs_[i].msg_len;
+            size_t segment = len;
+#ifdef UDP_GRO
+            if(gro_){
+                for(cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(const_cast<msghdr *>(&hdr), cmsg)){
+                    if(cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO){
+                        int gsoSize;
+                        ::memcpy(&gsoSize, CMSG_DATA(cmsg), sizeof(gsoSize));
+                        if(gsoSize > 0){
+                            segment = gsoSize;
+                        }
+                    }
+                }
+            }
+#endif
+            InetAddress peer((const sockaddr *)&recvAddrs_[i], hdr.msg_namelen);
+            // GRO合并的包按段长拆开，最后一段可能更短；空数据报也要交给上层一次
+            size_t offset = 0;
+            do{
+                size_t part = std::min(segment, len - offset);
+                ++packets;
+                bytes += part;
+                if(messageCallback_){
+                    messageCallback_(this, data + offset, part, peer, receiveTime);
+                }
+                offset += part;
+            }while(offset < len);
+        }
+        if(n < batch_){
+            break;
+        }
+    }
+    inRead_ = false;
+
+    if(calls > 0){
+        received_.fetch_add(packets, std::memory_order_relaxed);
+        receivedBytes_.fetch_add(bytes, std::memory_order_relaxed);
+        recvCalls_.fetch_add(calls, std::memory_order_relaxed);
+        truncated_.fetch_add(truncated, std::memory_order_relaxed);
+    }
+    // 这一批回调里产生的回复一起发出去
+    if(!pending_.empty() && !channel_.isWriting()){
+        flush();
+    }
+}
+
+void UdpSocket::handleWrite(){
+    flush();
+}
+
+void UdpSocket::send(const InetAddress &peer, const void *data, size_t len){
+    if(loop_->isInLoopThread()){
+        sendInLoop(peer.getSockAddr(), peer.getSockLen(), data, len);
+    }
+    else{
+        InetAddress addr(peer);
+        std::string copy(static_cast<const char *>(data), len);
+        loop_->runInLoop([this, addr, copy](){
+            sendInLoop(addr.getSockAddr(), addr.getSockLen(), copy.data(), copy.size());
+        });
+    }
+}
+
+void UdpSocket::sendInLoop(const sockaddr *peer, socklen_t peerLen, const void *data, size_t len){
+    if(pending_.size() >= kMaxPending){
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Pending entry;
+    ::memset(&entry.peer, 0, sizeof(entry.peer));
+    entry.peerLen = std::min<socklen_t>(peerLen, sizeof(entry.peer));
+    ::memcpy(&entry.peer, peer, entry.peerLen);
+    entry.offset = sendArena_.size();
+    entry.len = len;
+    const char *p = static_cast<const char *>(data);
+    sendArena_.insert(sendArena_.end(), p, p + len);
+    pending_.push_back(entry);
+
+    // 正在等可写时只管排队
+    if(channel_.isWriting()){
+        return;
+    }
+    // 攒够一批就不必再等
+    if(pending_.size() >= static_cast<size_t>(batch_)){
+        flush();
+        return;
+    }
+    // 读回调里的回复在这一批分发完后发出，其余的约到下一轮poll（UDP socket几乎总是可写）
+    if(!inRead_){
+        channel_.enableWriting();
+    }
+}
+
+int UdpSocket::buildSendBatch(size_t first){
+    const size_t controlSpace = CMSG_SPACE(sizeof(uint16_t));
+    int n = 0;
+    size_t i = first;
+    while(n < batch_ && i < pending_.size()){
+        const Pending &head = pending_[i];
+        size_t count = 1;
+        size_t bytes = head.len;
+        // 同一对端、长度相同的相邻数据报合成一个条目，只有最后一段可以更短
+        if(gso_ && head.len > 0){
+            while(i + count < pending_.size() && count < kMaxGsoSegments){
+                const Pending &next = pending_[i + count];
+                if(next.len == 0 || next.len > head.len || bytes + next.len > kMaxGsoBytes || !samePeer(next.peer, next.peerLen, head.peer, head.peerLen)){
+                    break;
+                }
+                bytes += next.len;
+                ++count;
+                if(next.len < head.len){
+                    break;
+                }
+            }
+        }
+
+        // 数据在sendArena_里首尾相接，合并后的条目仍是一段连续内存
+        sendIovecs_[n].iov_base = sendArena_.data() + head.offset;
+        sendIovecs_[n].iov_len = bytes;
+        msghdr &hdr = sendMsgs_[n].msg_hdr;
+        ::memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_name = const_cast<sockaddr_in6 *>(&head.peer);
+        hdr.msg_namelen = head.peerLen;
+        hdr.msg_iov = &sendIovecs_[n];
+        hdr.msg_iovlen = 1;
+#ifdef UDP_SEGMENT
+        if(count > 1){
+            hdr.msg_control = &sendControl_[n * controlSpace];
+            hdr.msg_controllen = controlSpace;
+            cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+            cmsg->cmsg_level = IPPROTO_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segment = static_cast<uint16_t>(head.len);
+            ::memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+        }
+#endif
+        groups_[n] = count;
+        ++n;
+        i += count;
+    }
+    return n;
+}
+
+void UdpSocket::flush(){
+    size_t done = 0;
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    uint64_t calls = 0;
+    uint64_t dropped = 0;
+    while(done < pending_.size()){
+        int n = buildSendBatch(done);
+        int sent = ::sendmmsg(socket_.fd(), sendMsgs_.data(), n, MSG_DONTWAIT);
+        if(sent < 0){
+            int savedErrno = errno;
+            // 内核发送缓冲区满了，剩下的等可写
+            if(savedErrno == EAGAIN || savedErrno == EWOULDBLOCK){
+                break;
+            }
+            if(savedErrno == EINTR){
+                continue;
+            }
+            // 网卡不支持校验和卸载时GSO会返回EIO，关掉GSO重新组批
+            if(savedErrno == EIO && gso_ && groups_[0] > 1){
+                LOG_ERROR("UdpSocket::flush fd=%d GSO not supported by device, disabled\n", socket_.fd());
+                gso_ = false;
+                continue;
+            }
+            // 其他错误只影响第一个条目（如对端地址不可达、数据报过大），丢掉它继续发后面的
+            LOG_ERROR("UdpSocket::flush fd=%d sendmmsg error:%d, dropped %zu datagrams\n",
+                      socket_.fd(), savedErrno, groups_[0]);
+            dropped += groups_[0];
+            done += groups_[0];
+            continue;
+        }
+        ++calls;
+        for(int i = 0; i < sent; ++i){
+            packets += groups_[i];
+            bytes += sendMsgs_[i].msg_len;
+            done += groups_[i];
+        }
+    }
+    consumePending(done);
+    updateWriting();
+
+    sent_.fetch_add(packets, std::memory_order_relaxed);
+    sentBytes_.fetch_add(bytes, std::memory_order_relaxed);
+    sendCalls_.fetch_add(calls, std::memory_order_relaxed);
+    if(dropped > 0){
+        dropped_.fetch_add(dropped, std::memory_order_relaxed);
+    }
+}
+
+void UdpSocket::consumePending(size_t n){
+    if(n == 0){
+        return;
+    }
+    if(n >= pending_.size()){
+        pending_.clear();
+        sendArena_.clear();
+        return;
+    }
+    size_t base = pending_[n].offset;
+    sendArena_.erase(sendArena_.begin(), sendArena_.begin() + base);
+    pending_.erase(pending_.begin(), pending_.begin() + n);
+    for(Pending &entry : pending_){
+        entry.offset -= base;
+    }
+}
+
+void UdpSocket::updateWriting(){
+    if(!pending_.empty() && !channel_.isWriting()){
+        channel_.enableWriting();
+    }
+    else if(pending_.empty() && channel_.isWriting()){
+        channel_.disableWriting();
+    }
+}
+
+UdpStats UdpSocket::stats() const{
+    UdpStats stats;
+    stats.received = received_.load(std::memory_order_relaxed);
+    stats.receivedBytes = receivedBytes_.load(std::memory_order_relaxed);
+    stats.recvCalls = recvCalls_.load(std::memory_order_relaxed);
+    stats.truncated = truncated_.load(std::memory_order_relaxed);
+    stats.sent = sent_.load(std::memory_order_relaxed);
+    stats.sentBytes = sentBytes_.load(std::memory_order_relaxed);
+    stats.sendCalls = sendCalls_.load(std::memory_order_relaxed);
+    stats.dropped = dropped_.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,343 @@
+#include <deque>
+#include <future>
+
+#include "ads_UpstreamPool.h"
+#include "ads_TcpClient.h"
+#include "ads_EventLoop.h"
+#include "ads_Buffer.h"
+#include "ads_Logger.h"
+
+// 一个loop自己的那部分连接池，只在该loop线程中访问
+class UpstreamPool::LoopPool : noncopyable{
+public:
+    LoopPool(UpstreamPool *owner, EventLoop *loop, int index)
+        : owner_(owner)
+        , loop_(loop)
+        , index_(index)
+    {
+    }
+
+    EventLoop *loop() const {return loop_;}
+
+    void start();
+    void stop();
+    void call(const StringPiece &request, const ResponseCallback &cb);
+    int healthy() const;
+
+private:
+    // 一个在途请求，响应按FIFO顺序与它对应
+    struct Pending{
+        ResponseCallback cb;
+        Timestamp sendTime;
+    };
+    // 一条上游连接
+    struct Upstream{
+        std::unique_ptr<TcpClient> client;
+        TcpConnectionPtr conn;          // 已连接且健康时非空
+        std::deque<Pending> inflight;
+        bool everConnected;
+    };
+    // 所有连接都忙时排队的请求
+    struct Queued{
+        std::string request;
+        ResponseCallback cb;
+        Timestamp enqueueTime;
+    };
+
+    void onConnection(Upstream *up, const TcpConnectionPtr &conn);
+    void onMessage(Upstream *up, const TcpConnectionPtr &conn, Buffer *buf);
+    Upstream *pick();
+    void sendOn(Upstream *up, const StringPiece &request, const ResponseCallback &cb);
+    void drainQueue();
+    void failAll(Upstream *up);
+    void evict(Upstream *up, const char *reason);
+    void checkTimeouts();
+
+    UpstreamPool *owner_;
+    EventLoop *loop_;
+    int index_;
+    std::vector<std::unique_ptr<Upstream>> upstreams_;
+    std::deque<Queued> queue_;
+    TimerId healthTimer_;
+};
+
+void UpstreamPool::LoopPool::start(){
+    for(int i = 0; i < owner_->connectionsPerLoop_; ++i){
+        char buf[64];
+        snprintf(buf, sizeof buf, "-%d-%d", index_, i);
+        std::unique_ptr<Upstream> up(new Upstream);
+        up->everConnected = false;
+        up->client.reset(new TcpClient(loop_, owner_->upstreamAddr_, owner_->name_ + buf));
+        Upstream *raw = up.get();
+        up->client->setConnectionCallback(
+            std::bind(&LoopPool::onConnection, this, raw, std::placeholders::_1));
+        up->client->setMessageCallback(
+            std::bind(&LoopPool::onMessage, this, raw, std::placeholders::_1, std::placeholders::_2));
+        // 断开后自动重连，被剔除的连接也靠它恢复
+        up->client->enableRetry();
+        up->client->connect();
+        upstreams_.push_back(std::move(up));
+    }
+    // 超时检查的粒度取超时时间的1/4
+    double interval = std::max(owner_->requestTimeout_ / 4, 0.01);
+    healthTimer_ = loop_->runEvery(interval, std::bind(&LoopPool::checkTimeouts, this));
+}
+
+void UpstreamPool::LoopPool::stop(){
+    loop_->cancel(healthTimer_);
+    while(!queue_.empty()){
+        Queued queued = std::move(queue_.front());
+        queue_.pop_front();
+        queued.cb(false, StringPiece());
+    }
+    for(const auto &up : upstreams_){
+        failAll(up.get());
+        TcpConnectionPtr conn = up->client->connection();
+        if(conn){
+            // 连接会比LoopPool活得久，先换掉指向this的回调
+            conn->setConnectionCallback([](const TcpConnectionPtr &){});
+            conn->setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp){ buf->retrieveAll(); });
+        }
+        up->conn.reset();
+        conn.reset();
+        // ~TcpClient会关闭唯一持有的连接或停止Connector
+        up->client.reset();
+    }
+    upstreams_.clear();
+}
+
+int UpstreamPool::LoopPool::healthy() const{
+    int n = 0;
+    for(const auto &up : upstreams_){
+        if(up->conn){
+            ++n;
+        }
+    }
+    return n;
+}
+
+void UpstreamPool::LoopPool::onConnection(Upstream *up, const TcpConnectionPtr &conn){
+    if(conn->connected()){
+        conn->setTcpNoDelay(true);
+        up->conn = conn;
+        if(!up->everConnected){
+            up->everConnected = true;
+            owner_->onConnectionUp();
+        }
+        drainQueue();
+    }
+    else if(up->conn == conn){
+        LOG_INFO("UpstreamPool %s lost connection %s\n", owner_->name_.c_str(), conn->name().c_str());
+        up->conn.reset();
+        failAll(up);
+    }
+}
+
+void UpstreamPool::LoopPool::onMessage(Upstream *up, const TcpConnectionPtr &conn, Buffer *buf){
+    // 已经被剔除的连接上迟到的数据直接丢掉
+    if(up->conn != conn){
+        buf->retrieveAll();
+        return;
+    }
+    while(true){
+        size_t length = owner_->codec_(buf);
+        if(length == 0){
+            break;
+        }
+        if(up->inflight.empty()){
+            // 上游应答比请求多，说明协议错位了，这条连接不能再用
+            evict(up, "unexpected response");
+            buf->retrieveAll();
+            return;
+        }
+        Pending pending = std::move(up->inflight.front());
+        up->inflight.pop_front();
+        pending.cb(true, StringPiece(buf->peek(), length));
+        buf->retrieve(length);
+        // 回调里可能剔除了这条连接
+        if(up->conn != conn){
+            buf->retrieveAll();
+            return;
+        }
+    }
+    drainQueue();
+}
+
+// 在健康且管道未满的连接里选在途请求最少的
+UpstreamPool::LoopPool::Upstream *UpstreamPool::LoopPool::pick(){
+    Upstream *best = nullptr;
+    for(const auto &up : upstreams_){
+        if(up->conn && up->inflight.size() < static_cast<size_t>(owner_->maxPipeline_)
+           && (best == nullptr || up->inflight.size() < best->inflight.size())){
+            best = up.get();
+            if(best->inflight.empty()){
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+void UpstreamPool::LoopPool::sendOn(Upstream *up, const StringPiece &request, const ResponseCallback &cb){
+    Pending pending;
+    pending.cb = cb;
+    pending.sendTime = loop_->pollReturnTime();
+    up->inflight.push_back(std::move(pending));
+    up->conn->send(request.data(), request.size());
+}
+
+void UpstreamPool::LoopPool::call(const StringPiece &request, const ResponseCallback &cb){
+    Upstream *up = pick();
+    if(up != nullptr){
+        sendOn(up, request, cb);
+    }
+    else if(queue_.size() < owner_->maxQueued_){
+        Queued queued;
+        queued.request = request.toString();
+        queued.cb = cb;
+        queued.enqueueTime = loop_->pollReturnTime();
+        queue_.push_back(std::move(queued));
+    }
+    else{
+        cb(false, StringPiece());
+    }
+}
+
+void UpstreamPool::LoopPool::drainQueue(){
+    while(!queue_.empty()){
+        Upstream *up = pick();
+        if(up == nullptr){
+            break;
+        }
+        Queued queued = std::move(queue_.front());
+        queue_.pop_front();
+        sendOn(up, queued.request, queued.cb);
+    }
+}
+
+void UpstreamPool::LoopPool::failAll(Upstream *up){
+    // 先整体取出再回调，回调里发起的新请求不会落到这条连接上
+    std::deque<Pending> inflight;
+    inflight.swap(up->inflight);
+    for(Pending &pending : inflight){
+        pending.cb(false, StringPiece());
+    }
+}
+
+void UpstreamPool::LoopPool::evict(Upstream *up, const char *reason){
+    TcpConnectionPtr conn = up->conn;
+    if(!conn){
+        return;
+    }
+    LOG_ERROR("UpstreamPool %s evicts %s: %s\n", owner_->name_.c_str(), conn->name().c_str(), reason);
+    // 先摘掉，关闭过程中不会再被选中，之后TcpClient自动重连
+    up->conn.reset();
+    failAll(up);
+    conn->forceClose();
+}
+
+void UpstreamPool::LoopPool::checkTimeouts(){
+    Timestamp now = Timestamp::now();
+    for(const auto &up : upstreams_){
+        if(up->conn && !up->inflight.empty()
+           && timeDifference(now, up->inflight.front().sendTime) > owner_->requestTimeout_){
+            evict(up.get(), "request timeout");
+        }
+    }
+    // 所有连接都断开时排队的请求也不能一直等下去；队列按入队时间排序，超时的都在队头
+    std::deque<Queued> expired;
+    while(!queue_.empty() && timeDifference(now, queue_.front().enqueueTime) > owner_->requestTimeout_){
+        expired.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+    }
+    for(Queued &queued : expired){
+        queued.cb(false, StringPiece());
+    }
+}
+
+UpstreamPool::UpstreamPool(const std::vector<EventLoop *> &loops,
+                           const InetAddress &upstreamAddr,
+                           const std::string &name,
+                           int connectionsPerLoop)
+    : upstreamAddr_(upstreamAddr)
+    , name_(name)
+    , connectionsPerLoop_(connectionsPerLoop)
+    , maxPipeline_(64)
+    , maxQueued_(65536)
+    , requestTimeout_(3.0)
+    , connectedOnce_(0)
+    , ready_(false)
+    , started_(false)
+{
+    for(size_t i = 0; i < loops.size(); ++i){
+        pools_.emplace_back(new LoopPool(this, loops[i], static_cast<int>(i)));
+        poolOfLoop_[loops[i]] = pools_.back().get();
+    }
+}
+
+UpstreamPool::~UpstreamPool(){
+    if(started_){
+        stop();
+    }
+}
+
+void UpstreamPool::start(){
+    if(!codec_){
+        LOG_FATAL("UpstreamPool %s has no FrameCodec\n", name_.c_str());
+    }
+    started_ = true;
+    for(const auto &pool : pools_){
+        pool->loop()->runInLoop(std::bind(&LoopPool::start, pool.get()));
+    }
+}
+
+void UpstreamPool::stop(){
+    if(!started_){
+        return;
+    }
+    started_ = false;
+    for(const auto &pool : pools_){
+        std::promise<void> done;
+        LoopPool *p = pool.get();
+        pool->loop()->runInLoop([p, &done](){
+            p->stop();
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+}
+
+UpstreamPool::LoopPool *UpstreamPool::localPool() const{
+    for(const auto &item : poolOfLoop_){
+        if(item.first->isInLoopThread()){
+            return item.second;
+        }
+    }
+    return nullptr;
+}
+
+void UpstreamPool::call(const StringPiece &request, const ResponseCallback &cb){
+    LoopPool *pool = localPool();
+    if(pool == nullptr){
+        LOG_ERROR("UpstreamPool::call %s - not in a pool loop thread\n", name_.c_str());
+        cb(false, StringPiece());
+        return;
+    }
+    pool->call(request, cb);
+}
+
+int UpstreamPool::healthyConnections() const{
+    LoopPool *pool = localPool();
+    return pool ? pool->healthy() : 0;
+}
+
+void UpstreamPool::onConnectionUp(){
+    int total = connectionsPerLoop_ * static_cast<int>(pools_.size());
+    if(++connectedOnce_ == total){
+        ready_ = true;
+        LOG_INFO("UpstreamPool %s warmed up with %d connections\n", name_.c_str(), total);
+        if(readyCallback_){
+            readyCallback_();
+        }
+    }
+}